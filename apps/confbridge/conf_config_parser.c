@@ -283,6 +283,20 @@
 						or 80.
 					</para></description>
 				</configOption>
+				<configOption name="mixing_threads" default="1">
+					<synopsis>Sets the most threads used to mix audio for the bridge</synopsis>
+					<description><para>
+						Sets the most threads used to prepare the audio written to the
+						participants of the conference.  Normally a single thread mixes
+						the whole conference, which limits how many participants it can
+						keep up with in real time.  Very large conferences, such as
+						webinars with hundreds of participants, can spread removing each
+						talker's own audio and translating to each participant's codec
+						across up to this many threads.  Extra threads are only used
+						once the conference is large enough to benefit from them.
+						Valid values are 1 through 16.
+					</para></description>
+				</configOption>
 				<configOption name="binaural_active">
 					<synopsis>If true binaural conferencing with stereo audio is active</synopsis>
 					<description><para>
@@ -1589,6 +1603,8 @@ static char *handle_cli_confbridge_show_bridge_profile(struct ast_cli_entry *e,
 		ast_cli(a->fd,"Mixing Interval:      Default 20ms\n");
 	}
 
+	ast_cli(a->fd,"Mixing Threads:       %u\n", b_profile.mixing_threads);
+
 	ast_cli(a->fd,"Record Conference:    %s\n",
 		b_profile.flags & BRIDGE_OPT_RECORD_CONFERENCE ?
 		"yes" : "no");
@@ -2180,6 +2196,7 @@ int conf_load_config(void)
 	aco_option_register(&cfg_info, "internal_sample_rate", ACO_EXACT, bridge_types, "0", OPT_UINT_T, PARSE_DEFAULT, FLDSET(struct bridge_profile, internal_sample_rate), 0);
 	aco_option_register(&cfg_info, "binaural_active", ACO_EXACT, bridge_types, "no", OPT_BOOLFLAG_T, 1, FLDSET(struct bridge_profile, flags), BRIDGE_OPT_BINAURAL_ACTIVE);
 	aco_option_register_custom(&cfg_info, "mixing_interval", ACO_EXACT, bridge_types, "20", mix_interval_handler, 0);
+	aco_option_register(&cfg_info, "mixing_threads", ACO_EXACT, bridge_types, "1", OPT_UINT_T, PARSE_IN_RANGE, FLDSET(struct bridge_profile, mixing_threads), 1, 16);
 	aco_option_register(&cfg_info, "record_conference", ACO_EXACT, bridge_types, "no", OPT_BOOLFLAG_T, 1, FLDSET(struct bridge_profile, flags), BRIDGE_OPT_RECORD_CONFERENCE);
 	aco_option_register_custom(&cfg_info, "video_mode", ACO_EXACT, bridge_types, NULL, video_mode_handler, 0);
 	aco_option_register(&cfg_info, "record_file_append", ACO_EXACT, bridge_types, "yes", OPT_BOOLFLAG_T, 1, FLDSET(struct bridge_profile, flags), BRIDGE_OPT_RECORD_FILE_APPEND);
@@ -49,9 +49,11 @@
 #include "asterisk/options.h"
 #include "asterisk/logger.h"
 #include "asterisk/slinfactory.h"
+#include "asterisk/slinear_mix.h"
 #include "asterisk/astobj2.h"
 #include "asterisk/timing.h"
 #include "asterisk/translate.h"
+#include "asterisk/test.h"
 
 #define MAX_DATALEN 8096
 
@@ -70,6 +72,12 @@
 /*! \brief Number of mixing iterations to perform between gathering statistics. */
 #define SOFTMIX_STAT_INTERVAL 100
 
+/*! \brief Most threads a single bridge may mix with. */
+#define SOFTMIX_MAX_MIXING_THREADS 16
+
+/*! \brief Fewest channels each mixing thread must have before another one is used. */
+#define SOFTMIX_MIN_CHANNELS_PER_THREAD 64
+
 /* This is the threshold in ms at which a channel's own audio will stop getting
  * mixed out its own write audio stream because it is not talking. */
 #define DEFAULT_SOFTMIX_SILENCE_THRESHOLD 2500
@@ -162,19 +170,81 @@ struct softmix_mixing_array {
 };
 
 struct softmix_translate_helper_entry {
-	int num_times_requested; /*!< Once this entry is no longer requested, free the trans_pvt
-	                              and re-init if it was usable. */
+	int num_times_requested; /*!< Once this entry is no longer requested, stop sharing
+	                              the translation and re-init if it was usable. */
 	struct ast_format *dst_format; /*!< The destination format for this helper */
-	struct ast_trans_pvt *trans_pvt; /*!< the translator for this slot. */
-	struct ast_frame *out_frame; /*!< The output frame from the last translation */
+	unsigned int shared:1; /*!< TRUE if the channels get the mix's shared translation */
 	AST_LIST_ENTRY(softmix_translate_helper_entry) entry;
 };
 
 struct softmix_translate_helper {
-	struct ast_format *slin_src; /*!< the source format expected for all the translators */
 	AST_LIST_HEAD_NOLOCK(, softmix_translate_helper_entry) entries;
 };
 
+struct softmix_mixing_pool;
+
+/*! \brief A thread writing the mixed audio to some of a bridge's channels */
+struct softmix_mixing_worker {
+	/*! The pool this worker belongs to */
+	struct softmix_mixing_pool *pool;
+	/*! Translation paths shared by the channels this worker writes to */
+	struct softmix_translate_helper trans_helper;
+	/*! Thread of the worker.  Worker 0 is the mixing thread itself. */
+	pthread_t thread;
+	/*! Position of this worker in the pool */
+	unsigned int index;
+	/*! The pool generation this worker last woke up for */
+	unsigned int generation;
+};
+
+/*!
+ * \brief Threads writing the mixed audio to a bridge's channels
+ *
+ * \details Each mixing interval the mixing thread reads and mixes the
+ * audio of every channel and then splits the channels between the
+ * workers.  Every worker removes each of its channels' own audio from the
+ * mix, translates it and queues it to the channel.  The mixing thread
+ * does a share of the channels itself and waits for the other workers to
+ * finish before the mixing interval is over.
+ */
+struct softmix_mixing_pool {
+	/*! Lock protecting the fields used to wake and wait on the workers */
+	ast_mutex_t lock;
+	/*! Signaled when the workers have a new mixing interval to write */
+	ast_cond_t work;
+	/*! Signaled when the last worker finishes writing its channels */
+	ast_cond_t done;
+	/*! The workers, including the mixing thread as worker 0 */
+	struct softmix_mixing_worker *workers;
+	/*! Number of workers, including the mixing thread */
+	unsigned int num_workers;
+	/*! Number of workers the bridge last asked for */
+	unsigned int requested;
+	/*! Number of workers splitting the channels this mixing interval */
+	unsigned int active;
+	/*! Number of workers other than the mixing thread still writing */
+	unsigned int pending;
+	/*! Incremented each time the workers are woken */
+	unsigned int generation;
+	/*! TRUE if the workers should exit */
+	unsigned int stop:1;
+	/*! Bridge callid, so the workers log like the mixing thread */
+	ast_callid callid;
+	/*! The channels to write this mixing interval */
+	AST_VECTOR(, struct ast_bridge_channel *) channels;
+	/*! Mix of the audio of every channel this mixing interval */
+	struct ast_frame mix_frame;
+	/*!
+	 * \brief The mix as written to the channels, sharing its data
+	 *
+	 * Kept until the next mixing interval since the shared translation
+	 * refers to it.
+	 */
+	struct ast_frame *mix;
+	/*! The mix translated once for all the workers, per write format */
+	struct ast_translate_shared *translate;
+};
+
 static struct softmix_translate_helper_entry *softmix_translate_helper_entry_alloc(struct ast_format *dst)
 {
 	struct softmix_translate_helper_entry *entry;
@@ -191,21 +261,13 @@ static struct softmix_translate_helper_entry *softmix_translate_helper_entry_all
 static void *softmix_translate_helper_free_entry(struct softmix_translate_helper_entry *entry)
 {
 	ao2_cleanup(entry->dst_format);
-
-	if (entry->trans_pvt) {
-		ast_translator_free_path(entry->trans_pvt);
-	}
-	if (entry->out_frame) {
-		ast_frfree(entry->out_frame);
-	}
 	ast_free(entry);
 	return NULL;
 }
 
-static void softmix_translate_helper_init(struct softmix_translate_helper *trans_helper, unsigned int sample_rate)
+static void softmix_translate_helper_init(struct softmix_translate_helper *trans_helper)
 {
 	memset(trans_helper, 0, sizeof(*trans_helper));
-	trans_helper->slin_src = ast_format_cache_get_slin_by_rate(sample_rate);
 }
 
 static void softmix_translate_helper_destroy(struct softmix_translate_helper *trans_helper)
@@ -217,23 +279,6 @@ static void softmix_translate_helper_destroy(struct softmix_translate_helper *tr
 	}
 }
 
-static void softmix_translate_helper_change_rate(struct softmix_translate_helper *trans_helper, unsigned int sample_rate)
-{
-	struct softmix_translate_helper_entry *entry;
-
-	trans_helper->slin_src = ast_format_cache_get_slin_by_rate(sample_rate);
-	AST_LIST_TRAVERSE_SAFE_BEGIN(&trans_helper->entries, entry, entry) {
-		if (entry->trans_pvt) {
-			ast_translator_free_path(entry->trans_pvt);
-			if (!(entry->trans_pvt = ast_translator_build_path(entry->dst_format, trans_helper->slin_src))) {
-				AST_LIST_REMOVE_CURRENT(entry);
-				entry = softmix_translate_helper_free_entry(entry);
-			}
-		}
-	}
-	AST_LIST_TRAVERSE_SAFE_END;
-}
-
 /*!
  * \internal
  * \brief Get the next available audio on the softmix channel's read stream
@@ -260,20 +305,32 @@ static int16_t *softmix_process_read_audio(struct softmix_channel *sc, unsigned
  * \details This function will remove the channel's talking from its own audio if present and
  * possibly even do the channel's write translation for it depending on how many other
  * channels use the same write format.
+ *
+ * Channels that are not talking all hear exactly the mix, so they are not given their own
+ * copy of it.  They share the mix itself, or the mix translated once for everyone using
+ * the same write format, across all the mixing workers.
+ *
+ * \return The frame to queue to the channel
  */
-static void softmix_process_write_audio(struct softmix_translate_helper *trans_helper,
+static struct ast_frame *softmix_process_write_audio(struct softmix_translate_helper *trans_helper,
+	struct ast_translate_shared *translate,
 	struct ast_format *raw_write_fmt,
-	struct softmix_channel *sc)
+	struct softmix_channel *sc,
+	struct ast_frame *mix_frame)
 {
 	struct softmix_translate_helper_entry *entry = NULL;
-	int i;
 
 	/* If we provided audio that was not determined to be silence,
 	 * then take it out while in slinear format. */
 	if (sc->have_audio && sc->talking) {
-		for (i = 0; i < sc->write_frame.samples; i++) {
-			ast_slinear_saturated_subtract(&sc->final_buf[i], &sc->our_buf[i]);
-		}
+		/* Make SLINEAR write frame from the mix */
+		ao2_t_replace(sc->write_frame.subclass.format, mix_frame->subclass.format,
+			"Replace softmix channel slin format");
+		sc->write_frame.datalen = mix_frame->datalen;
+		sc->write_frame.samples = mix_frame->samples;
+		memcpy(sc->final_buf, mix_frame->data.ptr, mix_frame->datalen);
+
+		ast_slinear_saturated_subtract_buf(sc->final_buf, sc->our_buf, sc->write_frame.samples);
 		/* check to see if any entries exist for the format. if not we'll want
 		   to remove it during cleanup */
 		AST_LIST_TRAVERSE(&trans_helper->entries, entry, entry) {
@@ -284,7 +341,7 @@ static void softmix_process_write_audio(struct softmix_translate_helper *trans_h
 		}
 		/* do not do any special write translate optimization if we had to make
 		 * a special mix for them to remove their own audio. */
-		return;
+		return &sc->write_frame;
 	}
 
 	/* Attempt to optimize channels using the same translation path/codec. Build a list of entries
@@ -298,17 +355,15 @@ static void softmix_process_write_audio(struct softmix_translate_helper *trans_h
 		} else {
 			continue;
 		}
-		if (!entry->trans_pvt && (entry->num_times_requested > 1)) {
-			entry->trans_pvt = ast_translator_build_path(entry->dst_format, trans_helper->slin_src);
+		if (entry->num_times_requested > 1) {
+			entry->shared = 1;
 		}
-		if (entry->trans_pvt && !entry->out_frame) {
-			entry->out_frame = ast_translate(entry->trans_pvt, &sc->write_frame, 0);
-		}
-		if (entry->out_frame && (entry->out_frame->datalen < MAX_DATALEN)) {
-			ao2_replace(sc->write_frame.subclass.format, entry->out_frame->subclass.format);
-			memcpy(sc->final_buf, entry->out_frame->data.ptr, entry->out_frame->datalen);
-			sc->write_frame.datalen = entry->out_frame->datalen;
-			sc->write_frame.samples = entry->out_frame->samples;
+		if (entry->shared && translate) {
+			struct ast_frame *out_frame = ast_translate_shared_get(translate, entry->dst_format);
+
+			if (out_frame) {
+				return out_frame;
+			}
 		}
 		break;
 	}
@@ -317,6 +372,8 @@ static void softmix_process_write_audio(struct softmix_translate_helper *trans_h
 	if (!entry && (entry = softmix_translate_helper_entry_alloc(raw_write_fmt))) {
 		AST_LIST_INSERT_HEAD(&trans_helper->entries, entry, entry);
 	}
+
+	return mix_frame;
 }
 
 static void softmix_translate_helper_cleanup(struct softmix_translate_helper *trans_helper)
@@ -331,16 +388,11 @@ static void softmix_translate_helper_cleanup(struct softmix_translate_helper *tr
 			continue;
 		}
 
-		if (entry->out_frame) {
-			ast_frfree(entry->out_frame);
-			entry->out_frame = NULL;
-		}
-
-		/* nothing is optimized for a single path reference, so there is
-		   no reason to continue to hold onto the codec */
-		if (entry->num_times_requested == 1 && entry->trans_pvt) {
-			ast_translator_free_path(entry->trans_pvt);
-			entry->trans_pvt = NULL;
+		/* nothing is optimized for a single path reference, so let the channel
+		   translate for itself again.  The shared translation frees the codec
+		   once nobody asks for it. */
+		if (entry->num_times_requested == 1) {
+			entry->shared = 0;
 		}
 
 		/* for each iteration (a mixing run) in the bridge softmix thread the number
@@ -897,6 +949,249 @@ static int softmix_mixing_array_grow(struct softmix_mixing_array *mixing_array,
 	return 0;
 }
 
+/*!
+ * \internal
+ * \brief Write the mixed audio to a softmix channel
+ *
+ * \details Gets the channel's write frame from the mix, removing the
+ * channel's own audio from it if present, and queues the frame to the
+ * channel.
+ */
+static void softmix_write_audio(struct softmix_translate_helper *trans_helper,
+	struct softmix_mixing_pool *pool,
+	struct ast_bridge_channel *bridge_channel)
+{
+	struct softmix_channel *sc = bridge_channel->tech_pvt;
+	struct ast_frame *frame;
+
+	ast_mutex_lock(&sc->lock);
+	/* process the softmix channel's new write audio */
+	frame = softmix_process_write_audio(trans_helper, pool->translate,
+		ast_channel_rawwriteformat(bridge_channel->chan), sc, pool->mix);
+	ast_mutex_unlock(&sc->lock);
+
+	/* A frame is now ready for the channel. */
+	ast_bridge_channel_queue_frame(bridge_channel, frame);
+}
+
+/*!
+ * \internal
+ * \brief Write the mixed audio to a mixing worker's share of the channels
+ */
+static void softmix_mixing_worker_write(struct softmix_mixing_worker *worker)
+{
+	struct softmix_mixing_pool *pool = worker->pool;
+	size_t idx;
+
+	for (idx = worker->index; idx < AST_VECTOR_SIZE(&pool->channels); idx += pool->active) {
+		softmix_write_audio(&worker->trans_helper, pool, AST_VECTOR_GET(&pool->channels, idx));
+	}
+
+	/* cleanup any translation frame data from this mixing iteration. */
+	softmix_translate_helper_cleanup(&worker->trans_helper);
+}
+
+static void *softmix_mixing_worker_thread(void *data)
+{
+	struct softmix_mixing_worker *worker = data;
+	struct softmix_mixing_pool *pool = worker->pool;
+
+	if (pool->callid) {
+		ast_callid_threadassoc_add(pool->callid);
+	}
+
+	ast_mutex_lock(&pool->lock);
+	for (;;) {
+		while (!pool->stop && worker->generation == pool->generation) {
+			ast_cond_wait(&pool->work, &pool->lock);
+		}
+		if (pool->stop) {
+			break;
+		}
+		worker->generation = pool->generation;
+		if (pool->active <= worker->index) {
+			/* Not enough channels this time to need us. */
+			continue;
+		}
+
+		ast_mutex_unlock(&pool->lock);
+		softmix_mixing_worker_write(worker);
+		ast_mutex_lock(&pool->lock);
+
+		if (!--pool->pending) {
+			ast_cond_signal(&pool->done);
+		}
+	}
+	ast_mutex_unlock(&pool->lock);
+
+	return NULL;
+}
+
+static int softmix_mixing_pool_init(struct softmix_mixing_pool *pool, unsigned int sample_rate, ast_callid callid)
+{
+	memset(pool, 0, sizeof(*pool));
+	if (!(pool->workers = ast_calloc(1, sizeof(*pool->workers)))) {
+		ast_log(LOG_NOTICE, "Failed to allocate softmix mixing pool.\n");
+		return -1;
+	}
+	if (AST_VECTOR_INIT(&pool->channels, 0)) {
+		ast_log(LOG_NOTICE, "Failed to allocate softmix mixing pool.\n");
+		ast_free(pool->workers);
+		pool->workers = NULL;
+		return -1;
+	}
+	ast_mutex_init(&pool->lock);
+	ast_cond_init(&pool->work, NULL);
+	ast_cond_init(&pool->done, NULL);
+	pool->callid = callid;
+	pool->num_workers = 1;
+	pool->requested = 1;
+	pool->workers[0].pool = pool;
+	pool->workers[0].thread = AST_PTHREADT_NULL;
+	softmix_translate_helper_init(&pool->workers[0].trans_helper);
+	/* Without it every channel translates for itself */
+	pool->translate = ast_translate_shared_alloc(ast_format_cache_get_slin_by_rate(sample_rate));
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Stop all the mixing workers other than the mixing thread
+ */
+static void softmix_mixing_pool_stop_workers(struct softmix_mixing_pool *pool)
+{
+	unsigned int idx;
+
+	ast_mutex_lock(&pool->lock);
+	pool->stop = 1;
+	ast_cond_broadcast(&pool->work);
+	ast_mutex_unlock(&pool->lock);
+
+	for (idx = 1; idx < pool->num_workers; ++idx) {
+		pthread_join(pool->workers[idx].thread, NULL);
+		softmix_translate_helper_destroy(&pool->workers[idx].trans_helper);
+	}
+	pool->num_workers = 1;
+	pool->stop = 0;
+}
+
+static void softmix_mixing_pool_release_mix(struct softmix_mixing_pool *pool)
+{
+	if (pool->mix && pool->mix != &pool->mix_frame) {
+		ast_frfree(pool->mix);
+	}
+	pool->mix = NULL;
+}
+
+static void softmix_mixing_pool_destroy(struct softmix_mixing_pool *pool)
+{
+	if (!pool->workers) {
+		return;
+	}
+	softmix_mixing_pool_stop_workers(pool);
+	softmix_translate_helper_destroy(&pool->workers[0].trans_helper);
+	ao2_cleanup(pool->translate);
+	softmix_mixing_pool_release_mix(pool);
+	ast_free(pool->workers);
+	AST_VECTOR_FREE(&pool->channels);
+	ast_mutex_destroy(&pool->lock);
+	ast_cond_destroy(&pool->work);
+	ast_cond_destroy(&pool->done);
+}
+
+/*!
+ * \internal
+ * \brief Change the number of mixing workers, including the mixing thread
+ *
+ * \note If not all the workers can be started the pool makes do with
+ * the ones that could be.
+ */
+static void softmix_mixing_pool_resize(struct softmix_mixing_pool *pool, unsigned int requested)
+{
+	struct softmix_mixing_worker *workers;
+	unsigned int num_workers = MAX(1, MIN(requested, SOFTMIX_MAX_MIXING_THREADS));
+	unsigned int idx;
+
+	pool->requested = requested;
+	softmix_mixing_pool_stop_workers(pool);
+	if (num_workers == 1) {
+		return;
+	}
+
+	if (!(workers = ast_realloc(pool->workers, num_workers * sizeof(*workers)))) {
+		ast_log(LOG_NOTICE, "Failed to re-allocate softmix mixing pool.\n");
+		return;
+	}
+	pool->workers = workers;
+
+	for (idx = 1; idx < num_workers; ++idx) {
+		struct softmix_mixing_worker *worker = &workers[idx];
+
+		worker->pool = pool;
+		worker->index = idx;
+		worker->generation = pool->generation;
+		softmix_translate_helper_init(&worker->trans_helper);
+		if (ast_pthread_create(&worker->thread, NULL, softmix_mixing_worker_thread, worker)) {
+			ast_log(LOG_WARNING, "Failed to start softmix mixing worker, mixing with %u threads.\n",
+				idx);
+			softmix_translate_helper_destroy(&worker->trans_helper);
+			break;
+		}
+		pool->num_workers = idx + 1;
+	}
+}
+
+static void softmix_mixing_pool_change_rate(struct softmix_mixing_pool *pool, unsigned int sample_rate)
+{
+	ao2_cleanup(pool->translate);
+	pool->translate = ast_translate_shared_alloc(ast_format_cache_get_slin_by_rate(sample_rate));
+}
+
+/*!
+ * \internal
+ * \brief Write the mixed audio to all the channels in the pool
+ *
+ * \details Only as many workers are used as there are channels to keep
+ * them busy.  The mixing thread writes its own share and then waits for
+ * the others, so every channel has its frame when this returns.
+ */
+static void softmix_mixing_pool_write(struct softmix_mixing_pool *pool)
+{
+	unsigned int active = AST_VECTOR_SIZE(&pool->channels) / SOFTMIX_MIN_CHANNELS_PER_THREAD;
+
+	/* Everyone hearing just the mix queues the same data */
+	softmix_mixing_pool_release_mix(pool);
+	if (!(pool->mix = ast_frshare(&pool->mix_frame))) {
+		pool->mix = &pool->mix_frame;
+	}
+
+	if (pool->translate) {
+		ast_translate_shared_frame(pool->translate, pool->mix);
+	}
+
+	active = MAX(1, MIN(active, pool->num_workers));
+	if (active == 1) {
+		pool->active = 1;
+		softmix_mixing_worker_write(&pool->workers[0]);
+		return;
+	}
+
+	ast_mutex_lock(&pool->lock);
+	pool->active = active;
+	pool->pending = active - 1;
+	++pool->generation;
+	ast_cond_broadcast(&pool->work);
+	ast_mutex_unlock(&pool->lock);
+
+	softmix_mixing_worker_write(&pool->workers[0]);
+
+	ast_mutex_lock(&pool->lock);
+	while (pool->pending) {
+		ast_cond_wait(&pool->done, &pool->lock);
+	}
+	ast_mutex_unlock(&pool->lock);
+}
+
 /*!
  * \brief Mixing loop.
  *
@@ -909,24 +1204,27 @@ static int softmix_mixing_loop(struct ast_bridge *bridge)
 	struct softmix_mixing_array mixing_array;
 	struct softmix_bridge_data *softmix_data = bridge->tech_pvt;
 	struct ast_timer *timer;
-	struct softmix_translate_helper trans_helper;
+	struct softmix_mixing_pool pool;
 	int16_t buf[MAX_DATALEN];
 	unsigned int stat_iteration_counter = 0; /* counts down, gather stats at zero and reset. */
 	int timingfd;
 	int update_all_rates = 0; /* set this when the internal sample rate has changed */
-	unsigned int idx;
-	unsigned int x;
 	int res = -1;
 
 	timer = softmix_data->timer;
 	timingfd = ast_timer_fd(timer);
-	softmix_translate_helper_init(&trans_helper, softmix_data->internal_rate);
 	ast_timer_set_rate(timer, (1000 / softmix_data->internal_mixing_interval));
 
 	/* Give the mixing array room to grow, memory is cheap but allocations are expensive. */
 	if (softmix_mixing_array_init(&mixing_array, bridge->num_channels + 10)) {
-		goto softmix_cleanup;
+		return -1;
+	}
+	if (softmix_mixing_pool_init(&pool, softmix_data->internal_rate, bridge->callid)) {
+		softmix_mixing_array_destroy(&mixing_array);
+		return -1;
 	}
+	pool.mix_frame.frametype = AST_FRAME_VOICE;
+	pool.mix_frame.data.ptr = buf;
 
 	/*
 	 * XXX Softmix needs to use channel roles to determine who gets
@@ -959,6 +1257,12 @@ static int softmix_mixing_loop(struct ast_bridge *bridge)
 		/* init the number of buffers stored in the mixing array to 0.
 		 * As buffers are added for mixing, this number is incremented. */
 		mixing_array.used_entries = 0;
+		AST_VECTOR_RESET(&pool.channels, AST_VECTOR_ELEM_CLEANUP_NOOP);
+
+		/* Start or stop mixing workers if the bridge asks for a different number. */
+		if (pool.requested != MAX(1, bridge->softmix.mixing_threads)) {
+			softmix_mixing_pool_resize(&pool, MAX(1, bridge->softmix.mixing_threads));
+		}
 
 		/* These variables help determine if a rate change is required */
 		if (!stat_iteration_counter) {
@@ -968,7 +1272,7 @@ static int softmix_mixing_loop(struct ast_bridge *bridge)
 
 		/* If the sample rate has changed, update the translator helper */
 		if (update_all_rates) {
-			softmix_translate_helper_change_rate(&trans_helper, softmix_data->internal_rate);
+			softmix_mixing_pool_change_rate(&pool, softmix_data->internal_rate);
 		}
 
 		/* Go through pulling audio from each factory that has it available */
@@ -995,6 +1299,11 @@ static int softmix_mixing_loop(struct ast_bridge *bridge)
 				continue;
 			}
 
+			if (AST_VECTOR_APPEND(&pool.channels, bridge_channel)) {
+				ast_log(LOG_NOTICE, "Failed to grow softmix mixing pool.\n");
+				goto softmix_cleanup;
+			}
+
 			/* Try to get audio from the factory if available */
 			ast_mutex_lock(&sc->lock);
 			if ((mixing_array.buffers[mixing_array.used_entries] = softmix_process_read_audio(sc, softmix_samples))) {
@@ -1004,39 +1313,14 @@ static int softmix_mixing_loop(struct ast_bridge *bridge)
 		}
 
 		/* mix it like crazy */
-		memset(buf, 0, softmix_datalen);
-		for (idx = 0; idx < mixing_array.used_entries; ++idx) {
-			for (x = 0; x < softmix_samples; ++x) {
-				ast_slinear_saturated_add(buf + x, mixing_array.buffers[idx] + x);
-			}
-		}
+		ast_slinear_saturated_mix(buf, mixing_array.buffers, mixing_array.used_entries,
+			softmix_samples);
 
 		/* Next step go through removing the channel's own audio and creating a good frame... */
-		AST_LIST_TRAVERSE(&bridge->channels, bridge_channel, entry) {
-			struct softmix_channel *sc = bridge_channel->tech_pvt;
-
-			if (!sc || bridge_channel->suspended) {
-				/* This channel failed to join successfully or is suspended. */
-				continue;
-			}
-
-			ast_mutex_lock(&sc->lock);
-
-			/* Make SLINEAR write frame from local buffer */
-			ao2_t_replace(sc->write_frame.subclass.format, cur_slin,
-				"Replace softmix channel slin format");
-			sc->write_frame.datalen = softmix_datalen;
-			sc->write_frame.samples = softmix_samples;
-			memcpy(sc->final_buf, buf, softmix_datalen);
-
-			/* process the softmix channel's new write audio */
-			softmix_process_write_audio(&trans_helper, ast_channel_rawwriteformat(bridge_channel->chan), sc);
-
-			ast_mutex_unlock(&sc->lock);
-
-			/* A frame is now ready for the channel. */
-			ast_bridge_channel_queue_frame(bridge_channel, &sc->write_frame);
-		}
+		pool.mix_frame.subclass.format = cur_slin;
+		pool.mix_frame.samples = softmix_samples;
+		pool.mix_frame.datalen = softmix_datalen;
+		softmix_mixing_pool_write(&pool);
 
 		update_all_rates = 0;
 		if (!stat_iteration_counter) {
@@ -1046,8 +1330,6 @@ static int softmix_mixing_loop(struct ast_bridge *bridge)
 		stat_iteration_counter--;
 
 		ast_bridge_unlock(bridge);
-		/* cleanup any translation frame data from the previous mixing iteration. */
-		softmix_translate_helper_cleanup(&trans_helper);
 		/* Wait for the timing source to tell us to wake up and get things done */
 		ast_waitfor_n_fd(&timingfd, 1, &timeout, NULL);
 		if (ast_timer_ack(timer, 1) < 0) {
@@ -1070,7 +1352,7 @@ static int softmix_mixing_loop(struct ast_bridge *bridge)
 	res = 0;
 
 softmix_cleanup:
-	softmix_translate_helper_destroy(&trans_helper);
+	softmix_mixing_pool_destroy(&pool);
 	softmix_mixing_array_destroy(&mixing_array);
 	return res;
 }
@@ -1237,8 +1519,221 @@ static struct ast_bridge_technology softmix_bridge = {
 	.write = softmix_bridge_write,
 };
 
+#ifdef TEST_FRAMEWORK
+/*! \brief Channels in the mixing pool test, enough to keep two workers busy */
+#define TEST_MIXING_CHANNELS (2 * SOFTMIX_MIN_CHANNELS_PER_THREAD + 16)
+
+/*! \brief Samples mixed by the mixing pool test, 20ms at 8kHz */
+#define TEST_MIXING_SAMPLES 160
+
+static void test_mixing_channel_destroy(struct ast_bridge_channel *bridge_channel)
+{
+	struct softmix_channel *sc;
+	struct ast_frame *frame;
+
+	if (!bridge_channel) {
+		return;
+	}
+	sc = bridge_channel->tech_pvt;
+	if (sc) {
+		ao2_cleanup(sc->write_frame.subclass.format);
+		ast_mutex_destroy(&sc->lock);
+		ast_free(sc);
+	}
+	while ((frame = AST_LIST_REMOVE_HEAD(&bridge_channel->wr_queue, frame_list))) {
+		ast_frfree(frame);
+	}
+	if (bridge_channel->alert_pipe[0] > -1) {
+		close(bridge_channel->alert_pipe[0]);
+		close(bridge_channel->alert_pipe[1]);
+	}
+	ast_channel_cleanup(bridge_channel->chan);
+	ao2_ref(bridge_channel, -1);
+}
+
+/*!
+ * \internal
+ * \brief Make a bridge channel just real enough for the mixing pool to write to
+ *
+ * \details Every third channel is talking, so the pool removes its own
+ * audio from the mix for it instead of handing it the shared mix.
+ */
+static struct ast_bridge_channel *test_mixing_channel_alloc(int idx)
+{
+	struct ast_bridge_channel *bridge_channel;
+	struct softmix_channel *sc;
+	int i;
+
+	bridge_channel = ao2_alloc(sizeof(*bridge_channel), NULL);
+	if (!bridge_channel) {
+		return NULL;
+	}
+	bridge_channel->alert_pipe[0] = bridge_channel->alert_pipe[1] = -1;
+	bridge_channel->state = BRIDGE_CHANNEL_STATE_WAIT;
+	if (pipe(bridge_channel->alert_pipe)) {
+		bridge_channel->alert_pipe[0] = bridge_channel->alert_pipe[1] = -1;
+		test_mixing_channel_destroy(bridge_channel);
+		return NULL;
+	}
+	bridge_channel->chan = ast_dummy_channel_alloc();
+	bridge_channel->tech_pvt = sc = ast_calloc(1, sizeof(*sc));
+	if (!bridge_channel->chan || !sc) {
+		test_mixing_channel_destroy(bridge_channel);
+		return NULL;
+	}
+	ast_channel_set_rawwriteformat(bridge_channel->chan, ast_format_slin);
+
+	ast_mutex_init(&sc->lock);
+	sc->write_frame.frametype = AST_FRAME_VOICE;
+	sc->write_frame.subclass.format = ao2_bump(ast_format_slin);
+	sc->write_frame.data.ptr = sc->final_buf;
+	if (!(idx % 3)) {
+		sc->talking = 1;
+		sc->have_audio = 1;
+		for (i = 0; i < TEST_MIXING_SAMPLES; ++i) {
+			sc->our_buf[i] = (idx * 31 + i * 7) % 1000;
+		}
+	}
+	return bridge_channel;
+}
+
+/*!
+ * \internal
+ * \brief Mix once with the pool and keep what each channel was written
+ *
+ * \retval 0 if every channel got exactly one frame of the right size.
+ */
+static int test_mixing_pool_run(struct softmix_mixing_pool *pool, int16_t *written)
+{
+	size_t idx;
+
+	softmix_mixing_pool_write(pool);
+
+	for (idx = 0; idx < AST_VECTOR_SIZE(&pool->channels); ++idx) {
+		struct ast_bridge_channel *bridge_channel = AST_VECTOR_GET(&pool->channels, idx);
+		struct ast_frame *frame;
+		char nudge;
+		int res;
+
+		frame = AST_LIST_REMOVE_HEAD(&bridge_channel->wr_queue, frame_list);
+		res = !frame || !AST_LIST_EMPTY(&bridge_channel->wr_queue)
+			|| frame->datalen != TEST_MIXING_SAMPLES * sizeof(int16_t)
+			|| read(bridge_channel->alert_pipe[0], &nudge, sizeof(nudge)) != sizeof(nudge);
+		if (!res) {
+			memcpy(&written[idx * TEST_MIXING_SAMPLES], frame->data.ptr, frame->datalen);
+		}
+		if (frame) {
+			ast_frfree(frame);
+		}
+		if (res) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+AST_TEST_DEFINE(mixing_pool_threads)
+{
+	struct softmix_mixing_pool pool;
+	int16_t mix[TEST_MIXING_SAMPLES];
+	int16_t *single = NULL;
+	int16_t *threaded = NULL;
+	size_t idx;
+	int i;
+	enum ast_test_result_state res = AST_TEST_FAIL;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "mixing_pool_threads";
+		info->category = "/bridges/bridge_softmix/";
+		info->summary = "Mixing with several threads";
+		info->description =
+			"Writes the same mix to the channels of a bridge with one\n"
+			"mixing thread and with several, and checks that every channel\n"
+			"is written the same audio either way.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	if (softmix_mixing_pool_init(&pool, SOFTMIX_MIN_SAMPLE_RATE, 0)) {
+		ast_test_status_update(test, "Failed to create the mixing pool\n");
+		return AST_TEST_FAIL;
+	}
+
+	for (i = 0; i < TEST_MIXING_SAMPLES; ++i) {
+		mix[i] = (i * 113) % 4000 - 2000;
+	}
+	pool.mix_frame.frametype = AST_FRAME_VOICE;
+	pool.mix_frame.subclass.format = ast_format_slin;
+	pool.mix_frame.data.ptr = mix;
+	pool.mix_frame.samples = TEST_MIXING_SAMPLES;
+	pool.mix_frame.datalen = sizeof(mix);
+
+	single = ast_calloc(TEST_MIXING_CHANNELS, sizeof(mix));
+	threaded = ast_calloc(TEST_MIXING_CHANNELS, sizeof(mix));
+	if (!single || !threaded) {
+		goto cleanup;
+	}
+
+	for (i = 0; i < TEST_MIXING_CHANNELS; ++i) {
+		struct ast_bridge_channel *bridge_channel = test_mixing_channel_alloc(i);
+
+		if (!bridge_channel) {
+			ast_test_status_update(test, "Failed to create channel %d\n", i);
+			goto cleanup;
+		}
+		if (AST_VECTOR_APPEND(&pool.channels, bridge_channel)) {
+			test_mixing_channel_destroy(bridge_channel);
+			goto cleanup;
+		}
+	}
+
+	if (test_mixing_pool_run(&pool, single)) {
+		ast_test_status_update(test, "Single threaded mix was not written to every channel\n");
+		goto cleanup;
+	}
+
+	softmix_mixing_pool_resize(&pool, 3);
+	if (pool.num_workers < 2) {
+		ast_test_status_update(test, "Failed to start the mixing workers\n");
+		goto cleanup;
+	}
+	if (test_mixing_pool_run(&pool, threaded)) {
+		ast_test_status_update(test, "Multi-threaded mix was not written to every channel\n");
+		goto cleanup;
+	}
+	if (pool.active < 2) {
+		ast_test_status_update(test, "Mixed with %u threads, expected several\n", pool.active);
+		goto cleanup;
+	}
+
+	for (idx = 0; idx < TEST_MIXING_CHANNELS; ++idx) {
+		if (memcmp(&single[idx * TEST_MIXING_SAMPLES], &threaded[idx * TEST_MIXING_SAMPLES], sizeof(mix))) {
+			ast_test_status_update(test, "Channel %d was written different audio with %u threads\n",
+				(int) idx, pool.active);
+			goto cleanup;
+		}
+	}
+	res = AST_TEST_PASS;
+
+cleanup:
+	/* Stop the workers before the channels they write to go away. */
+	softmix_mixing_pool_stop_workers(&pool);
+	for (idx = 0; idx < AST_VECTOR_SIZE(&pool.channels); ++idx) {
+		test_mixing_channel_destroy(AST_VECTOR_GET(&pool.channels, idx));
+	}
+	AST_VECTOR_RESET(&pool.channels, AST_VECTOR_ELEM_CLEANUP_NOOP);
+	softmix_mixing_pool_destroy(&pool);
+	ast_free(single);
+	ast_free(threaded);
+	return res;
+}
+#endif
+
 static int unload_module(void)
 {
+	AST_TEST_UNREGISTER(mixing_pool_threads);
 	ast_bridge_technology_unregister(&softmix_bridge);
 	return 0;
 }
@@ -1249,6 +1744,7 @@ static int load_module(void)
 		unload_module();
 		return AST_MODULE_LOAD_DECLINE;
 	}
+	AST_TEST_REGISTER(mixing_pool_threads);
 	return AST_MODULE_LOAD_SUCCESS;
 }
 
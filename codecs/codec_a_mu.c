@@ -31,15 +31,11 @@
 
 #include "asterisk/module.h"
 #include "asterisk/translate.h"
-#include "asterisk/alaw.h"
-#include "asterisk/ulaw.h"
+#include "asterisk/g711.h"
 #include "asterisk/utils.h"
 
 #define BUFFER_SAMPLES   8000	/* size for the translation buffers */
 
-static unsigned char mu2a[256];
-static unsigned char a2mu[256];
-
 /* Sample frame data */
 #include "ex_ulaw.h"
 #include "ex_alaw.h"
@@ -54,8 +50,7 @@ static int alawtoulaw_framein(struct ast_trans_pvt *pvt, struct ast_frame *f)
 	pvt->samples += x;
 	pvt->datalen += x;
 
-	while (x--)
-		*dst++ = a2mu[*src++];
+	ast_alaw_to_ulaw_buf(dst, src, x);
 
 	return 0;
 }
@@ -70,8 +65,7 @@ static int ulawtoalaw_framein(struct ast_trans_pvt *pvt, struct ast_frame *f)
 	pvt->samples += x;
 	pvt->datalen += x;
 
-	while (x--)
-		*dst++ = mu2a[*src++];
+	ast_ulaw_to_alaw_buf(dst, src, x);
 
 	return 0;
 }
@@ -129,12 +123,6 @@ static int unload_module(void)
 static int load_module(void)
 {
 	int res;
-	int x;
-
-	for (x=0;x<256;x++) {
-		mu2a[x] = AST_LIN2A(AST_MULAW(x));
-		a2mu[x] = AST_LIN2MU(AST_ALAW(x));
-	}
 
 	res = ast_register_translator(&alawtoulaw);
 	res |= ast_register_translator(&ulawtoalaw);
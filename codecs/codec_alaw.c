@@ -32,7 +32,7 @@
 #include "asterisk/module.h"
 #include "asterisk/config.h"
 #include "asterisk/translate.h"
-#include "asterisk/alaw.h"
+#include "asterisk/g711.h"
 #include "asterisk/utils.h"
 
 #define BUFFER_SAMPLES   8096	/* size for the translation buffers */
@@ -50,9 +50,8 @@ static int alawtolin_framein(struct ast_trans_pvt *pvt, struct ast_frame *f)
 
 	pvt->samples += i;
 	pvt->datalen += i * 2;	/* 2 bytes/sample */
-	
-	while (i--)
-		*dst++ = AST_ALAW(*src++);
+
+	ast_alaw_decode_buf(dst, src, i);
 
 	return 0;
 }
@@ -61,14 +60,13 @@ static int alawtolin_framein(struct ast_trans_pvt *pvt, struct ast_frame *f)
 static int lintoalaw_framein(struct ast_trans_pvt *pvt, struct ast_frame *f)
 {
 	int i = f->samples;
-	char *dst = pvt->outbuf.c + pvt->samples;
+	unsigned char *dst = pvt->outbuf.uc + pvt->samples;
 	int16_t *src = f->data.ptr;
 
 	pvt->samples += i;
 	pvt->datalen += i;	/* 1 byte/sample */
 
-	while (i--) 
-		*dst++ = AST_LIN2A(*src++);
+	ast_alaw_encode_buf(dst, src, i);
 
 	return 0;
 }
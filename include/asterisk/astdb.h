@@ -53,6 +53,27 @@ int ast_db_get_allocated(const char *family, const char *key, char **out);
 /*! \brief Store value addressed by family/key */
 int ast_db_put(const char *family, const char *key, const char *value);
 
+/*! \brief A value to store with ast_db_put_batch() */
+struct ast_db_put_entry {
+	const char *family;
+	const char *key;
+	const char *value;
+};
+
+/*!
+ * \brief Store many values at once
+ *
+ * \details
+ * Stores each of the \a count \a entries as ast_db_put() would, but under
+ * the database lock only once and as a single commit, so storing many keys
+ * costs little more than storing one.  Either all the values are stored or
+ * none of them are.
+ *
+ * \retval -1 An error occurred, nothing was stored
+ * \retval 0 Success
+ */
+int ast_db_put_batch(const struct ast_db_put_entry *entries, size_t count);
+
 /*! \brief Delete entry in astdb */
 int ast_db_del(const char *family, const char *key);
 
@@ -263,6 +263,14 @@ struct ast_bridge_softmix {
 	 * for itself.
 	 */
 	unsigned int internal_mixing_interval;
+	/*!
+	 * \brief The most threads softmix may use to prepare the audio
+	 * written to the channels of a single bridge.
+	 *
+	 * \note When set to 0 or 1, all the mixing is done by the
+	 * bridge's own mixing thread.
+	 */
+	unsigned int mixing_threads;
 };
 
 /*!
@@ -867,6 +875,21 @@ void ast_bridge_set_internal_sample_rate(struct ast_bridge *bridge, unsigned int
  */
 void ast_bridge_set_mixing_interval(struct ast_bridge *bridge, unsigned int mixing_interval);
 
+/*!
+ * \brief Adjust the number of threads a bridge may use for multimix mode.
+ *
+ * \param bridge Bridge to change the number of mixing threads on.
+ * \param mixing_threads The most threads the bridge tech may use to
+ * prepare the audio written to the bridge's channels.  If 0 or 1 is set
+ * all the mixing is done by a single thread.
+ *
+ * \note Extra threads are only worth their synchronization cost for
+ * conferences with hundreds of participants.
+ *
+ * \since 15.0.0
+ */
+void ast_bridge_set_mixing_threads(struct ast_bridge *bridge, unsigned int mixing_threads);
+
 /*!
  * \brief Set a bridge to feed a single video source to all participants.
  */
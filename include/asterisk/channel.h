@@ -4112,6 +4112,8 @@ struct ast_pbx *ast_channel_pbx(const struct ast_channel *chan);
 void ast_channel_pbx_set(struct ast_channel *chan, struct ast_pbx *value);
 struct ast_sched_context *ast_channel_sched(const struct ast_channel *chan);
 void ast_channel_sched_set(struct ast_channel *chan, struct ast_sched_context *value);
+struct ast_channel_snapshot *ast_channel_snapshot(const struct ast_channel *chan);
+void ast_channel_snapshot_set(struct ast_channel *chan, struct ast_channel_snapshot *snapshot);
 struct ast_timer *ast_channel_timer(const struct ast_channel *chan);
 void ast_channel_timer_set(struct ast_channel *chan, struct ast_timer *value);
 struct ast_tone_zone *ast_channel_zone(const struct ast_channel *chan);
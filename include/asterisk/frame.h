@@ -221,6 +221,10 @@ extern struct ast_frame ast_null_frame;
 #define AST_MALLOCD_DATA	(1 << 1)
 /*! Need the source be free'd? (haha!) */
 #define AST_MALLOCD_SRC		(1 << 2)
+/*! Was the header taken from the frame pool?  Only set by the frame core. */
+#define AST_MALLOCD_POOL	(1 << 3)
+/*! Is the data shared with other frames?  Only set by ast_frshare(). */
+#define AST_MALLOCD_SHARED	(1 << 4)
 
 /* MODEM subclasses */
 /*! T.38 Fax-over-IP */
@@ -558,6 +562,37 @@ struct ast_frame *ast_frisolate(struct ast_frame *fr);
  */
 struct ast_frame *ast_frdup(const struct ast_frame *fr);
 
+/*!
+ * \brief Copies a frame, sharing its data
+ * \param fr frame to copy
+ *
+ * Like ast_frdup(), but the new frame refers to a reference counted copy
+ * of the data instead of holding its own.  The data of \a fr is copied
+ * only if it is not already shared, so sharing the result again, such as
+ * to queue it to several channels, does not copy the data at all.
+ *
+ * The shared data must not be modified.  Call ast_frame_unshare() on a
+ * frame before modifying its data or the space before it.
+ *
+ * \return Returns a frame on success, NULL on error
+ * \since 15.0.0
+ */
+struct ast_frame *ast_frshare(const struct ast_frame *fr);
+
+/*!
+ * \brief Gives a frame its own copy of data it shares with other frames
+ * \param fr frame to act upon
+ *
+ * Does nothing unless the data of \a fr was shared by ast_frshare() and
+ * other frames still refer to it.  Afterwards the data and the space
+ * before it, AST_FRIENDLY_OFFSET bytes, may be modified.
+ *
+ * \retval 0 success
+ * \retval -1 the data could not be copied; it must not be modified
+ * \since 15.0.0
+ */
+int ast_frame_unshare(struct ast_frame *fr);
+
 void ast_swapcopy_samples(void *dst, const void *src, int samples);
 
 /* Helpers for byteswapping native samples to/from
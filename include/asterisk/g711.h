@@ -0,0 +1,151 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2017, Digium, Inc.
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+/*! \file
+ * \brief G.711 conversion of whole buffers
+ *
+ * These give the same results as AST_MULAW(), AST_LIN2MU(), AST_ALAW() and
+ * AST_LIN2A() applied one sample at a time, but use SIMD instructions when
+ * the CPU supports them.
+ */
+
+#ifndef _ASTERISK_G711_H
+#define _ASTERISK_G711_H
+
+#if defined(__cplusplus) || defined(c_plusplus)
+extern "C" {
+#endif
+
+/*! \brief Implementations of the G.711 conversion functions */
+enum ast_g711_impl {
+	/*! Plain C, one table lookup per sample */
+	AST_G711_SCALAR,
+	/*! x86 AVX2, 32 samples at a time without tables */
+	AST_G711_AVX2,
+};
+
+/*!
+ * \brief Set up the G.711 conversion functions
+ *
+ * Picks the best implementation this CPU supports.  Must be called after
+ * ast_ulaw_init() and ast_alaw_init().
+ *
+ * \since 15.0.0
+ */
+void ast_g711_init(void);
+
+/*!
+ * \brief Decode mu-law to signed linear
+ *
+ * \param dst Buffer for \a samples signed linear samples
+ * \param src Buffer of \a samples mu-law samples
+ * \param samples Number of samples to convert
+ *
+ * \since 15.0.0
+ */
+void ast_ulaw_decode_buf(int16_t *dst, const unsigned char *src, size_t samples);
+
+/*!
+ * \brief Encode signed linear to mu-law
+ *
+ * \param dst Buffer for \a samples mu-law samples
+ * \param src Buffer of \a samples signed linear samples
+ * \param samples Number of samples to convert
+ *
+ * \since 15.0.0
+ */
+void ast_ulaw_encode_buf(unsigned char *dst, const int16_t *src, size_t samples);
+
+/*!
+ * \brief Decode a-law to signed linear
+ *
+ * \param dst Buffer for \a samples signed linear samples
+ * \param src Buffer of \a samples a-law samples
+ * \param samples Number of samples to convert
+ *
+ * \since 15.0.0
+ */
+void ast_alaw_decode_buf(int16_t *dst, const unsigned char *src, size_t samples);
+
+/*!
+ * \brief Encode signed linear to a-law
+ *
+ * \param dst Buffer for \a samples a-law samples
+ * \param src Buffer of \a samples signed linear samples
+ * \param samples Number of samples to convert
+ *
+ * \since 15.0.0
+ */
+void ast_alaw_encode_buf(unsigned char *dst, const int16_t *src, size_t samples);
+
+/*!
+ * \brief Transcode a-law to mu-law
+ *
+ * The result is identical to AST_LIN2MU(AST_ALAW()) of every sample.
+ *
+ * \param dst Buffer for \a samples mu-law samples
+ * \param src Buffer of \a samples a-law samples
+ * \param samples Number of samples to convert
+ *
+ * \since 15.0.0
+ */
+void ast_alaw_to_ulaw_buf(unsigned char *dst, const unsigned char *src, size_t samples);
+
+/*!
+ * \brief Transcode mu-law to a-law
+ *
+ * The result is identical to AST_LIN2A(AST_MULAW()) of every sample.
+ *
+ * \param dst Buffer for \a samples a-law samples
+ * \param src Buffer of \a samples mu-law samples
+ * \param samples Number of samples to convert
+ *
+ * \since 15.0.0
+ */
+void ast_ulaw_to_alaw_buf(unsigned char *dst, const unsigned char *src, size_t samples);
+
+/*!
+ * \brief Get the implementation used by the G.711 conversion functions
+ * \since 15.0.0
+ */
+enum ast_g711_impl ast_g711_get_impl(void);
+
+/*!
+ * \brief Get the name of a G.711 conversion implementation
+ * \since 15.0.0
+ */
+const char *ast_g711_impl_name(enum ast_g711_impl impl);
+
+/*!
+ * \brief Select the implementation used by the G.711 conversion functions
+ *
+ * The best implementation the CPU supports is selected by ast_g711_init().
+ * This is intended for testing the implementations against each other.
+ *
+ * \param impl The implementation to use
+ *
+ * \retval 0 success
+ * \retval -1 \a impl is not supported by this CPU or build
+ *
+ * \since 15.0.0
+ */
+int ast_g711_set_impl(enum ast_g711_impl impl);
+
+#if defined(__cplusplus) || defined(c_plusplus)
+}
+#endif
+
+#endif /* _ASTERISK_G711_H */
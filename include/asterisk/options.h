@@ -66,6 +66,8 @@ enum ast_option_flags {
 	AST_OPT_FLAG_CACHE_RECORD_FILES = (1 << 13),
 	/*! Display timestamp in CLI verbose output */
 	AST_OPT_FLAG_TIMESTAMP = (1 << 14),
+	/*! Cache the values read from the astdb */
+	AST_OPT_FLAG_ASTDB_CACHE = (1 << 15),
 	/*! Reconnect */
 	AST_OPT_FLAG_RECONNECT = (1 << 16),
 	/*! Transmit Silence during Record() and DTMF Generation */
@@ -131,6 +133,7 @@ enum ast_option_flags {
 #define ast_opt_lock_confdir		ast_test_flag(&ast_options, AST_OPT_FLAG_LOCK_CONFIG_DIR)
 #define ast_opt_generic_plc         ast_test_flag(&ast_options, AST_OPT_FLAG_GENERIC_PLC)
 #define ast_opt_ref_debug           ast_test_flag(&ast_options, AST_OPT_FLAG_REF_DEBUG)
+#define ast_opt_astdb_cache		ast_test_flag(&ast_options, AST_OPT_FLAG_ASTDB_CACHE)
 
 /*! Maximum log level defined by PJPROJECT. */
 #define MAX_PJ_LOG_MAX_LEVEL		6
@@ -198,6 +201,9 @@ extern int ast_language_is_prefix;
 
 extern unsigned int ast_option_rtpptdynamic;
 
+extern int ast_option_astdb_readers;	/*!< Number of connections reading the astdb at once */
+extern int ast_option_hint_threads;	/*!< Maximum number of threads sending extension state updates */
+
 #if defined(__cplusplus) || defined(c_plusplus)
 }
 #endif
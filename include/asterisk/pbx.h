@@ -1436,6 +1436,12 @@ int pbx_set_autofallthrough(int newval);
   the old linear-search algorithm.  Returns previous value. */
 int pbx_set_extenpatternmatchnew(int newval);
 
+/*! Set "extenpatterncompile" flag.  If set to 1, the extensions of each context
+  are compiled into an automaton when the dialplan is loaded, and lookups use it
+  to skip the extensions that can't match.  If set to 0, lookups scan every
+  extension.  Returns previous value. */
+int pbx_set_extenpatterncompile(int newval);
+
 /*! Set "overrideswitch" field.  If set and of nonzero length, all contexts
  * will be tried directly through the named switch prior to any other
  * matching within that context.
@@ -152,6 +152,54 @@ extern "C" {
  */
 struct ast_sched_context *ast_sched_context_create(void);
 
+/*!
+ * \brief Data structures a scheduler context can keep its events in
+ * \since 15.0.0
+ */
+enum ast_sched_backend {
+	/*! Binary heap.  Suits contexts whose events mostly run. */
+	AST_SCHED_BACKEND_HEAP,
+	/*!
+	 * Hierarchical timing wheel with millisecond ticks.  Adding and
+	 * deleting events is O(1) so it suits contexts whose events are
+	 * mostly short protocol timeouts that get deleted before they run.
+	 */
+	AST_SCHED_BACKEND_WHEEL,
+};
+
+/*!
+ * \brief Create a scheduler context using the given backend
+ *
+ * \param backend Data structure the context keeps its events in
+ *
+ * \return Returns a malloc'd sched_context structure, NULL on failure
+ * \since 15.0.0
+ */
+struct ast_sched_context *ast_sched_context_create_backend(enum ast_sched_backend backend);
+
+/*!
+ * \brief Create a sharded scheduler context
+ *
+ * \param num_shards Number of shards to spread scheduled events over
+ *
+ * A sharded context spreads its scheduled events over several independent
+ * heaps, each with its own lock.  When ast_sched_start_thread() is called on
+ * a sharded context every shard gets its own thread to run its events, so
+ * busy contexts are not limited by a single lock and a single thread.
+ *
+ * The context is used through the regular scheduler API.  As with a normal
+ * context, ast_sched_del() does not return until a currently executing
+ * callback for the deleted event has completed.
+ *
+ * \note Callbacks on different shards may run at the same time.  A callback
+ * must not delete an event of the same context that could be executing on
+ * another shard while that event's callback deletes it in turn.
+ *
+ * \return Returns a malloc'd sched_context structure, NULL on failure
+ * \since 15.0.0
+ */
+struct ast_sched_context *ast_sched_context_create_sharded(unsigned int num_shards);
+
 /*!
  * \brief destroys a schedule context
  *
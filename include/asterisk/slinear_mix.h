@@ -0,0 +1,107 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2017, Digium, Inc.
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+/*! \file
+ * \brief Saturating mixing of signed linear audio buffers
+ *
+ * These give the same results as ast_slinear_saturated_add() and
+ * ast_slinear_saturated_subtract() applied one sample at a time, but use
+ * the widest SIMD instructions the CPU supports.
+ */
+
+#ifndef _ASTERISK_SLINEAR_MIX_H
+#define _ASTERISK_SLINEAR_MIX_H
+
+#if defined(__cplusplus) || defined(c_plusplus)
+extern "C" {
+#endif
+
+/*! \brief Implementations of the mixing functions */
+enum ast_slinear_mix_impl {
+	/*! Plain C, one sample at a time */
+	AST_SLINEAR_MIX_SCALAR,
+	/*! x86 SSE2, 8 samples at a time */
+	AST_SLINEAR_MIX_SSE2,
+	/*! x86 AVX2, 16 samples at a time */
+	AST_SLINEAR_MIX_AVX2,
+	/*! ARM NEON, 8 samples at a time */
+	AST_SLINEAR_MIX_NEON,
+};
+
+/*!
+ * \brief Mix signed linear buffers together
+ *
+ * \a output is set to the saturating sum of the \a inputs, added in order.
+ * The result is identical to zeroing \a output and calling
+ * ast_slinear_saturated_add() for every sample of every input.
+ *
+ * \param output Buffer to put the mix in
+ * \param inputs Buffers to mix; may not overlap \a output
+ * \param num_inputs Number of buffers in \a inputs
+ * \param samples Number of samples in every buffer
+ *
+ * \since 15.0.0
+ */
+void ast_slinear_saturated_mix(int16_t *output, int16_t * const *inputs,
+	size_t num_inputs, size_t samples);
+
+/*!
+ * \brief Subtract one signed linear buffer from another
+ *
+ * The result is identical to calling ast_slinear_saturated_subtract() for
+ * every sample.
+ *
+ * \param input Buffer to subtract from
+ * \param value Buffer to subtract
+ * \param samples Number of samples in each buffer
+ *
+ * \since 15.0.0
+ */
+void ast_slinear_saturated_subtract_buf(int16_t *input, const int16_t *value,
+	size_t samples);
+
+/*!
+ * \brief Get the implementation used by the mixing functions
+ * \since 15.0.0
+ */
+enum ast_slinear_mix_impl ast_slinear_mix_get_impl(void);
+
+/*!
+ * \brief Get the name of a mixing implementation
+ * \since 15.0.0
+ */
+const char *ast_slinear_mix_impl_name(enum ast_slinear_mix_impl impl);
+
+/*!
+ * \brief Select the implementation used by the mixing functions
+ *
+ * The best implementation the CPU supports is selected automatically.
+ * This is intended for testing the implementations against each other.
+ *
+ * \param impl The implementation to use
+ *
+ * \retval 0 success
+ * \retval -1 \a impl is not supported by this CPU or build
+ *
+ * \since 15.0.0
+ */
+int ast_slinear_mix_set_impl(enum ast_slinear_mix_impl impl);
+
+#if defined(__cplusplus) || defined(c_plusplus)
+}
+#endif
+
+#endif /* _ASTERISK_SLINEAR_MIX_H */
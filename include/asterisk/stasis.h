@@ -318,6 +318,17 @@ enum stasis_message_type_result stasis_message_type_create(const char *name,
  */
 const char *stasis_message_type_name(const struct stasis_message_type *type);
 
+/*!
+ * \brief Gets the identifier of a given message type
+ *
+ * Every message type gets a small unique number when it is created.
+ *
+ * \param type The type to get.
+ * \return The identifier of the type.
+ * \since 15.0.0
+ */
+int stasis_message_type_id(const struct stasis_message_type *type);
+
 /*!
  * \brief Check whether a message type is declined
  *
@@ -414,6 +425,9 @@ const struct timeval *stasis_message_timestamp(const struct stasis_message *msg)
  * May return \c NULL, to indicate no representation. The returned object should
  * be ast_json_unref()'ed.
  *
+ * The representation is built once per message and sanitizer; every call
+ * returns a copy that the caller is free to modify.
+ *
  * \param msg Message to convert to JSON string.
  * \param sanitize Snapshot sanitization callback.
  *
@@ -429,6 +443,9 @@ struct ast_json *stasis_message_to_json(struct stasis_message *msg, struct stasi
  * May return \c NULL, to indicate no representation. The returned object should
  * be ao2_cleanup()'ed.
  *
+ * The representation is built once per message and shared by every caller,
+ * so it must not be modified.
+ *
  * \param msg Message to convert to AMI.
  * \return \c NULL on error.
  * \return \c NULL if AMI format is not supported.
@@ -590,6 +607,90 @@ struct stasis_subscription *stasis_subscribe_pool(struct stasis_topic *topic,
 struct stasis_subscription *stasis_unsubscribe(
 	struct stasis_subscription *subscription);
 
+/*!
+ * \brief Callback function type for the end of a batch of Stasis messages.
+ *
+ * \param data Data pointer given when creating the subscription.
+ * \param sub Subscription the messages were delivered to.
+ * \since 15.0.0
+ */
+typedef void (*stasis_subscription_batch_cb)(void *data, struct stasis_subscription *sub);
+
+/*!
+ * \brief Set a callback for when a burst of messages has been delivered.
+ *
+ * When set, \a callback is invoked after a message has been passed to the
+ * subscription's callback and no further messages are waiting for the
+ * subscription.  The subscription's callback may then collect the work for
+ * each message of a burst, such as writes to the same connection, and do
+ * it once from \a callback.
+ *
+ * The callback is not invoked after the final message.
+ *
+ * \note Only subscriptions with a mailbox (stasis_subscribe() and
+ * stasis_subscribe_pool()) support batch callbacks.  The callback should be
+ * set before messages are published to the subscription's topic.
+ *
+ * \param subscription Subscription to set the callback on.
+ * \param callback Callback to invoke, or \c NULL to remove it.
+ *
+ * \retval 0 on success.
+ * \retval -1 on error.
+ * \since 15.0.0
+ */
+int stasis_subscription_set_batch_callback(struct stasis_subscription *subscription,
+	stasis_subscription_batch_cb callback);
+
+/*!
+ * \brief Stasis subscription message filters
+ */
+enum stasis_subscription_message_filter {
+	STASIS_SUBSCRIPTION_FILTER_NONE = 0,	/*!< No filter is in place, all messages are raised */
+	STASIS_SUBSCRIPTION_FILTER_SELECTIVE,	/*!< Only messages of allowed message types are raised */
+};
+
+/*!
+ * \brief Indicate to a subscription that we are interested in a message type.
+ *
+ * This will cause the subscription to allow the given message type to be
+ * raised to our subscription callback. This enforces type safety by only
+ * allowing the message types we know about to be raised, and it saves
+ * queueing the other messages at all.
+ *
+ * \note Only has an effect once the filter is set with
+ * stasis_subscription_set_filter().
+ *
+ * \param subscription Subscription to add message type to.
+ * \param type The message type we wish to receive.
+ *
+ * \retval 0 on success
+ * \retval -1 failure
+ * \since 15.0.0
+ */
+int stasis_subscription_accept_message_type(struct stasis_subscription *subscription,
+	const struct stasis_message_type *type);
+
+/*!
+ * \brief Set the message type filtering level on a subscription
+ *
+ * This will cause the subscription to filter messages according to the
+ * provided filter level. For example if selective is used then only
+ * messages matching those provided to stasis_subscription_accept_message_type()
+ * will be raised to the subscription callback.
+ *
+ * \note The final message, stasis_subscription_final_message(), is always
+ * raised.
+ *
+ * \param subscription Subscription that should receive all messages.
+ * \param filter What filter to use
+ *
+ * \retval 0 on success
+ * \retval -1 failure
+ * \since 15.0.0
+ */
+int stasis_subscription_set_filter(struct stasis_subscription *subscription,
+	enum stasis_subscription_message_filter filter);
+
 /*!
  * \brief Set the high and low alert water marks of the stasis subscription.
  * \since 13.10.0
@@ -29,39 +29,55 @@
  * @{
  */
 
+/*! \brief Identity of a channel, shared between snapshots while it is unchanged */
+struct ast_channel_snapshot_identity;
+/*! \brief Caller and connected line parties, shared between snapshots while unchanged */
+struct ast_channel_snapshot_party;
+/*! \brief Dialplan location, shared between snapshots while unchanged */
+struct ast_channel_snapshot_dialplan;
+/*! \brief Bridge membership, shared between snapshots while unchanged */
+struct ast_channel_snapshot_bridge;
+
 /*!
  * \since 12
  * \brief Structure representing a snapshot of channel state.
  *
  * While not enforced programmatically, this object is shared across multiple
  * threads, and should be treated as an immutable object.
+ *
+ * The strings are held by reference counted segments which successive
+ * snapshots of a channel share until something in the segment changes, so
+ * a snapshot only copies the strings that changed since the last one.
  */
 struct ast_channel_snapshot {
-	AST_DECLARE_STRING_FIELDS(
-		AST_STRING_FIELD(name);             /*!< ASCII unique channel name */
-		AST_STRING_FIELD(uniqueid);         /*!< Unique Channel Identifier */
-		AST_STRING_FIELD(linkedid);         /*!< Linked Channel Identifier -- gets propagated by linkage */
-		AST_STRING_FIELD(appl);             /*!< Current application */
-		AST_STRING_FIELD(data);             /*!< Data passed to current application */
-		AST_STRING_FIELD(context);          /*!< Dialplan: Current extension context */
-		AST_STRING_FIELD(exten);            /*!< Dialplan: Current extension number */
-		AST_STRING_FIELD(accountcode);      /*!< Account code for billing */
-		AST_STRING_FIELD(peeraccount);      /*!< Peer account code for billing */
-		AST_STRING_FIELD(userfield);        /*!< Userfield for CEL billing */
-		AST_STRING_FIELD(hangupsource);     /*!< Who is responsible for hanging up this channel */
-		AST_STRING_FIELD(caller_name);      /*!< Caller ID Name */
-		AST_STRING_FIELD(caller_number);    /*!< Caller ID Number */
-		AST_STRING_FIELD(caller_dnid);      /*!< Dialed ID Number */
-		AST_STRING_FIELD(caller_ani);       /*!< Caller ID ANI Number */
-		AST_STRING_FIELD(caller_rdnis);     /*!< Caller ID RDNIS Number */
-		AST_STRING_FIELD(caller_subaddr);   /*!< Caller subaddress */
-		AST_STRING_FIELD(dialed_subaddr);   /*!< Dialed subaddress */
-		AST_STRING_FIELD(connected_name);   /*!< Connected Line Name */
-		AST_STRING_FIELD(connected_number); /*!< Connected Line Number */
-		AST_STRING_FIELD(language);         /*!< The default spoken language for the channel */
-		AST_STRING_FIELD(bridgeid);         /*!< Unique Bridge Identifier */
-		AST_STRING_FIELD(type);             /*!< Type of channel technology */
-	);
+	const char *name;                       /*!< ASCII unique channel name */
+	const char *uniqueid;                   /*!< Unique Channel Identifier */
+	const char *linkedid;                   /*!< Linked Channel Identifier -- gets propagated by linkage */
+	const char *appl;                       /*!< Current application */
+	const char *data;                       /*!< Data passed to current application */
+	const char *context;                    /*!< Dialplan: Current extension context */
+	const char *exten;                      /*!< Dialplan: Current extension number */
+	const char *accountcode;                /*!< Account code for billing */
+	const char *peeraccount;                /*!< Peer account code for billing */
+	const char *userfield;                  /*!< Userfield for CEL billing */
+	const char *hangupsource;               /*!< Who is responsible for hanging up this channel */
+	const char *caller_name;                /*!< Caller ID Name */
+	const char *caller_number;              /*!< Caller ID Number */
+	const char *caller_dnid;                /*!< Dialed ID Number */
+	const char *caller_ani;                 /*!< Caller ID ANI Number */
+	const char *caller_rdnis;               /*!< Caller ID RDNIS Number */
+	const char *caller_subaddr;             /*!< Caller subaddress */
+	const char *dialed_subaddr;             /*!< Dialed subaddress */
+	const char *connected_name;             /*!< Connected Line Name */
+	const char *connected_number;           /*!< Connected Line Number */
+	const char *language;                   /*!< The default spoken language for the channel */
+	const char *bridgeid;                   /*!< Unique Bridge Identifier */
+	const char *type;                       /*!< Type of channel technology */
+
+	struct ast_channel_snapshot_identity *identity; /*!< Segment holding the identity strings */
+	struct ast_channel_snapshot_party *party;       /*!< Segment holding the caller and connected strings */
+	struct ast_channel_snapshot_dialplan *dialplan; /*!< Segment holding the dialplan strings */
+	struct ast_channel_snapshot_bridge *bridge;     /*!< Segment holding the bridge strings */
 
 	struct timeval creationtime;            /*!< The time of channel creation */
 	enum ast_channel_state state;           /*!< State of line */
@@ -152,6 +168,26 @@ struct stasis_message_type *ast_channel_snapshot_type(void);
 struct ast_channel_snapshot *ast_channel_snapshot_create(
 	struct ast_channel *chan);
 
+/*!
+ * \since 15.0.0
+ * \brief Replace the application of a snapshot that has not been published yet.
+ *
+ * Snapshots share their strings with other snapshots of the channel, so
+ * they may not be changed in place.  This gives the snapshot its own
+ * copy of the dialplan location with the application replaced.
+ *
+ * \pre The snapshot's channel is locked
+ *
+ * \param snapshot The snapshot to change
+ * \param appl The application
+ * \param data The data passed to the application
+ *
+ * \retval 0 on success
+ * \retval -1 on error
+ */
+int ast_channel_snapshot_set_application(struct ast_channel_snapshot *snapshot,
+	const char *appl, const char *data);
+
 /*!
  * \since 12
  * \brief Obtain the latest \ref ast_channel_snapshot from the \ref stasis cache. This is
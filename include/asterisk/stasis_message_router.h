@@ -238,4 +238,24 @@ int stasis_message_router_set_default(struct stasis_message_router *router,
 				      stasis_subscription_cb callback,
 				      void *data);
 
+/*!
+ * \brief Sets the callback for the end of a burst of routed messages.
+ *
+ * \a callback is invoked on the router's thread once a message has been
+ * routed and no further messages are waiting for the router.  Routes may
+ * then defer work shared by the messages of a burst to \a callback.
+ *
+ * \param router Router to set the batch callback of.
+ * \param callback Callback to invoke, or \c NULL to remove it.
+ * \param data Data pointer to pass to \a callback.
+ *
+ * \retval 0 on success
+ * \retval -1 on failure
+ *
+ * \since 15.0.0
+ */
+int stasis_message_router_set_batch_callback(struct stasis_message_router *router,
+	stasis_subscription_batch_cb callback,
+	void *data);
+
 #endif /* _ASTERISK_STASIS_MESSAGE_ROUTER_H */
@@ -62,6 +62,9 @@ struct ast_taskprocessor;
 /*! Default taskprocessor high water level alert trigger */
 #define AST_TASKPROCESSOR_HIGH_WATER_LEVEL 500
 
+/*! Default maximum number of tasks executed by ast_taskprocessor_execute_batch() */
+#define AST_TASKPROCESSOR_BATCH_SIZE 32
+
 /*!
  * \brief ast_tps_options for specification of taskprocessor options
  *
@@ -284,6 +287,22 @@ int ast_taskprocessor_is_suspended(struct ast_taskprocessor *tps);
  */
 int ast_taskprocessor_execute(struct ast_taskprocessor *tps);
 
+/*!
+ * \brief Pop several tasks off the taskprocessor and execute them.
+ *
+ * \since 15.0.0
+ *
+ * Up to \a max_tasks tasks are taken from the queue under a single lock
+ * acquisition and executed in order.  The tasks count as still queued
+ * until the last one has been executed.
+ *
+ * \param tps The taskprocessor from which to execute.
+ * \param max_tasks Maximum number of tasks to execute.
+ * \retval 0 There is no further work to be done.
+ * \retval 1 Tasks still remain in the taskprocessor queue.
+ */
+int ast_taskprocessor_execute_batch(struct ast_taskprocessor *tps, unsigned int max_tasks);
+
 /*!
  * \brief Am I the given taskprocessor's current task.
  * \since 12.7.0
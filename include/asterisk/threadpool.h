@@ -68,7 +68,7 @@ struct ast_threadpool_listener_callbacks {
 };
 
 struct ast_threadpool_options {
-#define AST_THREADPOOL_OPTIONS_VERSION 1
+#define AST_THREADPOOL_OPTIONS_VERSION 2
 	/*! Version of threadpool options in use */
 	int version;
 	/*!
@@ -122,6 +122,23 @@ struct ast_threadpool_options {
 	 * a thread completes
 	 */
 	void (*thread_end)(void);
+	/*!
+	 * \brief Give each thread its own task queue
+	 * \since 15.0.0
+	 *
+	 * Only read when \ref version is 2 or later.
+	 *
+	 * Instead of all threads taking tasks from one shared queue, each
+	 * thread has its own deque of tasks.  Tasks pushed from a thread of
+	 * the pool stay on that thread's deque, serializers are given an
+	 * affinity to one thread, and threads that run out of work steal
+	 * tasks from the others.
+	 *
+	 * Thread states and pool growth are reported and handled as usual,
+	 * but the listener is only told about pushed tasks individually if
+	 * it has a task_pushed callback.
+	 */
+	int work_stealing;
 };
 
 /*!
@@ -330,6 +330,67 @@ void ast_translator_free_path(struct ast_trans_pvt *tr);
  */
 struct ast_frame *ast_translate(struct ast_trans_pvt *tr, struct ast_frame *f, int consume);
 
+/*!
+ * \brief A source stream translated once for all its consumers
+ *
+ * \details Where many consumers need the same stream in the same format,
+ * such as the listeners of a conference or of a music on hold class, each
+ * source frame only needs to be translated once per destination format.
+ * The producer gives each source frame to ast_translate_shared_frame() and
+ * the consumers, possibly from several threads at once, get it in their
+ * format from ast_translate_shared_get().  Every destination format has a
+ * single translation path, so all the consumers of a format share one
+ * encoder instance.
+ *
+ * Translation paths no longer requested are freed after a while.
+ */
+struct ast_translate_shared;
+
+/*!
+ * \brief Allocate a shared translation of a source stream
+ *
+ * \param src Format of the source stream
+ *
+ * \return An ao2 object, NULL on failure
+ *
+ * \since 15.0.0
+ */
+struct ast_translate_shared *ast_translate_shared_alloc(struct ast_format *src);
+
+/*!
+ * \brief Set the current frame of the source stream
+ *
+ * Frees the translations of the previous frame.
+ *
+ * \param shared The shared translation
+ * \param f The new source frame, in the source format, or NULL for none.
+ * It must stay valid until the next call.
+ *
+ * \note Must not be called while any consumer is still using a frame from
+ * ast_translate_shared_get().
+ *
+ * \since 15.0.0
+ */
+void ast_translate_shared_frame(struct ast_translate_shared *shared, struct ast_frame *f);
+
+/*!
+ * \brief Get the current source frame in a destination format
+ *
+ * The first consumer of a format translates the frame, the others get
+ * the same result.
+ *
+ * \param shared The shared translation
+ * \param dst The destination format
+ *
+ * \return The translated frame, or frame list, which remains owned by
+ * \a shared until the next ast_translate_shared_frame().  The source frame
+ * itself if \a dst is the source format.  NULL if there is no frame or it
+ * could not be translated.
+ *
+ * \since 15.0.0
+ */
+struct ast_frame *ast_translate_shared_get(struct ast_translate_shared *shared, struct ast_format *dst);
+
 /*!
  * \brief Returns the number of steps required to convert from 'src' to 'dest'.
  * \param dest destination format
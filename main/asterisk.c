@@ -203,6 +203,7 @@ int daemon(int, int);  /* defined in libresolv of all places */
 #include "asterisk/acl.h"
 #include "asterisk/ulaw.h"
 #include "asterisk/alaw.h"
+#include "asterisk/g711.h"
 #include "asterisk/callerid.h"
 #include "asterisk/image.h"
 #include "asterisk/tdd.h"
@@ -340,6 +341,8 @@ unsigned int option_dtmfminduration;		/*!< Minimum duration of DTMF. */
 long option_minmemfree;				/*!< Minimum amount of free system memory - stop accepting calls if free memory falls below this watermark */
 #endif
 unsigned int ast_option_rtpptdynamic;
+int ast_option_astdb_readers;			/*!< Number of connections reading the astdb */
+int ast_option_hint_threads;			/*!< Max number of threads sending extension state updates */
 
 /*! @} */
 
@@ -3500,6 +3503,8 @@ static void ast_readconfig(void)
 	/* Set default value */
 	option_dtmfminduration = AST_MIN_DTMF_DURATION;
 	ast_option_rtpptdynamic = 35;
+	ast_option_hint_threads = 50;
+	ast_option_astdb_readers = 0;
 
 	/* init with buildtime config */
 	ast_copy_string(cfg_paths.config_dir, DEFAULT_CONFIG_DIR, sizeof(cfg_paths.config_dir));
@@ -3641,6 +3646,13 @@ static void ast_readconfig(void)
 		/* Build transcode paths via SLINEAR, instead of directly */
 		} else if (!strcasecmp(v->name, "transcode_via_sln")) {
 			ast_set2_flag(&ast_options, ast_true(v->value), AST_OPT_FLAG_TRANSCODE_VIA_SLIN);
+		} else if (!strcasecmp(v->name, "astdb_readers")) {
+			if ((sscanf(v->value, "%30d", &ast_option_astdb_readers) != 1) || (ast_option_astdb_readers < 0)) {
+				ast_log(LOG_WARNING, "Invalid astdb_readers '%s', using 0\n", v->value);
+				ast_option_astdb_readers = 0;
+			}
+		} else if (!strcasecmp(v->name, "astdb_cache")) {
+			ast_set2_flag(&ast_options, ast_true(v->value), AST_OPT_FLAG_ASTDB_CACHE);
 		/* Transmit SLINEAR silence while a channel is being recorded or DTMF is being generated on a channel */
 		} else if (!strcasecmp(v->name, "transmit_silence_during_record") || !strcasecmp(v->name, "transmit_silence")) {
 			ast_set2_flag(&ast_options, ast_true(v->value), AST_OPT_FLAG_TRANSMIT_SILENCE);
@@ -3664,6 +3676,11 @@ static void ast_readconfig(void)
 			if ((sscanf(v->value, "%30d", &ast_option_maxcalls) != 1) || (ast_option_maxcalls < 0)) {
 				ast_option_maxcalls = 0;
 			}
+		} else if (!strcasecmp(v->name, "hint_threads")) {
+			if ((sscanf(v->value, "%30d", &ast_option_hint_threads) != 1) || (ast_option_hint_threads < 1)) {
+				ast_log(LOG_WARNING, "Invalid hint_threads '%s', using 50\n", v->value);
+				ast_option_hint_threads = 50;
+			}
 		} else if (!strcasecmp(v->name, "maxload")) {
 			double test[1];
 
@@ -4489,6 +4506,7 @@ static void asterisk_daemon(int isroot, const char *runuser, const char *rungrou
 	ast_json_init();
 	ast_ulaw_init();
 	ast_alaw_init();
+	ast_g711_init();
 	tdd_init();
 	callerid_init();
 	ast_builtins_init();
@@ -4500,6 +4518,8 @@ static void asterisk_daemon(int isroot, const char *runuser, const char *rungrou
 #ifdef TEST_FRAMEWORK
 	check_init(ast_test_init(), "Test Framework");
 #endif
+	check_init(ast_sched_init(), "Scheduler");
+	check_init(ast_frame_init(), "Frames");
 	check_init(ast_translate_init(), "Translator Core");
 
 	ast_aoc_cli_init();
@@ -960,6 +960,14 @@ static struct ast_frame *audio_audiohook_write_list(struct ast_channel *chan, st
 	 */
 	internal_sample_rate = audiohook_list->list_internal_samp_rate;
 
+	/* Whisper sources and manipulators change the frame in place, which must not be done to shared data */
+	if (middle_frame == start_frame
+		&& (!AST_LIST_EMPTY(&audiohook_list->whisper_list)
+			|| !AST_LIST_EMPTY(&audiohook_list->manipulate_list))
+		&& ast_frame_unshare(middle_frame)) {
+		return frame;
+	}
+
 	/* ---Part_2: Send middle_frame to spy and manipulator lists.  middle_frame is guaranteed to be SLINEAR here.*/
 	/* Queue up signed linear frame to each spy */
 	AST_LIST_TRAVERSE_SAFE_BEGIN(&audiohook_list->spy_list, audiohook, list) {
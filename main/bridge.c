@@ -3736,6 +3736,13 @@ void ast_bridge_set_mixing_interval(struct ast_bridge *bridge, unsigned int mixi
 	ast_bridge_unlock(bridge);
 }
 
+void ast_bridge_set_mixing_threads(struct ast_bridge *bridge, unsigned int mixing_threads)
+{
+	ast_bridge_lock(bridge);
+	bridge->softmix.mixing_threads = mixing_threads;
+	ast_bridge_unlock(bridge);
+}
+
 void ast_bridge_set_internal_sample_rate(struct ast_bridge *bridge, unsigned int sample_rate)
 {
 	ast_bridge_lock(bridge);
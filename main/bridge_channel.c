@@ -930,6 +930,15 @@ static int bridge_channel_write_action_data(struct ast_bridge_channel *bridge_ch
 	return bridge_channel_write_frame(bridge_channel, &frame);
 }
 
+/*!
+ * \internal
+ * \brief Check if a frame carries media the channels may share
+ */
+static int bridge_frame_is_media(const struct ast_frame *frame)
+{
+	return frame->frametype == AST_FRAME_VOICE || frame->frametype == AST_FRAME_VIDEO;
+}
+
 static void bridge_frame_free(struct ast_frame *frame)
 {
 	if (frame->frametype == AST_FRAME_BRIDGE_ACTION_SYNC) {
@@ -969,7 +978,8 @@ int ast_bridge_channel_queue_frame(struct ast_bridge_channel *bridge_channel, st
 		return 0;
 	}
 
-	dup = ast_frdup(fr);
+	/* Media is only read on its way to the channel, so the queued copies share it */
+	dup = bridge_frame_is_media(fr) ? ast_frshare(fr) : ast_frdup(fr);
 	if (!dup) {
 		return -1;
 	}
@@ -994,6 +1004,7 @@ int ast_bridge_channel_queue_frame(struct ast_bridge_channel *bridge_channel, st
 int ast_bridge_queue_everyone_else(struct ast_bridge *bridge, struct ast_bridge_channel *bridge_channel, struct ast_frame *frame)
 {
 	struct ast_bridge_channel *cur;
+	struct ast_frame *shared = NULL;
 	int not_written = -1;
 
 	if (frame->frametype == AST_FRAME_NULL) {
@@ -1001,6 +1012,11 @@ int ast_bridge_queue_everyone_else(struct ast_bridge *bridge, struct ast_bridge_
 		return 0;
 	}
 
+	/* Copy media once for all the channels instead of once for each */
+	if (bridge_frame_is_media(frame) && (shared = ast_frshare(frame))) {
+		frame = shared;
+	}
+
 	AST_LIST_TRAVERSE(&bridge->channels, cur, entry) {
 		if (cur == bridge_channel) {
 			continue;
@@ -1009,6 +1025,10 @@ int ast_bridge_queue_everyone_else(struct ast_bridge *bridge, struct ast_bridge_
 			not_written = 0;
 		}
 	}
+
+	if (shared) {
+		ast_frfree(shared);
+	}
 	return not_written;
 }
 
@@ -5215,8 +5215,14 @@ int ast_write(struct ast_channel *chan, struct ast_frame *fr)
 		break;
 	case AST_FRAME_VIDEO:
 		/* XXX Handle translation of video codecs one day XXX */
-		res = (ast_channel_tech(chan)->write_video == NULL) ? 0 :
-			ast_channel_tech(chan)->write_video(chan, fr);
+		if (ast_channel_tech(chan)->write_video == NULL) {
+			res = 0;
+		} else if (ast_frame_unshare(fr)) {
+			/* The driver may build its headers in front of the data */
+			res = -1;
+		} else {
+			res = ast_channel_tech(chan)->write_video(chan, fr);
+		}
 		break;
 	case AST_FRAME_MODEM:
 		res = (ast_channel_tech(chan)->write == NULL) ? 0 :
@@ -5226,7 +5232,8 @@ int ast_write(struct ast_channel *chan, struct ast_frame *fr)
 		if (ast_channel_tech(chan)->write == NULL)
 			break;	/*! \todo XXX should return 0 maybe ? */
 
-		if (ast_opt_generic_plc && ast_format_cmp(fr->subclass.format, ast_format_slin) == AST_FORMAT_CMP_EQUAL) {
+		if (ast_opt_generic_plc && ast_format_cmp(fr->subclass.format, ast_format_slin) == AST_FORMAT_CMP_EQUAL
+			&& !ast_frame_unshare(fr)) {
 			apply_plc(chan, fr);
 		}
 
@@ -5370,6 +5377,13 @@ int ast_write(struct ast_channel *chan, struct ast_frame *fr)
 			}
 		}
 
+		/* The driver may build its headers in front of the data, which must
+		   not be done to data still shared with other channels */
+		if (f == fr && ast_frame_unshare(fr)) {
+			res = -1;
+			break;
+		}
+
 		/* the translator on chan->writetrans may have returned multiple frames
 		   from the single frame we passed in; if so, feed each one of them to the
 		   channel, freeing each one after it has been written */
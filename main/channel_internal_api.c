@@ -221,6 +221,7 @@ struct ast_channel {
 	struct stasis_cp_single *topics;		/*!< Topic for all channel's events */
 	struct stasis_forward *endpoint_forward;	/*!< Subscription for event forwarding to endpoint's topic */
 	struct stasis_forward *endpoint_cache_forward; /*!< Subscription for cache updates to endpoint's topic */
+	struct ast_channel_snapshot *snapshot;		/*!< The last snapshot taken, whose segments the next one may share */
 };
 
 /*! \brief The monotonically increasing integer counter for channel uniqueids */
@@ -861,6 +862,14 @@ void ast_channel_sched_set(struct ast_channel *chan, struct ast_sched_context *v
 {
 	chan->sched = value;
 }
+struct ast_channel_snapshot *ast_channel_snapshot(const struct ast_channel *chan)
+{
+	return chan->snapshot;
+}
+void ast_channel_snapshot_set(struct ast_channel *chan, struct ast_channel_snapshot *snapshot)
+{
+	ao2_replace(chan->snapshot, snapshot);
+}
 struct ast_timer *ast_channel_timer(const struct ast_channel *chan)
 {
 	return chan->timer;
@@ -1632,6 +1641,9 @@ void ast_channel_internal_cleanup(struct ast_channel *chan)
 
 	ast_string_field_free_memory(chan);
 
+	ao2_cleanup(chan->snapshot);
+	chan->snapshot = NULL;
+
 	chan->endpoint_forward = stasis_forward_cancel(chan->endpoint_forward);
 	chan->endpoint_cache_forward = stasis_forward_cancel(chan->endpoint_cache_forward);
 
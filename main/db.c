@@ -51,6 +51,8 @@
 #include "asterisk/cli.h"
 #include "asterisk/utils.h"
 #include "asterisk/manager.h"
+#include "asterisk/astobj2.h"
+#include "asterisk/linkedlists.h"
 
 /*** DOCUMENTATION
 	<manager name="DBGet" language="en_US">
@@ -72,10 +74,24 @@
 		<syntax>
 			<xi:include xpointer="xpointer(/docs/manager[@name='Login']/syntax/parameter[@name='ActionID'])" />
 			<parameter name="Family" required="true" />
-			<parameter name="Key" required="true" />
+			<parameter name="Key">
+				<para>Required unless <replaceable>Key-000000</replaceable> is given.</para>
+			</parameter>
 			<parameter name="Val" />
+			<parameter name="Key-000000">
+				<para>Key of one of many entries to put in the family.</para>
+				<para>0's represent 6 digit number beginning with 000000.</para>
+			</parameter>
+			<parameter name="Val-000000">
+				<para>Value of the entry with the same number.</para>
+				<xi:include xpointer="xpointer(/docs/manager[@name='DBPut']/syntax/parameter[@name='Key-000000']/para[2])" />
+			</parameter>
 		</syntax>
 		<description>
+			<para>Puts one entry given by <replaceable>Key</replaceable> and
+			<replaceable>Val</replaceable>, or many entries numbered from 000000 with
+			<replaceable>Key-000000</replaceable> and <replaceable>Val-000000</replaceable>.
+			Many entries are put at once, either all of them or none.</para>
 		</description>
 	</manager>
 	<manager name="DBDel" language="en_US">
@@ -105,6 +121,13 @@
  ***/
 
 #define MAX_DB_FIELD 256
+/*! Milliseconds a connection waits for a lock held by another before giving up */
+#define DB_BUSY_TIMEOUT 1000
+/*! Number of buckets in the cache of values */
+#define DB_CACHE_BUCKETS 563
+/*! Longest value kept in the cache of values */
+#define DB_CACHE_MAX_VALUE 1024
+
 AST_MUTEX_DEFINE_STATIC(dblock);
 static ast_cond_t dbcond;
 static sqlite3 *astdb;
@@ -112,7 +135,60 @@ static pthread_t syncthread;
 static int doexit;
 static int dosync;
 
+/*!
+ * \brief Whether the database is in WAL mode
+ *
+ * In WAL mode every change is committed right away, so the readers see it,
+ * and the sync thread checkpoints the log rather than committing.
+ */
+static int db_wal;
+/*! Connection the sync thread checkpoints the log with */
+static sqlite3 *checkpoint_db;
+
 static void db_sync(void);
+static int db_execute_sql(const char *sql, int (*callback)(void *, int, char **, char **), void *arg);
+static int db_journal_mode_cb(void *arg, int columns, char **values, char **colnames);
+
+/*! \brief A connection reading the database, with its own prepared statements */
+struct db_reader {
+	sqlite3 *db;
+	sqlite3_stmt *get_stmt;
+	sqlite3_stmt *gettree_stmt;
+	sqlite3_stmt *gettree_all_stmt;
+	sqlite3_stmt *showkey_stmt;
+	AST_LIST_ENTRY(db_reader) list;
+};
+
+/*! \brief The statements of the writer, which reads under dblock when there are no readers */
+static struct db_reader writer_reader;
+
+/*! Protects idle_readers */
+AST_MUTEX_DEFINE_STATIC(readers_lock);
+static ast_cond_t readers_cond;
+/*! Readers not in use */
+static AST_LIST_HEAD_NOLOCK_STATIC(idle_readers, db_reader);
+/*! All the readers */
+static struct db_reader *readers;
+/*! Number of readers opened */
+static int readers_count;
+
+/*! \brief A value in the cache of values */
+struct db_cache_entry {
+	/*! The value, stored after the key */
+	char *value;
+	/*! The full key, /family/key */
+	char key[0];
+};
+
+/*!
+ * \brief Cache of values by full key
+ *
+ * Values are cached when read and replaced or removed when written, while
+ * dblock is held.  NULL if the cache is disabled.
+ */
+static struct ao2_container *db_cache;
+/*! Number of changes made to the cache, protected by the cache lock */
+static unsigned int db_cache_generation;
 
 #define DEFINE_SQL_STATEMENT(stmt,sql) static sqlite3_stmt *stmt; \
 	const char stmt##_sql[] = sql;
@@ -127,19 +203,27 @@ DEFINE_SQL_STATEMENT(gettree_all_stmt, "SELECT key, value FROM astdb ORDER BY ke
 DEFINE_SQL_STATEMENT(showkey_stmt, "SELECT key, value FROM astdb WHERE key LIKE '%' || '/' || ? ORDER BY key")
 DEFINE_SQL_STATEMENT(create_astdb_stmt, "CREATE TABLE IF NOT EXISTS astdb(key VARCHAR(256), value VARCHAR(256), PRIMARY KEY(key))")
 
-static int init_stmt(sqlite3_stmt **stmt, const char *sql, size_t len)
+static int prepare_stmt(sqlite3 *db, sqlite3_stmt **stmt, const char *sql, size_t len)
 {
-	ast_mutex_lock(&dblock);
-	if (sqlite3_prepare(astdb, sql, len, stmt, NULL) != SQLITE_OK) {
-		ast_log(LOG_WARNING, "Couldn't prepare statement '%s': %s\n", sql, sqlite3_errmsg(astdb));
-		ast_mutex_unlock(&dblock);
+	if (sqlite3_prepare(db, sql, len, stmt, NULL) != SQLITE_OK) {
+		ast_log(LOG_WARNING, "Couldn't prepare statement '%s': %s\n", sql, sqlite3_errmsg(db));
 		return -1;
 	}
-	ast_mutex_unlock(&dblock);
 
 	return 0;
 }
 
+static int init_stmt(sqlite3_stmt **stmt, const char *sql, size_t len)
+{
+	int res;
+
+	ast_mutex_lock(&dblock);
+	res = prepare_stmt(astdb, stmt, sql, len);
+	ast_mutex_unlock(&dblock);
+
+	return res;
+}
+
 /*! \internal
  * \brief Clean up the prepared SQLite3 statement
  * \note dblock should already be locked prior to calling this method
@@ -176,14 +260,262 @@ static int init_statements(void)
 {
 	/* Don't initialize create_astdb_statment here as the astdb table needs to exist
 	 * brefore these statments can be initialized */
-	return init_stmt(&get_stmt, get_stmt_sql, sizeof(get_stmt_sql))
-	|| init_stmt(&del_stmt, del_stmt_sql, sizeof(del_stmt_sql))
-	|| init_stmt(&deltree_stmt, deltree_stmt_sql, sizeof(deltree_stmt_sql))
-	|| init_stmt(&deltree_all_stmt, deltree_all_stmt_sql, sizeof(deltree_all_stmt_sql))
-	|| init_stmt(&gettree_stmt, gettree_stmt_sql, sizeof(gettree_stmt_sql))
-	|| init_stmt(&gettree_all_stmt, gettree_all_stmt_sql, sizeof(gettree_all_stmt_sql))
-	|| init_stmt(&showkey_stmt, showkey_stmt_sql, sizeof(showkey_stmt_sql))
-	|| init_stmt(&put_stmt, put_stmt_sql, sizeof(put_stmt_sql));
+	if (init_stmt(&get_stmt, get_stmt_sql, sizeof(get_stmt_sql))
+		|| init_stmt(&del_stmt, del_stmt_sql, sizeof(del_stmt_sql))
+		|| init_stmt(&deltree_stmt, deltree_stmt_sql, sizeof(deltree_stmt_sql))
+		|| init_stmt(&deltree_all_stmt, deltree_all_stmt_sql, sizeof(deltree_all_stmt_sql))
+		|| init_stmt(&gettree_stmt, gettree_stmt_sql, sizeof(gettree_stmt_sql))
+		|| init_stmt(&gettree_all_stmt, gettree_all_stmt_sql, sizeof(gettree_all_stmt_sql))
+		|| init_stmt(&showkey_stmt, showkey_stmt_sql, sizeof(showkey_stmt_sql))
+		|| init_stmt(&put_stmt, put_stmt_sql, sizeof(put_stmt_sql))) {
+		return -1;
+	}
+
+	writer_reader.db = astdb;
+	writer_reader.get_stmt = get_stmt;
+	writer_reader.gettree_stmt = gettree_stmt;
+	writer_reader.gettree_all_stmt = gettree_all_stmt;
+	writer_reader.showkey_stmt = showkey_stmt;
+
+	return 0;
+}
+
+/*! \internal
+ * \brief Close a reader and finalize its statements
+ */
+static void db_reader_close(struct db_reader *reader)
+{
+	sqlite3_finalize(reader->get_stmt);
+	sqlite3_finalize(reader->gettree_stmt);
+	sqlite3_finalize(reader->gettree_all_stmt);
+	sqlite3_finalize(reader->showkey_stmt);
+	sqlite3_close(reader->db);
+	memset(reader, 0, sizeof(*reader));
+}
+
+/*! \internal
+ * \brief Open a connection reading the database and prepare its statements
+ */
+static int db_reader_open(struct db_reader *reader, const char *dbname)
+{
+	if (sqlite3_open_v2(dbname, &reader->db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK) {
+		ast_log(LOG_WARNING, "Unable to open Asterisk database '%s' for reading: %s\n",
+			dbname, sqlite3_errmsg(reader->db));
+		db_reader_close(reader);
+		return -1;
+	}
+	sqlite3_busy_timeout(reader->db, DB_BUSY_TIMEOUT);
+
+	if (prepare_stmt(reader->db, &reader->get_stmt, get_stmt_sql, sizeof(get_stmt_sql))
+		|| prepare_stmt(reader->db, &reader->gettree_stmt, gettree_stmt_sql, sizeof(gettree_stmt_sql))
+		|| prepare_stmt(reader->db, &reader->gettree_all_stmt, gettree_all_stmt_sql, sizeof(gettree_all_stmt_sql))
+		|| prepare_stmt(reader->db, &reader->showkey_stmt, showkey_stmt_sql, sizeof(showkey_stmt_sql))) {
+		db_reader_close(reader);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*! \internal
+ * \brief Open the readers, and the connection checkpointing the log
+ *
+ * Readers only see committed changes, so they are only used in WAL mode.
+ * Without them everything is read through the writer under dblock.
+ */
+static void db_readers_init(const char *dbname)
+{
+	int i;
+
+	if (!db_wal || ast_option_astdb_readers <= 0) {
+		return;
+	}
+
+	if (sqlite3_open(dbname, &checkpoint_db) != SQLITE_OK) {
+		ast_log(LOG_WARNING, "Unable to open Asterisk database '%s' to checkpoint: %s\n",
+			dbname, sqlite3_errmsg(checkpoint_db));
+		sqlite3_close(checkpoint_db);
+		checkpoint_db = NULL;
+
+		/* Let the writer checkpoint as it commits instead */
+		ast_mutex_lock(&dblock);
+		db_execute_sql("PRAGMA wal_autocheckpoint=1000", NULL, NULL);
+		ast_mutex_unlock(&dblock);
+	} else {
+		sqlite3_busy_timeout(checkpoint_db, DB_BUSY_TIMEOUT);
+	}
+
+	readers = ast_calloc(ast_option_astdb_readers, sizeof(*readers));
+	if (!readers) {
+		return;
+	}
+
+	ast_mutex_lock(&readers_lock);
+	for (i = 0; i < ast_option_astdb_readers; ++i) {
+		if (db_reader_open(&readers[readers_count], dbname)) {
+			break;
+		}
+		AST_LIST_INSERT_TAIL(&idle_readers, &readers[readers_count], list);
+		++readers_count;
+	}
+	ast_mutex_unlock(&readers_lock);
+
+	ast_verb(3, "Reading Asterisk database with %d connections\n", readers_count);
+}
+
+/*! \internal
+ * \brief Get a connection to read the database with
+ *
+ * \note Readers never wait for the writer, only for another reader to be done
+ * when all of them are in use.
+ *
+ * \note Must be given back with db_reader_release()
+ */
+static struct db_reader *db_reader_get(void)
+{
+	struct db_reader *reader;
+
+	if (!readers_count) {
+		ast_mutex_lock(&dblock);
+		return &writer_reader;
+	}
+
+	ast_mutex_lock(&readers_lock);
+	while (!(reader = AST_LIST_REMOVE_HEAD(&idle_readers, list))) {
+		ast_cond_wait(&readers_cond, &readers_lock);
+	}
+	ast_mutex_unlock(&readers_lock);
+
+	return reader;
+}
+
+static void db_reader_release(struct db_reader *reader)
+{
+	if (reader == &writer_reader) {
+		ast_mutex_unlock(&dblock);
+		return;
+	}
+
+	ast_mutex_lock(&readers_lock);
+	AST_LIST_INSERT_HEAD(&idle_readers, reader, list);
+	ast_cond_signal(&readers_cond);
+	ast_mutex_unlock(&readers_lock);
+}
+
+/*! \internal
+ * \brief Close all the readers, once each is done
+ */
+static void db_readers_close(void)
+{
+	int count = readers_count;
+
+	while (count--) {
+		db_reader_close(db_reader_get());
+	}
+	readers_count = 0;
+	ast_free(readers);
+	readers = NULL;
+
+	if (checkpoint_db) {
+		sqlite3_close(checkpoint_db);
+		checkpoint_db = NULL;
+	}
+}
+
+AO2_STRING_FIELD_HASH_FN(db_cache_entry, key)
+AO2_STRING_FIELD_CMP_FN(db_cache_entry, key)
+
+static struct db_cache_entry *db_cache_entry_alloc(const char *fullkey, const char *value)
+{
+	struct db_cache_entry *entry;
+	size_t keylen = strlen(fullkey) + 1;
+
+	entry = ao2_alloc_options(sizeof(*entry) + keylen + strlen(value) + 1, NULL,
+		AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!entry) {
+		return NULL;
+	}
+	strcpy(entry->key, fullkey);
+	entry->value = entry->key + keylen;
+	strcpy(entry->value, value);
+
+	return entry;
+}
+
+/*! \internal
+ * \brief Replace the cached value of a key, or remove it if \a value is NULL
+ *
+ * \note dblock must be held, and the database already changed.
+ */
+static void db_cache_set(const char *fullkey, const char *value)
+{
+	struct db_cache_entry *entry = NULL;
+
+	if (!db_cache) {
+		return;
+	}
+
+	if (value && strlen(value) <= DB_CACHE_MAX_VALUE) {
+		/* If this fails the stale value is still removed */
+		entry = db_cache_entry_alloc(fullkey, value);
+	}
+
+	ao2_wrlock(db_cache);
+	++db_cache_generation;
+	ao2_find(db_cache, fullkey, OBJ_SEARCH_KEY | OBJ_UNLINK | OBJ_NODATA | OBJ_NOLOCK);
+	if (entry) {
+		ao2_link_flags(db_cache, entry, OBJ_NOLOCK);
+	}
+	ao2_unlock(db_cache);
+
+	ao2_cleanup(entry);
+}
+
+/*! \internal
+ * \brief Empty the cache, after changes that are not made key by key
+ *
+ * \note dblock must be held.
+ */
+static void db_cache_flush(void)
+{
+	if (!db_cache) {
+		return;
+	}
+
+	ao2_wrlock(db_cache);
+	++db_cache_generation;
+	ao2_callback(db_cache, OBJ_UNLINK | OBJ_MULTIPLE | OBJ_NODATA | OBJ_NOLOCK, NULL, NULL);
+	ao2_unlock(db_cache);
+}
+
+/*! \internal
+ * \brief Cache a value read from the database
+ *
+ * \param generation The generation of the cache when the value was not found in it.
+ *
+ * \note The value is not cached if the cache changed since, as the value read
+ * may be older than what a writer put in the cache meanwhile.  Nor is it if
+ * another reader of the key cached it first.
+ */
+static void db_cache_fill(const char *fullkey, const char *value, unsigned int generation)
+{
+	struct db_cache_entry *entry;
+	struct db_cache_entry *cached = NULL;
+
+	if (strlen(value) > DB_CACHE_MAX_VALUE
+		|| !(entry = db_cache_entry_alloc(fullkey, value))) {
+		return;
+	}
+
+	ao2_wrlock(db_cache);
+	if (generation == db_cache_generation
+		&& !(cached = ao2_find(db_cache, fullkey, OBJ_SEARCH_KEY | OBJ_NOLOCK))) {
+		ao2_link_flags(db_cache, entry, OBJ_NOLOCK);
+	}
+	ao2_unlock(db_cache);
+
+	ao2_cleanup(cached);
+	ao2_ref(entry, -1);
 }
 
 static int convert_bdb_to_sqlite3(void)
@@ -255,6 +587,18 @@ static int db_open(void)
 		ast_mutex_unlock(&dblock);
 		return -1;
 	}
+	sqlite3_busy_timeout(astdb, DB_BUSY_TIMEOUT);
+
+	if (ast_option_astdb_readers > 0) {
+		db_execute_sql("PRAGMA journal_mode=WAL", db_journal_mode_cb, &db_wal);
+		if (db_wal) {
+			/* Commits only write the log, which is synced when checkpointed */
+			db_execute_sql("PRAGMA synchronous=NORMAL", NULL, NULL);
+			db_execute_sql("PRAGMA wal_autocheckpoint=0", NULL, NULL);
+		} else {
+			ast_log(LOG_WARNING, "Unable to use WAL mode for the Asterisk database, reads will wait for writes\n");
+		}
+	}
 
 	ast_mutex_unlock(&dblock);
 
@@ -263,6 +607,8 @@ static int db_open(void)
 
 static int db_init(void)
 {
+	char dbname[PATH_MAX];
+
 	if (astdb) {
 		return 0;
 	}
@@ -271,6 +617,19 @@ static int db_init(void)
 		return -1;
 	}
 
+	snprintf(dbname, sizeof(dbname), "%s.sqlite3", ast_config_AST_DB);
+	db_readers_init(dbname);
+
+	if (ast_opt_astdb_cache) {
+		/* Readers filling the same key at once must leave one entry for writers to replace */
+		db_cache = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_RWLOCK,
+			AO2_CONTAINER_ALLOC_OPT_DUPS_REPLACE, DB_CACHE_BUCKETS,
+			db_cache_entry_hash_fn, NULL, db_cache_entry_cmp_fn);
+		if (!db_cache) {
+			ast_log(LOG_WARNING, "Unable to cache Asterisk database values\n");
+		}
+	}
+
 	return 0;
 }
 
@@ -291,6 +650,14 @@ static int db_execute_sql(const char *sql, int (*callback)(void *, int, char **,
 	return res;
 }
 
+static int db_journal_mode_cb(void *arg, int columns, char **values, char **colnames)
+{
+	int *wal = arg;
+
+	*wal = columns > 0 && values[0] && !strcasecmp(values[0], "wal");
+	return 0;
+}
+
 static int ast_db_begin_transaction(void)
 {
 	return db_execute_sql("BEGIN TRANSACTION", NULL, NULL);
@@ -332,6 +699,67 @@ int ast_db_put(const char *family, const char *key, const char *value)
 	}
 
 	sqlite3_reset(put_stmt);
+	db_cache_set(fullkey, res ? NULL : value);
+	db_sync();
+	ast_mutex_unlock(&dblock);
+
+	return res;
+}
+
+int ast_db_put_batch(const struct ast_db_put_entry *entries, size_t count)
+{
+	char fullkey[MAX_DB_FIELD];
+	size_t fullkey_len;
+	size_t i;
+	int res = 0;
+
+	for (i = 0; i < count; ++i) {
+		if (strlen(entries[i].family) + strlen(entries[i].key) + 2 > sizeof(fullkey) - 1) {
+			ast_log(LOG_WARNING, "Family and key length must be less than %zu bytes\n", sizeof(fullkey) - 3);
+			return -1;
+		}
+	}
+
+	ast_mutex_lock(&dblock);
+	/* A savepoint is its own transaction in WAL mode, and nests in the pending one otherwise */
+	if (db_execute_sql("SAVEPOINT put_batch", NULL, NULL)) {
+		ast_mutex_unlock(&dblock);
+		return -1;
+	}
+
+	for (i = 0; i < count && !res; ++i) {
+		fullkey_len = snprintf(fullkey, sizeof(fullkey), "/%s/%s", entries[i].family, entries[i].key);
+
+		if (sqlite3_bind_text(put_stmt, 1, fullkey, fullkey_len, SQLITE_STATIC) != SQLITE_OK) {
+			ast_log(LOG_WARNING, "Couldn't bind key to stmt: %s\n", sqlite3_errmsg(astdb));
+			res = -1;
+		} else if (sqlite3_bind_text(put_stmt, 2, entries[i].value, -1, SQLITE_STATIC) != SQLITE_OK) {
+			ast_log(LOG_WARNING, "Couldn't bind value to stmt: %s\n", sqlite3_errmsg(astdb));
+			res = -1;
+		} else if (sqlite3_step(put_stmt) != SQLITE_DONE) {
+			ast_log(LOG_WARNING, "Couldn't execute statment: %s\n", sqlite3_errmsg(astdb));
+			res = -1;
+		}
+		sqlite3_reset(put_stmt);
+	}
+
+	if (!res && db_execute_sql("RELEASE put_batch", NULL, NULL)) {
+		/* The savepoint is still open when it can't be released, so undo it */
+		res = -1;
+	}
+	if (res) {
+		db_execute_sql("ROLLBACK TO put_batch", NULL, NULL);
+		if (db_execute_sql("RELEASE put_batch", NULL, NULL)) {
+			ast_log(LOG_ERROR, "Couldn't end the failed batch of Asterisk database changes\n");
+		}
+	}
+
+	if (!res) {
+		for (i = 0; i < count; ++i) {
+			snprintf(fullkey, sizeof(fullkey), "/%s/%s", entries[i].family, entries[i].key);
+			db_cache_set(fullkey, entries[i].value);
+		}
+	}
 	db_sync();
 	ast_mutex_unlock(&dblock);
 
@@ -357,6 +785,8 @@ static int db_get_common(const char *family, const char *key, char **buffer, int
 	const unsigned char *result;
 	char fullkey[MAX_DB_FIELD];
 	size_t fullkey_len;
+	struct db_reader *reader;
+	unsigned int generation = 0;
 	int res = 0;
 
 	if (strlen(family) + strlen(key) + 2 > sizeof(fullkey) - 1) {
@@ -366,14 +796,33 @@ static int db_get_common(const char *family, const char *key, char **buffer, int
 
 	fullkey_len = snprintf(fullkey, sizeof(fullkey), "/%s/%s", family, key);
 
-	ast_mutex_lock(&dblock);
-	if (sqlite3_bind_text(get_stmt, 1, fullkey, fullkey_len, SQLITE_STATIC) != SQLITE_OK) {
-		ast_log(LOG_WARNING, "Couldn't bind key to stmt: %s\n", sqlite3_errmsg(astdb));
+	if (db_cache) {
+		struct db_cache_entry *entry;
+
+		ao2_rdlock(db_cache);
+		entry = ao2_find(db_cache, fullkey, OBJ_SEARCH_KEY | OBJ_NOLOCK);
+		generation = db_cache_generation;
+		ao2_unlock(db_cache);
+
+		if (entry) {
+			if (bufferlen == -1) {
+				*buffer = ast_strdup(entry->value);
+			} else {
+				ast_copy_string(*buffer, entry->value, bufferlen);
+			}
+			ao2_ref(entry, -1);
+			return 0;
+		}
+	}
+
+	reader = db_reader_get();
+	if (sqlite3_bind_text(reader->get_stmt, 1, fullkey, fullkey_len, SQLITE_STATIC) != SQLITE_OK) {
+		ast_log(LOG_WARNING, "Couldn't bind key to stmt: %s\n", sqlite3_errmsg(reader->db));
 		res = -1;
-	} else if (sqlite3_step(get_stmt) != SQLITE_ROW) {
+	} else if (sqlite3_step(reader->get_stmt) != SQLITE_ROW) {
 		ast_debug(1, "Unable to find key '%s' in family '%s'\n", key, family);
 		res = -1;
-	} else if (!(result = sqlite3_column_text(get_stmt, 0))) {
+	} else if (!(result = sqlite3_column_text(reader->get_stmt, 0))) {
 		ast_log(LOG_WARNING, "Couldn't get value\n");
 		res = -1;
 	} else {
@@ -384,9 +833,12 @@ static int db_get_common(const char *family, const char *key, char **buffer, int
 		} else {
 			ast_copy_string(*buffer, value, bufferlen);
 		}
+		if (db_cache) {
+			db_cache_fill(fullkey, value, generation);
+		}
 	}
-	sqlite3_reset(get_stmt);
-	ast_mutex_unlock(&dblock);
+	sqlite3_reset(reader->get_stmt);
+	db_reader_release(reader);
 
 	return res;
 }
@@ -430,6 +882,7 @@ int ast_db_del(const char *family, const char *key)
 		res = -1;
 	}
 	sqlite3_reset(del_stmt);
+	db_cache_set(fullkey, NULL);
 	db_sync();
 	ast_mutex_unlock(&dblock);
 
@@ -465,6 +918,8 @@ int ast_db_deltree(const char *family, const char *keytree)
 	}
 	res = sqlite3_changes(astdb);
 	sqlite3_reset(stmt);
+	/* The tree is matched with LIKE, forget all the cached values rather than match them the same */
+	db_cache_flush();
 	db_sync();
 	ast_mutex_unlock(&dblock);
 
@@ -474,9 +929,12 @@ int ast_db_deltree(const char *family, const char *keytree)
 struct ast_db_entry *ast_db_gettree(const char *family, const char *keytree)
 {
 	char prefix[MAX_DB_FIELD];
-	sqlite3_stmt *stmt = gettree_stmt;
+	struct db_reader *reader;
+	sqlite3_stmt *stmt;
 	struct ast_db_entry *cur, *last = NULL, *ret = NULL;
 
+	reader = db_reader_get();
+	stmt = reader->gettree_stmt;
 	if (!ast_strlen_zero(family)) {
 		if (!ast_strlen_zero(keytree)) {
 			/* Family and key tree */
@@ -487,14 +945,13 @@ struct ast_db_entry *ast_db_gettree(const char *family, const char *keytree)
 		}
 	} else {
 		prefix[0] = '\0';
-		stmt = gettree_all_stmt;
+		stmt = reader->gettree_all_stmt;
 	}
 
-	ast_mutex_lock(&dblock);
 	if (!ast_strlen_zero(prefix) && (sqlite3_bind_text(stmt, 1, prefix, -1, SQLITE_STATIC) != SQLITE_OK)) {
-		ast_log(LOG_WARNING, "Could bind %s to stmt: %s\n", prefix, sqlite3_errmsg(astdb));
+		ast_log(LOG_WARNING, "Could bind %s to stmt: %s\n", prefix, sqlite3_errmsg(reader->db));
 		sqlite3_reset(stmt);
-		ast_mutex_unlock(&dblock);
+		db_reader_release(reader);
 		return NULL;
 	}
 
@@ -521,7 +978,7 @@ struct ast_db_entry *ast_db_gettree(const char *family, const char *keytree)
 		last = cur;
 	}
 	sqlite3_reset(stmt);
-	ast_mutex_unlock(&dblock);
+	db_reader_release(reader);
 
 	return ret;
 }
@@ -657,7 +1114,9 @@ static char *handle_cli_database_show(struct ast_cli_entry *e, int cmd, struct a
 {
 	char prefix[MAX_DB_FIELD];
 	int counter = 0;
-	sqlite3_stmt *stmt = gettree_stmt;
+	struct db_reader *reader;
+	sqlite3_stmt *stmt;
+	int all = 0;
 
 	switch (cmd) {
 	case CLI_INIT:
@@ -682,17 +1141,17 @@ static char *handle_cli_database_show(struct ast_cli_entry *e, int cmd, struct a
 	} else if (a->argc == 2) {
 		/* Neither */
 		prefix[0] = '\0';
-		stmt = gettree_all_stmt;
-
+		all = 1;
 	} else {
 		return CLI_SHOWUSAGE;
 	}
 
-	ast_mutex_lock(&dblock);
+	reader = db_reader_get();
+	stmt = all ? reader->gettree_all_stmt : reader->gettree_stmt;
 	if (!ast_strlen_zero(prefix) && (sqlite3_bind_text(stmt, 1, prefix, -1, SQLITE_STATIC) != SQLITE_OK)) {
-		ast_log(LOG_WARNING, "Could bind %s to stmt: %s\n", prefix, sqlite3_errmsg(astdb));
+		ast_log(LOG_WARNING, "Could bind %s to stmt: %s\n", prefix, sqlite3_errmsg(reader->db));
 		sqlite3_reset(stmt);
-		ast_mutex_unlock(&dblock);
+		db_reader_release(reader);
 		return NULL;
 	}
 
@@ -711,7 +1170,7 @@ static char *handle_cli_database_show(struct ast_cli_entry *e, int cmd, struct a
 	}
 
 	sqlite3_reset(stmt);
-	ast_mutex_unlock(&dblock);
+	db_reader_release(reader);
 
 	ast_cli(a->fd, "%d results found.\n", counter);
 	return CLI_SUCCESS;
@@ -720,6 +1179,7 @@ static char *handle_cli_database_show(struct ast_cli_entry *e, int cmd, struct a
 static char *handle_cli_database_showkey(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
 {
 	int counter = 0;
+	struct db_reader *reader;
 
 	switch (cmd) {
 	case CLI_INIT:
@@ -736,27 +1196,27 @@ static char *handle_cli_database_showkey(struct ast_cli_entry *e, int cmd, struc
 		return CLI_SHOWUSAGE;
 	}
 
-	ast_mutex_lock(&dblock);
-	if (!ast_strlen_zero(a->argv[2]) && (sqlite3_bind_text(showkey_stmt, 1, a->argv[2], -1, SQLITE_STATIC) != SQLITE_OK)) {
-		ast_log(LOG_WARNING, "Could bind %s to stmt: %s\n", a->argv[2], sqlite3_errmsg(astdb));
-		sqlite3_reset(showkey_stmt);
-		ast_mutex_unlock(&dblock);
+	reader = db_reader_get();
+	if (!ast_strlen_zero(a->argv[2]) && (sqlite3_bind_text(reader->showkey_stmt, 1, a->argv[2], -1, SQLITE_STATIC) != SQLITE_OK)) {
+		ast_log(LOG_WARNING, "Could bind %s to stmt: %s\n", a->argv[2], sqlite3_errmsg(reader->db));
+		sqlite3_reset(reader->showkey_stmt);
+		db_reader_release(reader);
 		return NULL;
 	}
 
-	while (sqlite3_step(showkey_stmt) == SQLITE_ROW) {
+	while (sqlite3_step(reader->showkey_stmt) == SQLITE_ROW) {
 		const char *key_s, *value_s;
-		if (!(key_s = (const char *) sqlite3_column_text(showkey_stmt, 0))) {
+		if (!(key_s = (const char *) sqlite3_column_text(reader->showkey_stmt, 0))) {
 			break;
 		}
-		if (!(value_s = (const char *) sqlite3_column_text(showkey_stmt, 1))) {
+		if (!(value_s = (const char *) sqlite3_column_text(reader->showkey_stmt, 1))) {
 			break;
 		}
 		++counter;
 		ast_cli(a->fd, "%-50s: %-25s\n", key_s, value_s);
 	}
-	sqlite3_reset(showkey_stmt);
-	ast_mutex_unlock(&dblock);
+	sqlite3_reset(reader->showkey_stmt);
+	db_reader_release(reader);
 
 	ast_cli(a->fd, "%d results found.\n", counter);
 	return CLI_SUCCESS;
@@ -795,6 +1255,7 @@ static char *handle_cli_database_query(struct ast_cli_entry *e, int cmd, struct
 
 	ast_mutex_lock(&dblock);
 	db_execute_sql(a->argv[2], display_results, a);
+	db_cache_flush(); /* Nothing cached can be trusted in case they write */
 	db_sync(); /* Go ahead and sync the db in case they write */
 	ast_mutex_unlock(&dblock);
 
@@ -811,6 +1272,44 @@ static struct ast_cli_entry cli_database[] = {
 	AST_CLI_DEFINE(handle_cli_database_query,   "Run a user-specified query on the astdb"),
 };
 
+/*!
+ * \internal
+ * \brief Put the numbered keys of a DBPut action as a batch
+ */
+static int manager_dbput_batch(struct mansession *s, const struct message *m, const char *family)
+{
+	struct ast_db_put_entry *entries;
+	size_t count;
+	size_t i;
+	char hdr[40];
+	int res;
+
+	for (count = 0; ; ++count) {
+		snprintf(hdr, sizeof(hdr), "Key-%06zu", count);
+		if (ast_strlen_zero(astman_get_header(m, hdr))) {
+			break;
+		}
+	}
+
+	entries = ast_malloc(count * sizeof(*entries));
+	if (!entries) {
+		return -1;
+	}
+
+	for (i = 0; i < count; ++i) {
+		entries[i].family = family;
+		snprintf(hdr, sizeof(hdr), "Key-%06zu", i);
+		entries[i].key = astman_get_header(m, hdr);
+		snprintf(hdr, sizeof(hdr), "Val-%06zu", i);
+		entries[i].value = S_OR(astman_get_header(m, hdr), "");
+	}
+
+	res = ast_db_put_batch(entries, count);
+	ast_free(entries);
+
+	return res;
+}
+
 static int manager_dbput(struct mansession *s, const struct message *m)
 {
 	const char *family = astman_get_header(m, "Family");
@@ -822,12 +1321,15 @@ static int manager_dbput(struct mansession *s, const struct message *m)
 		astman_send_error(s, m, "No family specified");
 		return 0;
 	}
-	if (ast_strlen_zero(key)) {
+
+	if (!ast_strlen_zero(astman_get_header(m, "Key-000000"))) {
+		res = manager_dbput_batch(s, m, family);
+	} else if (ast_strlen_zero(key)) {
 		astman_send_error(s, m, "No key specified");
 		return 0;
+	} else {
+		res = ast_db_put(family, key, S_OR(val, ""));
 	}
-
-	res = ast_db_put(family, key, S_OR(val, ""));
 	if (res) {
 		astman_send_error(s, m, "Failed to update entry");
 	} else {
@@ -943,6 +1445,24 @@ static void db_sync(void)
 	ast_cond_signal(&dbcond);
 }
 
+/*!
+ * \internal
+ * \brief Copy the changes in the log into the database
+ *
+ * \note Readers and writers go on while the log is checkpointed, so
+ * this is done without dblock.
+ */
+static void db_checkpoint(void)
+{
+	if (!checkpoint_db) {
+		return;
+	}
+
+	if (sqlite3_wal_checkpoint_v2(checkpoint_db, NULL, SQLITE_CHECKPOINT_PASSIVE, NULL, NULL) != SQLITE_OK) {
+		ast_log(LOG_WARNING, "Couldn't checkpoint the Asterisk database: %s\n", sqlite3_errmsg(checkpoint_db));
+	}
+}
+
 /*!
  * \internal
  * \brief astdb sync thread
@@ -952,11 +1472,16 @@ static void db_sync(void)
  * will not block other threads from performing other critical processing.
  * If changes happen rapidly, this thread will also ensure that the sync
  * operations are rate limited.
+ *
+ * In WAL mode changes are already committed, and this thread checkpoints
+ * them instead of committing the pending transaction.
  */
 static void *db_sync_thread(void *data)
 {
 	ast_mutex_lock(&dblock);
-	ast_db_begin_transaction();
+	if (!db_wal) {
+		ast_db_begin_transaction();
+	}
 	for (;;) {
 		/* If dosync is set, db_sync() was called during sleep(1), 
 		 * and the pending transaction should be committed. 
@@ -966,14 +1491,20 @@ static void *db_sync_thread(void *data)
 			ast_cond_wait(&dbcond, &dblock);
 		}
 		dosync = 0;
-		if (ast_db_commit_transaction()) {
+		if (db_wal) {
+			ast_mutex_unlock(&dblock);
+			db_checkpoint();
+			ast_mutex_lock(&dblock);
+		} else if (ast_db_commit_transaction()) {
 			ast_db_rollback_transaction();
 		}
 		if (doexit) {
 			ast_mutex_unlock(&dblock);
 			break;
 		}
-		ast_db_begin_transaction();
+		if (!db_wal) {
+			ast_db_begin_transaction();
+		}
 		ast_mutex_unlock(&dblock);
 		sleep(1);
 		ast_mutex_lock(&dblock);
@@ -1002,16 +1533,21 @@ static void astdb_atexit(void)
 	ast_mutex_unlock(&dblock);
 
 	pthread_join(syncthread, NULL);
+	db_readers_close();
 	ast_mutex_lock(&dblock);
 	clean_statements();
 	if (sqlite3_close(astdb) == SQLITE_OK) {
 		astdb = NULL;
 	}
+	ao2_cleanup(db_cache);
+	db_cache = NULL;
 	ast_mutex_unlock(&dblock);
 }
 
 int astdb_init(void)
 {
+	ast_cond_init(&readers_cond, NULL);
+
 	if (db_init()) {
 		return -1;
 	}
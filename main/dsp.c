@@ -57,6 +57,13 @@
 
 #include <math.h>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) \
+	&& (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+/* The compiler can build functions for instruction sets it was not told to use. */
+#define GOERTZEL_BLOCK_AVX2
+#include <immintrin.h>
+#endif
+
 #include "asterisk/frame.h"
 #include "asterisk/format_cache.h"
 #include "asterisk/channel.h"
@@ -376,6 +383,134 @@ static inline void goertzel_reset(goertzel_state_t *s)
 	s->v2 = s->v3 = s->chunky = 0;
 }
 
+/*! Most goertzel filters a goertzel block function runs at once */
+#define GOERTZEL_BLOCK_MAX 8
+
+/*!
+ * \brief Run a block of samples through several goertzel filters
+ *
+ * \param filters The filters to update
+ * \param num_filters Number of filters, at most GOERTZEL_BLOCK_MAX
+ * \param amp The samples
+ * \param samples Number of samples
+ *
+ * Every implementation leaves the filters exactly as calling
+ * goertzel_sample() for each filter and sample would.
+ */
+typedef void (*goertzel_block_fn)(goertzel_state_t * const *filters, int num_filters,
+	const int16_t *amp, int samples);
+
+static void goertzel_block_scalar(goertzel_state_t * const *filters, int num_filters,
+	const int16_t *amp, int samples)
+{
+	int i;
+	int j;
+
+	for (j = 0; j < samples; j++) {
+		for (i = 0; i < num_filters; i++) {
+			goertzel_sample(filters[i], amp[j]);
+		}
+	}
+}
+
+#ifdef GOERTZEL_BLOCK_AVX2
+/*!
+ * \brief Run a block of samples through up to 8 goertzel filters with AVX2
+ *
+ * The filters are split between two registers, four to a register in the
+ * even 32 bit lanes.  That lets _mm256_mul_epi32() do the multiply with
+ * half the latency of a full 32 bit multiply, and the two registers give
+ * the CPU two independent chains to work on.  The low half of each 64 bit
+ * product is the wrapped 32 bit product goertzel_sample() computes, so
+ * shifting the 32 bit lanes gives exactly the same result.  The odd lanes
+ * hold garbage that is never used.
+ *
+ * Rescaling a filter whose value grew too large only happens a few times
+ * per block, so it is kept off the common path.
+ */
+__attribute__((target("avx2")))
+static void goertzel_block_avx2(goertzel_state_t * const *filters, int num_filters,
+	const int16_t *amp, int samples)
+{
+	int32_t state[4][GOERTZEL_BLOCK_MAX * 2];
+	const __m256i limit = _mm256_set1_epi32(1 << 15);
+	/* x86 scalar shifts only use the bottom five bits of the count */
+	const __m256i shift_mask = _mm256_set1_epi32(31);
+	__m256i v2_lo, v3_lo, chunky_lo, fac_lo, live_lo;
+	__m256i v2_hi, v3_hi, chunky_hi, fac_hi, live_hi;
+	int i;
+	int j;
+
+	memset(state, 0, sizeof(state));
+	for (i = 0; i < num_filters; i++) {
+		state[0][i * 2] = filters[i]->v2;
+		state[1][i * 2] = filters[i]->v3;
+		state[2][i * 2] = filters[i]->chunky;
+		state[3][i * 2] = filters[i]->fac;
+	}
+	v2_lo = _mm256_loadu_si256((const __m256i *) &state[0][0]);
+	v2_hi = _mm256_loadu_si256((const __m256i *) &state[0][8]);
+	v3_lo = _mm256_loadu_si256((const __m256i *) &state[1][0]);
+	v3_hi = _mm256_loadu_si256((const __m256i *) &state[1][8]);
+	chunky_lo = _mm256_loadu_si256((const __m256i *) &state[2][0]);
+	chunky_hi = _mm256_loadu_si256((const __m256i *) &state[2][8]);
+	fac_lo = _mm256_loadu_si256((const __m256i *) &state[3][0]);
+	fac_hi = _mm256_loadu_si256((const __m256i *) &state[3][8]);
+
+	/* Only the even lanes of real filters may trigger a rescale */
+	for (i = 0; i < GOERTZEL_BLOCK_MAX * 2; i++) {
+		state[0][i] = (!(i & 1) && i / 2 < num_filters) ? -1 : 0;
+	}
+	live_lo = _mm256_loadu_si256((const __m256i *) &state[0][0]);
+	live_hi = _mm256_loadu_si256((const __m256i *) &state[0][8]);
+
+	for (j = 0; j < samples; j++) {
+		__m256i sample = _mm256_set1_epi32(amp[j]);
+		__m256i v1_lo = v2_lo;
+		__m256i v1_hi = v2_hi;
+		__m256i big_lo;
+		__m256i big_hi;
+
+		v2_lo = v3_lo;
+		v2_hi = v3_hi;
+		v3_lo = _mm256_srai_epi32(_mm256_mul_epi32(fac_lo, v2_lo), 15);
+		v3_hi = _mm256_srai_epi32(_mm256_mul_epi32(fac_hi, v2_hi), 15);
+		v3_lo = _mm256_add_epi32(v3_lo, _mm256_sub_epi32(
+			_mm256_srav_epi32(sample, _mm256_and_si256(chunky_lo, shift_mask)), v1_lo));
+		v3_hi = _mm256_add_epi32(v3_hi, _mm256_sub_epi32(
+			_mm256_srav_epi32(sample, _mm256_and_si256(chunky_hi, shift_mask)), v1_hi));
+
+		big_lo = _mm256_and_si256(_mm256_cmpgt_epi32(_mm256_abs_epi32(v3_lo), limit), live_lo);
+		big_hi = _mm256_and_si256(_mm256_cmpgt_epi32(_mm256_abs_epi32(v3_hi), limit), live_hi);
+		if (__builtin_expect(!_mm256_testz_si256(big_lo, big_lo)
+			|| !_mm256_testz_si256(big_hi, big_hi), 0)) {
+			/* The result is now too large so increase the chunky power. */
+			chunky_lo = _mm256_sub_epi32(chunky_lo, big_lo);
+			chunky_hi = _mm256_sub_epi32(chunky_hi, big_hi);
+			v3_lo = _mm256_blendv_epi8(v3_lo, _mm256_srai_epi32(v3_lo, 1), big_lo);
+			v3_hi = _mm256_blendv_epi8(v3_hi, _mm256_srai_epi32(v3_hi, 1), big_hi);
+			v2_lo = _mm256_blendv_epi8(v2_lo, _mm256_srai_epi32(v2_lo, 1), big_lo);
+			v2_hi = _mm256_blendv_epi8(v2_hi, _mm256_srai_epi32(v2_hi, 1), big_hi);
+		}
+	}
+
+	_mm256_storeu_si256((__m256i *) &state[0][0], v2_lo);
+	_mm256_storeu_si256((__m256i *) &state[0][8], v2_hi);
+	_mm256_storeu_si256((__m256i *) &state[1][0], v3_lo);
+	_mm256_storeu_si256((__m256i *) &state[1][8], v3_hi);
+	_mm256_storeu_si256((__m256i *) &state[2][0], chunky_lo);
+	_mm256_storeu_si256((__m256i *) &state[2][8], chunky_hi);
+	for (i = 0; i < num_filters; i++) {
+		filters[i]->v2 = state[0][i * 2];
+		filters[i]->v3 = state[1][i * 2];
+		filters[i]->chunky = state[2][i * 2];
+	}
+}
+#endif /* GOERTZEL_BLOCK_AVX2 */
+
+/*! \brief The goertzel block function for this CPU, picked by ast_dsp_init() */
+static goertzel_block_fn goertzel_block = goertzel_block_scalar;
+
 typedef struct {
 	int start;
 	int end;
@@ -683,6 +818,12 @@ static int dtmf_detect(struct ast_dsp *dsp, digit_detect_state_t *s, int16_t amp
 	int hit;
 	int limit;
 	fragment_t mute = {0, 0};
+	goertzel_state_t * const filters[] = {
+		&s->td.dtmf.row_out[0], &s->td.dtmf.row_out[1],
+		&s->td.dtmf.row_out[2], &s->td.dtmf.row_out[3],
+		&s->td.dtmf.col_out[0], &s->td.dtmf.col_out[1],
+		&s->td.dtmf.col_out[2], &s->td.dtmf.col_out[3],
+	};
 
 	if (squelch && s->td.dtmf.mute_samples > 0) {
 		mute.end = (s->td.dtmf.mute_samples < samples) ? s->td.dtmf.mute_samples : samples;
@@ -697,22 +838,12 @@ static int dtmf_detect(struct ast_dsp *dsp, digit_detect_state_t *s, int16_t amp
 		} else {
 			limit = samples;
 		}
-		/* The following unrolled loop takes only 35% (rough estimate) of the
-		   time of a rolled loop on the machine on which it was developed */
 		for (j = sample; j < limit; j++) {
 			samp = amp[j];
 			s->td.dtmf.energy += (int32_t) samp * (int32_t) samp;
-			/* With GCC 2.95, the following unrolled code seems to take about 35%
-			   (rough estimate) as long as a neat little 0-3 loop */
-			goertzel_sample(s->td.dtmf.row_out, samp);
-			goertzel_sample(s->td.dtmf.col_out, samp);
-			goertzel_sample(s->td.dtmf.row_out + 1, samp);
-			goertzel_sample(s->td.dtmf.col_out + 1, samp);
-			goertzel_sample(s->td.dtmf.row_out + 2, samp);
-			goertzel_sample(s->td.dtmf.col_out + 2, samp);
-			goertzel_sample(s->td.dtmf.row_out + 3, samp);
-			goertzel_sample(s->td.dtmf.col_out + 3, samp);
 		}
+		/* All eight filters see the samples at once */
+		goertzel_block(filters, ARRAY_LEN(filters), amp + sample, limit - sample);
 		s->td.dtmf.current_sample += (limit - sample);
 		if (s->td.dtmf.current_sample < DTMF_GSIZE) {
 			continue;
@@ -884,12 +1015,14 @@ static int mf_detect(struct ast_dsp *dsp, digit_detect_state_t *s, int16_t amp[]
 	int best;
 	int second_best;
 	int i;
-	int j;
 	int sample;
-	short samp;
 	int hit;
 	int limit;
 	fragment_t mute = {0, 0};
+	goertzel_state_t * const filters[] = {
+		&s->td.mf.tone_out[0], &s->td.mf.tone_out[1], &s->td.mf.tone_out[2],
+		&s->td.mf.tone_out[3], &s->td.mf.tone_out[4], &s->td.mf.tone_out[5],
+	};
 
 	if (squelch && s->td.mf.mute_samples > 0) {
 		mute.end = (s->td.mf.mute_samples < samples) ? s->td.mf.mute_samples : samples;
@@ -905,19 +1038,8 @@ static int mf_detect(struct ast_dsp *dsp, digit_detect_state_t *s, int16_t amp[]
 		} else {
 			limit = samples;
 		}
-		/* The following unrolled loop takes only 35% (rough estimate) of the
-		   time of a rolled loop on the machine on which it was developed */
-		for (j = sample; j < limit; j++) {
-			/* With GCC 2.95, the following unrolled code seems to take about 35%
-			   (rough estimate) as long as a neat little 0-3 loop */
-			samp = amp[j];
-			goertzel_sample(s->td.mf.tone_out, samp);
-			goertzel_sample(s->td.mf.tone_out + 1, samp);
-			goertzel_sample(s->td.mf.tone_out + 2, samp);
-			goertzel_sample(s->td.mf.tone_out + 3, samp);
-			goertzel_sample(s->td.mf.tone_out + 4, samp);
-			goertzel_sample(s->td.mf.tone_out + 5, samp);
-		}
+		/* All six filters see the samples at once */
+		goertzel_block(filters, ARRAY_LEN(filters), amp + sample, limit - sample);
 		s->td.mf.current_sample += (limit - sample);
 		if (s->td.mf.current_sample < MF_GSIZE) {
 			continue;
@@ -1060,6 +1182,11 @@ static int __ast_dsp_call_progress(struct ast_dsp *dsp, short *s, int len)
 	int newstate = DSP_TONE_STATE_SILENCE;
 	int res = 0;
 	int freqcount = dsp->freqcount > FREQ_ARRAY_SIZE ? FREQ_ARRAY_SIZE : dsp->freqcount;
+	goertzel_state_t *filters[FREQ_ARRAY_SIZE];
+
+	for (y = 0; y < freqcount; y++) {
+		filters[y] = &dsp->freqs[y];
+	}
 
 	while (len) {
 		/* Take the lesser of the number of samples we need and what we have */
@@ -1070,10 +1197,8 @@ static int __ast_dsp_call_progress(struct ast_dsp *dsp, short *s, int len)
 		for (x = 0; x < pass; x++) {
 			samp = s[x];
 			dsp->genergy += (int32_t) samp * (int32_t) samp;
-			for (y = 0; y < freqcount; y++) {
-				goertzel_sample(&dsp->freqs[y], samp);
-			}
 		}
+		goertzel_block(filters, freqcount, s, pass);
 		s += pass;
 		dsp->gsamps += pass;
 		len -= pass;
@@ -2383,22 +2508,184 @@ AST_TEST_DEFINE(test_dsp_dtmf_detect)
 }
 #endif
 
+#ifdef TEST_FRAMEWORK
+/*!
+ * \internal
+ * \brief Run samples through goertzel filters one sample at a time, as the reference
+ */
+static void test_goertzel_reference(goertzel_state_t *filters, int num_filters,
+	const int16_t *amp, int samples)
+{
+	int i;
+	int j;
+
+	for (j = 0; j < samples; j++) {
+		for (i = 0; i < num_filters; i++) {
+			goertzel_sample(&filters[i], amp[j]);
+		}
+	}
+}
+
+static void test_goertzel_filters_init(goertzel_state_t *filters, goertzel_state_t **pointers)
+{
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		goertzel_init(&filters[i], dtmf_row[i], DEFAULT_SAMPLE_RATE);
+		goertzel_init(&filters[i + 4], dtmf_col[i], DEFAULT_SAMPLE_RATE);
+	}
+	for (i = 0; i < GOERTZEL_BLOCK_MAX; i++) {
+		pointers[i] = &filters[i];
+	}
+}
+
+AST_TEST_DEFINE(test_dsp_goertzel_block)
+{
+	static const struct {
+		const char *name;
+		goertzel_block_fn fn;
+	} impls[] = {
+		{ "scalar", goertzel_block_scalar },
+#ifdef GOERTZEL_BLOCK_AVX2
+		{ "avx2", goertzel_block_avx2 },
+#endif
+	};
+	static const int sample_counts[] = { 1, 7, 80, DTMF_GSIZE, MF_GSIZE, 160 };
+	goertzel_state_t expected[GOERTZEL_BLOCK_MAX];
+	goertzel_state_t actual[GOERTZEL_BLOCK_MAX];
+	goertzel_state_t *pointers[GOERTZEL_BLOCK_MAX];
+	int16_t amp[160];
+	struct timeval start;
+	int64_t reference_us;
+	int impl;
+	int round;
+	int num_filters;
+	int samples;
+	int i;
+	enum ast_test_result_state result = AST_TEST_PASS;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "goertzel_block";
+		info->category = "/main/dsp/";
+		info->summary = "DSP goertzel block unit test";
+		info->description =
+			"Tests that every goertzel block implementation this CPU supports\n"
+			"leaves the filters exactly as running them one sample at a time\n"
+			"does, and reports how long each takes.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	for (impl = 0; impl < ARRAY_LEN(impls); impl++) {
+#ifdef GOERTZEL_BLOCK_AVX2
+		if (impls[impl].fn == goertzel_block_avx2 && !__builtin_cpu_supports("avx2")) {
+			ast_test_status_update(test, "Skipping unsupported %s implementation\n",
+				impls[impl].name);
+			continue;
+		}
+#endif
+		for (round = 0; round < 200; round++) {
+			/* Alternate between two tones, full scale noise and silence */
+			for (i = 0; i < ARRAY_LEN(amp); i++) {
+				switch (round % 4) {
+				case 0:
+					amp[i] = 8000 * sin(2.0 * M_PI * dtmf_row[round % 3] * i / DEFAULT_SAMPLE_RATE)
+						+ 8000 * sin(2.0 * M_PI * dtmf_col[round % 4] * i / DEFAULT_SAMPLE_RATE);
+					break;
+				case 1:
+					amp[i] = ast_random() % 65536 - 32768;
+					break;
+				case 2:
+					amp[i] = TONE_AMPLITUDE_MAX * sin(2.0 * M_PI * mf_tones[round % 6] * i / DEFAULT_SAMPLE_RATE);
+					break;
+				default:
+					amp[i] = 0;
+					break;
+				}
+			}
+			for (num_filters = 1; num_filters <= GOERTZEL_BLOCK_MAX; num_filters++) {
+				for (samples = 0; samples < ARRAY_LEN(sample_counts); samples++) {
+					test_goertzel_filters_init(expected, pointers);
+					test_goertzel_filters_init(actual, pointers);
+					/* Carry state over from a previous block as the detectors do */
+					test_goertzel_reference(expected, num_filters, amp, round % 50);
+					test_goertzel_reference(actual, num_filters, amp, round % 50);
+
+					test_goertzel_reference(expected, num_filters, amp, sample_counts[samples]);
+					impls[impl].fn(pointers, num_filters, amp, sample_counts[samples]);
+					if (memcmp(expected, actual, sizeof(expected))) {
+						ast_test_status_update(test,
+							"%s block of %d filters and %d samples differs\n",
+							impls[impl].name, num_filters, sample_counts[samples]);
+						result = AST_TEST_FAIL;
+					}
+				}
+			}
+		}
+	}
+
+	/* Time DTMF detection blocks of a 20 ms frame */
+	test_goertzel_filters_init(expected, pointers);
+	start = ast_tvnow();
+	for (round = 0; round < 100000; round++) {
+		test_goertzel_reference(expected, GOERTZEL_BLOCK_MAX, amp, ARRAY_LEN(amp));
+	}
+	reference_us = ast_tvdiff_us(ast_tvnow(), start);
+	ast_test_status_update(test, "Sample at a time: %" PRIi64 " us for %d frames\n",
+		reference_us, round);
+
+	for (impl = 0; impl < ARRAY_LEN(impls); impl++) {
+		int64_t elapsed_us;
+
+#ifdef GOERTZEL_BLOCK_AVX2
+		if (impls[impl].fn == goertzel_block_avx2 && !__builtin_cpu_supports("avx2")) {
+			continue;
+		}
+#endif
+		test_goertzel_filters_init(actual, pointers);
+		start = ast_tvnow();
+		for (round = 0; round < 100000; round++) {
+			impls[impl].fn(pointers, GOERTZEL_BLOCK_MAX, amp, ARRAY_LEN(amp));
+		}
+		elapsed_us = ast_tvdiff_us(ast_tvnow(), start);
+		ast_test_status_update(test, "%s: %" PRIi64 " us for %d frames (%.1fx)\n",
+			impls[impl].name, elapsed_us, round,
+			elapsed_us ? (double) reference_us / elapsed_us : 0.0);
+	}
+
+	return result;
+}
+#endif
+
 #ifdef TEST_FRAMEWORK
 static void test_dsp_shutdown(void)
 {
 	AST_TEST_UNREGISTER(test_dsp_fax_detect);
 	AST_TEST_UNREGISTER(test_dsp_dtmf_detect);
+	AST_TEST_UNREGISTER(test_dsp_goertzel_block);
 }
 #endif
 
 int ast_dsp_init(void)
 {
-	int res = _dsp_init(0);
+	int res;
+
+#ifdef GOERTZEL_BLOCK_AVX2
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		goertzel_block = goertzel_block_avx2;
+	}
+#endif
+
+	res = _dsp_init(0);
 
 #ifdef TEST_FRAMEWORK
 	if (!res) {
 		AST_TEST_REGISTER(test_dsp_fax_detect);
 		AST_TEST_REGISTER(test_dsp_dtmf_detect);
+		AST_TEST_REGISTER(test_dsp_goertzel_block);
 
 		ast_register_cleanup(test_dsp_shutdown);
 	}
@@ -44,105 +44,315 @@
 #include "asterisk/file.h"
 
 #if !defined(LOW_MEMORY)
-static void frame_cache_cleanup(void *data);
+/*!
+ * \brief Payload bytes each frame pool size class holds after the header
+ *
+ * The first class is for frame headers on their own.  The rest hold a
+ * header, AST_FRIENDLY_OFFSET, the data and the source string in one
+ * block, sized for 20 ms of mu-law, 8 kHz, 16 kHz and 48 kHz signed
+ * linear, and then a little more.  Anything larger is not pooled.
+ */
+static const size_t frame_pool_payloads[] = { 0, 256, 512, 1024, 2048, 4096 };
+
+#define FRAME_POOL_CLASSES ARRAY_LEN(frame_pool_payloads)
 
-/*! \brief A per-thread cache of frame headers */
-AST_THREADSTORAGE_CUSTOM(frame_cache, NULL, frame_cache_cleanup);
+/*! \brief Most free blocks of each size class a thread keeps to itself */
+#define FRAME_POOL_THREAD_MAX 64
 
 /*!
- * \brief Maximum ast_frame cache size
+ * \brief Most bytes of free blocks a thread keeps to itself
  *
- * In most cases where the frame header cache will be useful, the size
- * of the cache will stay very small.  However, it is not always the case that
- * the same thread that allocates the frame will be the one freeing them, so
- * sometimes a thread will never have any frames in its cache, or the cache
- * will never be pulled from.  For the latter case, we limit the maximum size.
+ * Past this the thread gives its largest blocks to the depot until it
+ * holds half as much, so a thread that once freed many large frames
+ * does not sit on them.
  */
-#define FRAME_CACHE_MAX_SIZE	10
+#define FRAME_POOL_THREAD_BYTES (128 * 1024)
 
-/*! \brief This is just so ast_frames, a list head struct for holding a list of
- *  ast_frame structures, is defined. */
-AST_LIST_HEAD_NOLOCK(ast_frames, ast_frame);
+/*! \brief Blocks moved between a thread and the shared depot at a time */
+#define FRAME_POOL_BATCH 16
 
-struct ast_frame_cache {
-	struct ast_frames list;
-	size_t size;
+/*!
+ * \brief Most free blocks of each size class kept in the shared depot
+ *
+ * Frames are often freed by a different thread than the one that
+ * allocated them, such as a bridge freeing a channel's frames.  The
+ * freeing thread passes its surplus to the depot, where the allocating
+ * thread picks them up again.  Blocks beyond this are given back to the
+ * system.
+ */
+#define FRAME_POOL_DEPOT_MAX 1024
+
+/*! \brief A frame pool block, holding a frame and maybe its payload */
+struct frame_pool_block {
+	/*! For placing in a free list */
+	AST_LIST_ENTRY(frame_pool_block) list;
+	/*! Size class of the block */
+	unsigned int size_class;
+	/*! The frame, followed by the payload */
+	struct ast_frame frame;
 };
-#endif
 
-struct ast_frame ast_null_frame = { AST_FRAME_NULL, };
+AST_LIST_HEAD_NOLOCK(frame_pool_list, frame_pool_block);
 
-static struct ast_frame *ast_frame_header_new(void)
+/*! \brief Free blocks of a size class */
+struct frame_pool_free {
+	struct frame_pool_list list;
+	unsigned int size;
+};
+
+/*! \brief Free blocks shared by all threads, and the pool statistics */
+struct frame_pool_depot {
+	struct frame_pool_free free;
+	/*! Blocks allocated from the system */
+	int created;
+	/*! Blocks given back to the system */
+	int released;
+	/*! Batches threads took from the depot */
+	int refills;
+	/*! Batches threads gave to the depot */
+	int spills;
+};
+
+static struct frame_pool_depot frame_pool_depots[FRAME_POOL_CLASSES];
+
+/*! \brief Frames too large for the pool, allocated on their own */
+static int frame_pool_oversize;
+
+/*! \brief Protects frame_pool_depots */
+AST_MUTEX_DEFINE_STATIC(frame_pool_lock);
+
+static void frame_pool_cleanup(void *data);
+
+/*! \brief Each thread's free frame pool blocks */
+AST_THREADSTORAGE_CUSTOM(frame_pool, NULL, frame_pool_cleanup);
+
+struct frame_pool_cache {
+	struct frame_pool_free classes[FRAME_POOL_CLASSES];
+	/*! Bytes held by the free blocks of all the classes */
+	size_t bytes;
+};
+
+/*!
+ * \internal
+ * \brief Get the number of bytes a frame pool size class holds, header included
+ */
+static size_t frame_pool_class_len(unsigned int size_class)
+{
+	return frame_pool_payloads[size_class]
+		? sizeof(struct ast_frame) + AST_FRIENDLY_OFFSET + frame_pool_payloads[size_class]
+		: sizeof(struct ast_frame);
+}
+
+/*!
+ * \internal
+ * \brief Move up to \a count blocks from the front of one free list to another
+ */
+static void frame_pool_move(struct frame_pool_free *to, struct frame_pool_free *from, unsigned int count)
+{
+	struct frame_pool_block *block;
+
+	while (count-- && (block = AST_LIST_REMOVE_HEAD(&from->list, list))) {
+		AST_LIST_INSERT_HEAD(&to->list, block, list);
+		from->size--;
+		to->size++;
+	}
+}
+
+/*!
+ * \internal
+ * \brief Give a thread's surplus blocks of a size class to the depot
+ *
+ * \param cache The thread's free blocks
+ * \param size_class The size class
+ * \param count Number of blocks to give
+ */
+static void frame_pool_spill(struct frame_pool_cache *cache, unsigned int size_class, unsigned int count)
+{
+	struct frame_pool_depot *depot = &frame_pool_depots[size_class];
+	struct frame_pool_free *local = &cache->classes[size_class];
+	struct frame_pool_free surplus = { AST_LIST_HEAD_NOLOCK_INIT_VALUE, 0 };
+	struct frame_pool_block *block;
+	unsigned int size = local->size;
+
+	ast_mutex_lock(&frame_pool_lock);
+	frame_pool_move(&depot->free, local, count);
+	depot->spills++;
+	if (depot->free.size > FRAME_POOL_DEPOT_MAX) {
+		frame_pool_move(&surplus, &depot->free, depot->free.size - FRAME_POOL_DEPOT_MAX);
+		ast_atomic_fetchadd_int(&depot->released, surplus.size);
+	}
+	ast_mutex_unlock(&frame_pool_lock);
+
+	while ((block = AST_LIST_REMOVE_HEAD(&surplus.list, list))) {
+		ast_free(block);
+	}
+
+	cache->bytes -= (size - local->size) * frame_pool_class_len(size_class);
+}
+
+/*!
+ * \internal
+ * \brief Give a thread's largest free blocks to the depot until it holds half its share
+ */
+static void frame_pool_trim(struct frame_pool_cache *cache)
 {
+	unsigned int size_class = FRAME_POOL_CLASSES;
+
+	while (size_class-- && cache->bytes > FRAME_POOL_THREAD_BYTES / 2) {
+		while (cache->classes[size_class].size && cache->bytes > FRAME_POOL_THREAD_BYTES / 2) {
+			frame_pool_spill(cache, size_class, FRAME_POOL_BATCH);
+		}
+	}
+}
+
+static void frame_pool_cleanup(void *data)
+{
+	struct frame_pool_cache *cache = data;
+	unsigned int size_class;
+
+	for (size_class = 0; size_class < FRAME_POOL_CLASSES; ++size_class) {
+		if (cache->classes[size_class].size) {
+			frame_pool_spill(cache, size_class, cache->classes[size_class].size);
+		}
+	}
+
+	ast_free(cache);
+}
+
+/*!
+ * \internal
+ * \brief Allocate a frame with room for \a len bytes, header included
+ *
+ * The frame header is zeroed and marked as malloc'd.  Its mallocd_hdr_len
+ * is the number of bytes available, which may be more than \a len.
+ */
+static struct ast_frame *frame_pool_alloc(size_t len)
+{
+	struct frame_pool_cache *cache;
+	struct frame_pool_free *local = NULL;
+	struct frame_pool_block *block;
 	struct ast_frame *f;
+	unsigned int size_class;
 
-#if !defined(LOW_MEMORY)
-	struct ast_frame_cache *frames;
+	for (size_class = 0; size_class < FRAME_POOL_CLASSES; ++size_class) {
+		if (len <= frame_pool_class_len(size_class)) {
+			break;
+		}
+	}
+
+	if (size_class == FRAME_POOL_CLASSES) {
+		ast_atomic_fetchadd_int(&frame_pool_oversize, +1);
+		if (!(f = ast_calloc_cache(1, len))) {
+			return NULL;
+		}
+		f->mallocd = AST_MALLOCD_HDR;
+		f->mallocd_hdr_len = len;
+		return f;
+	}
 
-	if ((frames = ast_threadstorage_get(&frame_cache, sizeof(*frames)))) {
-		if ((f = AST_LIST_REMOVE_HEAD(&frames->list, frame_list))) {
-			size_t mallocd_len = f->mallocd_hdr_len;
+	if ((cache = ast_threadstorage_get(&frame_pool, sizeof(*cache)))) {
+		local = &cache->classes[size_class];
+		if (!local->size) {
+			/* Take back blocks this thread or others have freed */
+			struct frame_pool_depot *depot = &frame_pool_depots[size_class];
 
-			memset(f, 0, sizeof(*f));
-			f->mallocd_hdr_len = mallocd_len;
-			frames->size--;
-			return f;
+			ast_mutex_lock(&frame_pool_lock);
+			if (depot->free.size) {
+				frame_pool_move(local, &depot->free, FRAME_POOL_BATCH);
+				depot->refills++;
+			}
+			ast_mutex_unlock(&frame_pool_lock);
+			cache->bytes += local->size * frame_pool_class_len(size_class);
 		}
 	}
-	if (!(f = ast_calloc_cache(1, sizeof(*f))))
-		return NULL;
-#else
-	if (!(f = ast_calloc(1, sizeof(*f))))
-		return NULL;
-#endif
 
-	f->mallocd_hdr_len = sizeof(*f);
+	if (local && (block = AST_LIST_REMOVE_HEAD(&local->list, list))) {
+		local->size--;
+		cache->bytes -= frame_pool_class_len(size_class);
+	} else {
+		if (!(block = ast_malloc(offsetof(struct frame_pool_block, frame)
+			+ frame_pool_class_len(size_class)))) {
+			return NULL;
+		}
+		block->size_class = size_class;
+		ast_atomic_fetchadd_int(&frame_pool_depots[size_class].created, +1);
+	}
 
+	f = &block->frame;
+	memset(f, 0, sizeof(*f));
+	f->mallocd = AST_MALLOCD_HDR | AST_MALLOCD_POOL;
+	f->mallocd_hdr_len = frame_pool_class_len(size_class);
 	return f;
 }
 
-#if !defined(LOW_MEMORY)
-static void frame_cache_cleanup(void *data)
+/*!
+ * \internal
+ * \brief Free the header of a frame allocated by frame_pool_alloc()
+ *
+ * \param f The frame
+ * \param cache Zero to give a pooled block straight back to the system
+ */
+static void frame_pool_free(struct ast_frame *f, int cache)
 {
-	struct ast_frame_cache *frames = data;
-	struct ast_frame *f;
+	struct frame_pool_block *block;
+	struct frame_pool_cache *frames;
+	struct frame_pool_free *local;
 
-	while ((f = AST_LIST_REMOVE_HEAD(&frames->list, frame_list)))
+	if (!(f->mallocd & AST_MALLOCD_POOL)) {
 		ast_free(f);
+		return;
+	}
 
-	ast_free(frames);
+	block = (struct frame_pool_block *) ((char *) f - offsetof(struct frame_pool_block, frame));
+	if (!cache || !(frames = ast_threadstorage_get(&frame_pool, sizeof(*frames)))) {
+		ast_atomic_fetchadd_int(&frame_pool_depots[block->size_class].released, +1);
+		ast_free(block);
+		return;
+	}
+
+	local = &frames->classes[block->size_class];
+	AST_LIST_INSERT_HEAD(&local->list, block, list);
+	frames->bytes += frame_pool_class_len(block->size_class);
+	if (++local->size > FRAME_POOL_THREAD_MAX) {
+		frame_pool_spill(frames, block->size_class, FRAME_POOL_BATCH);
+	}
+	if (frames->bytes > FRAME_POOL_THREAD_BYTES) {
+		frame_pool_trim(frames);
+	}
 }
 #endif
 
-static void __frame_free(struct ast_frame *fr, int cache)
+struct ast_frame ast_null_frame = { AST_FRAME_NULL, };
+
+static struct ast_frame *ast_frame_header_new(void)
 {
-	if (!fr->mallocd)
-		return;
+	struct ast_frame *f;
 
 #if !defined(LOW_MEMORY)
-	if (cache && fr->mallocd == AST_MALLOCD_HDR) {
-		/* Cool, only the header is malloc'd, let's just cache those for now
-		 * to keep things simple... */
-		struct ast_frame_cache *frames;
-		if ((frames = ast_threadstorage_get(&frame_cache, sizeof(*frames))) &&
-		    (frames->size < FRAME_CACHE_MAX_SIZE)) {
-			if ((fr->frametype == AST_FRAME_VOICE) || (fr->frametype == AST_FRAME_VIDEO) ||
-				(fr->frametype == AST_FRAME_IMAGE)) {
-				ao2_cleanup(fr->subclass.format);
-			}
-
-			AST_LIST_INSERT_HEAD(&frames->list, fr, frame_list);
-			frames->size++;
-			return;
-		}
+	f = frame_pool_alloc(sizeof(*f));
+#else
+	if ((f = ast_calloc(1, sizeof(*f)))) {
+		f->mallocd = AST_MALLOCD_HDR;
+		f->mallocd_hdr_len = sizeof(*f);
 	}
 #endif
 
+	return f;
+}
+
+static void __frame_free(struct ast_frame *fr, int cache)
+{
+	if (!fr->mallocd)
+		return;
+
 	if (fr->mallocd & AST_MALLOCD_DATA) {
 		if (fr->data.ptr) {
 			ast_free(fr->data.ptr - fr->offset);
 		}
 	}
+	if (fr->mallocd & AST_MALLOCD_SHARED) {
+		ao2_ref(fr->data.ptr - fr->offset, -1);
+	}
 	if (fr->mallocd & AST_MALLOCD_SRC) {
 		ast_free((void *) fr->src);
 	}
@@ -152,7 +362,11 @@ static void __frame_free(struct ast_frame *fr, int cache)
 			ao2_cleanup(fr->subclass.format);
 		}
 
+#if !defined(LOW_MEMORY)
+		frame_pool_free(fr, cache);
+#else
 		ast_free(fr);
+#endif
 	} else {
 		fr->mallocd = 0;
 	}
@@ -177,6 +391,16 @@ void ast_frame_dtor(struct ast_frame *f)
 	}
 }
 
+/*!
+ * \internal
+ * \brief Check if a pointer is in the same allocation as a malloc'd frame header
+ */
+static int frame_hdr_holds(const struct ast_frame *fr, const void *ptr)
+{
+	return (const char *) ptr >= (const char *) fr
+		&& (const char *) ptr < (const char *) fr + fr->mallocd_hdr_len;
+}
+
 /*!
  * \brief 'isolates' a frame by duplicating non-malloc'ed components
  * (header, src, data).
@@ -200,6 +424,14 @@ struct ast_frame *ast_frisolate(struct ast_frame *fr)
 		return fr;
 	}
 
+	/* the same goes for a frame from ast_frdup() or ast_frshare(), which hold their own copies */
+	if ((fr->mallocd & AST_MALLOCD_HDR)
+		&& (!fr->src || (fr->mallocd & AST_MALLOCD_SRC) || frame_hdr_holds(fr, fr->src))
+		&& (!fr->datalen || (fr->mallocd & (AST_MALLOCD_DATA | AST_MALLOCD_SHARED))
+			|| frame_hdr_holds(fr, fr->data.ptr))) {
+		return fr;
+	}
+
 	if (!(fr->mallocd & AST_MALLOCD_HDR)) {
 		/* Allocate a new header if needed */
 		if (!(out = ast_frame_header_new())) {
@@ -213,7 +445,6 @@ struct ast_frame *ast_frisolate(struct ast_frame *fr)
 		}
 		out->datalen = fr->datalen;
 		out->samples = fr->samples;
-		out->mallocd = AST_MALLOCD_HDR;
 		out->offset = fr->offset;
 		/* Copy the timing data */
 		ast_copy_flags(out, fr, AST_FLAGS_ALL);
@@ -253,7 +484,7 @@ struct ast_frame *ast_frisolate(struct ast_frame *fr)
 		}
 	}
 
-	if (!(fr->mallocd & AST_MALLOCD_DATA))  {
+	if (!(fr->mallocd & (AST_MALLOCD_DATA | AST_MALLOCD_SHARED)))  {
 		/* The original frame has a non-malloced data buffer. */
 		if (!fr->datalen) {
 			/* Actually it's just an int so we can simply copy it. */
@@ -277,25 +508,42 @@ struct ast_frame *ast_frisolate(struct ast_frame *fr)
 		out->data.ptr = newdata;
 		out->mallocd |= AST_MALLOCD_DATA;
 	} else if (out != fr) {
-		/* Steal the data buffer from the original frame. */
+		/* Steal the data buffer, or the reference to it, from the original frame. */
 		out->data = fr->data;
 		memset(&fr->data, 0, sizeof(fr->data));
-		fr->mallocd &= ~AST_MALLOCD_DATA;
-		out->mallocd |= AST_MALLOCD_DATA;
+		out->mallocd |= fr->mallocd & (AST_MALLOCD_DATA | AST_MALLOCD_SHARED);
+		fr->mallocd &= ~(AST_MALLOCD_DATA | AST_MALLOCD_SHARED);
 	}
 
 	return out;
 }
 
+/*!
+ * \internal
+ * \brief Copy the fields describing a frame, but not its data or source
+ */
+static void frame_copy_fields(struct ast_frame *out, const struct ast_frame *f)
+{
+	out->frametype = f->frametype;
+	out->subclass = f->subclass;
+	if ((f->frametype == AST_FRAME_VOICE) || (f->frametype == AST_FRAME_VIDEO) ||
+		(f->frametype == AST_FRAME_IMAGE)) {
+		ao2_bump(out->subclass.format);
+	}
+	out->datalen = f->datalen;
+	out->samples = f->samples;
+	out->delivery = f->delivery;
+	ast_copy_flags(out, f, AST_FLAGS_ALL);
+	out->ts = f->ts;
+	out->len = f->len;
+	out->seqno = f->seqno;
+}
+
 struct ast_frame *ast_frdup(const struct ast_frame *f)
 {
 	struct ast_frame *out = NULL;
 	int len, srclen = 0;
-	void *buf = NULL;
-
-#if !defined(LOW_MEMORY)
-	struct ast_frame_cache *frames;
-#endif
+	void *buf;
 
 	/* Start with standard stuff */
 	len = sizeof(*out) + AST_FRIENDLY_OFFSET + f->datalen;
@@ -310,47 +558,24 @@ struct ast_frame *ast_frdup(const struct ast_frame *f)
 		len += srclen + 1;
 
 #if !defined(LOW_MEMORY)
-	if ((frames = ast_threadstorage_get(&frame_cache, sizeof(*frames)))) {
-		AST_LIST_TRAVERSE_SAFE_BEGIN(&frames->list, out, frame_list) {
-			if (out->mallocd_hdr_len >= len) {
-				size_t mallocd_len = out->mallocd_hdr_len;
-
-				AST_LIST_REMOVE_CURRENT(frame_list);
-				memset(out, 0, sizeof(*out));
-				out->mallocd_hdr_len = mallocd_len;
-				buf = out;
-				frames->size--;
-				break;
-			}
-		}
-		AST_LIST_TRAVERSE_SAFE_END;
-	}
+	if (!(out = frame_pool_alloc(len)))
+		return NULL;
+#else
+	if (!(out = ast_calloc_cache(1, len)))
+		return NULL;
+	out->mallocd = AST_MALLOCD_HDR;
+	out->mallocd_hdr_len = len;
 #endif
+	buf = out;
 
-	if (!buf) {
-		if (!(buf = ast_calloc_cache(1, len)))
-			return NULL;
-		out = buf;
-		out->mallocd_hdr_len = len;
-	}
-
-	out->frametype = f->frametype;
-	out->subclass = f->subclass;
-	if ((f->frametype == AST_FRAME_VOICE) || (f->frametype == AST_FRAME_VIDEO) ||
-		(f->frametype == AST_FRAME_IMAGE)) {
-		ao2_bump(out->subclass.format);
-	}
-	out->datalen = f->datalen;
-	out->samples = f->samples;
-	out->delivery = f->delivery;
+	frame_copy_fields(out, f);
 	/* Even though this new frame was allocated from the heap, we can't mark it
 	 * with AST_MALLOCD_HDR, AST_MALLOCD_DATA and AST_MALLOCD_SRC, because that
 	 * would cause ast_frfree() to attempt to individually free each of those
 	 * under the assumption that they were separately allocated. Since this frame
-	 * was allocated in a single allocation, we'll only mark it as if the header
+	 * was allocated in a single allocation, it is only marked as if the header
 	 * was heap-allocated; this will result in the entire frame being properly freed.
 	 */
-	out->mallocd = AST_MALLOCD_HDR;
 	out->offset = AST_FRIENDLY_OFFSET;
 	if (out->datalen) {
 		out->data.ptr = buf + sizeof(*out) + AST_FRIENDLY_OFFSET;
@@ -366,13 +591,105 @@ struct ast_frame *ast_frdup(const struct ast_frame *f)
 		/* Must have space since we allocated for it */
 		strcpy(src, f->src);
 	}
-	ast_copy_flags(out, f, AST_FLAGS_ALL);
-	out->ts = f->ts;
-	out->len = f->len;
-	out->seqno = f->seqno;
 	return out;
 }
 
+/*!
+ * \internal
+ * \brief Copy data into a new shared buffer
+ *
+ * \return The copy, AST_FRIENDLY_OFFSET bytes into the buffer
+ * \retval NULL on error
+ */
+static void *frame_data_share(const void *data, int datalen)
+{
+	char *buf;
+
+	buf = ao2_alloc_options(AST_FRIENDLY_OFFSET + datalen, NULL, AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!buf) {
+		return NULL;
+	}
+	memcpy(buf + AST_FRIENDLY_OFFSET, data, datalen);
+	return buf + AST_FRIENDLY_OFFSET;
+}
+
+struct ast_frame *ast_frshare(const struct ast_frame *f)
+{
+	struct ast_frame *out;
+	size_t len = sizeof(*out);
+	size_t srclen = 0;
+
+	if (!f->datalen) {
+		/* Nothing to share */
+		return ast_frdup(f);
+	}
+
+	/* The source string is kept with the header */
+	if (f->src) {
+		srclen = strlen(f->src);
+	}
+	if (srclen > 0) {
+		len += srclen + 1;
+	}
+
+#if !defined(LOW_MEMORY)
+	if (!(out = frame_pool_alloc(len))) {
+		return NULL;
+	}
+#else
+	if (!(out = ast_calloc_cache(1, len))) {
+		return NULL;
+	}
+	out->mallocd = AST_MALLOCD_HDR;
+	out->mallocd_hdr_len = len;
+#endif
+
+	if (f->mallocd & AST_MALLOCD_SHARED) {
+		ao2_ref(f->data.ptr - f->offset, +1);
+		out->data.ptr = f->data.ptr;
+		out->offset = f->offset;
+	} else if ((out->data.ptr = frame_data_share(f->data.ptr, f->datalen))) {
+		out->offset = AST_FRIENDLY_OFFSET;
+	} else {
+		ast_frame_free(out, 0);
+		return NULL;
+	}
+	out->mallocd |= AST_MALLOCD_SHARED;
+
+	frame_copy_fields(out, f);
+	if (srclen > 0) {
+		char *src = (char *) (out + 1);
+
+		strcpy(src, f->src);
+		out->src = src;
+	}
+	return out;
+}
+
+int ast_frame_unshare(struct ast_frame *fr)
+{
+	void *buf;
+	void *data;
+
+	if (!(fr->mallocd & AST_MALLOCD_SHARED)) {
+		return 0;
+	}
+
+	buf = fr->data.ptr - fr->offset;
+	if (ao2_ref(buf, 0) == 1) {
+		/* Nobody else refers to the data, so it is already ours */
+		return 0;
+	}
+
+	if (!(data = frame_data_share(fr->data.ptr, fr->datalen))) {
+		return -1;
+	}
+	ao2_ref(buf, -1);
+	fr->data.ptr = data;
+	fr->offset = AST_FRIENDLY_OFFSET;
+	return 0;
+}
+
 void ast_swapcopy_samples(void *dst, const void *src, int samples)
 {
 	int i;
@@ -727,3 +1044,63 @@ int ast_frame_clear(struct ast_frame *frame)
 	}
 	return 0;
 }
+
+#if !defined(LOW_MEMORY)
+static char *handle_cli_core_show_frame_pool(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	unsigned int size_class;
+#define FMT_HEADERS		"%-10s %10s %10s %10s %10s %10s %10s\n"
+#define FMT_FIELDS		"%-10zu %10d %10d %10d %10u %10d %10d\n"
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "core show frame pool";
+		e->usage =
+			"Usage: core show frame pool\n"
+			"	Shows the frame pool size classes and their statistics.  Held\n"
+			"	blocks are in use or kept free by a thread; the depot keeps free\n"
+			"	blocks for any thread.\n";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc != e->args) {
+		return CLI_SHOWUSAGE;
+	}
+
+	ast_cli(a->fd, "\n" FMT_HEADERS, "Size", "Created", "Released", "Held", "In Depot", "Refills", "Spills");
+	ast_mutex_lock(&frame_pool_lock);
+	for (size_class = 0; size_class < FRAME_POOL_CLASSES; ++size_class) {
+		struct frame_pool_depot *depot = &frame_pool_depots[size_class];
+
+		ast_cli(a->fd, FMT_FIELDS, frame_pool_class_len(size_class),
+			depot->created, depot->released,
+			depot->created - depot->released - (int) depot->free.size,
+			depot->free.size, depot->refills, depot->spills);
+	}
+	ast_mutex_unlock(&frame_pool_lock);
+	ast_cli(a->fd, "\n%d frames too large for the pool\n\n", frame_pool_oversize);
+	return CLI_SUCCESS;
+#undef FMT_HEADERS
+#undef FMT_FIELDS
+}
+
+static struct ast_cli_entry frame_cli[] = {
+	AST_CLI_DEFINE(handle_cli_core_show_frame_pool, "Display frame pool statistics"),
+};
+
+static void frame_shutdown(void)
+{
+	ast_cli_unregister_multiple(frame_cli, ARRAY_LEN(frame_cli));
+}
+#endif
+
+int ast_frame_init(void)
+{
+#if !defined(LOW_MEMORY)
+	ast_cli_register_multiple(frame_cli, ARRAY_LEN(frame_cli));
+	ast_register_cleanup(frame_shutdown);
+#endif
+	return 0;
+}
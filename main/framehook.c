@@ -91,6 +91,12 @@ static struct ast_frame *framehook_list_push_event(struct ast_framehook_list *fr
 		return frame;
 	}
 
+	/* The hooks may modify the frame, which must not be done to shared data */
+	if (frame && framehooks->count && ast_frame_unshare(frame)) {
+		ast_log(LOG_WARNING, "Unable to copy shared frame data, passing the frame by the framehooks\n");
+		return frame;
+	}
+
 	skip_size = sizeof(int) * framehooks->count;
 	skip = ast_alloca(skip_size);
 	memset(skip, 0, skip_size);
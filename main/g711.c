@@ -0,0 +1,497 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2017, Digium, Inc.
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+/*! \file
+ *
+ * \brief G.711 conversion of whole buffers
+ *
+ * The scalar implementation uses the lookup tables from ulaw.c and alaw.c.
+ * The SIMD implementations compute the same values without memory lookups:
+ * the segment of a sample comes from in register byte shuffles of its
+ * nibbles and the variable shifts are done as multiplications, so a
+ * register of samples converts with no branches.
+ *
+ * The table free encoders reproduce the tables built by the default
+ * algorithm, so they are only used when G711_NEW_ALGORITHM is not defined.
+ */
+
+/*** MODULEINFO
+	<support_level>core</support_level>
+ ***/
+
+#include "asterisk.h"
+
+#include "asterisk/g711.h"
+#include "asterisk/ulaw.h"
+#include "asterisk/alaw.h"
+#include "asterisk/utils.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) \
+	&& (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)) \
+	&& !defined(G711_NEW_ALGORITHM)
+/* The compiler can build functions for instruction sets it was not told to use. */
+#define G711_X86
+#include <immintrin.h>
+#endif
+
+typedef void (*g711_decode_fn)(int16_t *dst, const unsigned char *src, size_t samples);
+typedef void (*g711_encode_fn)(unsigned char *dst, const int16_t *src, size_t samples);
+typedef void (*g711_transcode_fn)(unsigned char *dst, const unsigned char *src, size_t samples);
+
+/*! \brief a-law to mu-law, built by ast_g711_init() */
+static unsigned char a2mu[256];
+/*! \brief mu-law to a-law, built by ast_g711_init() */
+static unsigned char mu2a[256];
+
+static void ulaw_decode_scalar_from(int16_t *dst, const unsigned char *src,
+	size_t start, size_t samples)
+{
+	size_t x;
+
+	for (x = start; x < samples; ++x) {
+		dst[x] = AST_MULAW(src[x]);
+	}
+}
+
+static void ulaw_encode_scalar_from(unsigned char *dst, const int16_t *src,
+	size_t start, size_t samples)
+{
+	size_t x;
+
+	for (x = start; x < samples; ++x) {
+		dst[x] = AST_LIN2MU(src[x]);
+	}
+}
+
+static void alaw_decode_scalar_from(int16_t *dst, const unsigned char *src,
+	size_t start, size_t samples)
+{
+	size_t x;
+
+	for (x = start; x < samples; ++x) {
+		dst[x] = AST_ALAW(src[x]);
+	}
+}
+
+static void alaw_encode_scalar_from(unsigned char *dst, const int16_t *src,
+	size_t start, size_t samples)
+{
+	size_t x;
+
+	for (x = start; x < samples; ++x) {
+		dst[x] = AST_LIN2A(src[x]);
+	}
+}
+
+static void transcode_scalar_from(unsigned char *dst, const unsigned char *src,
+	const unsigned char *table, size_t start, size_t samples)
+{
+	size_t x;
+
+	for (x = start; x < samples; ++x) {
+		dst[x] = table[src[x]];
+	}
+}
+
+static void ulaw_decode_scalar(int16_t *dst, const unsigned char *src, size_t samples)
+{
+	ulaw_decode_scalar_from(dst, src, 0, samples);
+}
+
+static void ulaw_encode_scalar(unsigned char *dst, const int16_t *src, size_t samples)
+{
+	ulaw_encode_scalar_from(dst, src, 0, samples);
+}
+
+static void alaw_decode_scalar(int16_t *dst, const unsigned char *src, size_t samples)
+{
+	alaw_decode_scalar_from(dst, src, 0, samples);
+}
+
+static void alaw_encode_scalar(unsigned char *dst, const int16_t *src, size_t samples)
+{
+	alaw_encode_scalar_from(dst, src, 0, samples);
+}
+
+static void alaw_to_ulaw_scalar(unsigned char *dst, const unsigned char *src, size_t samples)
+{
+	transcode_scalar_from(dst, src, a2mu, 0, samples);
+}
+
+static void ulaw_to_alaw_scalar(unsigned char *dst, const unsigned char *src, size_t samples)
+{
+	transcode_scalar_from(dst, src, mu2a, 0, samples);
+}
+
+#ifdef G711_X86
+/*!
+ * \brief Decode 16 mu-law samples
+ *
+ * Without the complement and sign a mu-law byte is a 3 bit exponent and a
+ * 4 bit mantissa, and the magnitude is ((mantissa << 3) + 0x84 << exponent)
+ * - 0x84.
+ */
+__attribute__((target("avx2")))
+static inline __m256i ulaw_decode16_avx2(__m128i ulaw)
+{
+	const __m256i pow2 = _mm256_setr_epi8(
+		1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0,
+		1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0);
+	const __m256i bias = _mm256_set1_epi16(0x84);
+	__m256i byte = _mm256_xor_si256(_mm256_cvtepu8_epi16(ulaw), _mm256_set1_epi16(0xff));
+	__m256i exponent = _mm256_and_si256(_mm256_srli_epi16(byte, 4), _mm256_set1_epi16(0x07));
+	__m256i mantissa = _mm256_slli_epi16(_mm256_and_si256(byte, _mm256_set1_epi16(0x0f)), 3);
+	/* The high byte of each index has its top bit set, so it shuffles in a 0 */
+	__m256i scale = _mm256_shuffle_epi8(pow2,
+		_mm256_or_si256(exponent, _mm256_set1_epi16((short) 0x8000)));
+	__m256i sample = _mm256_sub_epi16(
+		_mm256_mullo_epi16(_mm256_or_si256(mantissa, bias), scale), bias);
+	__m256i negative = _mm256_srai_epi16(_mm256_slli_epi16(byte, 8), 15);
+
+	return _mm256_sub_epi16(_mm256_xor_si256(sample, negative), negative);
+}
+
+/*!
+ * \brief Decode 16 a-law samples
+ *
+ * Segment 0 holds (mantissa << 4) + 8, and every other segment adds 0x100
+ * and doubles for each segment above 1.
+ */
+__attribute__((target("avx2")))
+static inline __m256i alaw_decode16_avx2(__m128i alaw)
+{
+	const __m256i pow2 = _mm256_setr_epi8(
+		1, 1, 2, 4, 8, 16, 32, 64, 0, 0, 0, 0, 0, 0, 0, 0,
+		1, 1, 2, 4, 8, 16, 32, 64, 0, 0, 0, 0, 0, 0, 0, 0);
+	__m256i byte = _mm256_xor_si256(_mm256_cvtepu8_epi16(alaw), _mm256_set1_epi16(AST_ALAW_AMI_MASK));
+	__m256i segment = _mm256_and_si256(_mm256_srli_epi16(byte, 4), _mm256_set1_epi16(0x07));
+	__m256i sample = _mm256_add_epi16(
+		_mm256_slli_epi16(_mm256_and_si256(byte, _mm256_set1_epi16(0x0f)), 4),
+		_mm256_set1_epi16(8));
+	__m256i negative;
+
+	sample = _mm256_add_epi16(sample, _mm256_andnot_si256(
+		_mm256_cmpeq_epi16(segment, _mm256_setzero_si256()), _mm256_set1_epi16(0x100)));
+	sample = _mm256_mullo_epi16(sample, _mm256_shuffle_epi8(pow2,
+		_mm256_or_si256(segment, _mm256_set1_epi16((short) 0x8000))));
+	/* A clear sign bit is negative in a-law */
+	negative = _mm256_cmpeq_epi16(_mm256_and_si256(byte, _mm256_set1_epi16(0x80)),
+		_mm256_setzero_si256());
+
+	return _mm256_sub_epi16(_mm256_xor_si256(sample, negative), negative);
+}
+
+/*!
+ * \brief Shift each magnitude right by the amount picked by its segment
+ *
+ * AVX2 has no variable 16 bit shift, but the high half of multiplying by
+ * 1 << (16 - shift) is the same thing.  \a multipliers holds the eight
+ * 16 bit multipliers, indexed by segment.
+ */
+__attribute__((target("avx2")))
+static inline __m256i segment_shift_avx2(__m256i magnitude, __m256i segment, __m256i multipliers)
+{
+	/* Each 16 bit lane needs bytes 2 * segment and 2 * segment + 1 of the table */
+	__m256i index = _mm256_add_epi16(_mm256_mullo_epi16(segment, _mm256_set1_epi16(0x0202)),
+		_mm256_set1_epi16(0x0100));
+
+	return _mm256_mulhi_epu16(magnitude, _mm256_shuffle_epi8(multipliers, index));
+}
+
+/*!
+ * \brief Look up the segment of each 8 bit value in 16 bit lanes
+ *
+ * The segment depends only on the highest bit set, so it is the larger of
+ * the segments of the high and low nibbles.  Both tables map 0 to 0, which
+ * also clears the high byte of every lane.
+ */
+__attribute__((target("avx2")))
+static inline __m256i segment_avx2(__m256i value, __m256i high_segments, __m256i low_segments)
+{
+	return _mm256_max_epi16(
+		_mm256_shuffle_epi8(high_segments, _mm256_srli_epi16(value, 4)),
+		_mm256_shuffle_epi8(low_segments, _mm256_and_si256(value, _mm256_set1_epi16(0x0f))));
+}
+
+/*!
+ * \brief Encode 16 signed linear samples to mu-law, one per 16 bit lane
+ *
+ * The lookup table in ulaw.c holds the encoding of the largest sample in
+ * each group of 4, so the low 2 bits are set before encoding.
+ */
+__attribute__((target("avx2")))
+static inline __m256i ulaw_encode16_avx2(__m256i sample)
+{
+	const __m256i multipliers = _mm256_setr_epi16(
+		1 << 13, 1 << 12, 1 << 11, 1 << 10, 1 << 9, 1 << 8, 1 << 7, 1 << 6,
+		1 << 13, 1 << 12, 1 << 11, 1 << 10, 1 << 9, 1 << 8, 1 << 7, 1 << 6);
+	__m256i value = _mm256_or_si256(sample, _mm256_set1_epi16(0x03));
+	__m256i negative = _mm256_srai_epi16(value, 15);
+	/* Clipped to 32635 so adding the bias of 0x84 can not overflow */
+	__m256i magnitude = _mm256_add_epi16(
+		_mm256_min_epi16(_mm256_abs_epi16(value), _mm256_set1_epi16(32635)),
+		_mm256_set1_epi16(0x84));
+	/* The exponent of the 8 bit value magnitude >> 7 is its highest bit set */
+	const __m256i high_exponents = _mm256_setr_epi8(
+		0, 4, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7, 7, 7, 7, 7,
+		0, 4, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7, 7, 7, 7, 7);
+	const __m256i low_exponents = _mm256_setr_epi8(
+		0, 0, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3,
+		0, 0, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+	__m256i exponent = segment_avx2(_mm256_srli_epi16(magnitude, 7), high_exponents, low_exponents);
+	__m256i mantissa = _mm256_and_si256(segment_shift_avx2(magnitude, exponent, multipliers),
+		_mm256_set1_epi16(0x0f));
+	__m256i byte = _mm256_or_si256(_mm256_slli_epi16(exponent, 4), mantissa);
+
+	byte = _mm256_or_si256(byte, _mm256_and_si256(negative, _mm256_set1_epi16(0x80)));
+	return _mm256_xor_si256(byte, _mm256_set1_epi16(0xff));
+}
+
+/*!
+ * \brief Encode 16 signed linear samples to a-law, one per 16 bit lane
+ *
+ * The lookup table in alaw.c holds the encoding of the largest sample in
+ * each group of 8, so the low 3 bits are set before encoding.
+ */
+__attribute__((target("avx2")))
+static inline __m256i alaw_encode16_avx2(__m256i sample)
+{
+	/* Segments 0 and 1 both shift by 4, then each segment shifts by one more */
+	const __m256i multipliers = _mm256_setr_epi16(
+		1 << 12, 1 << 12, 1 << 11, 1 << 10, 1 << 9, 1 << 8, 1 << 7, 1 << 6,
+		1 << 12, 1 << 12, 1 << 11, 1 << 10, 1 << 9, 1 << 8, 1 << 7, 1 << 6);
+	__m256i value = _mm256_or_si256(sample, _mm256_set1_epi16(0x07));
+	__m256i negative = _mm256_srai_epi16(value, 15);
+	__m256i magnitude = _mm256_abs_epi16(value);
+	/* The segment of the 7 bit value magnitude >> 8 is one more than its highest bit set */
+	const __m256i high_segments = _mm256_setr_epi8(
+		0, 5, 6, 6, 7, 7, 7, 7, 0, 0, 0, 0, 0, 0, 0, 0,
+		0, 5, 6, 6, 7, 7, 7, 7, 0, 0, 0, 0, 0, 0, 0, 0);
+	const __m256i low_segments = _mm256_setr_epi8(
+		0, 1, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4,
+		0, 1, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4);
+	__m256i segment = segment_avx2(_mm256_srli_epi16(magnitude, 8), high_segments, low_segments);
+	__m256i mantissa = _mm256_and_si256(segment_shift_avx2(magnitude, segment, multipliers),
+		_mm256_set1_epi16(0x0f));
+	__m256i byte = _mm256_or_si256(_mm256_slli_epi16(segment, 4), mantissa);
+	/* Positive samples have the sign bit set in a-law */
+	__m256i mask = _mm256_or_si256(_mm256_set1_epi16(AST_ALAW_AMI_MASK),
+		_mm256_andnot_si256(negative, _mm256_set1_epi16(0x80)));
+
+	return _mm256_xor_si256(byte, mask);
+}
+
+/*! \brief Pack two registers of 16 bit lanes holding bytes into 32 bytes, in order */
+__attribute__((target("avx2")))
+static inline __m256i pack_bytes_avx2(__m256i low, __m256i high)
+{
+	return _mm256_permute4x64_epi64(_mm256_packus_epi16(low, high), 0xd8);
+}
+
+__attribute__((target("avx2")))
+static void ulaw_decode_avx2(int16_t *dst, const unsigned char *src, size_t samples)
+{
+	size_t x;
+
+	for (x = 0; x + 16 <= samples; x += 16) {
+		_mm256_storeu_si256((__m256i *) &dst[x],
+			ulaw_decode16_avx2(_mm_loadu_si128((const __m128i *) &src[x])));
+	}
+	ulaw_decode_scalar_from(dst, src, x, samples);
+}
+
+__attribute__((target("avx2")))
+static void ulaw_encode_avx2(unsigned char *dst, const int16_t *src, size_t samples)
+{
+	size_t x;
+
+	for (x = 0; x + 32 <= samples; x += 32) {
+		__m256i low = ulaw_encode16_avx2(_mm256_loadu_si256((const __m256i *) &src[x]));
+		__m256i high = ulaw_encode16_avx2(_mm256_loadu_si256((const __m256i *) &src[x + 16]));
+
+		_mm256_storeu_si256((__m256i *) &dst[x], pack_bytes_avx2(low, high));
+	}
+	ulaw_encode_scalar_from(dst, src, x, samples);
+}
+
+__attribute__((target("avx2")))
+static void alaw_decode_avx2(int16_t *dst, const unsigned char *src, size_t samples)
+{
+	size_t x;
+
+	for (x = 0; x + 16 <= samples; x += 16) {
+		_mm256_storeu_si256((__m256i *) &dst[x],
+			alaw_decode16_avx2(_mm_loadu_si128((const __m128i *) &src[x])));
+	}
+	alaw_decode_scalar_from(dst, src, x, samples);
+}
+
+__attribute__((target("avx2")))
+static void alaw_encode_avx2(unsigned char *dst, const int16_t *src, size_t samples)
+{
+	size_t x;
+
+	for (x = 0; x + 32 <= samples; x += 32) {
+		__m256i low = alaw_encode16_avx2(_mm256_loadu_si256((const __m256i *) &src[x]));
+		__m256i high = alaw_encode16_avx2(_mm256_loadu_si256((const __m256i *) &src[x + 16]));
+
+		_mm256_storeu_si256((__m256i *) &dst[x], pack_bytes_avx2(low, high));
+	}
+	alaw_encode_scalar_from(dst, src, x, samples);
+}
+
+__attribute__((target("avx2")))
+static void alaw_to_ulaw_avx2(unsigned char *dst, const unsigned char *src, size_t samples)
+{
+	size_t x;
+
+	for (x = 0; x + 32 <= samples; x += 32) {
+		__m256i low = ulaw_encode16_avx2(
+			alaw_decode16_avx2(_mm_loadu_si128((const __m128i *) &src[x])));
+		__m256i high = ulaw_encode16_avx2(
+			alaw_decode16_avx2(_mm_loadu_si128((const __m128i *) &src[x + 16])));
+
+		_mm256_storeu_si256((__m256i *) &dst[x], pack_bytes_avx2(low, high));
+	}
+	transcode_scalar_from(dst, src, a2mu, x, samples);
+}
+
+__attribute__((target("avx2")))
+static void ulaw_to_alaw_avx2(unsigned char *dst, const unsigned char *src, size_t samples)
+{
+	size_t x;
+
+	for (x = 0; x + 32 <= samples; x += 32) {
+		__m256i low = alaw_encode16_avx2(
+			ulaw_decode16_avx2(_mm_loadu_si128((const __m128i *) &src[x])));
+		__m256i high = alaw_encode16_avx2(
+			ulaw_decode16_avx2(_mm_loadu_si128((const __m128i *) &src[x + 16])));
+
+		_mm256_storeu_si256((__m256i *) &dst[x], pack_bytes_avx2(low, high));
+	}
+	transcode_scalar_from(dst, src, mu2a, x, samples);
+}
+#endif /* G711_X86 */
+
+/*! \brief An implementation of the G.711 conversion functions */
+struct g711_ops {
+	const char *name;
+	g711_decode_fn ulaw_decode;
+	g711_encode_fn ulaw_encode;
+	g711_decode_fn alaw_decode;
+	g711_encode_fn alaw_encode;
+	g711_transcode_fn alaw_to_ulaw;
+	g711_transcode_fn ulaw_to_alaw;
+};
+
+static const struct g711_ops g711_ops[] = {
+	[AST_G711_SCALAR] = { "scalar",
+		ulaw_decode_scalar, ulaw_encode_scalar,
+		alaw_decode_scalar, alaw_encode_scalar,
+		alaw_to_ulaw_scalar, ulaw_to_alaw_scalar },
+#ifdef G711_X86
+	[AST_G711_AVX2] = { "avx2",
+		ulaw_decode_avx2, ulaw_encode_avx2,
+		alaw_decode_avx2, alaw_encode_avx2,
+		alaw_to_ulaw_avx2, ulaw_to_alaw_avx2 },
+#else
+	[AST_G711_AVX2] = { "avx2", },
+#endif
+};
+
+/*! \brief The implementation in use, picked by ast_g711_init() */
+static enum ast_g711_impl current_impl = AST_G711_SCALAR;
+
+/*! \brief Determine if this CPU can run an implementation */
+static int impl_supported(enum ast_g711_impl impl)
+{
+	if (impl >= ARRAY_LEN(g711_ops) || !g711_ops[impl].ulaw_decode) {
+		return 0;
+	}
+
+#ifdef G711_X86
+	if (impl == AST_G711_AVX2) {
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2");
+	}
+#endif
+
+	return 1;
+}
+
+void ast_g711_init(void)
+{
+	int i;
+
+	for (i = 0; i < 256; ++i) {
+		mu2a[i] = AST_LIN2A(AST_MULAW(i));
+		a2mu[i] = AST_LIN2MU(AST_ALAW(i));
+	}
+
+	current_impl = impl_supported(AST_G711_AVX2) ? AST_G711_AVX2 : AST_G711_SCALAR;
+}
+
+void ast_ulaw_decode_buf(int16_t *dst, const unsigned char *src, size_t samples)
+{
+	g711_ops[current_impl].ulaw_decode(dst, src, samples);
+}
+
+void ast_ulaw_encode_buf(unsigned char *dst, const int16_t *src, size_t samples)
+{
+	g711_ops[current_impl].ulaw_encode(dst, src, samples);
+}
+
+void ast_alaw_decode_buf(int16_t *dst, const unsigned char *src, size_t samples)
+{
+	g711_ops[current_impl].alaw_decode(dst, src, samples);
+}
+
+void ast_alaw_encode_buf(unsigned char *dst, const int16_t *src, size_t samples)
+{
+	g711_ops[current_impl].alaw_encode(dst, src, samples);
+}
+
+void ast_alaw_to_ulaw_buf(unsigned char *dst, const unsigned char *src, size_t samples)
+{
+	g711_ops[current_impl].alaw_to_ulaw(dst, src, samples);
+}
+
+void ast_ulaw_to_alaw_buf(unsigned char *dst, const unsigned char *src, size_t samples)
+{
+	g711_ops[current_impl].ulaw_to_alaw(dst, src, samples);
+}
+
+enum ast_g711_impl ast_g711_get_impl(void)
+{
+	return current_impl;
+}
+
+const char *ast_g711_impl_name(enum ast_g711_impl impl)
+{
+	if (impl >= ARRAY_LEN(g711_ops)) {
+		return "unknown";
+	}
+	return g711_ops[impl].name;
+}
+
+int ast_g711_set_impl(enum ast_g711_impl impl)
+{
+	if (!impl_supported(impl)) {
+		return -1;
+	}
+	current_impl = impl;
+	return 0;
+}
@@ -1650,6 +1650,27 @@ static int __attribute__((format(printf, 9, 0))) __manager_event_sessions(
 	...);
 static enum add_filter_result manager_add_filter(const char *filter_pattern, struct ao2_container *whitefilters, struct ao2_container *blackfilters);
 
+/*!
+ * \brief A compiled manager event filter
+ *
+ * Filters without any regular expression syntax are matched with a plain
+ * substring search instead of regexec().  A plain "Event: <name>" filter
+ * also remembers the name so it can be checked against the name of an
+ * event that has not been built yet.
+ */
+struct event_filter_entry {
+	/*! Compiled filter, only valid if is_regex is set */
+	regex_t regex_filter;
+	/*! Event name prefix matched by a plain "Event: " filter, NULL otherwise */
+	const char *event_name_filter;
+	/*! Length of event_name_filter */
+	size_t event_name_filter_len;
+	/*! Set if the filter needs regexec() */
+	unsigned int is_regex:1;
+	/*! The filter text */
+	char string_filter[0];
+};
+
 static int match_filter(struct mansession *s, char *eventdata);
 
 /*!
@@ -2148,8 +2169,11 @@ static struct mansession_session *unref_mansession(struct mansession_session *s)
 
 static void event_filter_destructor(void *obj)
 {
-	regex_t *regex_filter = obj;
-	regfree(regex_filter);
+	struct event_filter_entry *entry = obj;
+
+	if (entry->is_regex) {
+		regfree(&entry->regex_filter);
+	}
 }
 
 static void session_destructor(void *obj)
@@ -3349,7 +3373,7 @@ static int authenticate(struct mansession *s, const struct message *m)
 	const char *password = astman_get_header(m, "Secret");
 	int error = -1;
 	struct ast_manager_user *user = NULL;
-	regex_t *regex_filter;
+	struct event_filter_entry *regex_filter;
 	struct ao2_iterator filter_iter;
 
 	if (ast_strlen_zero(username)) {	/* missing username */
@@ -5770,13 +5794,46 @@ static int action_timeout(struct mansession *s, const struct message *m)
 	return 0;
 }
 
+/*! \brief An event being checked against the event filters */
+struct event_filter_data {
+	/*! The complete event text */
+	const char *eventdata;
+	/*! Name from the leading Event: header, not NUL terminated */
+	const char *event_name;
+	/*! Length of event_name */
+	size_t event_name_len;
+};
+
+/*!
+ * \internal
+ * \brief Check if an event name starts with the name of a plain "Event: " filter.
+ */
+static int filter_matches_event_name(struct event_filter_entry *entry, const char *event_name, size_t event_name_len)
+{
+	return entry->event_name_filter && event_name
+		&& entry->event_name_filter_len <= event_name_len
+		&& !strncmp(event_name, entry->event_name_filter, entry->event_name_filter_len);
+}
+
+static int filter_matches(struct event_filter_entry *entry, struct event_filter_data *event)
+{
+	if (filter_matches_event_name(entry, event->event_name, event->event_name_len)) {
+		/* The filter text is at the start of the event. */
+		return 1;
+	}
+	if (!entry->is_regex) {
+		return strstr(event->eventdata, entry->string_filter) != NULL;
+	}
+	return !regexec(&entry->regex_filter, event->eventdata, 0, NULL, 0);
+}
+
 static int whitefilter_cmp_fn(void *obj, void *arg, void *data, int flags)
 {
-	regex_t *regex_filter = obj;
-	const char *eventdata = arg;
+	struct event_filter_entry *regex_filter = obj;
+	struct event_filter_data *event = arg;
 	int *result = data;
 
-	if (!regexec(regex_filter, eventdata, 0, NULL, 0)) {
+	if (filter_matches(regex_filter, event)) {
 		*result = 1;
 		return (CMP_MATCH | CMP_STOP);
 	}
@@ -5786,11 +5843,11 @@ static int whitefilter_cmp_fn(void *obj, void *arg, void *data, int flags)
 
 static int blackfilter_cmp_fn(void *obj, void *arg, void *data, int flags)
 {
-	regex_t *regex_filter = obj;
-	const char *eventdata = arg;
+	struct event_filter_entry *regex_filter = obj;
+	struct event_filter_data *event = arg;
 	int *result = data;
 
-	if (!regexec(regex_filter, eventdata, 0, NULL, 0)) {
+	if (filter_matches(regex_filter, event)) {
 		*result = 0;
 		return (CMP_MATCH | CMP_STOP);
 	}
@@ -5846,6 +5903,9 @@ static int action_filter(struct mansession *s, const struct message *m)
  * Filter can be any valid regular expression
  * Filter can be a valid regular expression prefixed with !, which will add the filter as a black filter
  *
+ * Filters without regular expression syntax are not compiled but searched
+ * for as plain text, which gives the same result.
+ *
  * Examples:
  * \code
  *   filter_pattern = "Event: Newchannel"
@@ -5855,13 +5915,9 @@ static int action_filter(struct mansession *s, const struct message *m)
  *
  */
 static enum add_filter_result manager_add_filter(const char *filter_pattern, struct ao2_container *whitefilters, struct ao2_container *blackfilters) {
-	regex_t *new_filter = ao2_t_alloc(sizeof(*new_filter), event_filter_destructor, "event_filter allocation");
+	struct event_filter_entry *new_filter;
 	int is_blackfilter;
 
-	if (!new_filter) {
-		return FILTER_ALLOC_FAILED;
-	}
-
 	if (filter_pattern[0] == '!') {
 		is_blackfilter = 1;
 		filter_pattern++;
@@ -5869,9 +5925,22 @@ static enum add_filter_result manager_add_filter(const char *filter_pattern, str
 		is_blackfilter = 0;
 	}
 
-	if (regcomp(new_filter, filter_pattern, REG_EXTENDED | REG_NOSUB)) {
-		ao2_t_ref(new_filter, -1, "failed to make regex");
-		return FILTER_COMPILE_FAIL;
+	new_filter = ao2_t_alloc(sizeof(*new_filter) + strlen(filter_pattern) + 1,
+		event_filter_destructor, "event_filter allocation");
+	if (!new_filter) {
+		return FILTER_ALLOC_FAILED;
+	}
+	strcpy(new_filter->string_filter, filter_pattern); /* Safe */
+
+	if (strpbrk(filter_pattern, "\\^$.[]()|*+?{}")) {
+		if (regcomp(&new_filter->regex_filter, filter_pattern, REG_EXTENDED | REG_NOSUB)) {
+			ao2_t_ref(new_filter, -1, "failed to make regex");
+			return FILTER_COMPILE_FAIL;
+		}
+		new_filter->is_regex = 1;
+	} else if (!strncmp(filter_pattern, "Event: ", 7) && filter_pattern[7]) {
+		new_filter->event_name_filter = new_filter->string_filter + 7;
+		new_filter->event_name_filter_len = strlen(new_filter->event_name_filter);
 	}
 
 	if (is_blackfilter) {
@@ -5888,6 +5957,9 @@ static enum add_filter_result manager_add_filter(const char *filter_pattern, str
 static int match_filter(struct mansession *s, char *eventdata)
 {
 	int result = 0;
+	struct event_filter_data event = {
+		.eventdata = eventdata,
+	};
 
 	if (manager_debug) {
 		ast_verbose("<-- Examining AMI event: -->\n%s\n", eventdata);
@@ -5896,18 +5968,25 @@ static int match_filter(struct mansession *s, char *eventdata)
 	}
 	if (!ao2_container_count(s->session->whitefilters) && !ao2_container_count(s->session->blackfilters)) {
 		return 1; /* no filtering means match all */
-	} else if (ao2_container_count(s->session->whitefilters) && !ao2_container_count(s->session->blackfilters)) {
+	}
+
+	if (!strncmp(eventdata, "Event: ", 7)) {
+		event.event_name = eventdata + 7;
+		event.event_name_len = strcspn(event.event_name, "\r\n");
+	}
+
+	if (ao2_container_count(s->session->whitefilters) && !ao2_container_count(s->session->blackfilters)) {
 		/* white filters only: implied black all filter processed first, then white filters */
-		ao2_t_callback_data(s->session->whitefilters, OBJ_NODATA, whitefilter_cmp_fn, eventdata, &result, "find filter in session filter container");
+		ao2_t_callback_data(s->session->whitefilters, OBJ_NODATA, whitefilter_cmp_fn, &event, &result, "find filter in session filter container");
 	} else if (!ao2_container_count(s->session->whitefilters) && ao2_container_count(s->session->blackfilters)) {
 		/* black filters only: implied white all filter processed first, then black filters */
-		ao2_t_callback_data(s->session->blackfilters, OBJ_NODATA, blackfilter_cmp_fn, eventdata, &result, "find filter in session filter container");
+		ao2_t_callback_data(s->session->blackfilters, OBJ_NODATA, blackfilter_cmp_fn, &event, &result, "find filter in session filter container");
 	} else {
 		/* white and black filters: implied black all filter processed first, then white filters, and lastly black filters */
-		ao2_t_callback_data(s->session->whitefilters, OBJ_NODATA, whitefilter_cmp_fn, eventdata, &result, "find filter in session filter container");
+		ao2_t_callback_data(s->session->whitefilters, OBJ_NODATA, whitefilter_cmp_fn, &event, &result, "find filter in session filter container");
 		if (result) {
 			result = 0;
-			ao2_t_callback_data(s->session->blackfilters, OBJ_NODATA, blackfilter_cmp_fn, eventdata, &result, "find filter in session filter container");
+			ao2_t_callback_data(s->session->blackfilters, OBJ_NODATA, blackfilter_cmp_fn, &event, &result, "find filter in session filter container");
 		}
 	}
 
@@ -6783,10 +6862,126 @@ static void append_channel_vars(struct ast_str **pbuf, struct ast_channel *chan)
 	ao2_ref(vars, -1);
 }
 
+static int blackfilter_event_name_cmp_fn(void *obj, void *arg, int flags)
+{
+	struct event_filter_entry *regex_filter = obj;
+	const char *event = arg;
+
+	return filter_matches_event_name(regex_filter, event, strlen(event)) ? (CMP_MATCH | CMP_STOP) : 0;
+}
+
+/*!
+ * \internal
+ * \brief Check if a session may accept an event that has not been built yet.
+ *
+ * \note Only what can be decided from the event name and category is
+ * checked.  The filters are run on the complete event when the session
+ * processes it.
+ */
+static int session_may_want_event_cb(void *obj, void *arg, void *data, int flags)
+{
+	struct mansession_session *session = obj;
+	const char *event = arg;
+	int category = *(int *) data;
+	struct event_filter_entry *blackfilter;
+
+	if (!session->authenticated) {
+		/* The session may still log in before it processes the event. */
+		return CMP_MATCH | CMP_STOP;
+	}
+
+	if ((session->readperm & category) != category
+		|| (session->send_events & category) != category) {
+		return 0;
+	}
+
+	/* A matching plain "Event: " black filter rejects the event whatever follows. */
+	blackfilter = ao2_callback(session->blackfilters, 0, blackfilter_event_name_cmp_fn, (void *) event);
+	if (blackfilter) {
+		ao2_ref(blackfilter, -1);
+		return 0;
+	}
+
+	return CMP_MATCH | CMP_STOP;
+}
+
 /* XXX see if can be moved inside the function */
 AST_THREADSTORAGE(manager_event_buf);
 #define MANAGER_EVENT_BUF_INITSIZE   256
 
+/*! \brief Most events raised during a burst of routed messages before the sessions are woken anyway */
+#define MANAGER_BATCH_MAX_EVENTS 64
+/*! \brief Most milliseconds an event raised during a burst of routed messages waits for the sessions to be woken */
+#define MANAGER_BATCH_MAX_DELAY 20
+
+/*! \brief Session wakeups deferred by the thread delivering the manager router's messages */
+struct manager_event_batch {
+	/*! Events raised on this thread wake sessions at the end of the burst */
+	int active;
+	/*! Number of events appended since the sessions were last woken */
+	int pending;
+	/*! When the first of them was appended */
+	struct timeval first_pending;
+};
+
+AST_THREADSTORAGE(manager_event_batch);
+
+/*! \brief Wake up the sessions so they send the events appended for them */
+static void manager_wake_sessions(struct ao2_container *sessions)
+{
+	struct ao2_iterator iter;
+	struct mansession_session *session;
+
+	iter = ao2_iterator_init(sessions, 0);
+	while ((session = ao2_iterator_next(&iter))) {
+		ao2_lock(session);
+		if (session->waiting_thread != AST_PTHREADT_NULL) {
+			pthread_kill(session->waiting_thread, SIGURG);
+		} else {
+			/* We have an event to process, but the mansession is
+			 * not waiting for it. We still need to indicate that there
+			 * is an event waiting so that get_input processes the pending
+			 * event instead of polling.
+			 */
+			session->pending_event = 1;
+		}
+		ao2_unlock(session);
+		unref_mansession(session);
+	}
+	ao2_iterator_destroy(&iter);
+}
+
+/*!
+ * \brief Wake up the sessions once for a burst of routed messages
+ *
+ * The router delivers all of its messages on one thread.  Once it has
+ * reached the end of a burst, the events raised on that thread only mark
+ * the wakeup as pending, so a burst costs one signal per session rather
+ * than one per event.  A burst that goes on and on still wakes the sessions
+ * every MANAGER_BATCH_MAX_EVENTS events or MANAGER_BATCH_MAX_DELAY ms.
+ */
+static void manager_router_batch_cb(void *data, struct stasis_subscription *sub)
+{
+	struct manager_event_batch *batch;
+	struct ao2_container *sessions;
+
+	batch = ast_threadstorage_get(&manager_event_batch, sizeof(*batch));
+	if (!batch) {
+		return;
+	}
+	batch->active = 1;
+	if (!batch->pending) {
+		return;
+	}
+	batch->pending = 0;
+
+	sessions = ao2_global_obj_ref(mgr_sessions);
+	if (sessions) {
+		manager_wake_sessions(sessions);
+		ao2_ref(sessions, -1);
+	}
+}
+
 static int __attribute__((format(printf, 9, 0))) __manager_event_sessions_va(
 	struct ao2_container *sessions,
 	int category,
@@ -6805,6 +7000,17 @@ static int __attribute__((format(printf, 9, 0))) __manager_event_sessions_va(
 	struct ast_str *buf;
 	int i;
 
+	if (sessions && category != EVENT_FLAG_SHUTDOWN && AST_RWLIST_EMPTY(&manager_hooks)) {
+		struct mansession_session *session;
+
+		session = ao2_callback_data(sessions, 0, session_may_want_event_cb, (void *) event, &category);
+		if (!session) {
+			/* No session would accept the event so do not bother building it. */
+			return 0;
+		}
+		ao2_ref(session, -1);
+	}
+
 	buf = ast_str_thread_get(&manager_event_buf, MANAGER_EVENT_BUF_INITSIZE);
 	if (!buf) {
 		return -1;
@@ -6851,26 +7057,20 @@ static int __attribute__((format(printf, 9, 0))) __manager_event_sessions_va(
 
 	/* Wake up any sleeping sessions */
 	if (sessions) {
-		struct ao2_iterator iter;
-		struct mansession_session *session;
+		struct manager_event_batch *batch;
 
-		iter = ao2_iterator_init(sessions, 0);
-		while ((session = ao2_iterator_next(&iter))) {
-			ao2_lock(session);
-			if (session->waiting_thread != AST_PTHREADT_NULL) {
-				pthread_kill(session->waiting_thread, SIGURG);
-			} else {
-				/* We have an event to process, but the mansession is
-				 * not waiting for it. We still need to indicate that there
-				 * is an event waiting so that get_input processes the pending
-				 * event instead of polling.
-				 */
-				session->pending_event = 1;
-			}
-			ao2_unlock(session);
-			unref_mansession(session);
+		batch = ast_threadstorage_get(&manager_event_batch, sizeof(*batch));
+		if (!batch || !batch->active) {
+			manager_wake_sessions(sessions);
+		} else if (!batch->pending++) {
+			/* The router wakes them once it has delivered the whole burst. */
+			batch->first_pending = ast_tvnow();
+		} else if (batch->pending >= MANAGER_BATCH_MAX_EVENTS
+			|| ast_tvdiff_ms(ast_tvnow(), batch->first_pending) >= MANAGER_BATCH_MAX_DELAY) {
+			/* The burst is not letting up, so don't keep them waiting for its end. */
+			batch->pending = 0;
+			manager_wake_sessions(sessions);
 		}
-		ao2_iterator_destroy(&iter);
 	}
 
 	if (category != EVENT_FLAG_SHUTDOWN && !AST_RWLIST_EMPTY(&manager_hooks)) {
@@ -8650,6 +8850,104 @@ static void manager_free_user(struct ast_manager_user *user)
  * \internal
  * \brief Clean up resources on Asterisk shutdown
  */
+#ifdef TEST_FRAMEWORK
+/*! \brief Whether a session has been told it has events to send */
+static int test_session_woken(struct mansession_session *session)
+{
+	int woken;
+
+	ao2_lock(session);
+	woken = session->pending_event;
+	ao2_unlock(session);
+	return woken;
+}
+
+AST_TEST_DEFINE(event_burst_wakeup)
+{
+	struct ast_sockaddr addr;
+	struct mansession_session *session;
+	struct manager_event_batch *batch;
+	struct ao2_container *sessions;
+	struct ast_json *blob = NULL;
+	struct timeval start;
+	enum ast_test_result_state res = AST_TEST_FAIL;
+	int woken = 0;
+	int i;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "event_burst_wakeup";
+		info->category = "/main/manager/";
+		info->summary = "manager session wakeup during bursts of events";
+		info->description =
+			"Ensures that a session waiting for events is woken while events\n"
+			"keep being raised, without waiting for the burst to end.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	session = build_mansession(&addr);
+	if (!session) {
+		return AST_TEST_FAIL;
+	}
+
+	/* Raise the events as the router's thread does in the middle of a burst */
+	batch = ast_threadstorage_get(&manager_event_batch, sizeof(*batch));
+	if (!batch) {
+		goto cleanup;
+	}
+	batch->active = 1;
+	batch->pending = 0;
+	for (i = 0; i <= MANAGER_BATCH_MAX_EVENTS && !woken; ++i) {
+		manager_event(EVENT_FLAG_TEST, "TestEvent", "Count: %d\r\n", i);
+		woken = test_session_woken(session);
+	}
+	batch->active = 0;
+	batch->pending = 0;
+	if (!woken) {
+		ast_test_status_update(test, "Session not woken by %d events in a burst\n",
+			MANAGER_BATCH_MAX_EVENTS);
+		goto cleanup;
+	}
+	if (i == 1) {
+		ast_test_status_update(test, "Session woken by the first event of a burst\n");
+		goto cleanup;
+	}
+
+	/* Publishing without pause keeps the router's burst going */
+	ao2_lock(session);
+	session->pending_event = 0;
+	ao2_unlock(session);
+	blob = ast_json_pack("{s: s}", "Test", "burst");
+	if (!blob) {
+		goto cleanup;
+	}
+	woken = 0;
+	start = ast_tvnow();
+	while (!woken && ast_tvdiff_ms(ast_tvnow(), start) < 5000) {
+		ast_manager_publish_event("TestEvent", EVENT_FLAG_TEST, blob);
+		woken = test_session_woken(session);
+	}
+	if (!woken) {
+		ast_test_status_update(test, "Session not woken while events were published\n");
+		goto cleanup;
+	}
+	res = AST_TEST_PASS;
+
+cleanup:
+	ast_json_unref(blob);
+	sessions = ao2_global_obj_ref(mgr_sessions);
+	if (sessions) {
+		ao2_unlink(sessions, session);
+		ao2_ref(sessions, -1);
+	}
+	unref_mansession(session);
+	return res;
+}
+#endif
+
 static void manager_shutdown(void)
 {
 	struct ast_manager_user *user;
@@ -8704,6 +9002,7 @@ static void manager_shutdown(void)
 #ifdef TEST_FRAMEWORK
 	stasis_forward_cancel(test_suite_forwarder);
 	test_suite_forwarder = NULL;
+	AST_TEST_UNREGISTER(event_burst_wakeup);
 #endif
 
 	if (stasis_router) {
@@ -8766,6 +9065,9 @@ static int manager_subscriptions_init(void)
 	res |= stasis_message_router_set_default(stasis_router,
 		manager_default_msg_cb, NULL);
 
+	res |= stasis_message_router_set_batch_callback(stasis_router,
+		manager_router_batch_cb, NULL);
+
 	res |= stasis_message_router_add(stasis_router,
 		ast_manager_get_generic_type(), manager_generic_msg_cb, NULL);
 
@@ -8904,6 +9206,7 @@ static int __init_manager(int reload, int by_external_config)
 
 #ifdef TEST_FRAMEWORK
 		test_suite_forwarder = stasis_forward_all(ast_test_suite_topic(), manager_topic);
+		AST_TEST_REGISTER(event_burst_wakeup);
 #endif
 
 		ast_cli_register_multiple(cli_manager, ARRAY_LEN(cli_manager));
@@ -66,6 +66,7 @@
 #include "asterisk/module.h"
 #include "asterisk/indications.h"
 #include "asterisk/taskprocessor.h"
+#include "asterisk/threadpool.h"
 #include "asterisk/xmldoc.h"
 #include "asterisk/astobj2.h"
 #include "asterisk/stasis_channels.h"
@@ -286,6 +287,8 @@ struct ast_context {
 	struct ast_exten *root;			/*!< The root of the list of extensions */
 	struct ast_hashtab *root_table;            /*!< For exact matches on the extensions in the pattern tree, and for traversals of the pattern_tree  */
 	struct match_char *pattern_tree;        /*!< A tree to speed up extension pattern matching */
+	struct pattern_dfa *pattern_dfa;        /*!< Extension patterns compiled when the dialplan was loaded */
+	struct pattern_dfa *retired_dfa;        /*!< Compiled extensions gone out of date, kept for lookups still using them */
 	struct ast_context *next;		/*!< Link them together */
 	struct ast_includes includes;		/*!< Include other contexts */
 	struct ast_ignorepats ignorepats;	/*!< Patterns for which to continue playing dialtone */
@@ -313,6 +316,8 @@ struct ast_state_cb {
 	AST_LIST_ENTRY(ast_state_cb) entry;
 };
 
+struct ast_hintdevice;
+
 /*!
  * \brief Structure for dial plan hints
  *
@@ -342,7 +347,15 @@ struct ast_hint {
 	char context_name[AST_MAX_CONTEXT];/*!< Context of destroyed hint extension. */
 	char exten_name[AST_MAX_EXTENSION];/*!< Extension of destroyed hint extension. */
 
-	AST_VECTOR(, char *) devices; /*!< Devices associated with the hint */
+	AST_VECTOR(, struct ast_hintdevice *) devices; /*!< Devices associated with the hint */
+	/*! Number of the devices making up the device state in each device state */
+	int device_counts[AST_DEVICE_TOTAL];
+	/*! Index of the hint serializer notifying the watchers of device state changes */
+	unsigned int serializer;
+	/*! Whether a device state notification is waiting on the serializer */
+	int notify_queued;
+	/*! Whether the devices changed and their states are not known until refreshed */
+	int devices_unknown;
 };
 
 STASIS_MESSAGE_TYPE_DEFN_LOCAL(hint_change_message_type);
@@ -361,6 +374,21 @@ AST_THREADSTORAGE(hintdevice_data);
 /*! \brief Container for hint devices */
 static struct ao2_container *hintdevices;
 
+/*! \brief Threads the hint threadpool starts with */
+#define HINT_THREADPOOL_INITIAL_SIZE 5
+
+/*! \brief Threadpool running the hint serializers */
+static struct ast_threadpool *hint_threadpool;
+
+/*!
+ * \brief Serializers notifying the watchers of hints
+ *
+ * There is one for each thread of the hint threadpool.  Every hint is
+ * hashed onto one of them, so the notifications of a hint stay in order
+ * without a taskprocessor for each hint.
+ */
+static AST_VECTOR(, struct ast_taskprocessor *) hint_serializers;
+
 /*!
  * \brief Structure for dial plan hint devices
  * \note hintdevice is one device pointing to a hint.
@@ -371,6 +399,13 @@ struct ast_hintdevice {
 	 * \note Holds a reference to the hint object.
 	 */
 	struct ast_hint *hint;
+	/*! Last known state of the device, protected by the hint lock */
+	enum ast_device_state state;
+	/*!
+	 * \brief Whether the device makes up the device state of the hint
+	 * \note Cleared for presence providers and when the device is removed from the hint.
+	 */
+	int aggregated;
 	/*! Name of the hint device. */
 	char hintdevice[1];
 };
@@ -499,35 +534,23 @@ static int autohint_cmp(void *obj, void *arg, int flags)
 	return cmp ? 0 : CMP_MATCH | CMP_STOP;
 }
 
-/*! \internal \brief \c ao2_callback function to remove hintdevices */
-static int hintdevice_remove_cb(void *obj, void *arg, void *data, int flags)
-{
-	struct ast_hintdevice *candidate = obj;
-	char *device = arg;
-	struct ast_hint *hint = data;
-
-	if (!strcasecmp(candidate->hintdevice, device)
-		&& candidate->hint == hint) {
-		return CMP_MATCH;
-	}
-	return 0;
-}
-
 static int remove_hintdevice(struct ast_hint *hint)
 {
+	ao2_lock(hint);
 	while (AST_VECTOR_SIZE(&hint->devices) > 0) {
-		char *device = AST_VECTOR_GET(&hint->devices, 0);
+		struct ast_hintdevice *device = AST_VECTOR_REMOVE_UNORDERED(&hint->devices, 0);
 
-		ao2_t_callback_data(hintdevices, OBJ_SEARCH_KEY | OBJ_UNLINK | OBJ_NODATA,
-			hintdevice_remove_cb, device, hint, "Remove device from container");
-		AST_VECTOR_REMOVE_UNORDERED(&hint->devices, 0);
-		ast_free(device);
+		/* An update for the device may still be under way, make it ignore the device */
+		device->aggregated = 0;
+		ao2_t_unlink(hintdevices, device, "Remove device from container");
+		ao2_t_ref(device, -1, "Remove device from hint");
 	}
+	memset(hint->device_counts, 0, sizeof(hint->device_counts));
+	ao2_unlock(hint);
 
 	return 0;
 }
 
-static char *parse_hint_device(struct ast_str *hint_args);
 /*!
  * \internal
  * \brief Destroy the given hintdevice object.
@@ -546,15 +569,59 @@ static void hintdevice_destroy(void *obj)
 	}
 }
 
+/*!
+ * \internal
+ * \brief Add a device to a hint and link it into the container.
+ *
+ * \param hint Hint the device belongs to.
+ * \param name Name of the device.
+ * \param aggregated Whether the device makes up the device state of the hint.
+ * \param query Whether to get the current state of the device now.  If not, the
+ * state is unknown until the hint devices are refreshed.
+ *
+ * \retval 0 on success.
+ * \retval -1 on error.
+ */
+static int add_hintdevice_one(struct ast_hint *hint, const char *name, int aggregated, int query)
+{
+	struct ast_hintdevice *device;
+
+	device = ao2_t_alloc(sizeof(*device) + strlen(name), hintdevice_destroy,
+		"allocating a hintdevice structure");
+	if (!device) {
+		return -1;
+	}
+	strcpy(device->hintdevice, name);
+	device->state = query && aggregated ? ast_device_state(name) : AST_DEVICE_UNKNOWN;
+	ao2_ref(hint, +1);
+	device->hint = hint;
+
+	ao2_lock(hint);
+	if (AST_VECTOR_APPEND(&hint->devices, device)) {
+		ao2_unlock(hint);
+		ao2_ref(device, -1);
+		return -1;
+	}
+	device->aggregated = aggregated;
+	if (aggregated) {
+		++hint->device_counts[device->state];
+	}
+	ao2_unlock(hint);
+
+	/* The hint holds the reference for the container, which remove_hintdevice() gives up */
+	ao2_t_link(hintdevices, device, "Linking device into hintdevice container.");
+
+	return 0;
+}
+
 /*! \brief add hintdevice structure and link it into the container.
  */
-static int add_hintdevice(struct ast_hint *hint, const char *devicelist)
+static int add_hintdevice(struct ast_hint *hint, const char *devicelist, int query)
 {
 	struct ast_str *str;
 	char *parse;
+	char *presence;
 	char *cur;
-	struct ast_hintdevice *device;
-	int devicelength;
 
 	if (!hint || !devicelist) {
 		/* Trying to add garbage? Don't bother. */
@@ -566,41 +633,101 @@ static int add_hintdevice(struct ast_hint *hint, const char *devicelist)
 	ast_str_set(&str, 0, "%s", devicelist);
 	parse = ast_str_buffer(str);
 
-	/* Spit on '&' and ',' to handle presence hints as well */
-	while ((cur = strsep(&parse, "&,"))) {
-		char *device_name;
-
-		devicelength = strlen(cur);
-		if (!devicelength) {
-			continue;
-		}
+	/* The presence providers follow the last ',', the same as parse_hint_presence() */
+	if ((presence = strrchr(parse, ','))) {
+		*presence++ = '\0';
+	}
 
-		device_name = ast_strdup(cur);
-		if (!device_name) {
+	/* The devices are separated by '&', the same as ast_extension_state3() */
+	while ((cur = strsep(&parse, "&"))) {
+		if (!ast_strlen_zero(cur) && add_hintdevice_one(hint, cur, 1, query)) {
 			return -1;
 		}
+	}
 
-		device = ao2_t_alloc(sizeof(*device) + devicelength, hintdevice_destroy,
-			"allocating a hintdevice structure");
-		if (!device) {
-			ast_free(device_name);
-			return -1;
-		}
-		strcpy(device->hintdevice, cur);
-		ao2_ref(hint, +1);
-		device->hint = hint;
-		if (AST_VECTOR_APPEND(&hint->devices, device_name)) {
-			ast_free(device_name);
-			ao2_ref(device, -1);
+	/* Spit on '&' and ',' to handle presence hints as well */
+	while ((cur = strsep(&presence, "&,"))) {
+		if (!ast_strlen_zero(cur) && add_hintdevice_one(hint, cur, 0, 0)) {
 			return -1;
 		}
-		ao2_t_link(hintdevices, device, "Linking device into hintdevice container.");
-		ao2_t_ref(device, -1, "hintdevice is linked so we can unref");
 	}
 
 	return 0;
 }
 
+/*!
+ * \internal
+ * \brief Get the extension state of a hint from the cached states of its devices.
+ *
+ * \note The hint must be locked.
+ *
+ * \note Devices in an empty or invalid state do not change the aggregate, so
+ * this gives the same state as ast_extension_state3() on the hint.
+ */
+static int hint_device_state(struct ast_hint *hint)
+{
+	struct ast_devstate_aggregate agg;
+	enum ast_device_state state;
+
+	/* The aggregate depends only on which states are present, not how often */
+	ast_devstate_aggregate_init(&agg);
+	for (state = 0; state < AST_DEVICE_TOTAL; ++state) {
+		if (hint->device_counts[state]) {
+			ast_devstate_aggregate_add(&agg, state);
+		}
+	}
+
+	return ast_devstate_to_extenstate(ast_devstate_aggregate_result(&agg));
+}
+
+/*!
+ * \internal
+ * \brief Update the cached state of a hint device.
+ *
+ * \note The hint must be locked.
+ */
+static void hint_device_set_state(struct ast_hint *hint, struct ast_hintdevice *device,
+	enum ast_device_state state)
+{
+	if (!device->aggregated || device->state == state) {
+		return;
+	}
+	--hint->device_counts[device->state];
+	++hint->device_counts[state];
+	device->state = state;
+}
+
+/*!
+ * \internal
+ * \brief Get the current state of every device of a hint.
+ *
+ * \note The hint must not be locked, the device states are
+ * gotten without holding any locks.
+ */
+static void hint_devices_refresh(struct ast_hint *hint)
+{
+	struct ast_hintdevice *device;
+	enum ast_device_state state;
+	int i;
+
+	ao2_lock(hint);
+	for (i = 0; i < AST_VECTOR_SIZE(&hint->devices); ++i) {
+		device = AST_VECTOR_GET(&hint->devices, i);
+		if (!device->aggregated) {
+			continue;
+		}
+		ao2_ref(device, +1);
+		ao2_unlock(hint);
+
+		state = ast_device_state(device->hintdevice);
+
+		ao2_lock(hint);
+		hint_device_set_state(hint, device, state);
+		ao2_ref(device, -1);
+	}
+	hint->devices_unknown = 0;
+	ao2_unlock(hint);
+}
 
 static const struct cfextension_states {
 	int extension_state;
@@ -655,6 +782,7 @@ static int ast_add_extension2_lockopt(struct ast_context *con,
 	const char *registrar, const char *registrar_file, int registrar_line,
 	int lock_context);
 static struct ast_context *find_context_locked(const char *context);
+static struct ast_context *find_context_in(struct ast_hashtab *table, const char *context);
 static struct ast_context *find_context(const char *context);
 static void get_device_state_causing_channels(struct ao2_container *c);
 static int ext_strncpy(char *dst, const char *src, int len, int nofluff);
@@ -761,6 +889,7 @@ static unsigned int hashtab_hash_labels(const void *obj)
 
 static int autofallthrough = 1;
 static int extenpatternmatchnew = 0;
+static int extenpatterncompile = 0;
 static char *overrideswitch = NULL;
 
 /*! \brief Subscription for device state change events */
@@ -780,9 +909,161 @@ static struct ast_hashtab *contexts_table = NULL;
  * \note
  * This lock MUST be recursive, or a deadlock on reload may result.  See
  * https://issues.asterisk.org/view.php?id=17643
+ *
+ * \note Holding it also write locks the current dialplan version, so holders
+ * of conlock are alone with the dialplan as they always were.
  */
 AST_MUTEX_DEFINE_STATIC(conlock);
 
+/*!
+ * \brief A published version of the dialplan
+ *
+ * Extension lookups pin the current version with a reference and read lock
+ * it, instead of taking conlock.  ast_merge_contexts_and_delete() builds the
+ * new dialplan off to the side and publishes it as a new version, so lookups
+ * never wait for a reload.  The old version is destroyed once the lookups
+ * still reading it are done.
+ */
+struct dialplan_version {
+	/*! Read locked by lookups, write locked while the dialplan is changed in place */
+	ast_rwlock_t lock;
+	/*! The contexts of this version */
+	struct ast_hashtab *table;
+	/*! Set once a newer version is published, this one is about to be destroyed */
+	int retired;
+};
+
+/*! \brief The current dialplan version */
+static AO2_GLOBAL_OBJ_STATIC(current_dialplan);
+
+/*! \brief What the dialplan locks of a thread are */
+struct dialplan_thread_state {
+	/*! Number of times conlock is held through ast_wrlock_contexts() and friends */
+	int depth;
+	/*! Number of lookups pinning a dialplan version */
+	int pins;
+	/*! Version write locked while conlock is held */
+	struct dialplan_version *locked;
+};
+
+AST_THREADSTORAGE(dialplan_thread_state);
+
+static void dialplan_version_destructor(void *obj)
+{
+	struct dialplan_version *version = obj;
+
+	ast_rwlock_destroy(&version->lock);
+}
+
+static struct dialplan_version *dialplan_version_alloc(struct ast_hashtab *table)
+{
+	struct dialplan_version *version;
+
+	version = ao2_alloc_options(sizeof(*version), dialplan_version_destructor,
+		AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!version) {
+		return NULL;
+	}
+	ast_rwlock_init(&version->lock);
+	version->table = table;
+
+	return version;
+}
+
+/*!
+ * \internal
+ * \brief Publish a new dialplan version in place of the current one
+ *
+ * \note Steals the reference to \a version.
+ */
+static void dialplan_replace(struct dialplan_version *version)
+{
+	struct dialplan_version *old;
+
+	old = ao2_global_obj_replace(current_dialplan, version);
+	ao2_ref(version, -1);
+	if (old) {
+		old->retired = 1;
+		ao2_ref(old, -1);
+	}
+}
+
+/*!
+ * \internal
+ * \brief Write lock the current dialplan version
+ *
+ * \return The locked version, to unlock and unref, NULL if there is none.
+ */
+static struct dialplan_version *dialplan_wrlock_current(void)
+{
+	for (;;) {
+		struct dialplan_version *version = ao2_global_obj_ref(current_dialplan);
+
+		if (!version) {
+			return NULL;
+		}
+
+		ast_rwlock_wrlock(&version->lock);
+		/* A reload may have published a new version while we waited */
+		if (!version->retired) {
+			return version;
+		}
+		ast_rwlock_unlock(&version->lock);
+		ao2_ref(version, -1);
+	}
+}
+
+/*!
+ * \internal
+ * \brief Start looking up extensions
+ *
+ * Pins the current dialplan version, which a reload leaves alone.  A thread
+ * already holding conlock looks up in the current dialplan under it as before.
+ *
+ * \param[out] version The pinned version, to give to dialplan_lookup_end().
+ *
+ * \return The contexts to look up in.
+ */
+static struct ast_hashtab *dialplan_lookup_start(struct dialplan_version **version)
+{
+	struct dialplan_thread_state *state;
+
+	state = ast_threadstorage_get(&dialplan_thread_state, sizeof(*state));
+	for (;;) {
+		*version = state && !state->depth ? ao2_global_obj_ref(current_dialplan) : NULL;
+		if (!*version) {
+			ast_rdlock_contexts();
+			return contexts_table;
+		}
+
+		ast_rwlock_rdlock(&(*version)->lock);
+		/* Pinned just as a reload published a newer version */
+		if (!(*version)->retired) {
+			break;
+		}
+		ast_rwlock_unlock(&(*version)->lock);
+		ao2_ref(*version, -1);
+	}
+	++state->pins;
+
+	return (*version)->table;
+}
+
+static void dialplan_lookup_end(struct dialplan_version *version)
+{
+	struct dialplan_thread_state *state;
+
+	if (!version) {
+		ast_unlock_contexts();
+		return;
+	}
+
+	state = ast_threadstorage_get(&dialplan_thread_state, sizeof(*state));
+	--state->pins;
+	ast_rwlock_unlock(&version->lock);
+	ao2_ref(version, -1);
+}
+
 /*!
  * \brief Lock to hold off restructuring of hints by ast_merge_contexts_and_delete.
  */
@@ -2413,6 +2694,8 @@ struct fake_context /* this struct is purely for matching in the hashtab */
 	struct ast_exten *root;
 	struct ast_hashtab *root_table;
 	struct match_char *pattern_tree;
+	struct pattern_dfa *pattern_dfa;
+	struct pattern_dfa *retired_dfa;
 	struct ast_context *next;
 	struct ast_includes includes;
 	struct ast_ignorepats ignorepats;
@@ -2424,49 +2707,723 @@ struct fake_context /* this struct is purely for matching in the hashtab */
 	char name[256];
 };
 
-struct ast_context *ast_context_find(const char *name)
+struct ast_context *ast_context_find(const char *name)
+{
+	struct ast_context *tmp;
+	struct fake_context item;
+	struct dialplan_version *version;
+	struct ast_hashtab *table;
+
+	if (!name) {
+		return NULL;
+	}
+	table = dialplan_lookup_start(&version);
+	if (table) {
+		ast_copy_string(item.name, name, sizeof(item.name));
+		tmp = ast_hashtab_lookup(table, &item);
+	} else {
+		tmp = NULL;
+		while ((tmp = ast_walk_contexts(tmp))) {
+			if (!strcasecmp(name, tmp->name)) {
+				break;
+			}
+		}
+	}
+	dialplan_lookup_end(version);
+	return tmp;
+}
+
+#define STATUS_NO_CONTEXT	1
+#define STATUS_NO_EXTENSION	2
+#define STATUS_NO_PRIORITY	3
+#define STATUS_NO_LABEL		4
+#define STATUS_SUCCESS		5
+
+static int matchcid(const char *cidpattern, const char *callerid)
+{
+	/* If the Caller*ID pattern is empty, then we're matching NO Caller*ID, so
+	   failing to get a number should count as a match, otherwise not */
+
+	if (ast_strlen_zero(callerid)) {
+		return ast_strlen_zero(cidpattern) ? 1 : 0;
+	}
+
+	return ast_extension_match(cidpattern, callerid);
+}
+
+/*
+ * Compiled extension patterns.
+ *
+ * The linear scan in find_extension_in() compares the dialed digits with every
+ * extension of a context in turn, until one matches.  With thousands of
+ * patterns in a context, as rate decks have, that is a lot of comparing, and
+ * overlap dialing does it all again for every digit.
+ *
+ * When extenpatterncompile is set, the extensions of each context are compiled
+ * into a deterministic automaton when the dialplan is loaded.  Each state of
+ * the automaton stands for every extension the digits so far could still
+ * match, and how far along each is.  Walking it with the dialed digits finds
+ * the extension the scan would first stop at, for each match mode, in time
+ * proportional to the digits rather than the extensions.  The scan carries on
+ * from there, so the results are exactly those of the scan.
+ *
+ * A context changed after it is compiled drops its automaton and goes back to
+ * the scan until the dialplan is next reloaded.
+ */
+
+/*!
+ * \brief Most states the patterns of a context may compile into
+ *
+ * Patterns that overlap so much that they need more are left to the scan.
+ */
+#define PATTERN_DFA_MAX_STATES (1 << 21)
+
+/*! \brief Tests for digit classes, after those for each single character */
+#define PATTERN_DFA_TEST_N 256
+#define PATTERN_DFA_TEST_X 257
+#define PATTERN_DFA_TEST_Z 258
+/*! \brief Tests for character sets, added as they are found */
+#define PATTERN_DFA_TEST_SETS 259
+
+/*! \brief Steps of a compiled extension, other than the tests of a character */
+enum pattern_dfa_step {
+	/*! The end of the extension */
+	PATTERN_DFA_END = -1,
+	/*! A '.', matching whatever more is dialed */
+	PATTERN_DFA_DOT = -2,
+	/*! A '!', matching early whatever more is dialed */
+	PATTERN_DFA_BANG = -3,
+	/*! An empty character set, skipped when more is dialed */
+	PATTERN_DFA_EMPTY = -4,
+	/*! A character set without its ']', failing when more is dialed */
+	PATTERN_DFA_BROKEN = -5,
+};
+
+/*! \brief Where an extension is, other than before one of its steps */
+enum pattern_dfa_pos {
+	/*! The extension can no longer match */
+	PATTERN_DFA_DEAD = -1,
+	/*! Matched by a '.' */
+	PATTERN_DFA_MATCHED = -2,
+	/*! Matched early by a '!' */
+	PATTERN_DFA_EARLY = -3,
+};
+
+/*! \brief The characters a step of a compiled extension accepts */
+struct pattern_dfa_test {
+	unsigned char bits[32];
+};
+
+/*! \brief What a state of a compiled context matches */
+struct pattern_dfa_state {
+	/*! First extension matching in each match mode, or the number of extensions */
+	int first[E_MATCH + 1];
+	/*! First extension not matching on caller id in each match mode */
+	int first_nocid[E_MATCH + 1];
+};
+
+/*! \brief The extensions of a context compiled into a deterministic automaton */
+struct pattern_dfa {
+	/*! Number of classes of characters the extensions tell apart */
+	int nclasses;
+	/*! The class of each character */
+	unsigned char classes[256];
+	/*! The next state for each state and class; state 0 matches nothing and state 1 is the start */
+	AST_VECTOR(, int) next;
+	/*! What each state matches */
+	AST_VECTOR(, struct pattern_dfa_state) states;
+	/*! The extensions of the context, in the order they are scanned */
+	AST_VECTOR(, struct ast_exten *) extens;
+	/*! Indexes of the extensions matching on caller id, ascending */
+	AST_VECTOR(, int) cid;
+	/*! The automaton the context retired before this one */
+	struct pattern_dfa *retired;
+};
+
+/*! \brief An extension and where it is in its steps */
+struct pattern_dfa_entry {
+	int exten;
+	int pos;
+};
+
+/*! \brief Working storage while compiling a context */
+struct pattern_dfa_build {
+	/*! Steps of all the extensions, each run of them ending in one that never advances */
+	AST_VECTOR(, int) steps;
+	/*! Tests the steps refer to */
+	AST_VECTOR(, struct pattern_dfa_test) tests;
+	/*! Which of the single character and digit class tests a step refers to */
+	unsigned char used[PATTERN_DFA_TEST_SETS];
+	/*! Entries of all the states, each state's run of them ordered by extension */
+	AST_VECTOR(, struct pattern_dfa_entry) entries;
+	/*! Where the entries of each state start, and where the last ends */
+	AST_VECTOR(, int) offsets;
+	/*! Hash of the entries of each state */
+	AST_VECTOR(, unsigned int) hashes;
+	/*! States by their entries, open addressed; 0 is an empty slot */
+	int *table;
+	/*! Size of the table, a power of two */
+	int table_size;
+	/*! Representative character of each class */
+	unsigned char reps[256];
+};
+
+static void pattern_dfa_test_add(struct pattern_dfa_test *test, unsigned char c)
+{
+	test->bits[c >> 3] |= 1 << (c & 7);
+}
+
+static int pattern_dfa_test_has(const struct pattern_dfa_test *test, unsigned char c)
+{
+	return test->bits[c >> 3] & (1 << (c & 7));
+}
+
+static void pattern_dfa_destroy(struct pattern_dfa *dfa)
+{
+	if (!dfa) {
+		return;
+	}
+	AST_VECTOR_FREE(&dfa->next);
+	AST_VECTOR_FREE(&dfa->states);
+	AST_VECTOR_FREE(&dfa->extens);
+	AST_VECTOR_FREE(&dfa->cid);
+	ast_free(dfa);
+}
+
+/*!
+ * \internal
+ * \brief Whether a character set of a pattern has a character
+ *
+ * The same as the comparison in _extension_match_core().
+ */
+static int pattern_set_has(const char *pattern, const char *end, char c)
+{
+	for (; pattern < end; ++pattern) {
+		if (pattern + 2 < end && pattern[1] == '-') {
+			if (c >= pattern[0] && c <= pattern[2]) {
+				return 1;
+			}
+			pattern += 2;
+		} else if (c == pattern[0]) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static int pattern_dfa_add_test_step(struct pattern_dfa_build *build, int test)
+{
+	if (test < PATTERN_DFA_TEST_SETS) {
+		build->used[test] = 1;
+	}
+	return AST_VECTOR_APPEND(&build->steps, test);
+}
+
+/*!
+ * \internal
+ * \brief Compile an extension into steps
+ *
+ * Follows _extension_match_core() for what each character of the extension
+ * does.
+ *
+ * \retval 0 on success
+ * \retval -1 on allocation failure
+ */
+static int pattern_dfa_parse(struct pattern_dfa_build *build, const char *exten)
+{
+	struct pattern_dfa_test set;
+	const char *end;
+	int c;
+	int res = 0;
+
+	if (exten[0] != '_') {
+		/* Not a pattern, so every character but fluff is compared */
+		for (; *exten; ++exten) {
+			if (*exten != '-') {
+				res |= pattern_dfa_add_test_step(build, (unsigned char) *exten);
+			}
+		}
+		return res | AST_VECTOR_APPEND(&build->steps, PATTERN_DFA_END);
+	}
+
+	for (++exten; ; ++exten) {
+		while (*exten == '-') {
+			++exten;
+		}
+		switch (*exten) {
+		case '\0':
+		case '/':
+			return res | AST_VECTOR_APPEND(&build->steps, PATTERN_DFA_END);
+		case '[':
+			end = strchr(++exten, ']');
+			if (!end) {
+				return res | AST_VECTOR_APPEND(&build->steps, PATTERN_DFA_BROKEN);
+			}
+			if (exten == end) {
+				res |= AST_VECTOR_APPEND(&build->steps, PATTERN_DFA_EMPTY);
+				break;
+			}
+			memset(&set, 0, sizeof(set));
+			for (c = 1; c < 256; ++c) {
+				if (pattern_set_has(exten, end, c)) {
+					pattern_dfa_test_add(&set, c);
+				}
+			}
+			res |= AST_VECTOR_APPEND(&build->tests, set);
+			res |= pattern_dfa_add_test_step(build, AST_VECTOR_SIZE(&build->tests) - 1);
+			exten = end;
+			break;
+		case 'n':
+		case 'N':
+			res |= pattern_dfa_add_test_step(build, PATTERN_DFA_TEST_N);
+			break;
+		case 'x':
+		case 'X':
+			res |= pattern_dfa_add_test_step(build, PATTERN_DFA_TEST_X);
+			break;
+		case 'z':
+		case 'Z':
+			res |= pattern_dfa_add_test_step(build, PATTERN_DFA_TEST_Z);
+			break;
+		case '.':
+			return res | AST_VECTOR_APPEND(&build->steps, PATTERN_DFA_DOT);
+		case '!':
+			return res | AST_VECTOR_APPEND(&build->steps, PATTERN_DFA_BANG);
+		default:
+			res |= pattern_dfa_add_test_step(build, (unsigned char) *exten);
+			break;
+		}
+	}
+}
+
+/*!
+ * \internal
+ * \brief Split the characters into classes no test tells apart
+ */
+static void pattern_dfa_classify(struct pattern_dfa_build *build, struct pattern_dfa *dfa)
+{
+	int remap[512];
+	size_t test;
+	int c;
+
+	dfa->nclasses = 1;
+	memset(dfa->classes, 0, sizeof(dfa->classes));
+	for (test = 0; test < AST_VECTOR_SIZE(&build->tests); ++test) {
+		const struct pattern_dfa_test *bits = AST_VECTOR_GET_ADDR(&build->tests, test);
+
+		if (test < PATTERN_DFA_TEST_SETS && !build->used[test]) {
+			continue;
+		}
+		memset(remap, -1, sizeof(remap));
+		dfa->nclasses = 0;
+		for (c = 0; c < 256; ++c) {
+			int key = dfa->classes[c] * 2 + !!pattern_dfa_test_has(bits, c);
+
+			if (remap[key] < 0) {
+				remap[key] = dfa->nclasses++;
+				build->reps[remap[key]] = c;
+			}
+			dfa->classes[c] = remap[key];
+		}
+	}
+}
+
+/*!
+ * \internal
+ * \brief Where an extension is after one more character
+ */
+static int pattern_dfa_advance(const struct pattern_dfa_build *build, int pos, unsigned char c)
+{
+	int step;
+
+	if (pos < 0) {
+		/* Matched, whatever more is dialed */
+		return pos;
+	}
+	while ((step = AST_VECTOR_GET(&build->steps, pos)) == PATTERN_DFA_EMPTY) {
+		++pos;
+	}
+	switch (step) {
+	case PATTERN_DFA_END:
+	case PATTERN_DFA_BROKEN:
+		return PATTERN_DFA_DEAD;
+	case PATTERN_DFA_DOT:
+		return PATTERN_DFA_MATCHED;
+	case PATTERN_DFA_BANG:
+		return PATTERN_DFA_EARLY;
+	}
+	return pattern_dfa_test_has(AST_VECTOR_GET_ADDR(&build->tests, step), c) ? pos + 1 : PATTERN_DFA_DEAD;
+}
+
+/*!
+ * \internal
+ * \brief What _extension_match_core() returns for an extension when the digits end where it is
+ */
+static int pattern_dfa_status(const struct pattern_dfa_build *build, int pos, enum ext_match_t mode)
+{
+	switch (pos) {
+	case PATTERN_DFA_MATCHED:
+		return 1;
+	case PATTERN_DFA_EARLY:
+		return 2;
+	}
+	switch (AST_VECTOR_GET(&build->steps, pos)) {
+	case PATTERN_DFA_END:
+		return mode == E_MATCHMORE ? 0 : 1;
+	case PATTERN_DFA_BANG:
+		return 2;
+	}
+	return mode == E_MATCH ? 0 : 1;
+}
+
+static int pattern_dfa_grow_table(struct pattern_dfa_build *build)
+{
+	int size = build->table_size ? build->table_size * 2 : 1024;
+	int *table;
+	size_t id;
+
+	table = ast_calloc(size, sizeof(*table));
+	if (!table) {
+		return -1;
+	}
+	for (id = 1; id < AST_VECTOR_SIZE(&build->hashes); ++id) {
+		int slot = AST_VECTOR_GET(&build->hashes, id) & (size - 1);
+
+		while (table[slot]) {
+			slot = (slot + 1) & (size - 1);
+		}
+		table[slot] = id;
+	}
+	ast_free(build->table);
+	build->table = table;
+	build->table_size = size;
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Find or add the state whose entries were appended from tail on
+ *
+ * \return the state
+ * \retval -1 on allocation failure or too many states
+ */
+static int pattern_dfa_intern(struct pattern_dfa_build *build, struct pattern_dfa *dfa, size_t tail)
+{
+	size_t count = AST_VECTOR_SIZE(&build->entries) - tail;
+	struct pattern_dfa_state state;
+	unsigned int hash = 5381;
+	enum ext_match_t mode;
+	size_t idx;
+	int slot;
+	int id;
+
+	if (!count) {
+		return 0;
+	}
+
+	for (idx = tail; idx < AST_VECTOR_SIZE(&build->entries); ++idx) {
+		const struct pattern_dfa_entry *entry = AST_VECTOR_GET_ADDR(&build->entries, idx);
+
+		hash = (hash * 33) ^ entry->exten;
+		hash = (hash * 33) ^ entry->pos;
+	}
+
+	for (slot = hash & (build->table_size - 1); (id = build->table[slot]); slot = (slot + 1) & (build->table_size - 1)) {
+		int start = AST_VECTOR_GET(&build->offsets, id);
+
+		if (AST_VECTOR_GET(&build->hashes, id) == hash
+			&& AST_VECTOR_GET(&build->offsets, id + 1) - start == count
+			&& !memcmp(AST_VECTOR_GET_ADDR(&build->entries, start),
+				AST_VECTOR_GET_ADDR(&build->entries, tail), count * sizeof(struct pattern_dfa_entry))) {
+			/* Already have it, so drop the copy */
+			build->entries.current = tail;
+			return id;
+		}
+	}
+
+	id = AST_VECTOR_SIZE(&dfa->states);
+	if (id >= PATTERN_DFA_MAX_STATES) {
+		return -1;
+	}
+
+	for (mode = E_MATCHMORE; mode <= E_MATCH; ++mode) {
+		state.first[mode] = AST_VECTOR_SIZE(&dfa->extens);
+		state.first_nocid[mode] = AST_VECTOR_SIZE(&dfa->extens);
+	}
+	for (idx = tail; idx < AST_VECTOR_SIZE(&build->entries); ++idx) {
+		const struct pattern_dfa_entry *entry = AST_VECTOR_GET_ADDR(&build->entries, idx);
+		int nocid = !AST_VECTOR_GET(&dfa->extens, entry->exten)->matchcid;
+
+		for (mode = E_MATCHMORE; mode <= E_MATCH; ++mode) {
+			if (!pattern_dfa_status(build, entry->pos, mode)) {
+				continue;
+			}
+			if (state.first[mode] > entry->exten) {
+				state.first[mode] = entry->exten;
+			}
+			if (nocid && state.first_nocid[mode] > entry->exten) {
+				state.first_nocid[mode] = entry->exten;
+			}
+		}
+	}
+
+	if (AST_VECTOR_APPEND(&dfa->states, state)
+		|| AST_VECTOR_APPEND(&build->hashes, hash)
+		|| AST_VECTOR_APPEND(&build->offsets, AST_VECTOR_SIZE(&build->entries))) {
+		return -1;
+	}
+	build->table[slot] = id;
+	if (id * 2 >= build->table_size && pattern_dfa_grow_table(build)) {
+		return -1;
+	}
+	return id;
+}
+
+/*!
+ * \internal
+ * \brief Compile the extensions of a context
+ *
+ * \return the automaton
+ * \retval NULL if the context has no extensions or can't be compiled
+ */
+static struct pattern_dfa *pattern_dfa_build(struct ast_context *con)
+{
+	struct pattern_dfa_build build = { .table = NULL, };
+	struct pattern_dfa_test test;
+	struct pattern_dfa *dfa;
+	struct ast_exten *exten = NULL;
+	int state;
+	int class;
+	int c;
+	int res = 0;
+
+	if (!con->root) {
+		return NULL;
+	}
+
+	dfa = ast_calloc(1, sizeof(*dfa));
+	if (!dfa || AST_VECTOR_INIT(&dfa->next, 64) || AST_VECTOR_INIT(&dfa->states, 64)
+		|| AST_VECTOR_INIT(&dfa->extens, 64) || AST_VECTOR_INIT(&dfa->cid, 0)
+		|| AST_VECTOR_INIT(&build.steps, 256) || AST_VECTOR_INIT(&build.tests, PATTERN_DFA_TEST_SETS)
+		|| AST_VECTOR_INIT(&build.entries, 256) || AST_VECTOR_INIT(&build.offsets, 64)
+		|| AST_VECTOR_INIT(&build.hashes, 64) || pattern_dfa_grow_table(&build)) {
+		res = -1;
+		goto cleanup;
+	}
+
+	/* The tests of single characters and of digit classes */
+	for (c = 0; c < PATTERN_DFA_TEST_SETS; ++c) {
+		memset(&test, 0, sizeof(test));
+		if (c < 256) {
+			pattern_dfa_test_add(&test, c);
+		} else {
+			for (class = c == PATTERN_DFA_TEST_N ? '2' : c == PATTERN_DFA_TEST_Z ? '1' : '0'; class <= '9'; ++class) {
+				pattern_dfa_test_add(&test, class);
+			}
+		}
+		res |= AST_VECTOR_APPEND(&build.tests, test);
+	}
+
+	/* State 0 matches nothing */
+	res |= AST_VECTOR_APPEND(&build.offsets, 0);
+	res |= AST_VECTOR_APPEND(&build.offsets, 0);
+	res |= AST_VECTOR_APPEND(&build.hashes, 0);
+
+	/* Every extension starts out at its first step */
+	while (!res && (exten = ast_walk_context_extensions(con, exten))) {
+		struct pattern_dfa_entry entry = {
+			.exten = AST_VECTOR_SIZE(&dfa->extens),
+			.pos = AST_VECTOR_SIZE(&build.steps),
+		};
+
+		res |= AST_VECTOR_APPEND(&dfa->extens, exten);
+		if (exten->matchcid) {
+			res |= AST_VECTOR_APPEND(&dfa->cid, entry.exten);
+		}
+		res |= AST_VECTOR_APPEND(&build.entries, entry);
+		res |= pattern_dfa_parse(&build, exten->exten);
+	}
+	if (res) {
+		goto cleanup;
+	}
+
+	pattern_dfa_classify(&build, dfa);
+
+	{
+		struct pattern_dfa_state dead;
+		enum ext_match_t mode;
+
+		for (mode = E_MATCHMORE; mode <= E_MATCH; ++mode) {
+			dead.first[mode] = AST_VECTOR_SIZE(&dfa->extens);
+			dead.first_nocid[mode] = AST_VECTOR_SIZE(&dfa->extens);
+		}
+		res |= AST_VECTOR_APPEND(&dfa->states, dead);
+	}
+	for (class = 0; class < dfa->nclasses; ++class) {
+		res |= AST_VECTOR_APPEND(&dfa->next, 0);
+	}
+	if (res || pattern_dfa_intern(&build, dfa, 0) != 1) {
+		res = -1;
+		goto cleanup;
+	}
+
+	/* Work out where every state goes with every class of character */
+	for (state = 1; !res && state < AST_VECTOR_SIZE(&dfa->states); ++state) {
+		for (class = 0; class < dfa->nclasses; ++class) {
+			size_t tail = AST_VECTOR_SIZE(&build.entries);
+			int end = AST_VECTOR_GET(&build.offsets, state + 1);
+			int idx;
+			int next;
+
+			for (idx = AST_VECTOR_GET(&build.offsets, state); idx < end; ++idx) {
+				struct pattern_dfa_entry entry = AST_VECTOR_GET(&build.entries, idx);
+
+				entry.pos = pattern_dfa_advance(&build, entry.pos, build.reps[class]);
+				if (entry.pos != PATTERN_DFA_DEAD && AST_VECTOR_APPEND(&build.entries, entry)) {
+					res = -1;
+					break;
+				}
+			}
+			next = res ? -1 : pattern_dfa_intern(&build, dfa, tail);
+			if (next < 0 || AST_VECTOR_APPEND(&dfa->next, next)) {
+				res = -1;
+				break;
+			}
+		}
+	}
+
+	if (!res) {
+		ast_debug(1, "Compiled %d extensions of context '%s' into %d states of %d character classes\n",
+			(int) AST_VECTOR_SIZE(&dfa->extens), con->name,
+			(int) AST_VECTOR_SIZE(&dfa->states), dfa->nclasses);
+	} else if (AST_VECTOR_SIZE(&dfa->states) >= PATTERN_DFA_MAX_STATES) {
+		ast_log(LOG_NOTICE, "Extensions of context '%s' overlap too much to compile, scanning them instead\n",
+			con->name);
+	}
+
+cleanup:
+	AST_VECTOR_FREE(&build.steps);
+	AST_VECTOR_FREE(&build.tests);
+	AST_VECTOR_FREE(&build.entries);
+	AST_VECTOR_FREE(&build.offsets);
+	AST_VECTOR_FREE(&build.hashes);
+	ast_free(build.table);
+	if (res) {
+		pattern_dfa_destroy(dfa);
+		return NULL;
+	}
+	return dfa;
+}
+
+/*!
+ * \internal
+ * \brief Find the first extension the scan of a compiled context stops at
+ *
+ * \param dfa The compiled context
+ * \param exten The dialed extension
+ * \param callerid The caller id to match
+ * \param action The match mode
+ *
+ * \return the first extension matching exten and callerid in the match
+ * mode of action, or one before it in the context
+ * \retval NULL if no extension matches
+ */
+static struct ast_exten *pattern_dfa_find(const struct pattern_dfa *dfa, const char *exten,
+	const char *callerid, enum ext_match_t action)
+{
+	const struct pattern_dfa_state *state;
+	enum ext_match_t mode = action & E_MATCH_MASK;
+	const char *digit;
+	size_t idx;
+	int first;
+	int id = 1;
+
+	if (mode == E_MATCH && exten[0] == '_') {
+		/* Extensions are compared with it as a pattern too, which only the scan does */
+		return AST_VECTOR_GET(&dfa->extens, 0);
+	}
+
+	for (digit = exten; *digit && id; ++digit) {
+		/* Ignore '-' chars as eye candy fluff. */
+		if (*digit != '-') {
+			id = AST_VECTOR_GET(&dfa->next, id * dfa->nclasses + dfa->classes[(unsigned char) *digit]);
+		}
+	}
+	state = AST_VECTOR_GET_ADDR(&dfa->states, id);
+
+	/* Any extensions matching on caller id before the first that doesn't need their caller id checked */
+	first = state->first_nocid[mode];
+	for (idx = 0; idx < AST_VECTOR_SIZE(&dfa->cid); ++idx) {
+		int cid = AST_VECTOR_GET(&dfa->cid, idx);
+		struct ast_exten *e;
+
+		if (cid >= first) {
+			break;
+		}
+		if (cid < state->first[mode]) {
+			continue;
+		}
+		e = AST_VECTOR_GET(&dfa->extens, cid);
+		if (extension_match_core(e->exten, exten, action) && matchcid(e->cidmatch, callerid)) {
+			first = cid;
+			break;
+		}
+	}
+
+	return first < AST_VECTOR_SIZE(&dfa->extens) ? AST_VECTOR_GET(&dfa->extens, first) : NULL;
+}
+
+/*!
+ * \internal
+ * \brief Compile the extensions of contexts not yet compiled
+ *
+ * \note Only for a table lookups can't see yet, since they use what is compiled.
+ */
+static void context_table_compile_patterns(struct ast_hashtab *table)
 {
-	struct ast_context *tmp;
-	struct fake_context item;
+	struct ast_hashtab_iter *iter;
+	struct ast_context *con;
 
-	if (!name) {
-		return NULL;
+	if (!extenpatterncompile) {
+		return;
 	}
-	ast_rdlock_contexts();
-	if (contexts_table) {
-		ast_copy_string(item.name, name, sizeof(item.name));
-		tmp = ast_hashtab_lookup(contexts_table, &item);
-	} else {
-		tmp = NULL;
-		while ((tmp = ast_walk_contexts(tmp))) {
-			if (!strcasecmp(name, tmp->name)) {
-				break;
-			}
+
+	iter = ast_hashtab_start_traversal(table);
+	while ((con = ast_hashtab_next(iter))) {
+		if (!con->pattern_dfa) {
+			con->pattern_dfa = pattern_dfa_build(con);
 		}
 	}
-	ast_unlock_contexts();
-	return tmp;
+	ast_hashtab_end_traversal(iter);
 }
 
-#define STATUS_NO_CONTEXT	1
-#define STATUS_NO_EXTENSION	2
-#define STATUS_NO_PRIORITY	3
-#define STATUS_NO_LABEL		4
-#define STATUS_SUCCESS		5
-
-static int matchcid(const char *cidpattern, const char *callerid)
+/*!
+ * \internal
+ * \brief Stop using the compiled extensions of a context that is about to change
+ *
+ * Lookups hold only the dialplan version, not the context lock, so one may
+ * still be walking the automaton.  It is kept until the context is destroyed.
+ * Contexts are only compiled when the dialplan is loaded, so few are kept.
+ *
+ * \note The context must be write locked.
+ */
+static void context_retire_pattern_dfa(struct ast_context *con)
 {
-	/* If the Caller*ID pattern is empty, then we're matching NO Caller*ID, so
-	   failing to get a number should count as a match, otherwise not */
-
-	if (ast_strlen_zero(callerid)) {
-		return ast_strlen_zero(cidpattern) ? 1 : 0;
+	if (!con->pattern_dfa) {
+		return;
 	}
-
-	return ast_extension_match(cidpattern, callerid);
+	con->pattern_dfa->retired = con->retired_dfa;
+	con->retired_dfa = con->pattern_dfa;
+	con->pattern_dfa = NULL;
 }
 
-struct ast_exten *pbx_find_extension(struct ast_channel *chan,
+/*!
+ * \internal
+ * \brief Find an extension in a table of contexts
+ *
+ * Same as pbx_find_extension(), in the contexts of a pinned dialplan version.
+ */
+static struct ast_exten *find_extension_in(struct ast_hashtab *table, struct ast_channel *chan,
 	struct ast_context *bypass, struct pbx_find_info *q,
 	const char *context, const char *exten, int priority,
 	const char *label, const char *callerid, enum ext_match_t action)
@@ -2505,7 +3462,7 @@ struct ast_exten *pbx_find_extension(struct ast_channel *chan,
 	if (bypass) { /* bypass means we only look there */
 		tmp = bypass;
 	} else {      /* look in contexts */
-		tmp = find_context(context);
+		tmp = find_context_in(table, context);
 		if (!tmp) {
 			return NULL;
 		}
@@ -2663,9 +3620,18 @@ struct ast_exten *pbx_find_extension(struct ast_channel *chan,
 		}
 	} else {   /* the old/current default exten pattern match algorithm */
 
+		/* An extension being added or removed may retire it meanwhile */
+		struct pattern_dfa *dfa = extenpatterncompile ? tmp->pattern_dfa : NULL;
+
+		if (dfa) {
+			/* Skip the extensions the scan would pass over */
+			eroot = pattern_dfa_find(dfa, S_OR(exten, ""), callerid, action);
+		} else {
+			eroot = ast_walk_context_extensions(tmp, NULL);
+		}
+
 		/* scan the list trying to match extension and CID */
-		eroot = NULL;
-		while ( (eroot = ast_walk_context_extensions(tmp, eroot)) ) {
+		for (; eroot; eroot = ast_walk_context_extensions(tmp, eroot)) {
 			int match = extension_match_core(eroot->exten, exten, action);
 			/* 0 on fail, 1 on match, 2 on earlymatch */
 
@@ -2751,7 +3717,7 @@ struct ast_exten *pbx_find_extension(struct ast_channel *chan,
 		const struct ast_include *i = ast_context_includes_get(tmp, idx);
 
 		if (include_valid(i)) {
-			if ((e = pbx_find_extension(chan, bypass, q, include_rname(i), exten, priority, label, callerid, action))) {
+			if ((e = find_extension_in(table, chan, bypass, q, include_rname(i), exten, priority, label, callerid, action))) {
 #ifdef NEED_DEBUG_HERE
 				ast_log(LOG_NOTICE,"Returning recursive match of %s\n", e->exten);
 #endif
@@ -2764,6 +3730,15 @@ struct ast_exten *pbx_find_extension(struct ast_channel *chan,
 	return NULL;
 }
 
+struct ast_exten *pbx_find_extension(struct ast_channel *chan,
+	struct ast_context *bypass, struct pbx_find_info *q,
+	const char *context, const char *exten, int priority,
+	const char *label, const char *callerid, enum ext_match_t action)
+{
+	return find_extension_in(contexts_table, chan, bypass, q, context, exten, priority,
+		label, callerid, action);
+}
+
 static void exception_store_free(void *data)
 {
 	struct pbx_exception *exception = data;
@@ -2867,21 +3842,23 @@ static int pbx_extension_helper(struct ast_channel *c, struct ast_context *con,
 	struct pbx_find_info q = { .stacklen = 0 }; /* the rest is reset in pbx_find_extension */
 	char passdata[EXT_DATA_SIZE];
 	int matching_action = (action == E_MATCH || action == E_CANMATCH || action == E_MATCHMORE);
+	struct dialplan_version *version;
+	struct ast_hashtab *table;
 
-	ast_rdlock_contexts();
+	table = dialplan_lookup_start(&version);
 	if (found)
 		*found = 0;
 
-	e = pbx_find_extension(c, con, &q, context, exten, priority, label, callerid, action);
+	e = find_extension_in(table, c, con, &q, context, exten, priority, label, callerid, action);
 	if (e) {
 		if (found)
 			*found = 1;
 		if (matching_action) {
-			ast_unlock_contexts();
+			dialplan_lookup_end(version);
 			return -1;	/* success, we found it */
 		} else if (action == E_FINDLABEL) { /* map the label to a priority */
 			res = e->priority;
-			ast_unlock_contexts();
+			dialplan_lookup_end(version);
 			return res;	/* the priority we were looking for */
 		} else {	/* spawn */
 			if (!e->cached_app)
@@ -2899,7 +3876,7 @@ static int pbx_extension_helper(struct ast_channel *c, struct ast_context *con,
 					substitute = ast_strdupa(e->data);
 				}
 			}
-			ast_unlock_contexts();
+			dialplan_lookup_end(version);
 			if (!app) {
 				ast_log(LOG_WARNING, "No application '%s' for extension (%s, %s, %d)\n", e->app, context, exten, priority);
 				return -1;
@@ -2926,7 +3903,7 @@ static int pbx_extension_helper(struct ast_channel *c, struct ast_context *con,
 	} else if (q.swo) {	/* not found here, but in another switch */
 		if (found)
 			*found = 1;
-		ast_unlock_contexts();
+		dialplan_lookup_end(version);
 		if (matching_action) {
 			return -1;
 		} else {
@@ -2937,7 +3914,7 @@ static int pbx_extension_helper(struct ast_channel *c, struct ast_context *con,
 			return q.swo->exec(c, q.foundcontext ? q.foundcontext : context, exten, priority, callerid, q.data);
 		}
 	} else {	/* not found anywhere, see what happened */
-		ast_unlock_contexts();
+		dialplan_lookup_end(version);
 		/* Using S_OR here because Solaris doesn't like NULL being passed to ast_log */
 		switch (q.status) {
 		case STATUS_NO_CONTEXT:
@@ -2973,10 +3950,14 @@ static struct ast_exten *ast_hint_extension_nolock(struct ast_channel *c, const
 
 static struct ast_exten *ast_hint_extension(struct ast_channel *c, const char *context, const char *exten)
 {
+	struct pbx_find_info q = { .stacklen = 0 }; /* the rest is set in pbx_find_context */
+	struct dialplan_version *version;
+	struct ast_hashtab *table;
 	struct ast_exten *e;
-	ast_rdlock_contexts();
-	e = ast_hint_extension_nolock(c, context, exten);
-	ast_unlock_contexts();
+
+	table = dialplan_lookup_start(&version);
+	e = find_extension_in(table, c, NULL, &q, context, exten, PRIORITY_HINT, NULL, "", E_MATCH);
+	dialplan_lookup_end(version);
 	return e;
 }
 
@@ -3337,13 +4318,56 @@ static void get_device_state_causing_channels(struct ao2_container *c)
 	ao2_iterator_destroy(&iter);
 }
 
-static void device_state_notify_callbacks(struct ast_hint *hint, struct ast_str **hint_app)
+/*!
+ * \internal
+ * \brief Make the detailed device state of a hint for extended callbacks.
+ *
+ * \return Container of ast_device_state_info for the cached device states.
+ * \retval NULL on error.
+ */
+static struct ao2_container *hint_device_state_info(struct ast_hint *hint)
+{
+	struct ao2_container *device_state_info;
+	int i;
+
+	device_state_info = alloc_device_state_info();
+	if (!device_state_info) {
+		return NULL;
+	}
+
+	ao2_lock(hint);
+	for (i = 0; i < AST_VECTOR_SIZE(&hint->devices); ++i) {
+		struct ast_hintdevice *device = AST_VECTOR_GET(&hint->devices, i);
+		struct ast_device_state_info *obj;
+
+		if (!device->aggregated) {
+			continue;
+		}
+
+		obj = ao2_alloc_options(sizeof(*obj) + strlen(device->hintdevice),
+			device_state_info_dt, AO2_ALLOC_OPT_LOCK_NOLOCK);
+		/* if failed we cannot add this device */
+		if (obj) {
+			obj->device_state = device->state;
+			strcpy(obj->device_name, device->hintdevice);
+			ao2_link(device_state_info, obj);
+			ao2_ref(obj, -1);
+		}
+	}
+	ao2_unlock(hint);
+
+	get_device_state_causing_channels(device_state_info);
+
+	return device_state_info;
+}
+
+static void device_state_notify_callbacks(struct ast_hint *hint)
 {
 	struct ao2_iterator cb_iter;
 	struct ast_state_cb *state_cb;
 	int state;
 	int same_state;
-	struct ao2_container *device_state_info;
+	struct ao2_container *device_state_info = NULL;
 	int first_extended_cb_call = 1;
 	char context_name[AST_MAX_CONTEXT];
 	char exten_name[AST_MAX_EXTENSION];
@@ -3364,31 +4388,29 @@ static void device_state_notify_callbacks(struct ast_hint *hint, struct ast_str
 			sizeof(context_name));
 	ast_copy_string(exten_name, ast_get_extension_name(hint->exten),
 			sizeof(exten_name));
-	ast_str_set(hint_app, 0, "%s", ast_get_extension_app(hint->exten));
-	ao2_unlock(hint);
-
-	/*
-	 * Get device state for this hint.
-	 *
-	 * NOTE: We cannot hold any locks while determining the hint
-	 * device state or notifying the watchers without causing a
-	 * deadlock.  (conlock, hints, and hint)
-	 */
 
-	/* Make a container so state3 can fill it if we wish.
-	 * If that failed we simply do not provide the extended state info.
-	 */
-	device_state_info = alloc_device_state_info();
+	if (hint->devices_unknown) {
+		/* The watchers are notified once the new devices are refreshed */
+		ao2_unlock(hint);
+		return;
+	}
 
-	state = ast_extension_state3(*hint_app, device_state_info);
+	/* The device states are kept up to date as they change, no need to get them now */
+	state = hint_device_state(hint);
 	same_state = state == hint->laststate;
 	if (same_state && (~state & AST_EXTENSION_RINGING)) {
-		ao2_cleanup(device_state_info);
+		ao2_unlock(hint);
 		return;
 	}
 
 	/* Device state changed since last check - notify the watchers. */
 	hint->laststate = state;	/* record we saw the change */
+	ao2_unlock(hint);
+
+	/*
+	 * NOTE: We cannot hold any locks while notifying the watchers
+	 * without causing a deadlock.  (conlock, hints, and hint)
+	 */
 
 	/* For general callbacks */
 	if (!same_state) {
@@ -3412,9 +4434,11 @@ static void device_state_notify_callbacks(struct ast_hint *hint, struct ast_str
 	cb_iter = ao2_iterator_init(hint->callbacks, 0);
 	for (; (state_cb = ao2_iterator_next(&cb_iter)); ao2_ref(state_cb, -1)) {
 		if (state_cb->extended && first_extended_cb_call) {
-			/* Fill detailed device_state_info now that we know it is used by extd. callback */
+			/* Make the detailed device_state_info now that we know it is used by extd. callback.
+			 * If that failed we simply do not provide the extended state info.
+			 */
 			first_extended_cb_call = 0;
-			get_device_state_causing_channels(device_state_info);
+			device_state_info = hint_device_state_info(hint);
 		}
 		if (state_cb->extended || !same_state) {
 			execute_state_callback(state_cb->change_cb,
@@ -3431,6 +4455,46 @@ static void device_state_notify_callbacks(struct ast_hint *hint, struct ast_str
 	ao2_cleanup(device_state_info);
 }
 
+/*! \internal \brief Notify the watchers of a hint from its serializer */
+static int hint_notify_task(void *data)
+{
+	struct ast_hint *hint = data;
+
+	/* Changes from now on need another notification */
+	ao2_lock(hint);
+	hint->notify_queued = 0;
+	ao2_unlock(hint);
+
+	device_state_notify_callbacks(hint);
+
+	ao2_ref(hint, -1);
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Queue notifying the watchers of a hint of its device state.
+ *
+ * \note The hint must be locked.
+ *
+ * \note The watchers are notified from the serializer of the hint so
+ * notifications for a hint are in order, without any global lock held.
+ * Changes made before an already queued notification runs are seen by it.
+ */
+static void hint_notify_queue(struct ast_hint *hint)
+{
+	if (hint->notify_queued || hint->serializer >= AST_VECTOR_SIZE(&hint_serializers)) {
+		return;
+	}
+
+	hint->notify_queued = 1;
+	if (ast_taskprocessor_push(AST_VECTOR_GET(&hint_serializers, hint->serializer),
+		hint_notify_task, ao2_bump(hint))) {
+		hint->notify_queued = 0;
+		ao2_ref(hint, -1);
+	}
+}
+
 static void presence_state_notify_callbacks(struct ast_hint *hint, struct ast_str **hint_app,
 					    struct ast_presence_state_message *presence_state)
 {
@@ -3521,7 +4585,11 @@ static int handle_hint_change_message_type(struct stasis_message *msg, enum ast_
 
 	switch (reason) {
 	case AST_HINT_UPDATE_DEVICE:
-		device_state_notify_callbacks(hint, &hint_app);
+		/* The devices of the hint changed, so their states are not known yet */
+		hint_devices_refresh(hint);
+		ao2_lock(hint);
+		hint_notify_queue(hint);
+		ao2_unlock(hint);
 		break;
 	case AST_HINT_UPDATE_PRESENCE:
 		{
@@ -3554,12 +4622,12 @@ static int handle_hint_change_message_type(struct stasis_message *msg, enum ast_
 static void device_state_cb(void *unused, struct stasis_subscription *sub, struct stasis_message *msg)
 {
 	struct ast_device_state_message *dev_state;
-	struct ast_str *hint_app;
 	struct ast_hintdevice *device;
 	struct ast_hintdevice *cmpdevice;
 	struct ao2_iterator *dev_iter;
 	struct ao2_iterator auto_iter;
 	struct ast_autohint *autohint;
+	enum ast_device_state state;
 	char *virtual_device;
 	char *type;
 	char *device_name;
@@ -3583,27 +4651,45 @@ static void device_state_cb(void *unused, struct stasis_subscription *sub, struc
 		return;
 	}
 
-	hint_app = ast_str_create(1024);
-	if (!hint_app) {
-		return;
-	}
-
 	cmpdevice = ast_alloca(sizeof(*cmpdevice) + strlen(dev_state->device));
 	strcpy(cmpdevice->hintdevice, dev_state->device);
 
-	ast_mutex_lock(&context_merge_lock);/* Hold off ast_merge_contexts_and_delete */
-
-	/* Initially we find all hints for the device and notify them */
+	/* Initially we find all hints for the device and update them */
 	dev_iter = ao2_t_callback(hintdevices,
 		OBJ_SEARCH_OBJECT | OBJ_MULTIPLE,
 		hintdevice_cmp_multiple,
 		cmpdevice,
 		"find devices in container");
 	if (dev_iter) {
+		/* An unknown state is what ast_device_state() asks the channel driver about */
+		state = dev_state->state != AST_DEVICE_UNKNOWN
+			? dev_state->state : ast_device_state(dev_state->device);
+
 		for (; (device = ao2_iterator_next(dev_iter)); ao2_t_ref(device, -1, "Next device")) {
-			if (device->hint) {
-				device_state_notify_callbacks(device->hint, &hint_app);
+			struct ast_hint *hint = device->hint;
+
+			if (!hint) {
+				continue;
+			}
+
+			/*
+			 * Only the state of this device changed, so the hint state is
+			 * aggregated again from the cached states without asking any
+			 * other device.  The watchers are only notified on a change,
+			 * or on every update while ringing as before.
+			 */
+			ao2_lock(hint);
+			if (device->aggregated) {
+				hint_device_set_state(hint, device, state);
+				if (!hint->notify_queued && !hint->devices_unknown) {
+					int exten_state = hint_device_state(hint);
+
+					if (exten_state != hint->laststate || (exten_state & AST_EXTENSION_RINGING)) {
+						hint_notify_queue(hint);
+					}
+				}
 			}
+			ao2_unlock(hint);
 		}
 		ao2_iterator_destroy(dev_iter);
 	}
@@ -3613,7 +4699,7 @@ static void device_state_cb(void *unused, struct stasis_subscription *sub, struc
 	 */
 	type = ast_strdupa(dev_state->device);
 	if (ast_strlen_zero(type)) {
-		goto end;
+		return;
 	}
 
 	/* Determine if this is a virtual/custom device or a real device */
@@ -3625,11 +4711,12 @@ static void device_state_cb(void *unused, struct stasis_subscription *sub, struc
 
 	/* Invalid device state name - not a virtual/custom device and not a real device */
 	if (ast_strlen_zero(device_name)) {
-		goto end;
+		return;
 	}
 
 	*device_name++ = '\0';
 
+	ast_mutex_lock(&context_merge_lock);/* Hold off ast_merge_contexts_and_delete */
 	auto_iter = ao2_iterator_init(autohints, 0);
 	for (; (autohint = ao2_iterator_next(&auto_iter)); ao2_t_ref(autohint, -1, "Next autohint")) {
 		if (ast_get_hint(NULL, 0, NULL, 0, NULL, autohint->context, device_name)) {
@@ -3644,11 +4731,7 @@ static void device_state_cb(void *unused, struct stasis_subscription *sub, struc
 		/* Since this hint was just created there are no watchers, so we don't need to notify anyone */
 	}
 	ao2_iterator_destroy(&auto_iter);
-
-end:
 	ast_mutex_unlock(&context_merge_lock);
-	ast_free(hint_app);
-	return;
 }
 
 /*!
@@ -3851,7 +4934,6 @@ static int hint_id_cmp(void *obj, void *arg, int flags)
 static void destroy_hint(void *obj)
 {
 	struct ast_hint *hint = obj;
-	int i;
 
 	if (hint->callbacks) {
 		struct ast_state_cb *state_cb;
@@ -3882,10 +4964,7 @@ static void destroy_hint(void *obj)
 		ao2_ref(hint->callbacks, -1);
 	}
 
-	for (i = 0; i < AST_VECTOR_SIZE(&hint->devices); i++) {
-		char *device = AST_VECTOR_GET(&hint->devices, i);
-		ast_free(device);
-	}
+	/* The devices were removed by remove_hintdevice() since they refer to the hint */
 	AST_VECTOR_FREE(&hint->devices);
 	ast_free(hint->last_presence_subtype);
 	ast_free(hint->last_presence_message);
@@ -3934,6 +5013,7 @@ static int ast_add_hint(struct ast_exten *e)
 	char *message = NULL;
 	char *subtype = NULL;
 	int presence_state;
+	int dynamic;
 
 	if (!e) {
 		return -1;
@@ -3957,12 +5037,28 @@ static int ast_add_hint(struct ast_exten *e)
 		return -1;
 	}
 	hint_new->exten = e;
-	if (strstr(e->app, "${") && e->exten[0] == '_') {
+	if (AST_VECTOR_SIZE(&hint_serializers)) {
+		hint_new->serializer = (unsigned int) (ast_str_case_hash(ast_get_extension_name(e))
+			+ ast_str_case_hash(ast_get_context_name(ast_get_extension_context(e))))
+			% AST_VECTOR_SIZE(&hint_serializers);
+	}
+	dynamic = strstr(e->app, "${") && e->exten[0] == '_';
+
+	/* Get the device states now, the hints container is locked below */
+	if (add_hintdevice(hint_new, ast_get_extension_app(e), !dynamic)) {
+		ast_log(LOG_WARNING, "Could not add devices for hint: %s@%s.\n",
+			ast_get_extension_name(e),
+			ast_get_context_name(ast_get_extension_context(e)));
+	}
+
+	if (dynamic) {
 		/* The hint is dynamic and hasn't been evaluted yet */
 		hint_new->laststate = AST_DEVICE_INVALID;
 		hint_new->last_presence_state = AST_PRESENCE_INVALID;
 	} else {
-		hint_new->laststate = ast_extension_state2(e, NULL);
+		ao2_lock(hint_new);
+		hint_new->laststate = hint_device_state(hint_new);
+		ao2_unlock(hint_new);
 		if ((presence_state = extension_presence_state_helper(e, &subtype, &message)) > 0) {
 			hint_new->last_presence_state = presence_state;
 			hint_new->last_presence_subtype = subtype;
@@ -3979,6 +5075,7 @@ static int ast_add_hint(struct ast_exten *e)
 	if (hint_found) {
 		ao2_ref(hint_found, -1);
 		ao2_unlock(hints);
+		remove_hintdevice(hint_new);
 		ao2_ref(hint_new, -1);
 		ast_debug(2, "HINTS: Not re-adding existing hint %s: %s\n",
 			ast_get_extension_name(e), ast_get_extension_app(e));
@@ -3989,14 +5086,9 @@ static int ast_add_hint(struct ast_exten *e)
 	ast_debug(2, "HINTS: Adding hint %s: %s\n",
 		ast_get_extension_name(e), ast_get_extension_app(e));
 	ao2_link(hints, hint_new);
-	if (add_hintdevice(hint_new, ast_get_extension_app(e))) {
-		ast_log(LOG_WARNING, "Could not add devices for hint: %s@%s.\n",
-			ast_get_extension_name(e),
-			ast_get_context_name(ast_get_extension_context(e)));
-	}
 
 	/* if not dynamic */
-	if (!(strstr(e->app, "${") && e->exten[0] == '_')) {
+	if (!dynamic) {
 		struct ast_state_cb *state_cb;
 		struct ao2_iterator cb_iter;
 
@@ -4069,11 +5161,12 @@ static int ast_change_hint(struct ast_exten *oe, struct ast_exten *ne)
 	/* Update the hint and put it back in the hints container. */
 	ao2_lock(hint);
 	hint->exten = ne;
-
+	/* The device states are gotten when the hint change is published, without our locks */
+	hint->devices_unknown = 1;
 	ao2_unlock(hint);
 
 	ao2_link(hints, hint);
-	if (add_hintdevice(hint, ast_get_extension_app(ne))) {
+	if (add_hintdevice(hint, ast_get_extension_app(ne), 0)) {
 		ast_log(LOG_WARNING, "Could not add devices for hint: %s@%s.\n",
 			ast_get_extension_name(ne),
 			ast_get_context_name(ast_get_extension_context(ne)));
@@ -4729,6 +5822,13 @@ int pbx_set_extenpatternmatchnew(int newval)
 	return oldval;
 }
 
+int pbx_set_extenpatterncompile(int newval)
+{
+	int oldval = extenpatterncompile;
+	extenpatterncompile = newval;
+	return oldval;
+}
+
 void pbx_set_overrideswitch(const char *newval)
 {
 	if (overrideswitch) {
@@ -4745,13 +5845,18 @@ void pbx_set_overrideswitch(const char *newval)
  * \brief lookup for a context with a given name,
  * \retval found context or NULL if not found.
  */
-static struct ast_context *find_context(const char *context)
+static struct ast_context *find_context_in(struct ast_hashtab *table, const char *context)
 {
 	struct fake_context item;
 
 	ast_copy_string(item.name, context, sizeof(item.name));
 
-	return ast_hashtab_lookup(contexts_table, &item);
+	return ast_hashtab_lookup(table, &item);
+}
+
+static struct ast_context *find_context(const char *context)
+{
+	return find_context_in(contexts_table, context);
 }
 
 /*!
@@ -5047,6 +6152,9 @@ int ast_context_remove_extension_callerid2(struct ast_context *con, const char *
 		return -1;
 	}
 
+	/* The compiled extensions are about to be out of date */
+	context_retire_pattern_dfa(con);
+
 	/* scan the priority list to remove extension with exten->priority == priority */
 	for (peer = exten, next_peer = exten->peer ? exten->peer : exten->next;
 		 peer && !strcmp(peer->exten, ex.exten) &&
@@ -6429,6 +7537,9 @@ void ast_merge_contexts_and_delete(struct ast_context **extcontexts, struct ast_
 	struct timeval writelocktime;
 	struct timeval endlocktime;
 	struct timeval enddeltime;
+	struct dialplan_thread_state *state;
+	struct dialplan_version *new_version;
+	struct dialplan_version *old_version = NULL;
 
 	/*
 	 * It is very important that this function hold the hints
@@ -6440,20 +7551,54 @@ void ast_merge_contexts_and_delete(struct ast_context **extcontexts, struct ast_
 	 *
 	 * In addition, the locks _must_ be taken in this order, because
 	 * there are already other code paths that use this order
+	 *
+	 * The current dialplan version is only read locked rather than
+	 * write locked with conlock.  Changes to it are held off, but
+	 * lookups go on in it until the new version is published.
 	 */
 
 	begintime = ast_tvnow();
+
+	new_version = dialplan_version_alloc(exttable);
+	if (!new_version) {
+		ast_log(LOG_ERROR, "Unable to publish the new dialplan, keeping the old one\n");
+		ast_hashtab_destroy(exttable, NULL);
+		for (tmp = *extcontexts; tmp; ) {
+			struct ast_context *next = tmp->next;
+
+			__ast_internal_context_destroy(tmp);
+			tmp = next;
+		}
+		return;
+	}
+
 	ast_mutex_lock(&context_merge_lock);/* Serialize ast_merge_contexts_and_delete */
-	ast_wrlock_contexts();
+	state = ast_threadstorage_get(&dialplan_thread_state, sizeof(*state));
+	if (state && !state->depth) {
+		old_version = ao2_global_obj_ref(current_dialplan);
+	}
+	if (old_version) {
+		ast_rwlock_rdlock(&old_version->lock);
+		/* Anything locking the contexts from here only needs conlock */
+		++state->pins;
+	}
+	ast_mutex_lock(&conlock);
 
 	if (!contexts_table) {
 		/* Create any autohint contexts */
 		context_table_create_autohints(exttable);
+		context_table_compile_patterns(exttable);
 
 		/* Well, that's odd. There are no contexts. */
 		contexts_table = exttable;
 		contexts = *extcontexts;
-		ast_unlock_contexts();
+		dialplan_replace(new_version);
+		ast_mutex_unlock(&conlock);
+		if (old_version) {
+			--state->pins;
+			ast_rwlock_unlock(&old_version->lock);
+			ao2_ref(old_version, -1);
+		}
 		ast_mutex_unlock(&context_merge_lock);
 		return;
 	}
@@ -6464,6 +7609,9 @@ void ast_merge_contexts_and_delete(struct ast_context **extcontexts, struct ast_
 	}
 	ast_hashtab_end_traversal(iter);
 
+	/* Compile before the hints are locked; only contexts changed from here on are left */
+	context_table_compile_patterns(exttable);
+
 	ao2_lock(hints);
 	writelocktime = ast_tvnow();
 
@@ -6562,6 +7710,10 @@ void ast_merge_contexts_and_delete(struct ast_context **extcontexts, struct ast_
 			hint->last_presence_state = saved_hint->last_presence_state;
 			hint->last_presence_subtype = saved_hint->last_presence_subtype;
 			hint->last_presence_message = saved_hint->last_presence_message;
+			/* Device states keep changing during the merge, catch the watchers up */
+			if (!hint->devices_unknown && hint_device_state(hint) != hint->laststate) {
+				hint_notify_queue(hint);
+			}
 			ao2_unlock(hint);
 			ao2_ref(hint, -1);
 			/*
@@ -6574,9 +7726,17 @@ void ast_merge_contexts_and_delete(struct ast_context **extcontexts, struct ast_
 
 	/* Create all applicable autohint contexts */
 	context_table_create_autohints(contexts_table);
+	context_table_compile_patterns(contexts_table);
+
+	/* Lookups find the new dialplan from now on */
+	dialplan_replace(new_version);
 
 	ao2_unlock(hints);
-	ast_unlock_contexts();
+	ast_mutex_unlock(&conlock);
+	if (old_version) {
+		--state->pins;
+		ast_rwlock_unlock(&old_version->lock);
+	}
 
 	/*
 	 * Notify watchers of all removed hints with the same lock
@@ -6606,8 +7766,14 @@ void ast_merge_contexts_and_delete(struct ast_context **extcontexts, struct ast_
 	/*
 	 * The old list and hashtab no longer are relevant, delete them
 	 * while the rest of asterisk is now freely using the new stuff
-	 * instead.
+	 * instead.  Lookups that pinned the old version before the new
+	 * one was published are waited for first.
 	 */
+	if (old_version) {
+		ast_rwlock_wrlock(&old_version->lock);
+		ast_rwlock_unlock(&old_version->lock);
+		ao2_ref(old_version, -1);
+	}
 
 	ast_hashtab_destroy(oldtable, NULL);
 
@@ -7367,7 +8533,10 @@ static int ast_add_extension2_lockopt(struct ast_context *con,
 		ast_wrlock_context(con);
 	}
 
-	if (con->pattern_tree) { /* usually, on initial load, the pattern_tree isn't formed until the first find_exten; so if we are adding
+	/* The compiled extensions are about to be out of date */
+	context_retire_pattern_dfa(con);
+
+	if (con->pattern_tree) { /* the trie is formed with the first extension; so if we are adding
 								an extension, and the trie exists, then we need to incrementally add this pattern to it. */
 		ext_strncpy(dummy_name, tmp->exten, sizeof(dummy_name), 1);
 		dummy_exten.exten = dummy_name;
@@ -7462,6 +8631,10 @@ static int ast_add_extension2_lockopt(struct ast_context *con,
 		}
 		ast_hashtab_insert_safe(tmp->peer_table, tmp);
 		ast_hashtab_insert_safe(con->root_table, tmp);
+		if (!con->pattern_tree) {
+			/* Lookups share the dialplan, so the trie can't wait to be formed by the first one */
+			create_match_char_tree(con);
+		}
 
 		if (lock_context) {
 			ast_unlock_context(con);
@@ -7970,6 +9143,13 @@ static void __ast_internal_context_destroy( struct ast_context *con)
 	/* and destroy the pattern tree */
 	if (tmp->pattern_tree)
 		destroy_pattern_tree(tmp->pattern_tree);
+	pattern_dfa_destroy(tmp->pattern_dfa);
+	while (tmp->retired_dfa) {
+		struct pattern_dfa *retired = tmp->retired_dfa;
+
+		tmp->retired_dfa = retired->retired;
+		pattern_dfa_destroy(retired);
+	}
 
 	for (e = tmp->root; e;) {
 		for (en = e->peer; en;) {
@@ -8441,19 +9621,52 @@ int load_pbx(void)
 /*
  * Lock context list functions ...
  */
-int ast_wrlock_contexts(void)
+
+/*!
+ * \internal
+ * \brief Lock conlock, and the current dialplan version the first time
+ *
+ * \note The version is locked first, as lookups hold it while a dialplan
+ * switch may take conlock.  A thread doing a lookup can't write lock the
+ * version it reads, so it only takes conlock.
+ */
+static int contexts_lock(void)
 {
+	struct dialplan_thread_state *state;
+
+	state = ast_threadstorage_get(&dialplan_thread_state, sizeof(*state));
+	if (state && !state->depth++ && !state->pins) {
+		state->locked = dialplan_wrlock_current();
+	}
+
 	return ast_mutex_lock(&conlock);
 }
 
+int ast_wrlock_contexts(void)
+{
+	return contexts_lock();
+}
+
 int ast_rdlock_contexts(void)
 {
-	return ast_mutex_lock(&conlock);
+	return contexts_lock();
 }
 
 int ast_unlock_contexts(void)
 {
-	return ast_mutex_unlock(&conlock);
+	struct dialplan_thread_state *state;
+	int res;
+
+	res = ast_mutex_unlock(&conlock);
+
+	state = ast_threadstorage_get(&dialplan_thread_state, sizeof(*state));
+	if (state && !--state->depth && state->locked) {
+		ast_rwlock_unlock(&state->locked->lock);
+		ao2_ref(state->locked, -1);
+		state->locked = NULL;
+	}
+
+	return res;
 }
 
 /*
@@ -8871,9 +10084,16 @@ static void pbx_shutdown(void)
 		ao2_ref(statecbs, -1);
 		statecbs = NULL;
 	}
+	ao2_global_obj_release(current_dialplan);
 	if (contexts_table) {
 		ast_hashtab_destroy(contexts_table, NULL);
 	}
+	AST_VECTOR_CALLBACK_VOID(&hint_serializers, ast_taskprocessor_unreference);
+	AST_VECTOR_FREE(&hint_serializers);
+	if (hint_threadpool) {
+		ast_threadpool_shutdown(hint_threadpool);
+		hint_threadpool = NULL;
+	}
 }
 
 static void print_hints_key(void *v_obj, void *where, ao2_prnt_fn *prnt)
@@ -8921,6 +10141,33 @@ static void print_statecbs_key(void *v_obj, void *where, ao2_prnt_fn *prnt)
 
 int ast_pbx_init(void)
 {
+	struct ast_threadpool_options options = {
+		.version = AST_THREADPOOL_OPTIONS_VERSION,
+		.auto_increment = 1,
+		.max_size = MAX(1, ast_option_hint_threads),
+		.idle_timeout = 60,
+		/* Enough for the usual trickle of updates without growing the pool */
+		.initial_size = MIN(HINT_THREADPOOL_INITIAL_SIZE, MAX(1, ast_option_hint_threads)),
+	};
+	struct dialplan_version *version;
+	int i;
+
+	hint_threadpool = ast_threadpool_create("pbx-hints", NULL, &options);
+	if (hint_threadpool && !AST_VECTOR_INIT(&hint_serializers, options.max_size)) {
+		for (i = 0; i < options.max_size; ++i) {
+			char tps_name[AST_TASKPROCESSOR_MAX_NAME + 1];
+			struct ast_taskprocessor *serializer;
+
+			/* Create name with seq number appended. */
+			ast_taskprocessor_build_name(tps_name, sizeof(tps_name), "pbx-hint");
+
+			serializer = ast_threadpool_serializer(tps_name, hint_threadpool);
+			if (!serializer || AST_VECTOR_APPEND(&hint_serializers, serializer)) {
+				ast_taskprocessor_unreference(serializer);
+				break;
+			}
+		}
+	}
 	hints = ao2_container_alloc(HASH_EXTENHINT_SIZE, hint_hash, hint_cmp);
 	if (hints) {
 		ao2_container_register("hints", hints, print_hints_key);
@@ -8940,11 +10187,23 @@ int ast_pbx_init(void)
 		ao2_container_register("statecbs", statecbs, print_statecbs_key);
 	}
 
+	/* Lookups need a dialplan version to pin before any context exists */
+	contexts_table = ast_hashtab_create(17,
+		ast_hashtab_compare_contexts,
+		ast_hashtab_resize_java,
+		ast_hashtab_newsize_java,
+		ast_hashtab_hash_contexts,
+		0);
+	version = contexts_table ? dialplan_version_alloc(contexts_table) : NULL;
+	if (version) {
+		dialplan_replace(version);
+	}
+
 	ast_register_cleanup(pbx_shutdown);
 
 	if (STASIS_MESSAGE_TYPE_INIT(hint_change_message_type) != 0) {
 		return -1;
 	}
 
-	return (hints && hintdevices && autohints && statecbs) ? 0 : -1;
+	return (AST_VECTOR_SIZE(&hint_serializers) && hints && hintdevices && autohints && statecbs && version) ? 0 : -1;
 }
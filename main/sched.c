@@ -47,6 +47,10 @@
 #include "asterisk/utils.h"
 #include "asterisk/heap.h"
 #include "asterisk/threadstorage.h"
+#include "asterisk/vector.h"
+#include "asterisk/dlinkedlists.h"
+#include "asterisk/test.h"
+#include "asterisk/_private.h"
 
 /*!
  * \brief Max num of schedule structs
@@ -94,6 +98,11 @@ struct sched {
 	const void *data;             /*!< Data */
 	ast_sched_cb callback;        /*!< Callback */
 	ssize_t __heap_index;
+	/*! Timing wheel slot holding the task (wheel backend only) */
+	struct sched_wheel_slot *wheel_slot;
+	/*! Timing wheel level of wheel_slot (wheel backend only) */
+	unsigned int wheel_level;
+	AST_DLLIST_ENTRY(sched) wheel_list;
 	/*!
 	 * Used to synchronize between thread running a task and thread
 	 * attempting to delete a task
@@ -103,6 +112,39 @@ struct sched {
 	unsigned int deleted:1;
 };
 
+/*!
+ * \brief Scheduler queue callback
+ *
+ * \retval 0 if the task is still queued
+ * \retval non-zero if the callback removed the task from the queue
+ */
+typedef int (*sched_queue_cb)(struct ast_sched_context *con, struct sched *s, void *arg);
+
+/*!
+ * \brief Scheduler queue backend
+ *
+ * Holds the scheduled tasks of a context ordered by the time they
+ * expire.  All methods are called with the context locked.
+ */
+struct sched_queue_methods {
+	/*! Allocate the queue.  Returns non-zero on failure. */
+	int (*alloc)(struct ast_sched_context *con);
+	/*! Free the queue.  The queue is already empty. */
+	void (*destroy)(struct ast_sched_context *con);
+	/*! Add a task to the queue.  Returns non-zero on failure. */
+	int (*push)(struct ast_sched_context *con, struct sched *s);
+	/*! Remove a task from the queue.  Returns non-zero if it was not queued. */
+	int (*remove)(struct ast_sched_context *con, struct sched *s);
+	/*! Get the next task to run if it expires before limit.  The task stays queued. */
+	struct sched *(*next_due)(struct ast_sched_context *con, struct timeval limit);
+	/*! Milliseconds until the queue needs to be run again, -1 if empty. */
+	int (*wait)(struct ast_sched_context *con);
+	/*! Number of queued tasks. */
+	size_t (*size)(struct ast_sched_context *con);
+	/*! Call cb on every queued task. */
+	void (*callback)(struct ast_sched_context *con, sched_queue_cb cb, void *arg);
+};
+
 struct sched_thread {
 	pthread_t thread;
 	ast_cond_t cond;
@@ -115,7 +157,12 @@ struct ast_sched_context {
 	unsigned int highwater;					/*!< highest count so far */
 	/*! Next tie breaker in case events expire at the same time. */
 	unsigned int tie_breaker;
+	/*! Backend of the queue holding the scheduled tasks */
+	const struct sched_queue_methods *methods;
+	/*! Scheduled tasks (heap backend only) */
 	struct ast_heap *sched_heap;
+	/*! Scheduled tasks (wheel backend only) */
+	struct sched_wheel *wheel;
 	struct sched_thread *sched_thread;
 	/*! The scheduled task that is currently executing */
 	struct sched *currently_executing;
@@ -128,8 +175,46 @@ struct ast_sched_context {
 	AST_LIST_HEAD_NOLOCK(, sched_id) id_queue;
 	/*! The number of IDs in the id_queue */
 	int id_queue_size;
+	/*! Distance between consecutive sched IDs handed out by this context */
+	unsigned int id_stride;
+	/*! Offset of the first sched ID handed out by this context */
+	unsigned int id_offset;
+	/*!
+	 * \brief Queued scheduled tasks indexed by sched_id_index()
+	 *
+	 * \note An entry is only set while the task is queued so
+	 * sched_find() does not need to walk the queue.
+	 */
+	AST_VECTOR(, struct sched *) id_map;
+	/*! Sub-contexts holding the scheduled tasks of a sharded context */
+	struct ast_sched_context **shards;
+	/*! The number of shards */
+	unsigned int num_shards;
+	/*! Round robin counter used to pick the shard for a new task */
+	int next_shard;
 };
 
+/*!
+ * \internal
+ * \brief Get the shard of a sharded context that owns a sched ID.
+ *
+ * \note Each shard hands out the IDs congruent to its index modulo
+ * the number of shards so no lookup is needed.
+ */
+static struct ast_sched_context *sched_shard_by_id(struct ast_sched_context *con, int id)
+{
+	return con->shards[(unsigned int) (id - 1) % con->num_shards];
+}
+
+/*!
+ * \internal
+ * \brief Get the id_map position of a sched ID handed out by this context.
+ */
+static unsigned int sched_id_index(struct ast_sched_context *con, int id)
+{
+	return (id - 1 - con->id_offset) / con->id_stride;
+}
+
 static void *sched_run(void *data)
 {
 	struct ast_sched_context *con = data;
@@ -196,6 +281,16 @@ static void sched_thread_destroy(struct ast_sched_context *con)
 int ast_sched_start_thread(struct ast_sched_context *con)
 {
 	struct sched_thread *st;
+	unsigned int i;
+
+	if (con->shards) {
+		for (i = 0; i < con->num_shards; i++) {
+			if (ast_sched_start_thread(con->shards[i])) {
+				return -1;
+			}
+		}
+		return 0;
+	}
 
 	if (con->sched_thread) {
 		ast_log(LOG_ERROR, "Thread already started on this scheduler context\n");
@@ -234,9 +329,391 @@ static int sched_time_cmp(void *va, void *vb)
 	return cmp;
 }
 
-struct ast_sched_context *ast_sched_context_create(void)
+static int sched_heap_alloc(struct ast_sched_context *con)
+{
+	con->sched_heap = ast_heap_create(8, sched_time_cmp,
+		offsetof(struct sched, __heap_index));
+	return con->sched_heap ? 0 : -1;
+}
+
+static void sched_heap_destroy(struct ast_sched_context *con)
+{
+	ast_heap_destroy(con->sched_heap);
+	con->sched_heap = NULL;
+}
+
+static int sched_heap_push(struct ast_sched_context *con, struct sched *s)
+{
+	return ast_heap_push(con->sched_heap, s);
+}
+
+static int sched_heap_remove(struct ast_sched_context *con, struct sched *s)
+{
+	return ast_heap_remove(con->sched_heap, s) ? 0 : -1;
+}
+
+static struct sched *sched_heap_next_due(struct ast_sched_context *con, struct timeval limit)
+{
+	struct sched *s;
+
+	s = ast_heap_peek(con->sched_heap, 1);
+	if (!s || ast_tvcmp(s->when, limit) != -1) {
+		return NULL;
+	}
+	return s;
+}
+
+static int sched_heap_wait(struct ast_sched_context *con)
+{
+	struct sched *s;
+	int ms;
+
+	if (!(s = ast_heap_peek(con->sched_heap, 1))) {
+		return -1;
+	}
+
+	ms = ast_tvdiff_ms(s->when, ast_tvnow());
+	return ms < 0 ? 0 : ms;
+}
+
+static size_t sched_heap_size(struct ast_sched_context *con)
+{
+	return ast_heap_size(con->sched_heap);
+}
+
+static void sched_heap_callback(struct ast_sched_context *con, sched_queue_cb cb, void *arg)
+{
+	int i = 1;
+	struct sched *current;
+
+	while ((current = ast_heap_peek(con->sched_heap, i))) {
+		if (!cb(con, current, arg)) {
+			i++;
+		}
+	}
+}
+
+/*! \brief Binary heap ordered by expiration time */
+static const struct sched_queue_methods sched_heap_methods = {
+	.alloc = sched_heap_alloc,
+	.destroy = sched_heap_destroy,
+	.push = sched_heap_push,
+	.remove = sched_heap_remove,
+	.next_due = sched_heap_next_due,
+	.wait = sched_heap_wait,
+	.size = sched_heap_size,
+	.callback = sched_heap_callback,
+};
+
+/*! Number of expiration time bits (ms) resolved by each timing wheel level */
+#define SCHED_WHEEL_BITS 8
+/*! Most slots on each timing wheel level */
+#define SCHED_WHEEL_SLOTS (1 << SCHED_WHEEL_BITS)
+/*! Number of timing wheel levels.  With 1 ms ticks the wheel spans about 49 days. */
+#define SCHED_WHEEL_LEVELS 4
+/*! Number of slots used on each level of the given wheel */
+#define SCHED_WHEEL_WIDTH(wheel) (1U << (wheel)->bits)
+#define SCHED_WHEEL_MASK(wheel) (SCHED_WHEEL_WIDTH(wheel) - 1)
+/*! Number of ticks covered by the given number of levels of the given wheel */
+#define SCHED_WHEEL_SPAN(wheel, levels) (1ULL << ((wheel)->bits * (levels)))
+
+AST_DLLIST_HEAD_NOLOCK(sched_wheel_slot, sched);
+
+/*!
+ * \brief Hierarchical timing wheel
+ *
+ * A task expiring less than SCHED_WHEEL_SPAN(wheel, level + 1) ticks after
+ * the wheel's current tick is put in the slot of that level selected
+ * by the matching bits of its expiration tick.  Adding and removing a
+ * task is O(1).  When the wheel reaches the start of a higher level
+ * slot the slot's tasks are cascaded down to the lower levels.  The
+ * lowest level slots hold the tasks of a single tick and are kept in
+ * the same order a heap would run them.
+ */
+struct sched_wheel {
+	/*! The tick (absolute time in ms) the wheel has advanced to */
+	uint64_t now;
+	/*! Expiration time bits resolved by each level, only lowered by tests to turn the wheel faster */
+	unsigned int bits;
+	/*! Number of tasks on each level */
+	unsigned int level_count[SCHED_WHEEL_LEVELS];
+	struct sched_wheel_slot slots[SCHED_WHEEL_LEVELS][SCHED_WHEEL_SLOTS];
+};
+
+static uint64_t sched_wheel_tick(struct timeval tv)
+{
+	return (uint64_t) tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+static void sched_wheel_insert(struct sched_wheel *wheel, struct sched *s)
+{
+	uint64_t expires = sched_wheel_tick(s->when);
+	uint64_t delta;
+	unsigned int level;
+	struct sched_wheel_slot *slot;
+	struct sched *cur;
+
+	if (expires < wheel->now) {
+		/* Already expired.  Run it with the tasks of the current tick. */
+		expires = wheel->now;
+	}
+
+	delta = expires - wheel->now;
+	for (level = 0; level < SCHED_WHEEL_LEVELS - 1; level++) {
+		if (delta < SCHED_WHEEL_SPAN(wheel, level + 1)) {
+			break;
+		}
+	}
+	if (delta >= SCHED_WHEEL_SPAN(wheel, SCHED_WHEEL_LEVELS)) {
+		/* Beyond the wheel.  Park it in the last top level slot to be re-sorted by the cascade. */
+		expires = wheel->now + SCHED_WHEEL_SPAN(wheel, SCHED_WHEEL_LEVELS) - 1;
+	}
+
+	slot = &wheel->slots[level][(expires >> (wheel->bits * level)) & SCHED_WHEEL_MASK(wheel)];
+	if (level) {
+		AST_DLLIST_INSERT_TAIL(slot, s, wheel_list);
+	} else {
+		/* New tasks usually run last so search from the tail. */
+		AST_DLLIST_TRAVERSE_BACKWARDS(slot, cur, wheel_list) {
+			if (sched_time_cmp(cur, s) > 0) {
+				break;
+			}
+		}
+		if (cur) {
+			AST_DLLIST_INSERT_AFTER(slot, cur, s, wheel_list);
+		} else {
+			AST_DLLIST_INSERT_HEAD(slot, s, wheel_list);
+		}
+	}
+
+	s->wheel_slot = slot;
+	s->wheel_level = level;
+	wheel->level_count[level]++;
+}
+
+static void sched_wheel_cascade(struct sched_wheel *wheel, unsigned int level)
+{
+	struct sched_wheel_slot *slot;
+	struct sched_wheel_slot pending;
+	struct sched *s;
+
+	slot = &wheel->slots[level][(wheel->now >> (wheel->bits * level)) & SCHED_WHEEL_MASK(wheel)];
+	pending = *slot;
+	AST_DLLIST_HEAD_INIT_NOLOCK(slot);
+
+	while ((s = AST_DLLIST_REMOVE_HEAD(&pending, wheel_list))) {
+		wheel->level_count[level]--;
+		sched_wheel_insert(wheel, s);
+	}
+}
+
+/*!
+ * \internal
+ * \brief Move the timing wheel forward, but not past target.
+ *
+ * \note The current lowest level slot must be empty.
+ */
+static void sched_wheel_advance(struct sched_wheel *wheel, uint64_t target)
+{
+	unsigned int level;
+	uint64_t next;
+
+	/* Empty levels need not be stepped through one tick at a time. */
+	for (level = 0; level < SCHED_WHEEL_LEVELS && !wheel->level_count[level]; level++) {
+	}
+	if (level == SCHED_WHEEL_LEVELS) {
+		wheel->now = target;
+		return;
+	}
+
+	next = ((wheel->now >> (wheel->bits * level)) + 1) << (wheel->bits * level);
+	if (next > target) {
+		wheel->now = target;
+		return;
+	}
+
+	wheel->now = next;
+	for (level = 1; level < SCHED_WHEEL_LEVELS; level++) {
+		if (wheel->now & (SCHED_WHEEL_SPAN(wheel, level) - 1)) {
+			break;
+		}
+		sched_wheel_cascade(wheel, level);
+	}
+}
+
+static int sched_wheel_alloc(struct ast_sched_context *con)
+{
+	con->wheel = ast_calloc(1, sizeof(*con->wheel));
+	if (!con->wheel) {
+		return -1;
+	}
+	con->wheel->now = sched_wheel_tick(ast_tvnow());
+	con->wheel->bits = SCHED_WHEEL_BITS;
+	return 0;
+}
+
+static void sched_wheel_destroy(struct ast_sched_context *con)
+{
+	ast_free(con->wheel);
+	con->wheel = NULL;
+}
+
+static size_t sched_wheel_size(struct ast_sched_context *con)
+{
+	size_t size = 0;
+	unsigned int level;
+
+	for (level = 0; level < SCHED_WHEEL_LEVELS; level++) {
+		size += con->wheel->level_count[level];
+	}
+	return size;
+}
+
+static int sched_wheel_push(struct ast_sched_context *con, struct sched *s)
+{
+	if (!sched_wheel_size(con)) {
+		/* Catch up with the clock rather than stepping through the idle time later. */
+		uint64_t now = sched_wheel_tick(ast_tvnow());
+
+		if (con->wheel->now < now) {
+			con->wheel->now = now;
+		}
+	}
+
+	sched_wheel_insert(con->wheel, s);
+	return 0;
+}
+
+static int sched_wheel_remove(struct ast_sched_context *con, struct sched *s)
+{
+	if (!s->wheel_slot) {
+		return -1;
+	}
+
+	AST_DLLIST_REMOVE(s->wheel_slot, s, wheel_list);
+	con->wheel->level_count[s->wheel_level]--;
+	s->wheel_slot = NULL;
+	return 0;
+}
+
+static struct sched *sched_wheel_next_due(struct ast_sched_context *con, struct timeval limit)
+{
+	struct sched_wheel *wheel = con->wheel;
+	uint64_t limit_tick = sched_wheel_tick(limit);
+	struct sched *s;
+
+	for (;;) {
+		s = AST_DLLIST_FIRST(&wheel->slots[0][wheel->now & SCHED_WHEEL_MASK(wheel)]);
+		if (s) {
+			return ast_tvcmp(s->when, limit) == -1 ? s : NULL;
+		}
+		if (limit_tick <= wheel->now) {
+			return NULL;
+		}
+		sched_wheel_advance(wheel, limit_tick);
+	}
+}
+
+static int sched_wheel_wait(struct ast_sched_context *con)
+{
+	struct sched_wheel *wheel = con->wheel;
+	struct timeval now = ast_tvnow();
+	int64_t ms = 0;
+	int found = 0;
+	unsigned int level;
+	unsigned int i;
+
+	if (wheel->level_count[0]) {
+		for (i = 0; i < SCHED_WHEEL_WIDTH(wheel); i++) {
+			struct sched *s = AST_DLLIST_FIRST(&wheel->slots[0][(wheel->now + i) & SCHED_WHEEL_MASK(wheel)]);
+
+			if (s) {
+				ms = ast_tvdiff_ms(s->when, now);
+				found = 1;
+				break;
+			}
+		}
+	}
+
+	/*
+	 * Tasks on the higher levels are not sorted.  Wake up when the
+	 * first occupied slot cascades at the latest.  The slot of the
+	 * current block was cascaded already, so what it holds wrapped
+	 * around and cascades a whole turn later.
+	 */
+	for (level = 1; level < SCHED_WHEEL_LEVELS; level++) {
+		uint64_t block = wheel->now >> (wheel->bits * level);
+
+		if (!wheel->level_count[level]) {
+			continue;
+		}
+		for (i = 1; i <= SCHED_WHEEL_WIDTH(wheel); i++) {
+			if (!AST_DLLIST_EMPTY(&wheel->slots[level][(block + i) & SCHED_WHEEL_MASK(wheel)])) {
+				int64_t cascade_ms = (int64_t) ((block + i) << (wheel->bits * level))
+					- (int64_t) sched_wheel_tick(now);
+
+				if (!found || cascade_ms < ms) {
+					ms = cascade_ms;
+				}
+				found = 1;
+				break;
+			}
+		}
+	}
+
+	if (!found) {
+		return -1;
+	}
+	if (ms < 0) {
+		return 0;
+	}
+	return ms > INT_MAX ? INT_MAX : ms;
+}
+
+static void sched_wheel_callback(struct ast_sched_context *con, sched_queue_cb cb, void *arg)
+{
+	unsigned int level;
+	unsigned int i;
+	struct sched *current;
+
+	for (level = 0; level < SCHED_WHEEL_LEVELS; level++) {
+		for (i = 0; i < SCHED_WHEEL_WIDTH(con->wheel) && con->wheel->level_count[level]; i++) {
+			AST_DLLIST_TRAVERSE_SAFE_BEGIN(&con->wheel->slots[level][i], current, wheel_list) {
+				cb(con, current, arg);
+			}
+			AST_DLLIST_TRAVERSE_SAFE_END;
+		}
+	}
+}
+
+/*! \brief Hierarchical timing wheel with 1 ms ticks */
+static const struct sched_queue_methods sched_wheel_methods = {
+	.alloc = sched_wheel_alloc,
+	.destroy = sched_wheel_destroy,
+	.push = sched_wheel_push,
+	.remove = sched_wheel_remove,
+	.next_due = sched_wheel_next_due,
+	.wait = sched_wheel_wait,
+	.size = sched_wheel_size,
+	.callback = sched_wheel_callback,
+};
+
+struct ast_sched_context *ast_sched_context_create_backend(enum ast_sched_backend backend)
 {
 	struct ast_sched_context *tmp;
+	const struct sched_queue_methods *methods;
+
+	switch (backend) {
+	case AST_SCHED_BACKEND_HEAP:
+		methods = &sched_heap_methods;
+		break;
+	case AST_SCHED_BACKEND_WHEEL:
+		methods = &sched_wheel_methods;
+		break;
+	default:
+		ast_log(LOG_ERROR, "Unknown scheduler backend %d\n", backend);
+		return NULL;
+	}
 
 	if (!(tmp = ast_calloc(1, sizeof(*tmp)))) {
 		return NULL;
@@ -244,18 +721,24 @@ struct ast_sched_context *ast_sched_context_create(void)
 
 	ast_mutex_init(&tmp->lock);
 	tmp->eventcnt = 1;
+	tmp->id_stride = 1;
 
 	AST_LIST_HEAD_INIT_NOLOCK(&tmp->id_queue);
 
-	if (!(tmp->sched_heap = ast_heap_create(8, sched_time_cmp,
-			offsetof(struct sched, __heap_index)))) {
+	if (AST_VECTOR_INIT(&tmp->id_map, 0) || methods->alloc(tmp)) {
 		ast_sched_context_destroy(tmp);
 		return NULL;
 	}
+	tmp->methods = methods;
 
 	return tmp;
 }
 
+struct ast_sched_context *ast_sched_context_create(void)
+{
+	return ast_sched_context_create_backend(AST_SCHED_BACKEND_HEAP);
+}
+
 static void sched_free(struct sched *task)
 {
 	/* task->sched_id will be NULL most of the time, but when the
@@ -267,10 +750,59 @@ static void sched_free(struct sched *task)
 	ast_free(task);
 }
 
+struct ast_sched_context *ast_sched_context_create_sharded(unsigned int num_shards)
+{
+	struct ast_sched_context *con;
+
+	if (!num_shards) {
+		ast_log(LOG_ERROR, "A sharded scheduler context needs at least one shard\n");
+		return NULL;
+	}
+
+	if (!(con = ast_sched_context_create())) {
+		return NULL;
+	}
+
+	if (!(con->shards = ast_calloc(num_shards, sizeof(*con->shards)))) {
+		ast_sched_context_destroy(con);
+		return NULL;
+	}
+
+	for (; con->num_shards < num_shards; con->num_shards++) {
+		struct ast_sched_context *shard;
+
+		if (!(shard = ast_sched_context_create())) {
+			ast_sched_context_destroy(con);
+			return NULL;
+		}
+		shard->id_stride = num_shards;
+		shard->id_offset = con->num_shards;
+		con->shards[con->num_shards] = shard;
+	}
+
+	return con;
+}
+
+static int sched_free_cb(struct ast_sched_context *con, struct sched *s, void *arg)
+{
+	con->methods->remove(con, s);
+	sched_free(s);
+	return 1;
+}
+
 void ast_sched_context_destroy(struct ast_sched_context *con)
 {
 	struct sched *s;
 	struct sched_id *sid;
+	unsigned int i;
+
+	if (con->shards) {
+		for (i = 0; i < con->num_shards; i++) {
+			ast_sched_context_destroy(con->shards[i]);
+		}
+		ast_free(con->shards);
+		con->shards = NULL;
+	}
 
 	sched_thread_destroy(con);
 	con->sched_thread = NULL;
@@ -283,17 +815,16 @@ void ast_sched_context_destroy(struct ast_sched_context *con)
 	}
 #endif
 
-	if (con->sched_heap) {
-		while ((s = ast_heap_pop(con->sched_heap))) {
-			sched_free(s);
-		}
-		ast_heap_destroy(con->sched_heap);
-		con->sched_heap = NULL;
+	if (con->methods) {
+		con->methods->callback(con, sched_free_cb, NULL);
+		con->methods->destroy(con);
+		con->methods = NULL;
 	}
 
 	while ((sid = AST_LIST_REMOVE_HEAD(&con->id_queue, list))) {
 		ast_free(sid);
 	}
+	AST_VECTOR_FREE(&con->id_map);
 
 	ast_mutex_unlock(&con->lock);
 	ast_mutex_destroy(&con->lock);
@@ -312,6 +843,7 @@ static int add_ids(struct ast_sched_context *con)
 {
 	int new_size;
 	int original_size;
+	int max_size;
 	int i;
 
 	original_size = con->id_queue_size;
@@ -324,6 +856,11 @@ static int add_ids(struct ast_sched_context *con)
 		/* Overflow. Cap it at INT_MAX. */
 		new_size = INT_MAX;
 	}
+	/* The largest handed out ID must still fit in an int. */
+	max_size = (INT_MAX - con->id_offset - 1) / con->id_stride + 1;
+	if (new_size > max_size) {
+		new_size = max_size;
+	}
 	for (i = original_size; i < new_size; ++i) {
 		struct sched_id *new_id;
 
@@ -332,13 +869,19 @@ static int add_ids(struct ast_sched_context *con)
 			break;
 		}
 
+		/* Reserve the id_map slot for the new ID. */
+		if (AST_VECTOR_APPEND(&con->id_map, NULL)) {
+			ast_free(new_id);
+			break;
+		}
+
 		/*
 		 * According to the API doxygen a sched ID of 0 is valid.
 		 * Unfortunately, 0 was never returned historically and
 		 * several users incorrectly coded usage of the returned
 		 * sched ID assuming that 0 was invalid.
 		 */
-		new_id->id = ++con->id_queue_size;
+		new_id->id = con->id_offset + con->id_queue_size++ * con->id_stride + 1;
 
 		AST_LIST_INSERT_TAIL(&con->id_queue, new_id, list);
 	}
@@ -356,6 +899,30 @@ static int set_sched_id(struct ast_sched_context *con, struct sched *new_sched)
 	return 0;
 }
 
+/*!
+ * \internal
+ * \brief Put a task into the scheduler queue and the ID lookup map.
+ */
+static void sched_queue_push(struct ast_sched_context *con, struct sched *s)
+{
+	if (!con->methods->push(con, s)) {
+		AST_VECTOR_REPLACE(&con->id_map, sched_id_index(con, s->sched_id->id), s);
+	}
+}
+
+/*!
+ * \internal
+ * \brief Take a task out of the scheduler queue and the ID lookup map.
+ *
+ * \retval 0 on success.
+ * \retval -1 if the task was not queued.
+ */
+static int sched_queue_remove(struct ast_sched_context *con, struct sched *s)
+{
+	AST_VECTOR_REPLACE(&con->id_map, sched_id_index(con, s->sched_id->id), NULL);
+	return con->methods->remove(con, s);
+}
+
 static void sched_release(struct ast_sched_context *con, struct sched *tmp)
 {
 	if (tmp->sched_id) {
@@ -405,20 +972,43 @@ static struct sched *sched_alloc(struct ast_sched_context *con)
 	return tmp;
 }
 
+struct sched_clean_args {
+	ast_sched_cb match;
+	AST_LIST_HEAD_NOLOCK(, sched) matches;
+};
+
+static int sched_clean_cb(struct ast_sched_context *con, struct sched *s, void *arg)
+{
+	struct sched_clean_args *args = arg;
+
+	if (s->callback != args->match) {
+		return 0;
+	}
+
+	sched_queue_remove(con, s);
+	AST_LIST_INSERT_TAIL(&args->matches, s, list);
+	return 1;
+}
+
 void ast_sched_clean_by_callback(struct ast_sched_context *con, ast_sched_cb match, ast_sched_cb cleanup_cb)
 {
-	int i = 1;
+	int i;
 	struct sched *current;
+	struct sched_clean_args args = {
+		.match = match,
+	};
 
-	ast_mutex_lock(&con->lock);
-	while ((current = ast_heap_peek(con->sched_heap, i))) {
-		if (current->callback != match) {
-			i++;
-			continue;
+	if (con->shards) {
+		for (i = 0; i < con->num_shards; i++) {
+			ast_sched_clean_by_callback(con->shards[i], match, cleanup_cb);
 		}
+		return;
+	}
 
-		ast_heap_remove(con->sched_heap, current);
-
+	ast_mutex_lock(&con->lock);
+	/* Collect the matches first since cleanup_cb may change the queue. */
+	con->methods->callback(con, sched_clean_cb, &args);
+	while ((current = AST_LIST_REMOVE_HEAD(&args.matches, list))) {
 		cleanup_cb(current->data);
 		sched_release(con, current);
 	}
@@ -432,19 +1022,25 @@ void ast_sched_clean_by_callback(struct ast_sched_context *con, ast_sched_cb mat
 int ast_sched_wait(struct ast_sched_context *con)
 {
 	int ms;
-	struct sched *s;
 
 	DEBUG(ast_debug(1, "ast_sched_wait()\n"));
 
-	ast_mutex_lock(&con->lock);
-	if ((s = ast_heap_peek(con->sched_heap, 1))) {
-		ms = ast_tvdiff_ms(s->when, ast_tvnow());
-		if (ms < 0) {
-			ms = 0;
-		}
-	} else {
+	if (con->shards) {
+		unsigned int i;
+
 		ms = -1;
+		for (i = 0; i < con->num_shards; i++) {
+			int shard_ms = ast_sched_wait(con->shards[i]);
+
+			if (shard_ms != -1 && (ms == -1 || shard_ms < ms)) {
+				ms = shard_ms;
+			}
+		}
+		return ms;
 	}
+
+	ast_mutex_lock(&con->lock);
+	ms = con->methods->wait(con);
 	ast_mutex_unlock(&con->lock);
 
 	return ms;
@@ -460,9 +1056,9 @@ static void schedule(struct ast_sched_context *con, struct sched *s)
 {
 	size_t size;
 
-	size = ast_heap_size(con->sched_heap);
+	size = con->methods->size(con);
 
-	/* Record the largest the scheduler heap became for reporting purposes. */
+	/* Record the largest the scheduler queue became for reporting purposes. */
 	if (con->highwater <= size) {
 		con->highwater = size + 1;
 	}
@@ -479,7 +1075,7 @@ static void schedule(struct ast_sched_context *con, struct sched *s)
 	}
 	s->tie_breaker = con->tie_breaker;
 
-	ast_heap_push(con->sched_heap, s);
+	sched_queue_push(con, s);
 }
 
 /*! \brief
@@ -530,6 +1126,13 @@ int ast_sched_add_variable(struct ast_sched_context *con, int when, ast_sched_cb
 
 	DEBUG(ast_debug(1, "ast_sched_add()\n"));
 
+	if (con->shards) {
+		unsigned int shard = (unsigned int) ast_atomic_fetchadd_int(&con->next_shard, 1);
+
+		return ast_sched_add_variable(con->shards[shard % con->num_shards],
+			when, callback, data, variable);
+	}
+
 	ast_mutex_lock(&con->lock);
 	if ((tmp = sched_alloc(con))) {
 		con->eventcnt++;
@@ -574,19 +1177,24 @@ int ast_sched_add(struct ast_sched_context *con, int when, ast_sched_cb callback
 
 static struct sched *sched_find(struct ast_sched_context *con, int id)
 {
-	int x;
-	size_t heap_size;
+	unsigned int idx;
+	struct sched *s;
 
-	heap_size = ast_heap_size(con->sched_heap);
-	for (x = 1; x <= heap_size; x++) {
-		struct sched *cur = ast_heap_peek(con->sched_heap, x);
+	if (id <= (int) con->id_offset) {
+		return NULL;
+	}
 
-		if (cur->sched_id->id == id) {
-			return cur;
-		}
+	idx = sched_id_index(con, id);
+	if (AST_VECTOR_SIZE(&con->id_map) <= idx) {
+		return NULL;
 	}
 
-	return NULL;
+	s = AST_VECTOR_GET(&con->id_map, idx);
+	if (!s || s->sched_id->id != id) {
+		return NULL;
+	}
+
+	return s;
 }
 
 const void *ast_sched_find_data(struct ast_sched_context *con, int id)
@@ -594,6 +1202,10 @@ const void *ast_sched_find_data(struct ast_sched_context *con, int id)
 	struct sched *s;
 	const void *data = NULL;
 
+	if (con->shards) {
+		return id > 0 ? ast_sched_find_data(sched_shard_by_id(con, id), id) : NULL;
+	}
+
 	ast_mutex_lock(&con->lock);
 
 	s = sched_find(con, id);
@@ -627,12 +1239,19 @@ int _ast_sched_del(struct ast_sched_context *con, int id, const char *file, int
 		return 0;
 	}
 
+	if (con->shards) {
+		if (!id) {
+			return -1;
+		}
+		return ast_sched_del(sched_shard_by_id(con, id), id);
+	}
+
 	ast_mutex_lock(&con->lock);
 
 	s = sched_find(con, id);
 	if (s) {
-		if (!ast_heap_remove(con->sched_heap, s)) {
-			ast_log(LOG_WARNING,"sched entry %d not in the sched heap?\n", s->sched_id->id);
+		if (sched_queue_remove(con, s)) {
+			ast_log(LOG_WARNING,"sched entry %d not in the sched queue?\n", s->sched_id->id);
 		}
 		sched_release(con, s);
 	} else if (con->currently_executing && (id == con->currently_executing->sched_id->id)) {
@@ -670,35 +1289,69 @@ int _ast_sched_del(struct ast_sched_context *con, int id, const char *file, int
 	return 0;
 }
 
+struct sched_report_args {
+	struct ast_cb_names *cbnames;
+	int *countlist;
+};
+
+static int sched_report_cb(struct ast_sched_context *con, struct sched *cur, void *arg)
+{
+	struct sched_report_args *args = arg;
+	int i;
+
+	/* match the callback to the cblist */
+	for (i = 0; i < args->cbnames->numassocs; i++) {
+		if (cur->callback == args->cbnames->cblist[i]) {
+			break;
+		}
+	}
+	args->countlist[i]++;
+
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Count the scheduled tasks of a context by callback.
+ *
+ * \return The number of tasks in the context.
+ */
+static size_t sched_report_count(struct ast_sched_context *con, struct ast_cb_names *cbnames, int *countlist)
+{
+	struct sched_report_args args = {
+		.cbnames = cbnames,
+		.countlist = countlist,
+	};
+	size_t size;
+
+	ast_mutex_lock(&con->lock);
+	size = con->methods->size(con);
+	con->methods->callback(con, sched_report_cb, &args);
+	ast_mutex_unlock(&con->lock);
+
+	return size;
+}
+
 void ast_sched_report(struct ast_sched_context *con, struct ast_str **buf, struct ast_cb_names *cbnames)
 {
-	int i, x;
-	struct sched *cur;
+	int i;
 	int countlist[cbnames->numassocs + 1];
-	size_t heap_size;
+	unsigned int highwater = 0;
+	size_t schedcnt = 0;
 
 	memset(countlist, 0, sizeof(countlist));
-	ast_str_set(buf, 0, " Highwater = %u\n schedcnt = %zu\n", con->highwater, ast_heap_size(con->sched_heap));
 
-	ast_mutex_lock(&con->lock);
-
-	heap_size = ast_heap_size(con->sched_heap);
-	for (x = 1; x <= heap_size; x++) {
-		cur = ast_heap_peek(con->sched_heap, x);
-		/* match the callback to the cblist */
-		for (i = 0; i < cbnames->numassocs; i++) {
-			if (cur->callback == cbnames->cblist[i]) {
-				break;
-			}
-		}
-		if (i < cbnames->numassocs) {
-			countlist[i]++;
-		} else {
-			countlist[cbnames->numassocs]++;
+	if (con->shards) {
+		for (i = 0; i < con->num_shards; i++) {
+			schedcnt += sched_report_count(con->shards[i], cbnames, countlist);
+			highwater += con->shards[i]->highwater;
 		}
+	} else {
+		schedcnt = sched_report_count(con, cbnames, countlist);
+		highwater = con->highwater;
 	}
 
-	ast_mutex_unlock(&con->lock);
+	ast_str_set(buf, 0, " Highwater = %u\n schedcnt = %zu\n", highwater, schedcnt);
 
 	for (i = 0; i < cbnames->numassocs; i++) {
 		ast_str_append(buf, 0, "    %s : %d\n", cbnames->list[i], countlist[i]);
@@ -707,35 +1360,48 @@ void ast_sched_report(struct ast_sched_context *con, struct ast_str **buf, struc
 	ast_str_append(buf, 0, "   <unknown> : %d\n", countlist[cbnames->numassocs]);
 }
 
+static int sched_dump_cb(struct ast_sched_context *con, struct sched *q, void *arg)
+{
+	struct timeval *when = arg;
+	struct timeval delta;
+
+	delta = ast_tvsub(q->when, *when);
+	ast_debug(1, "|%.4d | %-15p | %-15p | %.6ld : %.6ld |\n",
+		q->sched_id->id,
+		q->callback,
+		q->data,
+		(long)delta.tv_sec,
+		(long int)delta.tv_usec);
+
+	return 0;
+}
+
 /*! \brief Dump the contents of the scheduler to LOG_DEBUG */
 void ast_sched_dump(struct ast_sched_context *con)
 {
-	struct sched *q;
 	struct timeval when = ast_tvnow();
-	int x;
-	size_t heap_size;
+
+	if (con->shards) {
+		unsigned int i;
+
+		for (i = 0; i < con->num_shards; i++) {
+			ast_debug(1, "Asterisk Schedule Shard %u of %u\n", i + 1, con->num_shards);
+			ast_sched_dump(con->shards[i]);
+		}
+		return;
+	}
+
 #ifdef SCHED_MAX_CACHE
-	ast_debug(1, "Asterisk Schedule Dump (%zu in Q, %u Total, %u Cache, %u high-water)\n", ast_heap_size(con->sched_heap), con->eventcnt - 1, con->schedccnt, con->highwater);
+	ast_debug(1, "Asterisk Schedule Dump (%zu in Q, %u Total, %u Cache, %u high-water)\n", con->methods->size(con), con->eventcnt - 1, con->schedccnt, con->highwater);
 #else
-	ast_debug(1, "Asterisk Schedule Dump (%zu in Q, %u Total, %u high-water)\n", ast_heap_size(con->sched_heap), con->eventcnt - 1, con->highwater);
+	ast_debug(1, "Asterisk Schedule Dump (%zu in Q, %u Total, %u high-water)\n", con->methods->size(con), con->eventcnt - 1, con->highwater);
 #endif
 
 	ast_debug(1, "=============================================================\n");
 	ast_debug(1, "|ID    Callback          Data              Time  (sec:ms)   |\n");
 	ast_debug(1, "+-----+-----------------+-----------------+-----------------+\n");
 	ast_mutex_lock(&con->lock);
-	heap_size = ast_heap_size(con->sched_heap);
-	for (x = 1; x <= heap_size; x++) {
-		struct timeval delta;
-		q = ast_heap_peek(con->sched_heap, x);
-		delta = ast_tvsub(q->when, when);
-		ast_debug(1, "|%.4d | %-15p | %-15p | %.6ld : %.6ld |\n",
-			q->sched_id->id,
-			q->callback,
-			q->data,
-			(long)delta.tv_sec,
-			(long int)delta.tv_usec);
-	}
+	con->methods->callback(con, sched_dump_cb, &when);
 	ast_mutex_unlock(&con->lock);
 	ast_debug(1, "=============================================================\n");
 }
@@ -752,20 +1418,25 @@ int ast_sched_runq(struct ast_sched_context *con)
 
 	DEBUG(ast_debug(1, "ast_sched_runq()\n"));
 
-	ast_mutex_lock(&con->lock);
+	if (con->shards) {
+		unsigned int i;
 
-	when = ast_tvadd(ast_tvnow(), ast_tv(0, 1000));
-	for (numevents = 0; (current = ast_heap_peek(con->sched_heap, 1)); numevents++) {
-		/* schedule all events which are going to expire within 1ms.
-		 * We only care about millisecond accuracy anyway, so this will
-		 * help us get more than one event at one time if they are very
-		 * close together.
-		 */
-		if (ast_tvcmp(current->when, when) != -1) {
-			break;
+		for (i = 0, numevents = 0; i < con->num_shards; i++) {
+			numevents += ast_sched_runq(con->shards[i]);
 		}
+		return numevents;
+	}
 
-		current = ast_heap_pop(con->sched_heap);
+	ast_mutex_lock(&con->lock);
+
+	when = ast_tvadd(ast_tvnow(), ast_tv(0, 1000));
+	/* schedule all events which are going to expire within 1ms.
+	 * We only care about millisecond accuracy anyway, so this will
+	 * help us get more than one event at one time if they are very
+	 * close together.
+	 */
+	for (numevents = 0; (current = con->methods->next_due(con, when)); numevents++) {
+		sched_queue_remove(con, current);
 
 		/*
 		 * At this point, the schedule queue is still intact.  We
@@ -810,6 +1481,10 @@ long ast_sched_when(struct ast_sched_context *con,int id)
 	long secs = -1;
 	DEBUG(ast_debug(1, "ast_sched_when()\n"));
 
+	if (con->shards) {
+		return id > 0 ? ast_sched_when(sched_shard_by_id(con, id), id) : -1;
+	}
+
 	ast_mutex_lock(&con->lock);
 
 	s = sched_find(con, id);
@@ -822,3 +1497,89 @@ long ast_sched_when(struct ast_sched_context *con,int id)
 
 	return secs;
 }
+
+#ifdef TEST_FRAMEWORK
+/*! Expiration time bits per level of the wheel the wrap test turns */
+#define SCHED_TEST_WHEEL_BITS 4
+
+/*! Delays (ms) just short of a turn of the second level of the narrowed wheel */
+static const int sched_test_wrap_delays[] = { 248, 255 };
+
+static int sched_test_count_cb(const void *data)
+{
+	ast_atomic_fetchadd_int((int *) data, 1);
+	return 0;
+}
+
+AST_TEST_DEFINE(sched_test_wheel_wrap_run)
+{
+	struct ast_sched_context *con;
+	enum ast_test_result_state res = AST_TEST_FAIL;
+	unsigned int i;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "sched_test_wheel_wrap_run";
+		info->category = "/main/sched/";
+		info->summary = "Test running a wrapped around timing wheel event";
+		info->description =
+			"This test ensures that an event in the slot of the second level "
+			"of a timing wheel that wrapped around runs when waited for the "
+			"way a scheduler thread does.  The wheel is narrowed so that it "
+			"wraps around in a quarter of a second.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	for (i = 0; i < ARRAY_LEN(sched_test_wrap_delays); i++) {
+		int delay = sched_test_wrap_delays[i];
+		struct timeval deadline;
+		int ran = 0;
+
+		if (!(con = ast_sched_context_create_backend(AST_SCHED_BACKEND_WHEEL))) {
+			ast_test_status_update(test, "Test failed - could not create scheduler context\n");
+			return AST_TEST_FAIL;
+		}
+		/* Nothing is scheduled yet, so the wheel can be narrowed */
+		con->wheel->bits = SCHED_TEST_WHEEL_BITS;
+
+		ast_test_validate_cleanup(test, ast_sched_add(con, delay, sched_test_count_cb, &ran) > 0,
+			res, return_cleanup);
+
+		deadline = ast_tvadd(ast_tvnow(), ast_samp2tv(delay + 5000, 1000));
+		while (!ran && ast_tvcmp(ast_tvnow(), deadline) < 0) {
+			int wait = ast_sched_wait(con);
+
+			ast_test_validate_cleanup(test, wait != -1, res, return_cleanup);
+			usleep(MIN(wait, 1000) * 1000);
+			ast_sched_runq(con);
+		}
+		if (ran != 1) {
+			ast_test_status_update(test, "Event %d ms away ran %d times\n", delay, ran);
+			goto return_cleanup;
+		}
+
+		ast_sched_context_destroy(con);
+	}
+
+	return AST_TEST_PASS;
+
+return_cleanup:
+	ast_sched_context_destroy(con);
+
+	return res;
+}
+#endif
+
+static void sched_shutdown(void)
+{
+	AST_TEST_UNREGISTER(sched_test_wheel_wrap_run);
+}
+
+int ast_sched_init(void)
+{
+	AST_TEST_REGISTER(sched_test_wheel_wrap_run);
+	ast_register_cleanup(sched_shutdown);
+	return 0;
+}
@@ -0,0 +1,302 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2017, Digium, Inc.
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+/*! \file
+ *
+ * \brief Saturating mixing of signed linear audio buffers
+ *
+ * Every implementation adds the inputs in the same order, one vector of
+ * samples at a time, so saturation happens exactly where the scalar code
+ * would saturate and the results are bit for bit identical.
+ */
+
+/*** MODULEINFO
+	<support_level>core</support_level>
+ ***/
+
+#include "asterisk.h"
+
+#include "asterisk/slinear_mix.h"
+#include "asterisk/utils.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) \
+	&& (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+/* The compiler can build functions for instruction sets it was not told to use. */
+#define SLINEAR_MIX_X86
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define SLINEAR_MIX_NEON
+#include <arm_neon.h>
+#endif
+
+typedef void (*slinear_mix_fn)(int16_t *output, int16_t * const *inputs,
+	size_t num_inputs, size_t samples);
+typedef void (*slinear_subtract_fn)(int16_t *input, const int16_t *value,
+	size_t samples);
+
+/*!
+ * \brief Mix the samples from \a start on, one at a time
+ *
+ * \note The buffers are restrict qualified so the compiler is free to
+ * vectorize this on its own where it can.
+ */
+static void mix_scalar_from(int16_t * restrict output, int16_t * const *inputs,
+	size_t num_inputs, size_t start, size_t samples)
+{
+	size_t idx;
+	size_t x;
+
+	for (x = start; x < samples; ++x) {
+		output[x] = 0;
+	}
+	for (idx = 0; idx < num_inputs; ++idx) {
+		int16_t * restrict input = inputs[idx];
+
+		for (x = start; x < samples; ++x) {
+			ast_slinear_saturated_add(&output[x], &input[x]);
+		}
+	}
+}
+
+/*! \brief Subtract the samples from \a start on, one at a time */
+static void subtract_scalar_from(int16_t * restrict input, const int16_t * restrict value,
+	size_t start, size_t samples)
+{
+	size_t x;
+
+	for (x = start; x < samples; ++x) {
+		ast_slinear_saturated_subtract(&input[x], (short *) &value[x]);
+	}
+}
+
+static void mix_scalar(int16_t *output, int16_t * const *inputs,
+	size_t num_inputs, size_t samples)
+{
+	mix_scalar_from(output, inputs, num_inputs, 0, samples);
+}
+
+static void subtract_scalar(int16_t *input, const int16_t *value, size_t samples)
+{
+	subtract_scalar_from(input, value, 0, samples);
+}
+
+#ifdef SLINEAR_MIX_X86
+__attribute__((target("sse2")))
+static void mix_sse2(int16_t *output, int16_t * const *inputs,
+	size_t num_inputs, size_t samples)
+{
+	size_t idx;
+	size_t x;
+
+	for (x = 0; x + 8 <= samples; x += 8) {
+		__m128i acc = _mm_setzero_si128();
+
+		for (idx = 0; idx < num_inputs; ++idx) {
+			acc = _mm_adds_epi16(acc, _mm_loadu_si128((const __m128i *) &inputs[idx][x]));
+		}
+		_mm_storeu_si128((__m128i *) &output[x], acc);
+	}
+	mix_scalar_from(output, inputs, num_inputs, x, samples);
+}
+
+__attribute__((target("sse2")))
+static void subtract_sse2(int16_t *input, const int16_t *value, size_t samples)
+{
+	size_t x;
+
+	for (x = 0; x + 8 <= samples; x += 8) {
+		__m128i in = _mm_loadu_si128((const __m128i *) &input[x]);
+
+		in = _mm_subs_epi16(in, _mm_loadu_si128((const __m128i *) &value[x]));
+		_mm_storeu_si128((__m128i *) &input[x], in);
+	}
+	subtract_scalar_from(input, value, x, samples);
+}
+
+__attribute__((target("avx2")))
+static void mix_avx2(int16_t *output, int16_t * const *inputs,
+	size_t num_inputs, size_t samples)
+{
+	size_t idx;
+	size_t x;
+
+	for (x = 0; x + 16 <= samples; x += 16) {
+		__m256i acc = _mm256_setzero_si256();
+
+		for (idx = 0; idx < num_inputs; ++idx) {
+			acc = _mm256_adds_epi16(acc, _mm256_loadu_si256((const __m256i *) &inputs[idx][x]));
+		}
+		_mm256_storeu_si256((__m256i *) &output[x], acc);
+	}
+	mix_scalar_from(output, inputs, num_inputs, x, samples);
+}
+
+__attribute__((target("avx2")))
+static void subtract_avx2(int16_t *input, const int16_t *value, size_t samples)
+{
+	size_t x;
+
+	for (x = 0; x + 16 <= samples; x += 16) {
+		__m256i in = _mm256_loadu_si256((const __m256i *) &input[x]);
+
+		in = _mm256_subs_epi16(in, _mm256_loadu_si256((const __m256i *) &value[x]));
+		_mm256_storeu_si256((__m256i *) &input[x], in);
+	}
+	subtract_scalar_from(input, value, x, samples);
+}
+#endif /* SLINEAR_MIX_X86 */
+
+#ifdef SLINEAR_MIX_NEON
+static void mix_neon(int16_t *output, int16_t * const *inputs,
+	size_t num_inputs, size_t samples)
+{
+	size_t idx;
+	size_t x;
+
+	for (x = 0; x + 8 <= samples; x += 8) {
+		int16x8_t acc = vdupq_n_s16(0);
+
+		for (idx = 0; idx < num_inputs; ++idx) {
+			acc = vqaddq_s16(acc, vld1q_s16(&inputs[idx][x]));
+		}
+		vst1q_s16(&output[x], acc);
+	}
+	mix_scalar_from(output, inputs, num_inputs, x, samples);
+}
+
+static void subtract_neon(int16_t *input, const int16_t *value, size_t samples)
+{
+	size_t x;
+
+	for (x = 0; x + 8 <= samples; x += 8) {
+		vst1q_s16(&input[x], vqsubq_s16(vld1q_s16(&input[x]), vld1q_s16(&value[x])));
+	}
+	subtract_scalar_from(input, value, x, samples);
+}
+#endif /* SLINEAR_MIX_NEON */
+
+/*! \brief An implementation of the mixing functions */
+struct slinear_mix_ops {
+	const char *name;
+	slinear_mix_fn mix;
+	slinear_subtract_fn subtract;
+};
+
+static const struct slinear_mix_ops mix_ops[] = {
+	[AST_SLINEAR_MIX_SCALAR] = { "scalar", mix_scalar, subtract_scalar },
+#ifdef SLINEAR_MIX_X86
+	[AST_SLINEAR_MIX_SSE2] = { "sse2", mix_sse2, subtract_sse2 },
+	[AST_SLINEAR_MIX_AVX2] = { "avx2", mix_avx2, subtract_avx2 },
+#else
+	[AST_SLINEAR_MIX_SSE2] = { "sse2", NULL, NULL },
+	[AST_SLINEAR_MIX_AVX2] = { "avx2", NULL, NULL },
+#endif
+#ifdef SLINEAR_MIX_NEON
+	[AST_SLINEAR_MIX_NEON] = { "neon", mix_neon, subtract_neon },
+#else
+	[AST_SLINEAR_MIX_NEON] = { "neon", NULL, NULL },
+#endif
+};
+
+/*! \brief Determine if this CPU can run an implementation */
+static int impl_supported(enum ast_slinear_mix_impl impl)
+{
+	if (impl >= ARRAY_LEN(mix_ops) || !mix_ops[impl].mix) {
+		return 0;
+	}
+
+#ifdef SLINEAR_MIX_X86
+	__builtin_cpu_init();
+	switch (impl) {
+	case AST_SLINEAR_MIX_SSE2:
+		return __builtin_cpu_supports("sse2");
+	case AST_SLINEAR_MIX_AVX2:
+		return __builtin_cpu_supports("avx2");
+	default:
+		break;
+	}
+#endif
+
+	return 1;
+}
+
+/*!
+ * \brief The implementation in use
+ *
+ * -1 until the first call picks the best one.  Picking is idempotent, so
+ * threads racing to do it all store the same value.
+ */
+static int current_impl = -1;
+
+static const struct slinear_mix_ops *get_ops(void)
+{
+	int impl = current_impl;
+
+	if (impl < 0) {
+		static const enum ast_slinear_mix_impl preferred[] = {
+			AST_SLINEAR_MIX_AVX2,
+			AST_SLINEAR_MIX_SSE2,
+			AST_SLINEAR_MIX_NEON,
+		};
+		int i;
+
+		impl = AST_SLINEAR_MIX_SCALAR;
+		for (i = 0; i < ARRAY_LEN(preferred); ++i) {
+			if (impl_supported(preferred[i])) {
+				impl = preferred[i];
+				break;
+			}
+		}
+		current_impl = impl;
+	}
+
+	return &mix_ops[impl];
+}
+
+void ast_slinear_saturated_mix(int16_t *output, int16_t * const *inputs,
+	size_t num_inputs, size_t samples)
+{
+	get_ops()->mix(output, inputs, num_inputs, samples);
+}
+
+void ast_slinear_saturated_subtract_buf(int16_t *input, const int16_t *value,
+	size_t samples)
+{
+	get_ops()->subtract(input, value, samples);
+}
+
+enum ast_slinear_mix_impl ast_slinear_mix_get_impl(void)
+{
+	get_ops();
+	return current_impl;
+}
+
+const char *ast_slinear_mix_impl_name(enum ast_slinear_mix_impl impl)
+{
+	if (impl >= ARRAY_LEN(mix_ops)) {
+		return "unknown";
+	}
+	return mix_ops[impl].name;
+}
+
+int ast_slinear_mix_set_impl(enum ast_slinear_mix_impl impl)
+{
+	if (!impl_supported(impl)) {
+		return -1;
+	}
+	current_impl = impl;
+	return 0;
+}
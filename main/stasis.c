@@ -299,6 +299,12 @@
 /*! The number of buckets to use for topic pools */
 #define TOPIC_POOL_BUCKETS 57
 
+/*!
+ * Number of messages a subscription's ring holds before it falls back to
+ * one mailbox task per message.  Must be a power of two.
+ */
+#define SUBSCRIPTION_RING_SIZE 32
+
 /*! Thread pool for topics that don't want a dedicated taskprocessor */
 static struct ast_threadpool *pool;
 
@@ -370,6 +376,14 @@ const char *stasis_topic_name(const struct stasis_topic *topic)
 	return topic->name;
 }
 
+/*! \internal \brief A message waiting in a subscription's ring */
+struct subscription_ring_entry {
+	/*! The message; the entry owns a reference */
+	struct stasis_message *message;
+	/*! Set for a synchronous publish to signal once it is delivered */
+	struct sync_task_data *sync;
+};
+
 /*! \internal */
 struct stasis_subscription {
 	/*! Unique ID for this subscription */
@@ -382,6 +396,34 @@ struct stasis_subscription {
 	stasis_subscription_cb callback;
 	/*! Data pointer to be handed to the callback. */
 	void *data;
+	/*! Callback invoked once no more messages are waiting. */
+	stasis_subscription_batch_cb batch_callback;
+
+	/*! Which message types are raised; indexed by stasis_message_type_id(). */
+	AST_VECTOR(, char) accepted_message_types;
+	/*! The message filter currently in use. */
+	enum stasis_subscription_message_filter filter;
+	/*! Lock for the accepted message types and the filter; dispatch only reads them. */
+	ast_rwlock_t filter_lock;
+
+	/*! Lock for the ring and the counters below. */
+	ast_mutex_t ring_lock;
+	/*!
+	 * \brief Messages waiting to be delivered by the mailbox
+	 *
+	 * Publishing a message to a subscription that has a mailbox puts it
+	 * here, so a burst of messages costs one mailbox task instead of one
+	 * per message.  Only allocated for subscriptions with a mailbox.
+	 */
+	struct subscription_ring_entry *ring;
+	/*! Index of the oldest message in the ring. */
+	unsigned int ring_head;
+	/*! Number of messages in the ring. */
+	unsigned int ring_count;
+	/*! Number of messages pushed to the mailbox as individual tasks. */
+	unsigned int ring_spilled;
+	/*! Set while a task to drain the ring is queued to the mailbox. */
+	unsigned int ring_scheduled:1;
 
 	/*! Condition for joining with subscription. */
 	ast_cond_t join_cond;
@@ -409,6 +451,18 @@ static void subscription_dtor(void *obj)
 	ast_taskprocessor_unreference(sub->mailbox);
 	sub->mailbox = NULL;
 	ast_cond_destroy(&sub->join_cond);
+
+	/* Only left behind if the mailbox could not be given the ring. */
+	while (sub->ring_count) {
+		ao2_cleanup(sub->ring[sub->ring_head].message);
+		sub->ring_head = (sub->ring_head + 1) & (SUBSCRIPTION_RING_SIZE - 1);
+		--sub->ring_count;
+	}
+	ast_free(sub->ring);
+	ast_mutex_destroy(&sub->ring_lock);
+
+	ast_rwlock_destroy(&sub->filter_lock);
+	AST_VECTOR_FREE(&sub->accepted_message_types);
 }
 
 /*!
@@ -437,6 +491,10 @@ static void subscription_invoke(struct stasis_subscription *sub,
 
 		sub->final_message_processed = 1;
 		ast_cond_signal(&sub->join_cond);
+	} else if (sub->batch_callback && sub->mailbox && !sub->ring_count
+		&& !ast_taskprocessor_size(sub->mailbox)) {
+		/* End of the burst; let the subscriber do its deferred work. */
+		sub->batch_callback(sub->data, sub);
 	}
 }
 
@@ -466,6 +524,11 @@ struct stasis_subscription *internal_stasis_subscribe(
 		return NULL;
 	}
 	ast_uuid_generate_str(sub->uniqueid, sizeof(sub->uniqueid));
+	ast_mutex_init(&sub->ring_lock);
+	ast_rwlock_init(&sub->filter_lock);
+	if (AST_VECTOR_INIT(&sub->accepted_message_types, 0)) {
+		return NULL;
+	}
 
 	if (needs_mailbox) {
 		char tps_name[AST_TASKPROCESSOR_MAX_NAME + 1];
@@ -488,6 +551,12 @@ struct stasis_subscription *internal_stasis_subscribe(
 		if (!sub->mailbox) {
 			return NULL;
 		}
+		sub->ring = ast_calloc(SUBSCRIPTION_RING_SIZE, sizeof(*sub->ring));
+		if (!sub->ring) {
+			ast_taskprocessor_unreference(sub->mailbox);
+			sub->mailbox = NULL;
+			return NULL;
+		}
 		ast_taskprocessor_set_local(sub->mailbox, sub);
 		/* Taskprocessor has a reference */
 		ao2_ref(sub, +1);
@@ -563,6 +632,95 @@ struct stasis_subscription *stasis_unsubscribe(struct stasis_subscription *sub)
 	return NULL;
 }
 
+int stasis_subscription_set_batch_callback(struct stasis_subscription *subscription,
+	stasis_subscription_batch_cb callback)
+{
+	if (!subscription || !subscription->mailbox) {
+		return -1;
+	}
+
+	subscription->batch_callback = callback;
+	return 0;
+}
+
+int stasis_subscription_accept_message_type(struct stasis_subscription *subscription,
+	const struct stasis_message_type *type)
+{
+	int id;
+	int res = 0;
+
+	if (!subscription) {
+		return -1;
+	}
+
+	ast_assert(type != NULL);
+
+	id = stasis_message_type_id(type);
+	ast_rwlock_wrlock(&subscription->filter_lock);
+	if (id >= AST_VECTOR_SIZE(&subscription->accepted_message_types)) {
+		/* Grow the vector with every type up to this one declined. */
+		while (!res && AST_VECTOR_SIZE(&subscription->accepted_message_types) <= id) {
+			res = AST_VECTOR_APPEND(&subscription->accepted_message_types, 0);
+		}
+	}
+	if (!res) {
+		AST_VECTOR_REPLACE(&subscription->accepted_message_types, id, 1);
+	}
+	ast_rwlock_unlock(&subscription->filter_lock);
+
+	return res;
+}
+
+int stasis_subscription_set_filter(struct stasis_subscription *subscription,
+	enum stasis_subscription_message_filter filter)
+{
+	if (!subscription) {
+		return -1;
+	}
+
+	ast_rwlock_wrlock(&subscription->filter_lock);
+	subscription->filter = filter;
+	ast_rwlock_unlock(&subscription->filter_lock);
+
+	return 0;
+}
+
+/*!
+ * \internal \brief Determine if a subscription is interested in a message
+ * \param sub The subscription
+ * \param message The message
+ *
+ * \retval 1 The message should be raised to the subscription
+ * \retval 0 The message is filtered out
+ */
+static int subscription_accepts(struct stasis_subscription *sub,
+	struct stasis_message *message)
+{
+	struct stasis_message_type *type;
+	int id;
+	int accepted;
+
+	if (sub->filter != STASIS_SUBSCRIPTION_FILTER_SELECTIVE) {
+		return 1;
+	}
+
+	type = stasis_message_type(message);
+	if (type == stasis_subscription_change_type()) {
+		/* The final message has to get through. */
+		return 1;
+	}
+
+	id = stasis_message_type_id(type);
+	/* Every publisher may read the filter at once; only changing it is exclusive. */
+	ast_rwlock_rdlock(&sub->filter_lock);
+	accepted = sub->filter != STASIS_SUBSCRIPTION_FILTER_SELECTIVE
+		|| (id < AST_VECTOR_SIZE(&sub->accepted_message_types)
+			&& AST_VECTOR_GET(&sub->accepted_message_types, id));
+	ast_rwlock_unlock(&sub->filter_lock);
+
+	return accepted;
+}
+
 int stasis_subscription_set_congestion_limits(struct stasis_subscription *subscription,
 	long low_water, long high_water)
 {
@@ -713,6 +871,10 @@ static int dispatch_exec_async(struct ast_taskprocessor_local *local)
 	subscription_invoke(sub, message);
 	ao2_cleanup(message);
 
+	ast_mutex_lock(&sub->ring_lock);
+	--sub->ring_spilled;
+	ast_mutex_unlock(&sub->ring_lock);
+
 	return 0;
 }
 
@@ -741,6 +903,10 @@ static int dispatch_exec_sync(struct ast_taskprocessor_local *local)
 	subscription_invoke(sub, message);
 	ao2_cleanup(message);
 
+	ast_mutex_lock(&sub->ring_lock);
+	--sub->ring_spilled;
+	ast_mutex_unlock(&sub->ring_lock);
+
 	ast_mutex_lock(&std->lock);
 	std->complete = 1;
 	ast_cond_signal(&std->cond);
@@ -749,10 +915,104 @@ static int dispatch_exec_sync(struct ast_taskprocessor_local *local)
 	return 0;
 }
 
+/*!
+ * \internal \brief Deliver the messages waiting in a subscriber's ring
+ * \param local \ref ast_taskprocessor_local object
+ * \return 0
+ */
+static int dispatch_exec_ring(struct ast_taskprocessor_local *local)
+{
+	struct stasis_subscription *sub = local->local_data;
+	struct subscription_ring_entry entry;
+
+	for (;;) {
+		ast_mutex_lock(&sub->ring_lock);
+		if (!sub->ring_count) {
+			/* The next message published will need a new task. */
+			sub->ring_scheduled = 0;
+			ast_mutex_unlock(&sub->ring_lock);
+			break;
+		}
+		entry = sub->ring[sub->ring_head];
+		sub->ring_head = (sub->ring_head + 1) & (SUBSCRIPTION_RING_SIZE - 1);
+		--sub->ring_count;
+		ast_mutex_unlock(&sub->ring_lock);
+
+		subscription_invoke(sub, entry.message);
+		ao2_cleanup(entry.message);
+
+		if (entry.sync) {
+			ast_mutex_lock(&entry.sync->lock);
+			entry.sync->complete = 1;
+			ast_cond_signal(&entry.sync->cond);
+			ast_mutex_unlock(&entry.sync->lock);
+		}
+	}
+
+	return 0;
+}
+
+/*!
+ * \internal \brief Put a message in a subscriber's ring
+ *
+ * Messages only go in the ring while no message is waiting in the mailbox
+ * as a task of its own, so messages are always delivered in order.
+ *
+ * \param sub The subscriber
+ * \param message The message, whose reference is taken over on success
+ * \param sync Synchronization data for a synchronous publish, or NULL
+ *
+ * \retval 0 The message is in the ring
+ * \retval -1 The message has to be pushed to the mailbox as a task of its
+ * own.  The caller must push it and call ring_spill_failed() if that fails.
+ */
+static int ring_push(struct stasis_subscription *sub, struct stasis_message *message,
+	struct sync_task_data *sync)
+{
+	struct subscription_ring_entry *entry;
+	int schedule;
+
+	ast_mutex_lock(&sub->ring_lock);
+	if (sub->ring_spilled || sub->ring_count == SUBSCRIPTION_RING_SIZE) {
+		++sub->ring_spilled;
+		ast_mutex_unlock(&sub->ring_lock);
+		return -1;
+	}
+
+	entry = &sub->ring[(sub->ring_head + sub->ring_count) & (SUBSCRIPTION_RING_SIZE - 1)];
+	entry->message = message;
+	entry->sync = sync;
+	++sub->ring_count;
+	schedule = !sub->ring_scheduled;
+	sub->ring_scheduled = 1;
+	ast_mutex_unlock(&sub->ring_lock);
+
+	if (schedule && ast_taskprocessor_push_local(sub->mailbox, dispatch_exec_ring, NULL)) {
+		/* Push failed; the next message published gets to try again. */
+		ast_log(LOG_ERROR, "Delaying ring dispatch\n");
+		ast_mutex_lock(&sub->ring_lock);
+		sub->ring_scheduled = 0;
+		ast_mutex_unlock(&sub->ring_lock);
+	}
+
+	return 0;
+}
+
+/*!
+ * \internal \brief Undo ring_push() for a message that could not be pushed
+ * \param sub The subscriber
+ */
+static void ring_spill_failed(struct stasis_subscription *sub)
+{
+	ast_mutex_lock(&sub->ring_lock);
+	--sub->ring_spilled;
+	ast_mutex_unlock(&sub->ring_lock);
+}
+
 /*!
  * \internal \brief Dispatch a message to a subscriber
  * \param sub The subscriber to dispatch to
- * \param message The message to send
+ * \param message The message to send, whose reference is taken over
  * \param synchronous If non-zero, synchronize on the subscriber receiving
  * the message
  */
@@ -760,20 +1020,28 @@ static void dispatch_message(struct stasis_subscription *sub,
 	struct stasis_message *message,
 	int synchronous)
 {
+	if (!subscription_accepts(sub, message)) {
+		/* Not interested; nothing is queued or invoked. */
+		ao2_ref(message, -1);
+		return;
+	}
+
 	if (!sub->mailbox) {
 		/* Dispatch directly */
 		subscription_invoke(sub, message);
+		ao2_ref(message, -1);
 		return;
 	}
 
-	/* Bump the message for the taskprocessor push. This will get de-ref'd
-	 * by the task processor callback.
-	 */
-	ao2_bump(message);
+	/* The reference is de-ref'd once the mailbox delivers the message. */
 	if (!synchronous) {
+		if (!ring_push(sub, message, NULL)) {
+			return;
+		}
 		if (ast_taskprocessor_push_local(sub->mailbox, dispatch_exec_async, message)) {
 			/* Push failed; ugh. */
 			ast_log(LOG_ERROR, "Dropping async dispatch\n");
+			ring_spill_failed(sub);
 			ao2_cleanup(message);
 		}
 	} else {
@@ -784,9 +1052,11 @@ static void dispatch_message(struct stasis_subscription *sub,
 		std.complete = 0;
 		std.task_data = message;
 
-		if (ast_taskprocessor_push_local(sub->mailbox, dispatch_exec_sync, &std)) {
+		if (ring_push(sub, message, &std)
+			&& ast_taskprocessor_push_local(sub->mailbox, dispatch_exec_sync, &std)) {
 			/* Push failed; ugh. */
 			ast_log(LOG_ERROR, "Dropping sync dispatch\n");
+			ring_spill_failed(sub);
 			ao2_cleanup(message);
 			ast_mutex_destroy(&std.lock);
 			ast_cond_destroy(&std.cond);
@@ -815,6 +1085,7 @@ static void publish_msg(struct stasis_topic *topic,
 	struct stasis_message *message, struct stasis_subscription *sync_sub)
 {
 	size_t i;
+	size_t count;
 
 	ast_assert(topic != NULL);
 	ast_assert(message != NULL);
@@ -825,13 +1096,25 @@ static void publish_msg(struct stasis_topic *topic,
 	 */
 	ao2_ref(topic, +1);
 	ao2_lock(topic);
-	for (i = 0; i < AST_VECTOR_SIZE(&topic->subscribers); ++i) {
+	/*
+	 * Take every subscriber's reference to the message at once; each
+	 * dispatch owns one of them.
+	 */
+	count = AST_VECTOR_SIZE(&topic->subscribers);
+	if (count) {
+		ao2_ref(message, +(int) count);
+	}
+	for (i = 0; i < count && i < AST_VECTOR_SIZE(&topic->subscribers); ++i) {
 		struct stasis_subscription *sub = AST_VECTOR_GET(&topic->subscribers, i);
 
 		ast_assert(sub != NULL);
 
 		dispatch_message(sub, message, (sub == sync_sub));
 	}
+	if (i < count) {
+		/* A direct subscriber unsubscribed something while we dispatched. */
+		ao2_ref(message, -(int) (count - i));
+	}
 	ao2_unlock(topic);
 	ao2_ref(topic, -1);
 }
@@ -1025,7 +1308,7 @@ static void send_subscription_unsubscribe(struct stasis_topic *topic,
 	stasis_publish(topic, msg);
 
 	/* Now we have to dispatch to the subscription itself */
-	dispatch_message(sub, msg, 0);
+	dispatch_message(sub, ao2_bump(msg), 0);
 
 	ao2_cleanup(msg);
 	ao2_cleanup(change);
@@ -1628,6 +1911,7 @@ int stasis_init(void)
 	threadpool_opts.auto_increment = 1;
 	threadpool_opts.max_size = cfg->threadpool_options->max_size;
 	threadpool_opts.idle_timeout = cfg->threadpool_options->idle_timeout_sec;
+	threadpool_opts.work_stealing = 1;
 	pool = ast_threadpool_create("stasis-core", NULL, &threadpool_opts);
 	if (!pool) {
 		ast_log(LOG_ERROR, "Failed to create 'stasis-core' threadpool\n");
@@ -189,19 +189,272 @@ static int channel_snapshot_cmp_cb(void *obj, void *arg, int flags)
 	return strcasecmp(left->name, match) ? 0 : (CMP_MATCH | CMP_STOP);
 }
 
+/*! \brief Identity of a channel, which rarely changes once it is set up */
+struct ast_channel_snapshot_identity {
+	AST_DECLARE_STRING_FIELDS(
+		AST_STRING_FIELD(name);
+		AST_STRING_FIELD(uniqueid);
+		AST_STRING_FIELD(linkedid);
+		AST_STRING_FIELD(type);
+		AST_STRING_FIELD(accountcode);
+		AST_STRING_FIELD(peeraccount);
+		AST_STRING_FIELD(userfield);
+		AST_STRING_FIELD(hangupsource);
+		AST_STRING_FIELD(language);
+	);
+};
+
+/*! \brief Caller and connected line parties of a channel */
+struct ast_channel_snapshot_party {
+	AST_DECLARE_STRING_FIELDS(
+		AST_STRING_FIELD(caller_name);
+		AST_STRING_FIELD(caller_number);
+		AST_STRING_FIELD(caller_dnid);
+		AST_STRING_FIELD(caller_ani);
+		AST_STRING_FIELD(caller_rdnis);
+		AST_STRING_FIELD(caller_subaddr);
+		AST_STRING_FIELD(dialed_subaddr);
+		AST_STRING_FIELD(connected_name);
+		AST_STRING_FIELD(connected_number);
+	);
+};
+
+/*! \brief Dialplan location of a channel */
+struct ast_channel_snapshot_dialplan {
+	AST_DECLARE_STRING_FIELDS(
+		AST_STRING_FIELD(appl);
+		AST_STRING_FIELD(data);
+		AST_STRING_FIELD(context);
+		AST_STRING_FIELD(exten);
+	);
+};
+
+/*! \brief Bridge a channel is in */
+struct ast_channel_snapshot_bridge {
+	AST_DECLARE_STRING_FIELDS(
+		AST_STRING_FIELD(bridgeid);
+	);
+};
+
+static void identity_segment_dtor(void *obj)
+{
+	struct ast_channel_snapshot_identity *identity = obj;
+
+	ast_string_field_free_memory(identity);
+}
+
+static void party_segment_dtor(void *obj)
+{
+	struct ast_channel_snapshot_party *party = obj;
+
+	ast_string_field_free_memory(party);
+}
+
+static void dialplan_segment_dtor(void *obj)
+{
+	struct ast_channel_snapshot_dialplan *dialplan = obj;
+
+	ast_string_field_free_memory(dialplan);
+}
+
+static void bridge_segment_dtor(void *obj)
+{
+	struct ast_channel_snapshot_bridge *bridge = obj;
+
+	ast_string_field_free_memory(bridge);
+}
+
 static void channel_snapshot_dtor(void *obj)
 {
 	struct ast_channel_snapshot *snapshot = obj;
 
-	ast_string_field_free_memory(snapshot);
+	ao2_cleanup(snapshot->identity);
+	ao2_cleanup(snapshot->party);
+	ao2_cleanup(snapshot->dialplan);
+	ao2_cleanup(snapshot->bridge);
 	ao2_cleanup(snapshot->manager_vars);
 	ao2_cleanup(snapshot->ari_vars);
 }
 
+/*!
+ * \internal
+ * \brief Allocate a snapshot segment
+ *
+ * \note The segments are immutable once created so they need no lock.
+ */
+#define snapshot_segment_alloc(type, dtor, size) ({ \
+	type *__segment__ = ao2_alloc_options(sizeof(type), dtor, \
+		AO2_ALLOC_OPT_LOCK_NOLOCK); \
+	if (__segment__ && ast_string_field_init(__segment__, size)) { \
+		ao2_ref(__segment__, -1); \
+		__segment__ = NULL; \
+	} \
+	__segment__; \
+})
+
+static struct ast_channel_snapshot_identity *identity_segment_get(struct ast_channel *chan,
+	struct ast_channel_snapshot_identity *previous)
+{
+	struct ast_channel_snapshot_identity *identity;
+	const char *type = ast_channel_tech(chan)->type;
+
+	if (previous
+		&& !strcmp(previous->name, ast_channel_name(chan))
+		&& !strcmp(previous->uniqueid, ast_channel_uniqueid(chan))
+		&& !strcmp(previous->linkedid, ast_channel_linkedid(chan))
+		&& !strcmp(previous->type, type)
+		&& !strcmp(previous->accountcode, ast_channel_accountcode(chan))
+		&& !strcmp(previous->peeraccount, ast_channel_peeraccount(chan))
+		&& !strcmp(previous->userfield, ast_channel_userfield(chan))
+		&& !strcmp(previous->hangupsource, ast_channel_hangupsource(chan))
+		&& !strcmp(previous->language, ast_channel_language(chan))) {
+		return ao2_bump(previous);
+	}
+
+	identity = snapshot_segment_alloc(struct ast_channel_snapshot_identity, identity_segment_dtor, 256);
+	if (!identity) {
+		return NULL;
+	}
+
+	ast_string_field_set(identity, name, ast_channel_name(chan));
+	ast_string_field_set(identity, uniqueid, ast_channel_uniqueid(chan));
+	ast_string_field_set(identity, linkedid, ast_channel_linkedid(chan));
+	ast_string_field_set(identity, type, type);
+	ast_string_field_set(identity, accountcode, ast_channel_accountcode(chan));
+	ast_string_field_set(identity, peeraccount, ast_channel_peeraccount(chan));
+	ast_string_field_set(identity, userfield, ast_channel_userfield(chan));
+	ast_string_field_set(identity, hangupsource, ast_channel_hangupsource(chan));
+	ast_string_field_set(identity, language, ast_channel_language(chan));
+
+	return identity;
+}
+
+static struct ast_channel_snapshot_party *party_segment_get(struct ast_channel *chan,
+	struct ast_channel_snapshot_party *previous)
+{
+	struct ast_channel_snapshot_party *party;
+	struct ast_party_caller *caller = ast_channel_caller(chan);
+	struct ast_party_dialed *dialed = ast_channel_dialed(chan);
+	struct ast_party_connected_line *connected = ast_channel_connected(chan);
+	const char *caller_name = S_COR(caller->id.name.valid, caller->id.name.str, "");
+	const char *caller_number = S_COR(caller->id.number.valid, caller->id.number.str, "");
+	const char *caller_dnid = S_OR(dialed->number.str, "");
+	const char *caller_ani = S_COR(caller->ani.number.valid, caller->ani.number.str, "");
+	const char *caller_rdnis = S_COR(ast_channel_redirecting(chan)->from.number.valid,
+		ast_channel_redirecting(chan)->from.number.str, "");
+	const char *caller_subaddr = S_COR(caller->id.subaddress.valid, caller->id.subaddress.str, "");
+	const char *dialed_subaddr = S_COR(dialed->subaddress.valid, dialed->subaddress.str, "");
+	const char *connected_name = S_COR(connected->id.name.valid, connected->id.name.str, "");
+	const char *connected_number = S_COR(connected->id.number.valid, connected->id.number.str, "");
+
+	if (previous
+		&& !strcmp(previous->caller_name, caller_name)
+		&& !strcmp(previous->caller_number, caller_number)
+		&& !strcmp(previous->caller_dnid, caller_dnid)
+		&& !strcmp(previous->caller_ani, caller_ani)
+		&& !strcmp(previous->caller_rdnis, caller_rdnis)
+		&& !strcmp(previous->caller_subaddr, caller_subaddr)
+		&& !strcmp(previous->dialed_subaddr, dialed_subaddr)
+		&& !strcmp(previous->connected_name, connected_name)
+		&& !strcmp(previous->connected_number, connected_number)) {
+		return ao2_bump(previous);
+	}
+
+	party = snapshot_segment_alloc(struct ast_channel_snapshot_party, party_segment_dtor, 256);
+	if (!party) {
+		return NULL;
+	}
+
+	ast_string_field_set(party, caller_name, caller_name);
+	ast_string_field_set(party, caller_number, caller_number);
+	ast_string_field_set(party, caller_dnid, caller_dnid);
+	ast_string_field_set(party, caller_ani, caller_ani);
+	ast_string_field_set(party, caller_rdnis, caller_rdnis);
+	ast_string_field_set(party, caller_subaddr, caller_subaddr);
+	ast_string_field_set(party, dialed_subaddr, dialed_subaddr);
+	ast_string_field_set(party, connected_name, connected_name);
+	ast_string_field_set(party, connected_number, connected_number);
+
+	return party;
+}
+
+static struct ast_channel_snapshot_dialplan *dialplan_segment_create(const char *appl,
+	const char *data, const char *context, const char *exten)
+{
+	struct ast_channel_snapshot_dialplan *dialplan;
+
+	dialplan = snapshot_segment_alloc(struct ast_channel_snapshot_dialplan, dialplan_segment_dtor, 128);
+	if (!dialplan) {
+		return NULL;
+	}
+
+	ast_string_field_set(dialplan, appl, appl);
+	ast_string_field_set(dialplan, data, data);
+	ast_string_field_set(dialplan, context, context);
+	ast_string_field_set(dialplan, exten, exten);
+
+	return dialplan;
+}
+
+static struct ast_channel_snapshot_dialplan *dialplan_segment_get(struct ast_channel *chan,
+	struct ast_channel_snapshot_dialplan *previous)
+{
+	const char *appl = S_OR(ast_channel_appl(chan), "");
+	const char *data = S_OR(ast_channel_data(chan), "");
+
+	if (previous
+		&& !strcmp(previous->appl, appl)
+		&& !strcmp(previous->data, data)
+		&& !strcmp(previous->context, ast_channel_context(chan))
+		&& !strcmp(previous->exten, ast_channel_exten(chan))) {
+		return ao2_bump(previous);
+	}
+
+	return dialplan_segment_create(appl, data, ast_channel_context(chan), ast_channel_exten(chan));
+}
+
+static struct ast_channel_snapshot_bridge *bridge_segment_get(struct ast_channel *chan,
+	struct ast_channel_snapshot_bridge *previous)
+{
+	struct ast_channel_snapshot_bridge *segment;
+	struct ast_bridge *bridge;
+	const char *bridgeid = "";
+
+	bridge = ast_channel_get_bridge(chan);
+	if (bridge && !ast_test_flag(&bridge->feature_flags, AST_BRIDGE_FLAG_INVISIBLE)) {
+		bridgeid = bridge->uniqueid;
+	}
+
+	if (previous && !strcmp(previous->bridgeid, bridgeid)) {
+		ao2_cleanup(bridge);
+		return ao2_bump(previous);
+	}
+
+	segment = snapshot_segment_alloc(struct ast_channel_snapshot_bridge, bridge_segment_dtor, 64);
+	if (segment) {
+		ast_string_field_set(segment, bridgeid, bridgeid);
+	}
+	ao2_cleanup(bridge);
+
+	return segment;
+}
+
+/*!
+ * \internal
+ * \brief Point the snapshot's dialplan strings at its dialplan segment
+ */
+static void snapshot_dialplan_link(struct ast_channel_snapshot *snapshot)
+{
+	snapshot->appl = snapshot->dialplan->appl;
+	snapshot->data = snapshot->dialplan->data;
+	snapshot->context = snapshot->dialplan->context;
+	snapshot->exten = snapshot->dialplan->exten;
+}
+
 struct ast_channel_snapshot *ast_channel_snapshot_create(struct ast_channel *chan)
 {
 	struct ast_channel_snapshot *snapshot;
-	struct ast_bridge *bridge;
+	struct ast_channel_snapshot *previous;
 
 	/* no snapshots for dummy channels */
 	if (!ast_channel_tech(chan)) {
@@ -210,57 +463,45 @@ struct ast_channel_snapshot *ast_channel_snapshot_create(struct ast_channel *cha
 
 	snapshot = ao2_alloc_options(sizeof(*snapshot), channel_snapshot_dtor,
 		AO2_ALLOC_OPT_LOCK_NOLOCK);
-	if (!snapshot || ast_string_field_init(snapshot, 1024)) {
-		ao2_cleanup(snapshot);
+	if (!snapshot) {
 		return NULL;
 	}
 
-	ast_string_field_set(snapshot, name, ast_channel_name(chan));
-	ast_string_field_set(snapshot, type, ast_channel_tech(chan)->type);
-	ast_string_field_set(snapshot, accountcode, ast_channel_accountcode(chan));
-	ast_string_field_set(snapshot, peeraccount, ast_channel_peeraccount(chan));
-	ast_string_field_set(snapshot, userfield, ast_channel_userfield(chan));
-	ast_string_field_set(snapshot, uniqueid, ast_channel_uniqueid(chan));
-	ast_string_field_set(snapshot, linkedid, ast_channel_linkedid(chan));
-	ast_string_field_set(snapshot, hangupsource, ast_channel_hangupsource(chan));
-	if (ast_channel_appl(chan)) {
-		ast_string_field_set(snapshot, appl, ast_channel_appl(chan));
-	}
-	if (ast_channel_data(chan)) {
-		ast_string_field_set(snapshot, data, ast_channel_data(chan));
-	}
-	ast_string_field_set(snapshot, context, ast_channel_context(chan));
-	ast_string_field_set(snapshot, exten, ast_channel_exten(chan));
-
-	ast_string_field_set(snapshot, caller_name,
-		S_COR(ast_channel_caller(chan)->id.name.valid, ast_channel_caller(chan)->id.name.str, ""));
-	ast_string_field_set(snapshot, caller_number,
-		S_COR(ast_channel_caller(chan)->id.number.valid, ast_channel_caller(chan)->id.number.str, ""));
-	ast_string_field_set(snapshot, caller_dnid, S_OR(ast_channel_dialed(chan)->number.str, ""));
-	ast_string_field_set(snapshot, caller_subaddr,
-		S_COR(ast_channel_caller(chan)->id.subaddress.valid, ast_channel_caller(chan)->id.subaddress.str, ""));
-	ast_string_field_set(snapshot, dialed_subaddr,
-		S_COR(ast_channel_dialed(chan)->subaddress.valid, ast_channel_dialed(chan)->subaddress.str, ""));
-	ast_string_field_set(snapshot, caller_ani,
-		S_COR(ast_channel_caller(chan)->ani.number.valid, ast_channel_caller(chan)->ani.number.str, ""));
-	ast_string_field_set(snapshot, caller_rdnis,
-		S_COR(ast_channel_redirecting(chan)->from.number.valid, ast_channel_redirecting(chan)->from.number.str, ""));
-	ast_string_field_set(snapshot, caller_dnid,
-		S_OR(ast_channel_dialed(chan)->number.str, ""));
-
-	ast_string_field_set(snapshot, connected_name,
-		S_COR(ast_channel_connected(chan)->id.name.valid, ast_channel_connected(chan)->id.name.str, ""));
-	ast_string_field_set(snapshot, connected_number,
-		S_COR(ast_channel_connected(chan)->id.number.valid, ast_channel_connected(chan)->id.number.str, ""));
-	ast_string_field_set(snapshot, language, ast_channel_language(chan));
-
-	if ((bridge = ast_channel_get_bridge(chan))) {
-		if (!ast_test_flag(&bridge->feature_flags, AST_BRIDGE_FLAG_INVISIBLE)) {
-			ast_string_field_set(snapshot, bridgeid, bridge->uniqueid);
-		}
-		ao2_cleanup(bridge);
+	/* Share whatever has not changed since the last snapshot of the channel. */
+	previous = ast_channel_snapshot(chan);
+	snapshot->identity = identity_segment_get(chan, previous ? previous->identity : NULL);
+	snapshot->party = party_segment_get(chan, previous ? previous->party : NULL);
+	snapshot->dialplan = dialplan_segment_get(chan, previous ? previous->dialplan : NULL);
+	snapshot->bridge = bridge_segment_get(chan, previous ? previous->bridge : NULL);
+	if (!snapshot->identity || !snapshot->party || !snapshot->dialplan || !snapshot->bridge) {
+		ao2_ref(snapshot, -1);
+		return NULL;
 	}
 
+	snapshot->name = snapshot->identity->name;
+	snapshot->uniqueid = snapshot->identity->uniqueid;
+	snapshot->linkedid = snapshot->identity->linkedid;
+	snapshot->type = snapshot->identity->type;
+	snapshot->accountcode = snapshot->identity->accountcode;
+	snapshot->peeraccount = snapshot->identity->peeraccount;
+	snapshot->userfield = snapshot->identity->userfield;
+	snapshot->hangupsource = snapshot->identity->hangupsource;
+	snapshot->language = snapshot->identity->language;
+
+	snapshot->caller_name = snapshot->party->caller_name;
+	snapshot->caller_number = snapshot->party->caller_number;
+	snapshot->caller_dnid = snapshot->party->caller_dnid;
+	snapshot->caller_ani = snapshot->party->caller_ani;
+	snapshot->caller_rdnis = snapshot->party->caller_rdnis;
+	snapshot->caller_subaddr = snapshot->party->caller_subaddr;
+	snapshot->dialed_subaddr = snapshot->party->dialed_subaddr;
+	snapshot->connected_name = snapshot->party->connected_name;
+	snapshot->connected_number = snapshot->party->connected_number;
+
+	snapshot_dialplan_link(snapshot);
+
+	snapshot->bridgeid = snapshot->bridge->bridgeid;
+
 	snapshot->creationtime = ast_channel_creationtime(chan);
 	snapshot->state = ast_channel_state(chan);
 	snapshot->priority = ast_channel_priority(chan);
@@ -274,9 +515,28 @@ struct ast_channel_snapshot *ast_channel_snapshot_create(struct ast_channel *cha
 	snapshot->ari_vars = ast_channel_get_ari_vars(chan);
 	snapshot->tech_properties = ast_channel_tech(chan)->properties;
 
+	ast_channel_snapshot_set(chan, snapshot);
+
 	return snapshot;
 }
 
+int ast_channel_snapshot_set_application(struct ast_channel_snapshot *snapshot,
+	const char *appl, const char *data)
+{
+	struct ast_channel_snapshot_dialplan *dialplan;
+
+	dialplan = dialplan_segment_create(appl, data, snapshot->context, snapshot->exten);
+	if (!dialplan) {
+		return -1;
+	}
+
+	ao2_ref(snapshot->dialplan, -1);
+	snapshot->dialplan = dialplan;
+	snapshot_dialplan_link(snapshot);
+
+	return 0;
+}
+
 static void publish_message_for_channel_topics(struct stasis_message *message, struct ast_channel *chan)
 {
 	if (chan) {
@@ -954,6 +1214,9 @@ int ast_channel_snapshot_caller_id_equal(
 {
 	ast_assert(old_snapshot != NULL);
 	ast_assert(new_snapshot != NULL);
+	if (old_snapshot->party == new_snapshot->party) {
+		return 1;
+	}
 	return strcmp(old_snapshot->caller_number, new_snapshot->caller_number) == 0 &&
 		strcmp(old_snapshot->caller_name, new_snapshot->caller_name) == 0;
 }
@@ -964,6 +1227,9 @@ int ast_channel_snapshot_connected_line_equal(
 {
 	ast_assert(old_snapshot != NULL);
 	ast_assert(new_snapshot != NULL);
+	if (old_snapshot->party == new_snapshot->party) {
+		return 1;
+	}
 	return strcmp(old_snapshot->connected_number, new_snapshot->connected_number) == 0 &&
 		strcmp(old_snapshot->connected_name, new_snapshot->connected_name) == 0;
 }
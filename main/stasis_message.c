@@ -30,6 +30,7 @@
 #include "asterisk.h"
 
 #include "asterisk/astobj2.h"
+#include "asterisk/json.h"
 #include "asterisk/stasis.h"
 #include "asterisk/utils.h"
 
@@ -37,10 +38,15 @@
 struct stasis_message_type {
 	struct stasis_message_vtable *vtable;
 	char *name;
+	/*! Unique identifier, used to index subscription filters */
+	int id;
 };
 
 static struct stasis_message_vtable null_vtable = {};
 
+/*! The identifier for the next message type */
+static int message_type_id;
+
 static void message_type_dtor(void *obj)
 {
 	struct stasis_message_type *type = obj;
@@ -74,6 +80,7 @@ int stasis_message_type_create(const char *name,
 		return STASIS_MESSAGE_TYPE_ERROR;
 	}
 	type->vtable = vtable;
+	type->id = ast_atomic_fetchadd_int(&message_type_id, +1);
 	*result = type;
 
 	return STASIS_MESSAGE_TYPE_SUCCESS;
@@ -84,6 +91,20 @@ const char *stasis_message_type_name(const struct stasis_message_type *type)
 	return type->name;
 }
 
+int stasis_message_type_id(const struct stasis_message_type *type)
+{
+	return type->id;
+}
+
+/*! \internal \brief JSON representation of a message for one sanitizer */
+struct message_json_cache {
+	/*! The sanitizer the representation was built with */
+	const struct stasis_message_sanitizer *sanitize;
+	/*! The representation; \c NULL if there is none */
+	struct ast_json *json;
+	struct message_json_cache *next;
+};
+
 /*! \internal */
 struct stasis_message {
 	/*! Time the message was created */
@@ -96,13 +117,33 @@ struct stasis_message {
 	void *data;
 	/*! Where this message originated. */
 	struct ast_eid eid;
+	/*!
+	 * AMI representation, built the first time it is needed.
+	 * Protected by the message lock.
+	 */
+	struct ast_manager_event_blob *ami;
+	/*!
+	 * JSON representations, built the first time each is needed.
+	 * Protected by the message lock; the JSON itself is never modified.
+	 */
+	struct message_json_cache *json;
+	/*! Set once \ref ami is built, even if there is no representation */
+	unsigned int ami_built:1;
 };
 
 static void stasis_message_dtor(void *obj)
 {
 	struct stasis_message *message = obj;
+	struct message_json_cache *cached;
+
 	ao2_cleanup(message->type);
 	ao2_cleanup(message->data);
+	ao2_cleanup(message->ami);
+	while ((cached = message->json)) {
+		message->json = cached->next;
+		ast_json_unref(cached->json);
+		ast_free(cached);
+	}
 }
 
 struct stasis_message *stasis_message_create_full(struct stasis_message_type *type, void *data, const struct ast_eid *eid)
@@ -181,16 +222,125 @@ const struct timeval *stasis_message_timestamp(const struct stasis_message *msg)
 		msg->type->vtable->fn(__VA_ARGS__);		\
 	})
 
-struct ast_manager_event_blob *stasis_message_to_ami(struct stasis_message *msg)
+/*!
+ * \internal
+ * \brief Build the AMI representation of a message
+ */
+static struct ast_manager_event_blob *message_to_ami(struct stasis_message *msg)
 {
 	return INVOKE_VIRTUAL(to_ami, msg);
 }
 
+/*!
+ * \internal
+ * \brief Build the JSON representation of a message
+ */
+static struct ast_json *message_to_json(struct stasis_message *msg,
+	const struct stasis_message_sanitizer *sanitize)
+{
+	return INVOKE_VIRTUAL(to_json, msg, sanitize);
+}
+
+struct ast_manager_event_blob *stasis_message_to_ami(struct stasis_message *msg)
+{
+	struct ast_manager_event_blob *ami;
+
+	if (!msg) {
+		return NULL;
+	}
+
+	/*
+	 * Every AMI session and every module with an AMI subscription asks
+	 * for the same text, so it is built once per message.
+	 */
+	ao2_lock(msg);
+	if (msg->ami_built) {
+		ami = ao2_bump(msg->ami);
+		ao2_unlock(msg);
+		return ami;
+	}
+	ao2_unlock(msg);
+
+	ami = message_to_ami(msg);
+
+	ao2_lock(msg);
+	if (msg->ami_built) {
+		/* Someone else beat us to it; use theirs so everyone shares one. */
+		ao2_cleanup(ami);
+		ami = ao2_bump(msg->ami);
+	} else {
+		msg->ami = ao2_bump(ami);
+		msg->ami_built = 1;
+	}
+	ao2_unlock(msg);
+
+	return ami;
+}
+
+/*!
+ * \internal
+ * \brief Find the cached JSON for a sanitizer
+ *
+ * \note The message must be locked.
+ */
+static struct message_json_cache *message_json_cache_find(struct stasis_message *msg,
+	const struct stasis_message_sanitizer *sanitize)
+{
+	struct message_json_cache *cached;
+
+	for (cached = msg->json; cached; cached = cached->next) {
+		if (cached->sanitize == sanitize) {
+			break;
+		}
+	}
+	return cached;
+}
+
 struct ast_json *stasis_message_to_json(
 	struct stasis_message *msg,
 	struct stasis_message_sanitizer *sanitize)
 {
-	return INVOKE_VIRTUAL(to_json, msg, sanitize);
+	struct message_json_cache *cached;
+	struct ast_json *json;
+
+	if (!msg) {
+		return NULL;
+	}
+
+	ao2_lock(msg);
+	cached = message_json_cache_find(msg, sanitize);
+	ao2_unlock(msg);
+
+	if (!cached) {
+		json = message_to_json(msg, sanitize);
+
+		ao2_lock(msg);
+		cached = message_json_cache_find(msg, sanitize);
+		if (cached) {
+			/* Someone else beat us to it. */
+			ao2_unlock(msg);
+			ast_json_unref(json);
+		} else {
+			cached = ast_calloc(1, sizeof(*cached));
+			if (!cached) {
+				ao2_unlock(msg);
+				return json;
+			}
+			cached->sanitize = sanitize;
+			cached->json = json;
+			cached->next = msg->json;
+			msg->json = cached;
+			ao2_unlock(msg);
+		}
+	}
+
+	/*
+	 * Callers are free to modify what they get, and JSON cannot be shared
+	 * between threads, so each caller gets its own copy. Copying is still
+	 * much cheaper than building the representation from the snapshots.
+	 * The cached JSON never changes once added, so it can be read unlocked.
+	 */
+	return cached->json ? ast_json_deep_copy(cached->json) : NULL;
 }
 
 struct ast_event *stasis_message_to_event(struct stasis_message *msg)
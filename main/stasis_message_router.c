@@ -137,6 +137,10 @@ struct stasis_message_router {
 	struct route_table cache_routes;
 	/*! Route of last resort */
 	struct stasis_message_route default_route;
+	/*! Callback for the end of a burst of routed messages */
+	stasis_subscription_batch_cb batch_callback;
+	/*! Data pointer to be handed to the batch callback */
+	void *batch_data;
 };
 
 static void router_dtor(void *obj)
@@ -204,6 +208,22 @@ static void router_dispatch(void *data,
 	}
 }
 
+static void router_batch(void *data, struct stasis_subscription *sub)
+{
+	struct stasis_message_router *router = data;
+	stasis_subscription_batch_cb callback;
+	void *batch_data;
+
+	ao2_lock(router);
+	callback = router->batch_callback;
+	batch_data = router->batch_data;
+	ao2_unlock(router);
+
+	if (callback) {
+		callback(batch_data, sub);
+	}
+}
+
 static struct stasis_message_router *stasis_message_router_create_internal(
 	struct stasis_topic *topic, int use_thread_pool)
 {
@@ -299,6 +319,27 @@ int stasis_message_router_set_congestion_limits(struct stasis_message_router *ro
 	return res;
 }
 
+/*!
+ * \internal \brief Let a router's subscription raise a message type
+ *
+ * The subscription only raises the types the router has routes for,
+ * unless the router has a default route.
+ *
+ * \note The router must be locked.
+ */
+static int router_accept_message_type(struct stasis_message_router *router,
+	struct stasis_message_type *message_type)
+{
+	if (stasis_subscription_accept_message_type(router->subscription, message_type)) {
+		return -1;
+	}
+	if (!router->default_route.callback) {
+		stasis_subscription_set_filter(router->subscription,
+			STASIS_SUBSCRIPTION_FILTER_SELECTIVE);
+	}
+	return 0;
+}
+
 int stasis_message_router_add(struct stasis_message_router *router,
 	struct stasis_message_type *message_type,
 	stasis_subscription_cb callback, void *data)
@@ -313,6 +354,10 @@ int stasis_message_router_add(struct stasis_message_router *router,
 	}
 	ao2_lock(router);
 	res = route_table_add(&router->routes, message_type, callback, data);
+	if (!res && router_accept_message_type(router, message_type)) {
+		route_table_remove(&router->routes, message_type);
+		res = -1;
+	}
 	ao2_unlock(router);
 	return res;
 }
@@ -331,6 +376,10 @@ int stasis_message_router_add_cache_update(struct stasis_message_router *router,
 	}
 	ao2_lock(router);
 	res = route_table_add(&router->cache_routes, message_type, callback, data);
+	if (!res && router_accept_message_type(router, stasis_cache_update_type())) {
+		route_table_remove(&router->cache_routes, message_type);
+		res = -1;
+	}
 	ao2_unlock(router);
 	return res;
 }
@@ -374,7 +423,26 @@ int stasis_message_router_set_default(struct stasis_message_router *router,
 	ao2_lock(router);
 	router->default_route.callback = callback;
 	router->default_route.data = data;
+	/* Every message now has somewhere to go. */
+	stasis_subscription_set_filter(router->subscription, STASIS_SUBSCRIPTION_FILTER_NONE);
 	ao2_unlock(router);
 	/* While this implementation can never fail, it used to be able to */
 	return 0;
 }
+
+int stasis_message_router_set_batch_callback(struct stasis_message_router *router,
+	stasis_subscription_batch_cb callback,
+	void *data)
+{
+	int res;
+
+	ast_assert(router != NULL);
+
+	ao2_lock(router);
+	router->batch_callback = callback;
+	router->batch_data = data;
+	res = stasis_subscription_set_batch_callback(router->subscription,
+		callback ? router_batch : NULL);
+	ao2_unlock(router);
+	return res;
+}
@@ -29,6 +29,8 @@
 
 #include "asterisk.h"
 
+#include <sched.h>                      /* for sched_yield */
+
 #include "asterisk/_private.h"
 #include "asterisk/module.h"
 #include "asterisk/time.h"
@@ -36,6 +38,7 @@
 #include "asterisk/cli.h"
 #include "asterisk/taskprocessor.h"
 #include "asterisk/sem.h"
+#include "asterisk/threadstorage.h"
 
 /*!
  * \brief tps_task structure is queued to a taskprocessor
@@ -43,6 +46,11 @@
  * tps_tasks are processed in FIFO order and freed by the taskprocessing
  * thread after the task handler returns.  The callback function that is assigned
  * to the execute() function pointer is responsible for releasing datap resources if necessary.
+ *
+ * The task queue is an intrusive multi-producer single-consumer queue.
+ * Producers link new tasks at the tail without taking the taskprocessor
+ * lock.  Consumers hold the taskprocessor lock to take tasks from the head
+ * so there is only ever one consumer at a time.
  */
 struct tps_task {
 	/*! \brief The execute() task callback function pointer */
@@ -52,8 +60,8 @@ struct tps_task {
 	} callback;
 	/*! \brief The data pointer for the task execute() function */
 	void *datap;
-	/*! \brief AST_LIST_ENTRY overhead */
-	AST_LIST_ENTRY(tps_task) list;
+	/*! \brief Next task in the queue, linked by the producer */
+	struct tps_task *volatile next;
 	unsigned int wants_local:1;
 };
 
@@ -73,18 +81,22 @@ struct ast_taskprocessor {
 	struct tps_taskprocessor_stats *stats;
 	void *local_data;
 	/*! \brief Taskprocessor current queue size */
-	long tps_queue_size;
+	volatile int tps_queue_size;
+	/*! \brief Number of tasks queued or currently executing */
+	volatile int tps_pending;
 	/*! \brief Taskprocessor low water clear alert level */
 	long tps_queue_low;
 	/*! \brief Taskprocessor high water alert trigger level */
 	long tps_queue_high;
-	/*! \brief Taskprocessor queue */
-	AST_LIST_HEAD_NOLOCK(tps_queue, tps_task) tps_queue;
+	/*! \brief Oldest end of the taskprocessor queue, only used by the consumer */
+	struct tps_task *tps_queue_head;
+	/*! \brief Newest end of the taskprocessor queue, swapped in by producers */
+	struct tps_task *volatile tps_queue_tail;
+	/*! \brief Placeholder task that keeps the queue from ever being empty */
+	struct tps_task tps_queue_stub;
 	struct ast_taskprocessor_listener *listener;
 	/*! Current thread executing the tasks */
 	pthread_t thread;
-	/*! Indicates if the taskprocessor is currently executing a task */
-	unsigned int executing:1;
 	/*! Indicates that a high water warning has been issued on this task processor */
 	unsigned int high_water_warned:1;
 	/*! Indicates that a high water alert is active on this taskprocessor */
@@ -180,7 +192,10 @@ static void *default_tps_processing_function(void *data)
 			/* Just give up */
 			break;
 		}
-		ast_taskprocessor_execute(tps);
+		/* Run until the queue is empty, the next push will post again. */
+		while (ast_taskprocessor_execute_batch(tps, AST_TASKPROCESSOR_BATCH_SIZE)
+			&& !pvt->dead) {
+		}
 	}
 
 	/* No posting to a dead taskprocessor! */
@@ -208,6 +223,11 @@ static void default_task_pushed(struct ast_taskprocessor_listener *listener, int
 {
 	struct default_taskprocessor_listener_pvt *pvt = listener->user_data;
 
+	if (!was_empty) {
+		/* The processing thread has not yet run out of tasks. */
+		return;
+	}
+
 	if (ast_sem_post(&pvt->sem) != 0) {
 		ast_log(LOG_ERROR, "Failed to notify of enqueued task: %s\n",
 			strerror(errno));
@@ -282,6 +302,56 @@ int ast_tps_init(void)
 	return 0;
 }
 
+#if !defined(LOW_MEMORY)
+/*!
+ * \brief Maximum number of tps_tasks kept in a thread's cache
+ *
+ * Tasks are usually freed by a different thread than the one that
+ * allocated them so the cache of a thread that only executes tasks
+ * would otherwise grow without bound.
+ */
+#define TPS_TASK_CACHE_MAX_SIZE 64
+
+/*! \brief A per-thread cache of freed tps_tasks */
+struct tps_task_cache {
+	struct tps_task *head;
+	unsigned int size;
+};
+
+static void tps_task_cache_cleanup(void *data)
+{
+	struct tps_task_cache *cache = data;
+	struct tps_task *task;
+
+	while ((task = cache->head)) {
+		cache->head = task->next;
+		ast_free(task);
+	}
+	ast_free(cache);
+}
+
+AST_THREADSTORAGE_CUSTOM(tps_task_cache, NULL, tps_task_cache_cleanup);
+#endif
+
+/* get a zeroed task from the thread's cache or the heap */
+static struct tps_task *tps_task_get(void)
+{
+	struct tps_task *t;
+#if !defined(LOW_MEMORY)
+	struct tps_task_cache *cache;
+
+	if ((cache = ast_threadstorage_get(&tps_task_cache, sizeof(*cache)))
+		&& (t = cache->head)) {
+		cache->head = t->next;
+		--cache->size;
+		memset(t, 0, sizeof(*t));
+		return t;
+	}
+#endif
+
+	return ast_calloc(1, sizeof(*t));
+}
+
 /* allocate resources for the task */
 static struct tps_task *tps_task_alloc(int (*task_exe)(void *datap), void *datap)
 {
@@ -291,7 +361,7 @@ static struct tps_task *tps_task_alloc(int (*task_exe)(void *datap), void *datap
 		return NULL;
 	}
 
-	t = ast_calloc(1, sizeof(*t));
+	t = tps_task_get();
 	if (!t) {
 		ast_log(LOG_ERROR, "failed to allocate task!\n");
 		return NULL;
@@ -311,7 +381,7 @@ static struct tps_task *tps_task_alloc_local(int (*task_exe)(struct ast_taskproc
 		return NULL;
 	}
 
-	t = ast_calloc(1, sizeof(*t));
+	t = tps_task_get();
 	if (!t) {
 		ast_log(LOG_ERROR, "failed to allocate task!\n");
 		return NULL;
@@ -327,6 +397,18 @@ static struct tps_task *tps_task_alloc_local(int (*task_exe)(struct ast_taskproc
 /* release task resources */
 static void *tps_task_free(struct tps_task *task)
 {
+#if !defined(LOW_MEMORY)
+	struct tps_task_cache *cache;
+
+	if ((cache = ast_threadstorage_get(&tps_task_cache, sizeof(*cache)))
+		&& cache->size < TPS_TASK_CACHE_MAX_SIZE) {
+		task->next = cache->head;
+		cache->head = task;
+		++cache->size;
+		return NULL;
+	}
+#endif
+
 	ast_free(task);
 	return NULL;
 }
@@ -618,16 +700,92 @@ int ast_taskprocessor_alert_set_levels(struct ast_taskprocessor *tps, long low_w
 	return 0;
 }
 
+/*!
+ * \internal
+ * \brief Link a task onto the tail of the taskprocessor queue.
+ *
+ * \note May be called by any number of threads at once without
+ * holding the taskprocessor lock.
+ */
+static void tps_queue_link(struct ast_taskprocessor *tps, struct tps_task *t)
+{
+	struct tps_task *prev;
+
+	t->next = NULL;
+#if defined(HAVE_GCC_ATOMICS)
+	do {
+		prev = tps->tps_queue_tail;
+	} while (!__sync_bool_compare_and_swap(&tps->tps_queue_tail, prev, t));
+#else
+	ao2_lock(tps);
+	prev = tps->tps_queue_tail;
+	tps->tps_queue_tail = t;
+	ao2_unlock(tps);
+#endif
+	/*
+	 * Until this store the consumer can see the new tail but cannot
+	 * reach it from the head yet.
+	 */
+	prev->next = t;
+}
+
+/*!
+ * \internal
+ * \brief Unlink the task at the head of the taskprocessor queue.
+ *
+ * \note The caller must hold the taskprocessor lock.
+ *
+ * \retval NULL if the queue is empty or a producer has not finished
+ * linking the next task yet.
+ */
+static struct tps_task *tps_queue_unlink(struct ast_taskprocessor *tps)
+{
+	struct tps_task *head = tps->tps_queue_head;
+	struct tps_task *next = head->next;
+
+	if (head == &tps->tps_queue_stub) {
+		if (!next) {
+			return NULL;
+		}
+		tps->tps_queue_head = next;
+		head = next;
+		next = next->next;
+	}
+
+	if (next) {
+		tps->tps_queue_head = next;
+		return head;
+	}
+
+	if (head != tps->tps_queue_tail) {
+		/* A producer is part way through linking behind head. */
+		return NULL;
+	}
+
+	/* Head is the last task.  Put the stub behind it so it can be removed. */
+	tps_queue_link(tps, &tps->tps_queue_stub);
+	next = head->next;
+	if (next) {
+		tps->tps_queue_head = next;
+		return head;
+	}
+
+	return NULL;
+}
+
 /* destroy the taskprocessor */
 static void tps_taskprocessor_dtor(void *tps)
 {
 	struct ast_taskprocessor *t = tps;
 	struct tps_task *task;
 
-	while ((task = AST_LIST_REMOVE_HEAD(&t->tps_queue, list))) {
-		tps_task_free(task);
+	if (t->tps_queue_head) {
+		while ((task = tps_queue_unlink(t))) {
+			tps_task_free(task);
+		}
 	}
 	t->tps_queue_size = 0;
+	t->tps_pending = 0;
 
 	if (t->high_water_alert) {
 		t->high_water_alert = 0;
@@ -642,17 +800,28 @@ static void tps_taskprocessor_dtor(void *tps)
 	t->listener = NULL;
 }
 
-/* pop the front task and return it */
+/* pop the front task and return it, the taskprocessor lock must be held */
 static struct tps_task *tps_taskprocessor_pop(struct ast_taskprocessor *tps)
 {
 	struct tps_task *task;
+	int size;
 
-	if ((task = AST_LIST_REMOVE_HEAD(&tps->tps_queue, list))) {
-		--tps->tps_queue_size;
-		if (tps->high_water_alert && tps->tps_queue_size <= tps->tps_queue_low) {
-			tps->high_water_alert = 0;
-			tps_alert_add(tps, -1);
-		}
+	if (!tps->tps_queue_size) {
+		return NULL;
+	}
+
+	/*
+	 * The queue size is counted before a task is linked so a counted
+	 * task that is not reachable yet is only moments away.
+	 */
+	while (!(task = tps_queue_unlink(tps))) {
+		sched_yield();
+	}
+
+	size = ast_atomic_fetchadd_int(&tps->tps_queue_size, -1) - 1;
+	if (tps->high_water_alert && size <= tps->tps_queue_low) {
+		tps->high_water_alert = 0;
+		tps_alert_add(tps, -1);
 	}
 	return task;
 }
@@ -739,6 +908,9 @@ static struct ast_taskprocessor *__allocate_taskprocessor(const char *name, stru
 		return NULL;
 	}
 
+	p->tps_queue_head = &p->tps_queue_stub;
+	p->tps_queue_tail = &p->tps_queue_stub;
+
 	/* Set default congestion water level alert triggers. */
 	p->tps_queue_low = (AST_TASKPROCESSOR_HIGH_WATER_LEVEL * 9) / 10;
 	p->tps_queue_high = AST_TASKPROCESSOR_HIGH_WATER_LEVEL;
@@ -864,7 +1036,7 @@ void *ast_taskprocessor_unreference(struct ast_taskprocessor *tps)
 /* push the task into the taskprocessor queue */
 static int taskprocessor_push(struct ast_taskprocessor *tps, struct tps_task *t)
 {
-	int previous_size;
+	int size;
 	int was_empty;
 
 	if (!tps) {
@@ -877,23 +1049,27 @@ static int taskprocessor_push(struct ast_taskprocessor *tps, struct tps_task *t)
 		return -1;
 	}
 
-	ao2_lock(tps);
-	AST_LIST_INSERT_TAIL(&tps->tps_queue, t, list);
-	previous_size = tps->tps_queue_size++;
+	/*
+	 * Count the task before it becomes reachable.  A consumer that sees
+	 * the count then knows the task will be linked shortly.
+	 */
+	size = ast_atomic_fetchadd_int(&tps->tps_queue_size, +1) + 1;
+	/* The currently executing task counts as still in queue */
+	was_empty = ast_atomic_fetchadd_int(&tps->tps_pending, +1) == 0;
+	tps_queue_link(tps, t);
 
-	if (tps->tps_queue_high <= tps->tps_queue_size) {
-		if (!tps->high_water_alert) {
-			ast_log(LOG_WARNING, "The '%s' task processor queue reached %ld scheduled tasks%s.\n",
-				tps->name, tps->tps_queue_size, tps->high_water_warned ? " again" : "");
+	if (tps->tps_queue_high <= size) {
+		ao2_lock(tps);
+		if (!tps->high_water_alert && tps->tps_queue_high <= tps->tps_queue_size) {
+			ast_log(LOG_WARNING, "The '%s' task processor queue reached %d scheduled tasks%s.\n",
+				tps->name, size, tps->high_water_warned ? " again" : "");
 			tps->high_water_warned = 1;
 			tps->high_water_alert = 1;
 			tps_alert_add(tps, +1);
 		}
+		ao2_unlock(tps);
 	}
 
-	/* The currently executing task counts as still in queue */
-	was_empty = tps->executing ? 0 : previous_size == 0;
-	ao2_unlock(tps);
 	tps->listener->callbacks->task_pushed(tps->listener, was_empty);
 	return 0;
 }
@@ -936,55 +1112,70 @@ int ast_taskprocessor_is_suspended(struct ast_taskprocessor *tps)
 }
 
 int ast_taskprocessor_execute(struct ast_taskprocessor *tps)
+{
+	return ast_taskprocessor_execute_batch(tps, 1);
+}
+
+int ast_taskprocessor_execute_batch(struct ast_taskprocessor *tps, unsigned int max_tasks)
 {
 	struct ast_taskprocessor_local local;
+	struct tps_task *first = NULL;
+	struct tps_task *last = NULL;
 	struct tps_task *t;
+	unsigned int count;
 	long size;
 
 	ao2_lock(tps);
-	t = tps_taskprocessor_pop(tps);
-	if (!t) {
+	/* Popped tasks are chained through their now unused next pointers. */
+	for (count = 0; count < max_tasks && (t = tps_taskprocessor_pop(tps)); ++count) {
+		t->next = NULL;
+		if (last) {
+			last->next = t;
+		} else {
+			first = t;
+		}
+		last = t;
+	}
+	if (!count) {
 		ao2_unlock(tps);
 		return 0;
 	}
 
 	tps->thread = pthread_self();
-	tps->executing = 1;
-
-	if (t->wants_local) {
-		local.local_data = tps->local_data;
-		local.data = t->datap;
-	}
+	local.local_data = tps->local_data;
 	ao2_unlock(tps);
 
-	if (t->wants_local) {
-		t->callback.execute_local(&local);
-	} else {
-		t->callback.execute(t->datap);
+	while ((t = first)) {
+		first = t->next;
+		if (t->wants_local) {
+			local.data = t->datap;
+			t->callback.execute_local(&local);
+		} else {
+			t->callback.execute(t->datap);
+		}
+		tps_task_free(t);
 	}
-	tps_task_free(t);
+
+	/* The pending count must drop in one step so exactly one of this
+	 * thread and a concurrent pusher sees the taskprocessor as empty.
+	 */
+	size = ast_atomic_fetchadd_int(&tps->tps_pending, -(int) count) - (int) count;
 
 	ao2_lock(tps);
 	tps->thread = AST_PTHREADT_NULL;
-	/* We need to check size in the same critical section where we reset the
-	 * executing bit. Avoids a race condition where a task is pushed right
-	 * after we pop an empty stack.
-	 */
-	tps->executing = 0;
-	size = ast_taskprocessor_size(tps);
 
 	/* Update the stats */
 	if (tps->stats) {
-		++tps->stats->_tasks_processed_count;
+		tps->stats->_tasks_processed_count += count;
 
-		/* Include the task we just executed as part of the queue size. */
-		if (size >= tps->stats->max_qsize) {
-			tps->stats->max_qsize = size + 1;
+		/* Include the tasks we just executed as part of the queue size. */
+		if (size + count > tps->stats->max_qsize) {
+			tps->stats->max_qsize = size + count;
 		}
 	}
 	ao2_unlock(tps);
 
-	/* If we executed a task, check for the transition to empty */
+	/* If we executed tasks, check for the transition to empty */
 	if (size == 0 && tps->listener->callbacks->emptied) {
 		tps->listener->callbacks->emptied(tps->listener);
 	}
@@ -23,10 +23,37 @@
 #include "asterisk/taskprocessor.h"
 #include "asterisk/astobj2.h"
 #include "asterisk/utils.h"
+#include "asterisk/dlinkedlists.h"
+#include "asterisk/vector.h"
 
 /* Needs to stay prime if increased */
 #define THREAD_BUCKETS 89
 
+/*!
+ * \brief A task queued to a work stealing threadpool
+ */
+struct threadpool_task {
+	/*! The task callback */
+	int (*task)(void *data);
+	/*! The data for the task callback */
+	void *data;
+	AST_DLLIST_ENTRY(threadpool_task) list;
+};
+
+/*!
+ * \brief A deque of tasks for work stealing
+ *
+ * The owner works through its deque oldest task first while other threads
+ * steal the newest, so a stolen task is the one that would otherwise have
+ * waited the longest.
+ */
+struct task_deque {
+	ast_mutex_t lock;
+	AST_DLLIST_HEAD_NOLOCK(, threadpool_task) tasks;
+};
+
+struct worker_thread;
+
 /*!
  * \brief An opaque threadpool structure
  *
@@ -98,6 +125,27 @@ struct ast_threadpool {
 	int shutting_down;
 	/*! Threadpool-specific options */
 	struct ast_threadpool_options options;
+	/*!
+	 * \brief Running worker threads, for work stealing
+	 *
+	 * Workers add themselves when they start and remove themselves
+	 * before they exit.  Protected by ws_lock.
+	 */
+	AST_VECTOR(, struct worker_thread *) ws_workers;
+	/*! Lock protecting ws_workers */
+	ast_rwlock_t ws_lock;
+	/*! Tasks pushed while no worker could take them, for work stealing */
+	struct task_deque ws_shared;
+	/*! Number of tasks waiting in any deque */
+	volatile int ws_queued;
+	/*! Number of tasks waiting or executing */
+	volatile int ws_pending;
+	/*! Number of workers that are idle or about to be */
+	volatile int ws_idle;
+	/*! Counter to spread pushes and serializers over the workers */
+	volatile int ws_next;
+	/*! Set while a wake up is queued to the control taskprocessor */
+	int ws_wake_pending;
 };
 
 /*!
@@ -157,6 +205,10 @@ struct worker_thread {
 	int wake_up;
 	/*! Options for this threadpool */
 	struct ast_threadpool_options options;
+	/*! Tasks queued to this worker, for work stealing */
+	struct task_deque tasks;
+	/*! True if this worker is counted in the pool's ws_idle */
+	int counted_idle;
 };
 
 /* Worker thread forward declarations. See definitions for documentation */
@@ -170,6 +222,7 @@ static int worker_thread_start(struct worker_thread *worker);
 static int worker_idle(struct worker_thread *worker);
 static int worker_set_state(struct worker_thread *worker, enum worker_state state);
 static void worker_shutdown(struct worker_thread *worker);
+static int activate_thread(void *obj, void *arg, int flags);
 
 /*!
  * \brief Notify the threadpool listener that the state has changed.
@@ -238,6 +291,15 @@ static int queued_active_thread_idle(void *data)
 	ao2_link(pair->pool->idle_threads, pair->worker);
 	ao2_unlink(pair->pool->active_threads, pair->worker);
 
+	if (pair->pool->options.work_stealing && pair->pool->ws_queued > 0) {
+		/*
+		 * A task was pushed while this worker was going idle and its
+		 * wake up may have run before the worker became idle.
+		 */
+		ao2_callback(pair->pool->idle_threads, OBJ_UNLINK | OBJ_NOLOCK | OBJ_NODATA,
+				activate_thread, pair->pool);
+	}
+
 	threadpool_send_state_changed(pair->pool);
 
 	ao2_ref(pair, -1);
@@ -345,10 +407,20 @@ static void threadpool_idle_thread_dead(struct ast_threadpool *pool,
  */
 static int threadpool_execute(struct ast_threadpool *pool)
 {
+	unsigned int batch;
+	int active;
+
 	ao2_lock(pool);
 	if (!pool->shutting_down) {
+		/*
+		 * Only take this worker's share of the queue so a burst of
+		 * tasks is still spread over all of the active threads.
+		 */
+		active = ao2_container_count(pool->active_threads);
+		batch = ast_taskprocessor_size(pool->tps) / (active > 0 ? active : 1);
 		ao2_unlock(pool);
-		return ast_taskprocessor_execute(pool->tps);
+		return ast_taskprocessor_execute_batch(pool->tps,
+			MAX(1, MIN(batch, AST_TASKPROCESSOR_BATCH_SIZE)));
 	}
 	ao2_unlock(pool);
 	return 0;
@@ -370,7 +442,16 @@ static int threadpool_execute(struct ast_threadpool *pool)
 static void threadpool_destructor(void *obj)
 {
 	struct ast_threadpool *pool = obj;
+	struct threadpool_task *task;
+
 	ao2_cleanup(pool->listener);
+
+	while ((task = AST_DLLIST_REMOVE_HEAD(&pool->ws_shared.tasks, list))) {
+		ast_free(task);
+	}
+	ast_mutex_destroy(&pool->ws_shared.lock);
+	AST_VECTOR_FREE(&pool->ws_workers);
+	ast_rwlock_destroy(&pool->ws_lock);
 }
 
 /*
@@ -391,9 +472,18 @@ static struct ast_threadpool *threadpool_alloc(const char *name, const struct as
 	struct ast_str *control_tps_name;
 
 	pool = ao2_alloc(sizeof(*pool), threadpool_destructor);
+	if (!pool) {
+		return NULL;
+	}
+	/* The destructor tears these down, so set them up before anything can fail. */
+	ast_rwlock_init(&pool->ws_lock);
+	ast_mutex_init(&pool->ws_shared.lock);
+	if (AST_VECTOR_INIT(&pool->ws_workers, 0)) {
+		return NULL;
+	}
+
 	control_tps_name = ast_str_create(64);
-	if (!pool || !control_tps_name) {
-		ast_free(control_tps_name);
+	if (!control_tps_name) {
 		return NULL;
 	}
 
@@ -416,7 +506,12 @@ static struct ast_threadpool *threadpool_alloc(const char *name, const struct as
 	if (!pool->zombie_threads) {
 		return NULL;
 	}
-	pool->options = *options;
+	if (options->version >= 2) {
+		pool->options = *options;
+	} else {
+		/* Version 1 options end before work_stealing */
+		memcpy(&pool->options, options, offsetof(struct ast_threadpool_options, work_stealing));
+	}
 
 	ao2_ref(pool, +1);
 	return pool;
@@ -534,25 +629,19 @@ static void grow(struct ast_threadpool *pool, int delta)
 }
 
 /*!
- * \brief Queued task called when tasks are pushed into the threadpool
+ * \brief Activate idle threads, growing the pool if there are none
  *
- * This function first calls into the threadpool's listener to let it know
- * that a task has been pushed. It then wakes up all idle threads and moves
- * them into the active thread container.
- * \param data A task_pushed_data
- * \return 0
+ * This wakes up all idle threads and moves them into the active thread
+ * container. If there are no idle threads, the pool is grown as permitted.
+ *
+ * Called from the threadpool's control taskprocessor thread.
+ * \param pool The threadpool
+ * \param may_grow Non-zero if the pool may be grown
  */
-static int queued_task_pushed(void *data)
+static void threadpool_activate_or_grow(struct ast_threadpool *pool, int may_grow)
 {
-	struct task_pushed_data *tpd = data;
-	struct ast_threadpool *pool = tpd->pool;
-	int was_empty = tpd->was_empty;
 	unsigned int existing_active;
 
-	if (pool->listener && pool->listener->callbacks->task_pushed) {
-		pool->listener->callbacks->task_pushed(pool, pool->listener, was_empty);
-	}
-
 	existing_active = ao2_container_count(pool->active_threads);
 
 	/* The first pass transitions any existing idle threads to be active, and
@@ -564,9 +653,8 @@ static int queued_task_pushed(void *data)
 
 	/* If no idle threads could be transitioned to active grow the pool as permitted. */
 	if (ao2_container_count(pool->active_threads) == existing_active) {
-		if (!pool->options.auto_increment) {
-			ao2_ref(tpd, -1);
-			return 0;
+		if (!may_grow || !pool->options.auto_increment) {
+			return;
 		}
 		grow(pool, pool->options.auto_increment);
 		/* An optional second pass transitions any newly added threads. */
@@ -575,6 +663,28 @@ static int queued_task_pushed(void *data)
 	}
 
 	threadpool_send_state_changed(pool);
+}
+
+/*!
+ * \brief Queued task called when tasks are pushed into the threadpool
+ *
+ * This function first calls into the threadpool's listener to let it know
+ * that a task has been pushed. It then wakes up all idle threads and moves
+ * them into the active thread container.
+ * \param data A task_pushed_data
+ * \return 0
+ */
+static int queued_task_pushed(void *data)
+{
+	struct task_pushed_data *tpd = data;
+	struct ast_threadpool *pool = tpd->pool;
+	int was_empty = tpd->was_empty;
+
+	if (pool->listener && pool->listener->callbacks->task_pushed) {
+		pool->listener->callbacks->task_pushed(pool, pool->listener, was_empty);
+	}
+
+	threadpool_activate_or_grow(pool, 1);
 	ao2_ref(tpd, -1);
 	return 0;
 }
@@ -675,6 +785,322 @@ static struct ast_taskprocessor_listener_callbacks threadpool_tps_listener_callb
 	.shutdown = threadpool_tps_shutdown,
 };
 
+/*! The worker thread running on this thread, if any */
+AST_THREADSTORAGE_RAW(current_worker);
+
+/*!
+ * \brief Take a task from one end of a deque
+ *
+ * \param deque The deque to take from
+ * \param newest Take the newest task instead of the oldest
+ * \param steal Give up instead of waiting if the deque is in use
+ * \retval NULL No task was taken
+ */
+static struct threadpool_task *task_deque_take(struct task_deque *deque, int newest, int steal)
+{
+	struct threadpool_task *task;
+
+	if (AST_DLLIST_EMPTY(&deque->tasks)) {
+		/* Unlocked peek, a task being added now will be found by the wake up. */
+		return NULL;
+	}
+
+	if (steal) {
+		if (ast_mutex_trylock(&deque->lock)) {
+			return NULL;
+		}
+	} else {
+		ast_mutex_lock(&deque->lock);
+	}
+	if (newest) {
+		task = AST_DLLIST_REMOVE_TAIL(&deque->tasks, list);
+	} else {
+		task = AST_DLLIST_REMOVE_HEAD(&deque->tasks, list);
+	}
+	ast_mutex_unlock(&deque->lock);
+
+	return task;
+}
+
+/*!
+ * \brief Queue a task to wake up idle threads of a work stealing threadpool
+ *
+ * This function is run from the threadpool control taskprocessor thread.
+ *
+ * \param data The threadpool
+ * \return 0
+ */
+static int queued_work_stealing_wake(void *data)
+{
+	struct ast_threadpool *pool = data;
+
+	/* Pushes from now on need another wake up. */
+	ao2_lock(pool);
+	pool->ws_wake_pending = 0;
+	ao2_unlock(pool);
+
+	/* Only grow if the existing threads are leaving tasks waiting. */
+	threadpool_activate_or_grow(pool, pool->ws_queued > 0);
+	return 0;
+}
+
+/*!
+ * \brief Make sure a task pushed to a work stealing threadpool gets run
+ *
+ * The listener is told about every task if it wants to be. Otherwise the
+ * control taskprocessor is only involved when an idle thread needs waking
+ * up or the pool may need to grow, and then only once for all the tasks
+ * pushed until it gets to it.
+ *
+ * \param pool The threadpool
+ * \param was_empty True if the pool had no tasks before this one
+ */
+static void threadpool_work_stealing_wake(struct ast_threadpool *pool, int was_empty)
+{
+	struct task_pushed_data *tpd;
+	int size;
+
+	if (pool->listener && pool->listener->callbacks->task_pushed) {
+		SCOPED_AO2LOCK(lock, pool);
+
+		if (pool->shutting_down) {
+			return;
+		}
+		tpd = task_pushed_data_alloc(pool, was_empty);
+		if (tpd) {
+			ast_taskprocessor_push(pool->control_tps, queued_task_pushed, tpd);
+		}
+		return;
+	}
+
+	if (!pool->ws_idle) {
+		/* Every thread is busy; only worth a wake up if the pool can grow. */
+		size = AST_VECTOR_SIZE(&pool->ws_workers);
+		if (!pool->options.auto_increment
+			|| (pool->options.max_size && size >= pool->options.max_size)) {
+			return;
+		}
+	}
+
+	if (pool->ws_wake_pending) {
+		return;
+	}
+
+	ao2_lock(pool);
+	if (!pool->shutting_down && !pool->ws_wake_pending
+		&& !ast_taskprocessor_push(pool->control_tps, queued_work_stealing_wake, pool)) {
+		pool->ws_wake_pending = 1;
+	}
+	ao2_unlock(pool);
+}
+
+/*!
+ * \brief Push a task to a work stealing threadpool
+ *
+ * A task pushed from one of the pool's own threads goes on that thread's
+ * deque. Otherwise the task goes on the deque of the worker chosen by
+ * \a affinity, or of the next worker in turn if there is no affinity.
+ *
+ * \param pool The threadpool
+ * \param task The task to add
+ * \param data The parameter for the task
+ * \param affinity Number used to pick a worker, or -1 for none
+ * \retval 0 success
+ * \retval -1 failure
+ */
+static int threadpool_work_stealing_push(struct ast_threadpool *pool,
+	int (*task)(void *data), void *data, int affinity)
+{
+	struct threadpool_task *ws_task;
+	struct worker_thread *worker;
+	struct task_deque *deque;
+	int was_empty;
+	size_t size;
+
+	ws_task = ast_malloc(sizeof(*ws_task));
+	if (!ws_task) {
+		return -1;
+	}
+	ws_task->task = task;
+	ws_task->data = data;
+
+	ast_rwlock_rdlock(&pool->ws_lock);
+	if (pool->shutting_down) {
+		ast_rwlock_unlock(&pool->ws_lock);
+		ast_free(ws_task);
+		return -1;
+	}
+
+	worker = ast_threadstorage_get_ptr(&current_worker);
+	size = AST_VECTOR_SIZE(&pool->ws_workers);
+	if (worker && worker->pool == pool && affinity < 0) {
+		deque = &worker->tasks;
+	} else if (size) {
+		if (affinity < 0) {
+			affinity = ast_atomic_fetchadd_int(&pool->ws_next, +1);
+		}
+		deque = &AST_VECTOR_GET(&pool->ws_workers, (unsigned int) affinity % size)->tasks;
+	} else {
+		deque = &pool->ws_shared;
+	}
+
+	ast_mutex_lock(&deque->lock);
+	AST_DLLIST_INSERT_TAIL(&deque->tasks, ws_task, list);
+	ast_mutex_unlock(&deque->lock);
+
+	/*
+	 * The task is counted after it is reachable.  A worker going idle
+	 * counts itself idle before it last looks at the count, so either
+	 * it sees this task or this thread sees it idle and wakes it.
+	 */
+	ast_atomic_fetchadd_int(&pool->ws_queued, +1);
+	was_empty = ast_atomic_fetchadd_int(&pool->ws_pending, +1) == 0;
+	ast_rwlock_unlock(&pool->ws_lock);
+
+	threadpool_work_stealing_wake(pool, was_empty);
+	return 0;
+}
+
+/*!
+ * \brief Steal a task from another worker of a work stealing threadpool
+ *
+ * \param worker The worker looking for a task
+ * \retval NULL Nothing could be stolen
+ */
+static struct threadpool_task *threadpool_work_steal(struct worker_thread *worker)
+{
+	struct ast_threadpool *pool = worker->pool;
+	struct threadpool_task *task = NULL;
+	size_t size;
+	size_t i;
+
+	ast_rwlock_rdlock(&pool->ws_lock);
+	size = AST_VECTOR_SIZE(&pool->ws_workers);
+	/* Start at a different victim for each worker so thieves spread out. */
+	for (i = 0; i < size && !task; ++i) {
+		struct worker_thread *victim;
+
+		victim = AST_VECTOR_GET(&pool->ws_workers, (worker->id + i) % size);
+		if (victim != worker) {
+			task = task_deque_take(&victim->tasks, 1, 1);
+		}
+	}
+	ast_rwlock_unlock(&pool->ws_lock);
+
+	return task;
+}
+
+/*!
+ * \brief Execute a task in a work stealing threadpool
+ *
+ * The worker runs the tasks on its own deque first, then those pushed
+ * while there were no workers and then steals from the other workers.
+ * A worker that is going away only finishes its own tasks.
+ *
+ * \param worker The worker executing the task
+ * \retval 0 Either the pool has been shut down or there are no tasks.
+ * \retval 1 A task was executed.
+ */
+static int threadpool_work_stealing_execute(struct worker_thread *worker)
+{
+	struct ast_threadpool *pool = worker->pool;
+	struct threadpool_task *task;
+
+	if (pool->shutting_down) {
+		return 0;
+	}
+
+	task = task_deque_take(&worker->tasks, 0, 0);
+	if (!task && worker->state == ALIVE) {
+		task = task_deque_take(&pool->ws_shared, 0, 0);
+		if (!task) {
+			task = threadpool_work_steal(worker);
+		}
+	}
+	if (!task) {
+		return 0;
+	}
+	ast_atomic_fetchadd_int(&pool->ws_queued, -1);
+
+	task->task(task->data);
+	ast_free(task);
+
+	if (ast_atomic_fetchadd_int(&pool->ws_pending, -1) == 1
+		&& pool->listener && pool->listener->callbacks->emptied) {
+		SCOPED_AO2LOCK(lock, pool);
+
+		if (!pool->shutting_down) {
+			ast_taskprocessor_push(pool->control_tps, queued_emptied, pool);
+		}
+	}
+	return 1;
+}
+
+/*!
+ * \brief Stop counting a worker as idle in a work stealing threadpool
+ */
+static void worker_idle_uncount(struct worker_thread *worker)
+{
+	if (worker->counted_idle) {
+		ast_atomic_fetchadd_int(&worker->pool->ws_idle, -1);
+		worker->counted_idle = 0;
+	}
+}
+
+/*!
+ * \brief Add a starting worker to the workers of a work stealing threadpool
+ */
+static void worker_work_stealing_register(struct worker_thread *worker)
+{
+	struct ast_threadpool *pool = worker->pool;
+
+	ast_threadstorage_set_ptr(&current_worker, worker);
+
+	/* New workers start out idle. */
+	ast_atomic_fetchadd_int(&pool->ws_idle, +1);
+	worker->counted_idle = 1;
+
+	ast_rwlock_wrlock(&pool->ws_lock);
+	if (AST_VECTOR_APPEND(&pool->ws_workers, worker)) {
+		/* The worker can still take shared and stolen tasks. */
+		ast_log(LOG_WARNING, "Failed to add worker thread %d for work stealing\n", worker->id);
+	}
+	ast_rwlock_unlock(&pool->ws_lock);
+}
+
+/*!
+ * \brief Remove an exiting worker from the workers of a work stealing threadpool
+ *
+ * Tasks left on the worker's deque are moved to the shared deque for
+ * the remaining workers.
+ */
+static void worker_work_stealing_unregister(struct worker_thread *worker)
+{
+	struct ast_threadpool *pool = worker->pool;
+	struct threadpool_task *task;
+	int moved = 0;
+
+	worker_idle_uncount(worker);
+
+	ast_rwlock_wrlock(&pool->ws_lock);
+	AST_VECTOR_REMOVE_ELEM_UNORDERED(&pool->ws_workers, worker, AST_VECTOR_ELEM_CLEANUP_NOOP);
+	ast_rwlock_unlock(&pool->ws_lock);
+
+	/* No one can push to this worker now. */
+	ast_mutex_lock(&pool->ws_shared.lock);
+	while ((task = AST_DLLIST_REMOVE_HEAD(&worker->tasks.tasks, list))) {
+		AST_DLLIST_INSERT_TAIL(&pool->ws_shared.tasks, task, list);
+		moved = 1;
+	}
+	ast_mutex_unlock(&pool->ws_shared.lock);
+
+	if (moved) {
+		threadpool_work_stealing_wake(pool, 0);
+	}
+
+	ast_threadstorage_set_ptr(&current_worker, NULL);
+}
+
 /*!
  * \brief ao2 callback to kill a set number of threads.
  *
@@ -891,6 +1317,11 @@ struct ast_threadpool *ast_threadpool_create(const char *name,
 	RAII_VAR(struct ast_taskprocessor_listener *, tps_listener, NULL, ao2_cleanup);
 	RAII_VAR(struct ast_threadpool *, pool, NULL, ao2_cleanup);
 
+	if (options->version < 1 || options->version > AST_THREADPOOL_OPTIONS_VERSION) {
+		ast_log(LOG_WARNING, "Incompatible version of threadpool options in use.\n");
+		return NULL;
+	}
+
 	pool = threadpool_alloc(name, options);
 	if (!pool) {
 		return NULL;
@@ -901,11 +1332,6 @@ struct ast_threadpool *ast_threadpool_create(const char *name,
 		return NULL;
 	}
 
-	if (options->version != AST_THREADPOOL_OPTIONS_VERSION) {
-		ast_log(LOG_WARNING, "Incompatible version of threadpool options in use.\n");
-		return NULL;
-	}
-
 	tps = ast_taskprocessor_create_with_listener(name, tps_listener);
 	if (!tps) {
 		return NULL;
@@ -923,6 +1349,10 @@ struct ast_threadpool *ast_threadpool_create(const char *name,
 
 int ast_threadpool_push(struct ast_threadpool *pool, int (*task)(void *data), void *data)
 {
+	if (pool->options.work_stealing) {
+		return threadpool_work_stealing_push(pool, task, data, -1);
+	}
+
 	SCOPED_AO2LOCK(lock, pool);
 	if (!pool->shutting_down) {
 		return ast_taskprocessor_push(pool->tps, task, data);
@@ -939,7 +1369,9 @@ void ast_threadpool_shutdown(struct ast_threadpool *pool)
 	 * takes care of itself via the taskprocessor callbacks
 	 */
 	ao2_lock(pool);
+	ast_rwlock_wrlock(&pool->ws_lock);
 	pool->shutting_down = 1;
+	ast_rwlock_unlock(&pool->ws_lock);
 	ao2_unlock(pool);
 	ast_taskprocessor_unreference(pool->control_tps);
 	ast_taskprocessor_unreference(pool->tps);
@@ -993,8 +1425,14 @@ static void worker_shutdown(struct worker_thread *worker)
 static void worker_thread_destroy(void *obj)
 {
 	struct worker_thread *worker = obj;
+	struct threadpool_task *task;
+
 	ast_debug(3, "Destroying worker thread %d\n", worker->id);
 	worker_shutdown(worker);
+	while ((task = AST_DLLIST_REMOVE_HEAD(&worker->tasks.tasks, list))) {
+		ast_free(task);
+	}
+	ast_mutex_destroy(&worker->tasks.lock);
 	ast_mutex_destroy(&worker->lock);
 	ast_cond_destroy(&worker->cond);
 }
@@ -1018,6 +1456,10 @@ static void *worker_start(void *arg)
 		worker->options.thread_start();
 	}
 
+	if (worker->options.work_stealing) {
+		worker_work_stealing_register(worker);
+	}
+
 	ast_mutex_lock(&worker->lock);
 	while (worker_idle(worker)) {
 		ast_mutex_unlock(&worker->lock);
@@ -1031,6 +1473,10 @@ static void *worker_start(void *arg)
 	saved_state = worker->state;
 	ast_mutex_unlock(&worker->lock);
 
+	if (worker->options.work_stealing) {
+		worker_work_stealing_unregister(worker);
+	}
+
 	/* Reaching this portion means the thread is
 	 * on death's door. It may have been killed while
 	 * it was idle, in which case it can just die
@@ -1067,6 +1513,7 @@ static struct worker_thread *worker_thread_alloc(struct ast_threadpool *pool)
 	worker->id = ast_atomic_fetchadd_int(&worker_id_counter, 1);
 	ast_mutex_init(&worker->lock);
 	ast_cond_init(&worker->cond, NULL);
+	ast_mutex_init(&worker->tasks.lock);
 	worker->pool = pool;
 	worker->thread = AST_PTHREADT_NULL;
 	worker->state = ALIVE;
@@ -1091,8 +1538,31 @@ static int worker_thread_start(struct worker_thread *worker)
  */
 static void worker_active(struct worker_thread *worker)
 {
+	struct ast_threadpool *pool = worker->pool;
 	int alive;
 
+	if (worker->options.work_stealing) {
+		worker_idle_uncount(worker);
+		for (;;) {
+			do {
+				alive = threadpool_work_stealing_execute(worker);
+			} while (alive);
+
+			/*
+			 * Count this worker idle before the final look for tasks.
+			 * A concurrent push then either leaves its task for this look
+			 * or sees this worker idle and wakes it up.
+			 */
+			ast_atomic_fetchadd_int(&pool->ws_idle, +1);
+			worker->counted_idle = 1;
+			if (pool->ws_queued <= 0 || pool->shutting_down || worker->state != ALIVE) {
+				break;
+			}
+			worker_idle_uncount(worker);
+		}
+		return;
+	}
+
 	/* The following is equivalent to 
 	 *
 	 * while (threadpool_execute(worker->pool));
@@ -1283,6 +1753,8 @@ static void serializer_shutdown_group_dec(struct ast_serializer_shutdown_group *
 struct serializer {
 	/*! Threadpool the serializer will use to process the jobs. */
 	struct ast_threadpool *pool;
+	/*! Picks the worker the serializer runs on in a work stealing pool. */
+	int affinity;
 	/*! Which group will wait for this serializer to shutdown. */
 	struct ast_serializer_shutdown_group *shutdown_group;
 };
@@ -1309,6 +1781,7 @@ static struct serializer *serializer_create(struct ast_threadpool *pool,
 	ao2_ref(pool, +1);
 	ser->pool = pool;
 	ser->shutdown_group = ao2_bump(shutdown_group);
+	ser->affinity = ast_atomic_fetchadd_int(&pool->ws_next, +1) & INT_MAX;
 	return ser;
 }
 
@@ -1319,7 +1792,7 @@ static int execute_tasks(void *data)
 	struct ast_taskprocessor *tps = data;
 
 	ast_threadstorage_set_ptr(&current_serializer, tps);
-	while (ast_taskprocessor_execute(tps)) {
+	while (ast_taskprocessor_execute_batch(tps, AST_TASKPROCESSOR_BATCH_SIZE)) {
 		/* No-op */
 	}
 	ast_threadstorage_set_ptr(&current_serializer, NULL);
@@ -1333,8 +1806,14 @@ static void serializer_task_pushed(struct ast_taskprocessor_listener *listener,
 	if (was_empty) {
 		struct serializer *ser = ast_taskprocessor_listener_get_user_data(listener);
 		struct ast_taskprocessor *tps = ast_taskprocessor_listener_get_tps(listener);
+		int res;
 
-		if (ast_threadpool_push(ser->pool, execute_tasks, tps)) {
+		if (ser->pool->options.work_stealing) {
+			res = threadpool_work_stealing_push(ser->pool, execute_tasks, tps, ser->affinity);
+		} else {
+			res = ast_threadpool_push(ser->pool, execute_tasks, tps);
+		}
+		if (res) {
 			ast_taskprocessor_unreference(tps);
 		}
 	}
@@ -1404,5 +1883,8 @@ struct ast_taskprocessor *ast_threadpool_serializer(const char *name, struct ast
 
 long ast_threadpool_queue_size(struct ast_threadpool *pool)
 {
+	if (pool->options.work_stealing) {
+		return pool->ws_queued;
+	}
 	return ast_taskprocessor_size(pool->tps);
 }
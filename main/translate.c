@@ -43,6 +43,7 @@
 #include "asterisk/term.h"
 #include "asterisk/format.h"
 #include "asterisk/linkedlists.h"
+#include "asterisk/test.h"
 
 /*! \todo
  * TODO: sample frames for each supported input format.
@@ -71,7 +72,7 @@ struct translator_path {
  * Array indexes are 'src' and 'dest', in that order.
  *
  * Note: the lock in the 'translators' list is also used to protect
- * this structure.
+ * this structure.  Call setup reads the published_matrix copy instead.
  */
 static struct translator_path **__matrix;
 
@@ -95,6 +96,71 @@ static int cur_max_index;
 /*! the largest index that can be used in either the __indextable or __matrix before resize must occur */
 static int index_size;
 
+/*! Number of buckets in the translation path cache */
+#define PATH_CACHE_BUCKETS 61
+
+/*!
+ * \brief The translators making up the path between two codecs
+ *
+ * Building a path from the matrix needs both codecs looked up in the
+ * index table and the matrix walked one step at a time.  The steps are
+ * remembered by codec id instead, until the matrix is next rebuilt.
+ */
+struct path_cache_entry {
+	/*! Id of the source codec */
+	unsigned int src_id;
+	/*! Id of the destination codec */
+	unsigned int dst_id;
+	/*! The matrix generation the steps were found in */
+	unsigned int generation;
+	/*! Number of translators in steps */
+	int num_steps;
+	/*! The translators, in the order they are applied */
+	struct ast_translator *steps[0];
+};
+
+/*! Translation paths by source and destination codec id */
+static struct ao2_container *path_cache;
+
+/*!
+ * \brief Incremented by every matrix rebuild, invalidating the cached paths
+ *
+ * \note Protected by the translators list lock.
+ */
+static unsigned int matrix_generation;
+
+/*! \brief The cost of translating between two codecs, as seen by call setup */
+struct translator_cost {
+	uint32_t table_cost;               /*!< Complete table cost to destination */
+	uint8_t multistep;                 /*!< Multiple conversions required for this translation */
+	uint8_t exists;                    /*!< There is a translation path at all */
+};
+
+/*!
+ * \brief An immutable copy of the translation matrix
+ *
+ * Choosing formats at call setup only needs the translation costs, not
+ * the translators themselves.  Each matrix rebuild publishes a new copy
+ * that readers use without taking the translators list lock.  The copy
+ * holds no translator pointers, so it stays valid after a translator
+ * module unloads.
+ */
+struct translator_matrix {
+	/*! Number of codecs in the matrix */
+	int num_codecs;
+	/*! Largest codec id in index_of */
+	unsigned int max_codec_id;
+	/*! Matrix index of each codec id, -1 for codecs not in the matrix */
+	int *index_of;
+	/*! A format for each matrix index */
+	struct ast_format **formats;
+	/*! num_codecs * num_codecs costs, by source then destination index */
+	struct translator_cost *costs;
+};
+
+/*! The most recently published translation matrix */
+static AO2_GLOBAL_OBJ_STATIC(published_matrix);
+
 static void matrix_rebuild(int samples);
 
 /*!
@@ -284,6 +350,109 @@ static struct translator_path *matrix_get(unsigned int x, unsigned int y)
 	return __matrix[x] + y;
 }
 
+static void translator_matrix_destructor(void *obj)
+{
+	struct translator_matrix *matrix = obj;
+	int x;
+
+	for (x = 0; x < matrix->num_codecs; x++) {
+		ao2_cleanup(matrix->formats[x]);
+	}
+}
+
+/*!
+ * \internal
+ * \brief Publish a copy of the matrix for call setup to read
+ *
+ * \note Must be called with the translators list lock held.  The table
+ * lock may or may not be held, so the index table is read directly.
+ */
+static void matrix_publish(void)
+{
+	struct translator_matrix *matrix;
+	unsigned int max_codec_id = 0;
+	int num_codecs = cur_max_index;
+	char *pos;
+	int x;
+	int y;
+
+	for (x = 0; x < num_codecs; x++) {
+		max_codec_id = MAX(max_codec_id, __indextable[x]);
+	}
+
+	matrix = ao2_alloc_options(sizeof(*matrix)
+		+ (max_codec_id + 1) * sizeof(*matrix->index_of)
+		+ num_codecs * sizeof(*matrix->formats)
+		+ num_codecs * num_codecs * sizeof(*matrix->costs),
+		translator_matrix_destructor, AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!matrix) {
+		ast_log(LOG_ERROR, "Unable to publish the translation matrix; call setup sees the previous one\n");
+		return;
+	}
+
+	/* The formats go first as they have the strictest alignment */
+	pos = (char *) (matrix + 1);
+	matrix->formats = (struct ast_format **) pos;
+	pos += num_codecs * sizeof(*matrix->formats);
+	matrix->costs = (struct translator_cost *) pos;
+	pos += num_codecs * num_codecs * sizeof(*matrix->costs);
+	matrix->index_of = (int *) pos;
+
+	matrix->max_codec_id = max_codec_id;
+	for (x = 0; x <= max_codec_id; x++) {
+		matrix->index_of[x] = -1;
+	}
+
+	for (x = 0; x < num_codecs; x++) {
+		struct ast_codec *codec = ast_codec_get_by_id(__indextable[x]);
+
+		if (codec) {
+			matrix->formats[x] = ast_format_create(codec);
+			ao2_ref(codec, -1);
+		}
+		if (!matrix->formats[x]) {
+			/* Leave the codec out of the copy rather than publish nothing */
+			continue;
+		}
+		matrix->index_of[__indextable[x]] = x;
+
+		for (y = 0; y < num_codecs; y++) {
+			struct translator_path *path = matrix_get(x, y);
+			struct translator_cost *cost = &matrix->costs[x * num_codecs + y];
+
+			cost->exists = path->step ? 1 : 0;
+			cost->table_cost = path->table_cost;
+			cost->multistep = path->multistep;
+		}
+	}
+	matrix->num_codecs = num_codecs;
+
+	ao2_global_obj_replace_unref(published_matrix, matrix);
+	ao2_ref(matrix, -1);
+}
+
+/*!
+ * \internal
+ * \brief Get the matrix index of a format in a published matrix
+ *
+ * \retval -1 the codec is not in the matrix
+ */
+static int matrix_index(const struct translator_matrix *matrix, struct ast_format *format)
+{
+	unsigned int id = ast_format_get_codec_id(format);
+
+	return id <= matrix->max_codec_id ? matrix->index_of[id] : -1;
+}
+
+/*!
+ * \internal
+ * \brief Get the cost of translating between two indexes of a published matrix
+ */
+static const struct translator_cost *matrix_cost(const struct translator_matrix *matrix, int x, int y)
+{
+	return &matrix->costs[x * matrix->num_codecs + y];
+}
+
 /*
  * wrappers around the translator routines.
  */
@@ -466,11 +635,46 @@ void ast_translator_free_path(struct ast_trans_pvt *p)
 	}
 }
 
-/*! \brief Build a chain of translators based upon the given source and dest formats */
-struct ast_trans_pvt *ast_translator_build_path(struct ast_format *dst, struct ast_format *src)
+static int path_cache_hash(const void *obj, const int flags)
 {
-	struct ast_trans_pvt *head = NULL, *tail = NULL;
-	int src_index, dst_index;
+	const struct path_cache_entry *entry = obj;
+
+	return entry->src_id * 31 + entry->dst_id;
+}
+
+static int path_cache_cmp(void *obj, void *arg, int flags)
+{
+	const struct path_cache_entry *left = obj;
+	const struct path_cache_entry *right = arg;
+
+	return left->src_id == right->src_id && left->dst_id == right->dst_id ? CMP_MATCH : 0;
+}
+
+/*!
+ * \internal
+ * \brief Find the translators on the path between two formats
+ *
+ * \note Must be called with the translators list lock held.
+ *
+ * \return The path with a reference, NULL if there is none
+ */
+static struct path_cache_entry *path_cache_get(struct ast_format *dst, struct ast_format *src)
+{
+	struct path_cache_entry search = {
+		.src_id = ast_format_get_codec_id(src),
+		.dst_id = ast_format_get_codec_id(dst),
+	};
+	struct path_cache_entry *entry;
+	int src_index;
+	int dst_index;
+	int index;
+	int num_steps = 0;
+
+	entry = ao2_find(path_cache, &search, OBJ_SEARCH_OBJECT);
+	if (entry && entry->generation == matrix_generation) {
+		return entry;
+	}
+	ao2_cleanup(entry);
 
 	src_index = format2index(src);
 	dst_index = format2index(dst);
@@ -480,18 +684,56 @@ struct ast_trans_pvt *ast_translator_build_path(struct ast_format *dst, struct a
 		return NULL;
 	}
 
-	AST_RWLIST_RDLOCK(&translators);
+	for (index = src_index; index != dst_index; ++num_steps) {
+		struct ast_translator *t = matrix_get(index, dst_index)->step;
 
-	while (src_index != dst_index) {
-		struct ast_trans_pvt *cur;
-		struct ast_format *explicit_dst = NULL;
-		struct ast_translator *t = matrix_get(src_index, dst_index)->step;
 		if (!t) {
 			ast_log(LOG_WARNING, "No translator path from %s to %s\n",
 				ast_format_get_name(src), ast_format_get_name(dst));
-			AST_RWLIST_UNLOCK(&translators);
 			return NULL;
 		}
+		index = t->dst_fmt_index;
+	}
+
+	entry = ao2_alloc_options(sizeof(*entry) + num_steps * sizeof(entry->steps[0]), NULL,
+		AO2_ALLOC_OPT_LOCK_NOLOCK);
+	if (!entry) {
+		return NULL;
+	}
+	*entry = search;
+	entry->generation = matrix_generation;
+	entry->num_steps = num_steps;
+	for (index = src_index, num_steps = 0; index != dst_index; ++num_steps) {
+		entry->steps[num_steps] = matrix_get(index, dst_index)->step;
+		index = entry->steps[num_steps]->dst_fmt_index;
+	}
+
+	/* Replaces any path found by an earlier matrix */
+	ao2_link(path_cache, entry);
+
+	return entry;
+}
+
+/*! \brief Build a chain of translators based upon the given source and dest formats */
+struct ast_trans_pvt *ast_translator_build_path(struct ast_format *dst, struct ast_format *src)
+{
+	struct ast_trans_pvt *head = NULL, *tail = NULL;
+	struct path_cache_entry *path;
+	int step;
+
+	AST_RWLIST_RDLOCK(&translators);
+
+	path = path_cache_get(dst, src);
+	if (!path) {
+		AST_RWLIST_UNLOCK(&translators);
+		return NULL;
+	}
+
+	for (step = 0; step < path->num_steps; ++step) {
+		struct ast_trans_pvt *cur;
+		struct ast_format *explicit_dst = NULL;
+		struct ast_translator *t = path->steps[step];
+
 		if ((t->dst_codec.sample_rate == ast_format_get_sample_rate(dst)) && (t->dst_codec.type == ast_format_get_type(dst))) {
 			explicit_dst = dst;
 		}
@@ -502,6 +744,7 @@ struct ast_trans_pvt *ast_translator_build_path(struct ast_format *dst, struct a
 				ast_translator_free_path(head);
 			}
 			AST_RWLIST_UNLOCK(&translators);
+			ao2_ref(path, -1);
 			return NULL;
 		}
 		if (!head) {
@@ -511,11 +754,10 @@ struct ast_trans_pvt *ast_translator_build_path(struct ast_format *dst, struct a
 		}
 		tail = cur;
 		cur->nextin = cur->nextout = ast_tv(0, 0);
-		/* Keep going if this isn't the final destination */
-		src_index = cur->t->dst_fmt_index;
 	}
 
 	AST_RWLIST_UNLOCK(&translators);
+	ao2_ref(path, -1);
 	return head;
 }
 
@@ -631,6 +873,202 @@ struct ast_frame *ast_translate(struct ast_trans_pvt *path, struct ast_frame *f,
 	return out;
 }
 
+/*! Source frames a shared translation can go unrequested before it is freed */
+#define SHARED_IDLE_FRAMES 50
+
+/*! \brief One destination format of a shared translation */
+struct shared_translation {
+	/*! Serializes translating into this destination format */
+	ast_mutex_t lock;
+	/*! The destination format */
+	struct ast_format *dst;
+	/*! The translation path, built the first time it is needed */
+	struct ast_trans_pvt *path;
+	/*! The current source frame translated, if it has been */
+	struct ast_frame *out;
+	/*! The source frame count out was translated at */
+	unsigned int translated;
+	/*! The source frame count this format was last requested at */
+	unsigned int requested;
+	/*! TRUE if no translation path could be built */
+	unsigned int failed:1;
+	AST_LIST_ENTRY(shared_translation) list;
+};
+
+struct ast_translate_shared {
+	/*! Format of the source stream */
+	struct ast_format *src;
+	/*! The current source frame, owned by the caller */
+	struct ast_frame *frame;
+	/*! Incremented for every source frame */
+	unsigned int frame_count;
+	/*! The destination formats translated to */
+	AST_LIST_HEAD_NOLOCK(, shared_translation) translations;
+};
+
+static struct shared_translation *shared_translation_alloc(struct ast_format *dst,
+	unsigned int frame_count)
+{
+	struct shared_translation *translation;
+
+	translation = ast_calloc(1, sizeof(*translation));
+	if (!translation) {
+		return NULL;
+	}
+	ast_mutex_init(&translation->lock);
+	translation->dst = ao2_bump(dst);
+	/* Not yet translated at the current frame count */
+	translation->translated = frame_count - 1;
+	return translation;
+}
+
+static void shared_translation_free(struct shared_translation *translation)
+{
+	if (translation->out) {
+		ast_frfree(translation->out);
+	}
+	if (translation->path) {
+		ast_translator_free_path(translation->path);
+	}
+	ao2_cleanup(translation->dst);
+	ast_mutex_destroy(&translation->lock);
+	ast_free(translation);
+}
+
+static void translate_shared_destructor(void *obj)
+{
+	struct ast_translate_shared *shared = obj;
+	struct shared_translation *translation;
+
+	while ((translation = AST_LIST_REMOVE_HEAD(&shared->translations, list))) {
+		shared_translation_free(translation);
+	}
+	ao2_cleanup(shared->src);
+}
+
+struct ast_translate_shared *ast_translate_shared_alloc(struct ast_format *src)
+{
+	struct ast_translate_shared *shared;
+
+	shared = ao2_alloc(sizeof(*shared), translate_shared_destructor);
+	if (!shared) {
+		return NULL;
+	}
+	shared->src = ao2_bump(src);
+	return shared;
+}
+
+void ast_translate_shared_frame(struct ast_translate_shared *shared, struct ast_frame *f)
+{
+	struct shared_translation *translation;
+
+	ao2_lock(shared);
+	shared->frame = f;
+	++shared->frame_count;
+	AST_LIST_TRAVERSE_SAFE_BEGIN(&shared->translations, translation, list) {
+		if (shared->frame_count - translation->requested > SHARED_IDLE_FRAMES) {
+			AST_LIST_REMOVE_CURRENT(list);
+			shared_translation_free(translation);
+			continue;
+		}
+		if (translation->out) {
+			ast_frfree(translation->out);
+			translation->out = NULL;
+		}
+	}
+	AST_LIST_TRAVERSE_SAFE_END;
+	ao2_unlock(shared);
+}
+
+/*!
+ * \internal
+ * \brief Share every frame of a translator's output
+ *
+ * \param out Frame, or frame list, returned by ast_translate()
+ *
+ * \return Shared copy of the whole list, NULL on failure
+ */
+static struct ast_frame *shared_frame_list(struct ast_frame *out)
+{
+	struct ast_frame *head = NULL;
+	struct ast_frame *tail = NULL;
+	struct ast_frame *current;
+
+	for (current = out; current; current = AST_LIST_NEXT(current, frame_list)) {
+		struct ast_frame *copy = ast_frshare(current);
+
+		if (!copy) {
+			if (head) {
+				ast_frfree(head);
+			}
+			return NULL;
+		}
+		if (tail) {
+			AST_LIST_NEXT(tail, frame_list) = copy;
+		} else {
+			head = copy;
+		}
+		tail = copy;
+	}
+
+	return head;
+}
+
+struct ast_frame *ast_translate_shared_get(struct ast_translate_shared *shared, struct ast_format *dst)
+{
+	struct shared_translation *translation;
+	struct ast_frame *frame;
+	unsigned int frame_count;
+
+	ao2_lock(shared);
+	frame = shared->frame;
+	frame_count = shared->frame_count;
+	if (!frame || ast_format_cmp(dst, shared->src) == AST_FORMAT_CMP_EQUAL) {
+		ao2_unlock(shared);
+		return frame;
+	}
+
+	AST_LIST_TRAVERSE(&shared->translations, translation, list) {
+		if (ast_format_cmp(translation->dst, dst) == AST_FORMAT_CMP_EQUAL) {
+			break;
+		}
+	}
+	if (!translation) {
+		translation = shared_translation_alloc(dst, frame_count);
+		if (!translation) {
+			ao2_unlock(shared);
+			return NULL;
+		}
+		AST_LIST_INSERT_HEAD(&shared->translations, translation, list);
+	}
+	translation->requested = frame_count;
+
+	/* Others asking for the same format wait for this one translation */
+	ast_mutex_lock(&translation->lock);
+	ao2_unlock(shared);
+
+	if (translation->translated != frame_count) {
+		translation->translated = frame_count;
+		if (!translation->path && !translation->failed
+			&& !(translation->path = ast_translator_build_path(dst, shared->src))) {
+			translation->failed = 1;
+		}
+		if (translation->path) {
+			struct ast_frame *out = ast_translate(translation->path, frame, 0);
+
+			/* Everyone asking for this format queues the same data */
+			if (out) {
+				translation->out = shared_frame_list(out);
+				ast_frfree(out);
+			}
+		}
+	}
+	frame = translation->out;
+	ast_mutex_unlock(&translation->lock);
+
+	return frame;
+}
+
 /*!
  * \internal
  * \brief Compute the computational cost of a single translation step.
@@ -785,6 +1223,7 @@ static void matrix_rebuild(int samples)
 	ast_debug(1, "Resetting translation matrix\n");
 
 	matrix_clear();
+	++matrix_generation;
 
 	/* first, compute all direct costs */
 	AST_RWLIST_TRAVERSE(&translators, t, list) {
@@ -867,6 +1306,8 @@ static void matrix_rebuild(int samples)
 			break;
 		}
 	}
+
+	matrix_publish();
 }
 
 static void codec_append_name(const struct ast_codec *codec, struct ast_str **buf)
@@ -1316,6 +1757,7 @@ int ast_translator_best_choice(struct ast_format_cap *dst_cap,
 	RAII_VAR(struct ast_format *, best, NULL, ao2_cleanup);
 	RAII_VAR(struct ast_format *, bestdst, NULL, ao2_cleanup);
 	struct ast_format_cap *joint_cap;
+	struct translator_matrix *matrix;
 	int i;
 	int j;
 
@@ -1351,7 +1793,10 @@ int ast_translator_best_choice(struct ast_format_cap *dst_cap,
 	}
 
 	/* need to translate */
-	AST_RWLIST_RDLOCK(&translators);
+	matrix = ao2_global_obj_ref(published_matrix);
+	if (!matrix) {
+		return -1;
+	}
 	for (i = 0; i < ast_format_cap_count(dst_cap); ++i, ao2_cleanup(dst)) {
 		dst = ast_format_cap_get_format(dst_cap, i);
 		if (!dst
@@ -1360,6 +1805,7 @@ int ast_translator_best_choice(struct ast_format_cap *dst_cap,
 		}
 
 		for (j = 0; j < ast_format_cap_count(src_cap); ++j, ao2_cleanup(src)) {
+			const struct translator_cost *cost;
 			int x;
 			int y;
 
@@ -1369,25 +1815,26 @@ int ast_translator_best_choice(struct ast_format_cap *dst_cap,
 				continue;
 			}
 
-			x = format2index(src);
-			y = format2index(dst);
+			x = matrix_index(matrix, src);
+			y = matrix_index(matrix, dst);
 			if (x < 0 || y < 0) {
 				continue;
 			}
-			if (!matrix_get(x, y) || !(matrix_get(x, y)->step)) {
+			cost = matrix_cost(matrix, x, y);
+			if (!cost->exists) {
 				continue;
 			}
-			if (matrix_get(x, y)->table_cost < besttablecost
-				|| matrix_get(x, y)->multistep < beststeps) {
+			if (cost->table_cost < besttablecost
+				|| cost->multistep < beststeps) {
 				/* better than what we have so far */
 				ao2_replace(best, src);
 				ao2_replace(bestdst, dst);
-				besttablecost = matrix_get(x, y)->table_cost;
-				beststeps = matrix_get(x, y)->multistep;
+				besttablecost = cost->table_cost;
+				beststeps = cost->multistep;
 			}
 		}
 	}
-	AST_RWLIST_UNLOCK(&translators);
+	ao2_ref(matrix, -1);
 
 	if (!best) {
 		return -1;
@@ -1400,42 +1847,42 @@ int ast_translator_best_choice(struct ast_format_cap *dst_cap,
 unsigned int ast_translate_path_steps(struct ast_format *dst_format, struct ast_format *src_format)
 {
 	unsigned int res = -1;
-	/* convert bitwise format numbers into array indices */
-	int src = format2index(src_format);
-	int dest = format2index(dst_format);
+	struct translator_matrix *matrix;
+	int src;
+	int dest;
 
-	if (src < 0 || dest < 0) {
-		ast_log(LOG_WARNING, "No translator path: (%s codec is not valid)\n", src < 0 ? "starting" : "ending");
+	matrix = ao2_global_obj_ref(published_matrix);
+	if (!matrix) {
 		return -1;
 	}
-	AST_RWLIST_RDLOCK(&translators);
 
-	if (matrix_get(src, dest)->step) {
-		res = matrix_get(src, dest)->multistep + 1;
+	/* convert codec ids into array indices */
+	src = matrix_index(matrix, src_format);
+	dest = matrix_index(matrix, dst_format);
+	if (src < 0 || dest < 0) {
+		ast_log(LOG_WARNING, "No translator path: (%s codec is not valid)\n", src < 0 ? "starting" : "ending");
+	} else if (matrix_cost(matrix, src, dest)->exists) {
+		res = matrix_cost(matrix, src, dest)->multistep + 1;
 	}
 
-	AST_RWLIST_UNLOCK(&translators);
-
+	ao2_ref(matrix, -1);
 	return res;
 }
 
-static void check_translation_path(
+static void check_translation_path(const struct translator_matrix *matrix,
 	struct ast_format_cap *dest, struct ast_format_cap *src,
 	struct ast_format_cap *result, struct ast_format *src_fmt,
 	enum ast_media_type type)
 {
-	int index, src_index = format2index(src_fmt);
+	int index, src_index = matrix_index(matrix, src_fmt);
 	/* For a given source format, traverse the list of
 	   known formats to determine whether there exists
 	   a translation path from the source format to the
 	   destination format. */
-	for (index = 0; (src_index >= 0) && index < cur_max_index; index++) {
-		struct ast_codec *codec = index2codec(index);
-		RAII_VAR(struct ast_format *, fmt, ast_format_create(codec), ao2_cleanup);
+	for (index = 0; (src_index >= 0) && index < matrix->num_codecs; index++) {
+		struct ast_format *fmt = matrix->formats[index];
 
-		ao2_ref(codec, -1);
-
-		if (ast_format_get_type(fmt) != type) {
+		if (!fmt || ast_format_get_type(fmt) != type) {
 			continue;
 		}
 
@@ -1452,13 +1899,13 @@ static void check_translation_path(
 
 		/* if we don't have a translation path from the src
 		   to this format, remove it from the result */
-		if (!matrix_get(src_index, index)->step) {
+		if (!matrix_cost(matrix, src_index, index)->exists) {
 			ast_format_cap_remove(result, fmt);
 			continue;
 		}
 
 		/* now check the opposite direction */
-		if (!matrix_get(index, src_index)->step) {
+		if (!matrix_cost(matrix, index, src_index)->exists) {
 			ast_format_cap_remove(result, fmt);
 		}
 	}
@@ -1468,6 +1915,7 @@ static void check_translation_path(
 void ast_translate_available_formats(struct ast_format_cap *dest, struct ast_format_cap *src, struct ast_format_cap *result)
 {
 	struct ast_format *cur_dest, *cur_src;
+	struct translator_matrix *matrix;
 	int index;
 
 	for (index = 0; index < ast_format_cap_count(dest); ++index) {
@@ -1492,25 +1940,156 @@ void ast_translate_available_formats(struct ast_format_cap *dest, struct ast_for
 		return;
 	}
 
+	matrix = ao2_global_obj_ref(published_matrix);
+	if (!matrix) {
+		return;
+	}
+
 	for (index = 0; index < ast_format_cap_count(src); ++index) {
 		if (!(cur_src = ast_format_cap_get_format(src, index))) {
 			continue;
 		}
 
-		AST_RWLIST_RDLOCK(&translators);
-		check_translation_path(dest, src, result,
+		check_translation_path(matrix, dest, src, result,
 				       cur_src, AST_MEDIA_TYPE_AUDIO);
-		check_translation_path(dest, src, result,
+		check_translation_path(matrix, dest, src, result,
 				       cur_src, AST_MEDIA_TYPE_VIDEO);
-		AST_RWLIST_UNLOCK(&translators);
 		ao2_ref(cur_src, -1);
 	}
+	ao2_ref(matrix, -1);
+}
+
+#ifdef TEST_FRAMEWORK
+/*! Most threads looking up paths at once */
+#define LOOKUP_THREADS 8
+/*! Path lookups done by each thread */
+#define LOOKUP_ITERATIONS 200000
+
+/*!
+ * \internal
+ * \brief Steps from src to dst read from the translators' own matrix
+ *
+ * This is how ast_translate_path_steps() looked paths up before the
+ * matrix was published for call setup.
+ */
+static unsigned int path_steps_locked(struct ast_format *dst_format, struct ast_format *src_format)
+{
+	unsigned int res = -1;
+	int src = format2index(src_format);
+	int dest = format2index(dst_format);
+
+	if (src < 0 || dest < 0) {
+		return -1;
+	}
+	AST_RWLIST_RDLOCK(&translators);
+	if (matrix_get(src, dest)->step) {
+		res = matrix_get(src, dest)->multistep + 1;
+	}
+	AST_RWLIST_UNLOCK(&translators);
+
+	return res;
+}
+
+struct lookup_paths {
+	/*! Look the path up by taking the translators list lock */
+	int locked;
+	/*! Steps from a-law to mu-law */
+	unsigned int steps;
+	/*! Number of lookups that found a different number of steps */
+	int failures;
+};
+
+static void *lookup_thread(void *data)
+{
+	struct lookup_paths *paths = data;
+	int i;
+
+	for (i = 0; i < LOOKUP_ITERATIONS; ++i) {
+		unsigned int steps;
+
+		if (paths->locked) {
+			steps = path_steps_locked(ast_format_ulaw, ast_format_alaw);
+		} else {
+			steps = ast_translate_path_steps(ast_format_ulaw, ast_format_alaw);
+		}
+		if (steps != paths->steps) {
+			ast_atomic_fetchadd_int(&paths->failures, +1);
+		}
+	}
+
+	return NULL;
 }
 
+AST_TEST_DEFINE(translate_path_lookup)
+{
+	static const char * const methods[] = { "published matrix", "translators lock" };
+	pthread_t threads[LOOKUP_THREADS];
+	struct lookup_paths paths;
+	struct timeval start;
+	int64_t elapsed_us;
+	int num_threads;
+	int created;
+	int i;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "translate_path_lookup";
+		info->category = "/main/translate/";
+		info->summary = "translation path lookup benchmark";
+		info->description =
+			"Ensures that looking up a translation path in the published\n"
+			"matrix agrees with the translators' own matrix, and reports how\n"
+			"many lookups per second each does as threads are added.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	paths.steps = path_steps_locked(ast_format_ulaw, ast_format_alaw);
+	if (paths.steps == -1) {
+		ast_test_status_update(test, "No translation path from a-law to mu-law\n");
+		return AST_TEST_FAIL;
+	}
+
+	for (num_threads = 1; num_threads <= LOOKUP_THREADS; num_threads *= 2) {
+		for (paths.locked = 0; paths.locked < ARRAY_LEN(methods); ++paths.locked) {
+			paths.failures = 0;
+			start = ast_tvnow();
+			for (created = 0; created < num_threads; ++created) {
+				if (ast_pthread_create(&threads[created], NULL, lookup_thread, &paths)) {
+					ast_test_status_update(test, "Unable to create thread\n");
+					break;
+				}
+			}
+			for (i = 0; i < created; ++i) {
+				pthread_join(threads[i], NULL);
+			}
+			elapsed_us = ast_tvdiff_us(ast_tvnow(), start);
+
+			if (created < num_threads) {
+				return AST_TEST_FAIL;
+			}
+			if (paths.failures) {
+				ast_test_status_update(test, "%d lookups in the %s did not find %u steps\n",
+					paths.failures, methods[paths.locked], paths.steps);
+				return AST_TEST_FAIL;
+			}
+
+			ast_test_status_update(test, "%d threads, %s: %.0f lookups per second\n",
+				num_threads, methods[paths.locked], elapsed_us
+				? (double) num_threads * LOOKUP_ITERATIONS * 1000000.0 / elapsed_us : 0.0);
+		}
+	}
+
+	return AST_TEST_PASS;
+}
+#endif
+
 static void translate_shutdown(void)
 {
 	int x;
 	ast_cli_unregister_multiple(cli_translate, ARRAY_LEN(cli_translate));
+	AST_TEST_UNREGISTER(translate_path_lookup);
 
 	ast_rwlock_wrlock(&tablelock);
 	for (x = 0; x < index_size; x++) {
@@ -1522,14 +2101,25 @@ static void translate_shutdown(void)
 	__indextable = NULL;
 	ast_rwlock_unlock(&tablelock);
 	ast_rwlock_destroy(&tablelock);
+
+	ao2_cleanup(path_cache);
+	path_cache = NULL;
+	ao2_global_obj_release(published_matrix);
 }
 
 int ast_translate_init(void)
 {
 	int res = 0;
 	ast_rwlock_init(&tablelock);
+	path_cache = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX,
+		AO2_CONTAINER_ALLOC_OPT_DUPS_REPLACE, PATH_CACHE_BUCKETS,
+		path_cache_hash, NULL, path_cache_cmp);
+	if (!path_cache) {
+		return -1;
+	}
 	res = matrix_resize(1);
 	res |= ast_cli_register_multiple(cli_translate, ARRAY_LEN(cli_translate));
+	AST_TEST_REGISTER(translate_path_lookup);
 	ast_register_cleanup(translate_shutdown);
 	return res;
 }
@@ -102,6 +102,7 @@ static int write_protect_config = 1;
 static int autofallthrough_config = 1;
 static int clearglobalvars_config = 0;
 static int extenpatternmatchnew_config = 0;
+static int extenpatterncompile_config = 0;
 static char *overrideswitch_config = NULL;
 
 AST_MUTEX_DEFINE_STATIC(save_dialplan_lock);
@@ -891,13 +892,14 @@ static char *handle_cli_dialplan_save(struct ast_cli_entry *e, int cmd, struct a
 	if (overrideswitch_config) {
 		snprintf(overrideswitch, sizeof(overrideswitch), "overrideswitch=%s\n", overrideswitch_config);
 	}
-	fprintf(output, "[general]\nstatic=%s\nwriteprotect=%s\nautofallthrough=%s\nclearglobalvars=%s\n%sextenpatternmatchnew=%s\n\n",
+	fprintf(output, "[general]\nstatic=%s\nwriteprotect=%s\nautofallthrough=%s\nclearglobalvars=%s\n%sextenpatternmatchnew=%s\nextenpatterncompile=%s\n\n",
 		static_config ? "yes" : "no",
 		write_protect_config ? "yes" : "no",
                 autofallthrough_config ? "yes" : "no",
 				clearglobalvars_config ? "yes" : "no",
 				overrideswitch_config ? overrideswitch : "",
-				extenpatternmatchnew_config ? "yes" : "no");
+				extenpatternmatchnew_config ? "yes" : "no",
+				extenpatterncompile_config ? "yes" : "no");
 
 	if ((v = ast_variable_browse(cfg, "globals"))) {
 		fprintf(output, "[globals]\n");
@@ -1695,6 +1697,7 @@ static int pbx_load_config(const char *config_file)
 		autofallthrough_config = ast_true(aft);
 	if ((newpm = ast_variable_retrieve(cfg, "general", "extenpatternmatchnew")))
 		extenpatternmatchnew_config = ast_true(newpm);
+	extenpatterncompile_config = ast_true(ast_variable_retrieve(cfg, "general", "extenpatterncompile"));
 	clearglobalvars_config = ast_true(ast_variable_retrieve(cfg, "general", "clearglobalvars"));
 	if ((ovsw = ast_variable_retrieve(cfg, "general", "overrideswitch"))) {
 		if (overrideswitch_config) {
@@ -2085,6 +2088,8 @@ static int pbx_load_module(void)
 	
 	pbx_load_users();
 
+	/* The merge compiles the extensions if this is set */
+	pbx_set_extenpatterncompile(extenpatterncompile_config);
 	ast_merge_contexts_and_delete(&local_contexts, local_table, registrar);
 	local_table = NULL; /* the local table has been moved into the global one. */
 	local_contexts = NULL;
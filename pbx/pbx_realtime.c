@@ -334,14 +334,17 @@ static int realtime_exec(struct ast_channel *chan, const char *context, const ch
 				if (ast_channel_snapshot_type()) {
 					ast_channel_lock(chan);
 					snapshot = ast_channel_snapshot_create(chan);
-					ast_channel_unlock(chan);
-				}
-				if (snapshot) {
 					/* pbx_exec sets application name and data, but we don't want to log
 					 * every exec. Just update the snapshot here instead.
 					 */
-					ast_string_field_set(snapshot, appl, app);
-					ast_string_field_set(snapshot, data, !ast_strlen_zero(appdata) ? appdata : "(NULL)");
+					if (snapshot && ast_channel_snapshot_set_application(snapshot, app,
+						!ast_strlen_zero(appdata) ? appdata : "(NULL)")) {
+						ao2_ref(snapshot, -1);
+						snapshot = NULL;
+					}
+					ast_channel_unlock(chan);
+				}
+				if (snapshot) {
 					msg = stasis_message_create(ast_channel_snapshot_type(), snapshot);
 					if (msg) {
 						stasis_publish(ast_channel_topic(chan), msg);
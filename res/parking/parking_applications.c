@@ -658,7 +658,9 @@ static int parked_call_app_exec(struct ast_channel *chan, const char *data)
 
 	/* The parked call needs to know who is retrieving it before we move it out of the parking bridge */
 	ast_assert(pu->retriever == NULL);
+	ast_channel_lock(chan);
 	pu->retriever = ast_channel_snapshot_create(chan);
+	ast_channel_unlock(chan);
 
 	/* Create bridge */
 	retrieval_bridge = ast_bridge_basic_new();
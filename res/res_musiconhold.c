@@ -182,6 +182,8 @@ struct mohclass {
 	int srcfd;
 	/*! Generic timer */
 	struct ast_timer *timer;
+	/*! The source audio translated once for all the members using each format */
+	struct ast_translate_shared *translate;
 	/*! Created on the fly, from RT engine */
 	unsigned int realtime:1;
 	unsigned int delete:1;
@@ -191,6 +193,8 @@ struct mohclass {
 
 struct mohdata {
 	int pipe[2];
+	/*! Format of the audio in the pipe, the class's or the channel's raw write format */
+	struct ast_format *format;
 	struct ast_format *origwfmt;
 	struct mohclass *parent;
 	struct ast_frame f;
@@ -679,6 +683,32 @@ static int spawn_mp3(struct mohclass *class)
 	return fds[0];
 }
 
+/*!
+ * \internal
+ * \brief Write the class's latest audio to a member's pipe, in the member's format
+ *
+ * \note Must be called with the class locked.
+ */
+static void moh_member_write(struct mohclass *class, struct mohdata *moh, void *data, int len)
+{
+	struct ast_frame *f;
+	int res;
+
+	if (!class->translate || ast_format_cmp(moh->format, class->format) == AST_FORMAT_CMP_EQUAL) {
+		if ((res = write(moh->pipe[1], data, len)) != len) {
+			ast_debug(1, "Only wrote %d of %d bytes to pipe\n", res, len);
+		}
+		return;
+	}
+
+	/* Every member using this format gets the same translation */
+	for (f = ast_translate_shared_get(class->translate, moh->format); f; f = AST_LIST_NEXT(f, frame_list)) {
+		if ((res = write(moh->pipe[1], f->data.ptr, f->datalen)) != f->datalen) {
+			ast_debug(1, "Only wrote %d of %d bytes to pipe\n", res, f->datalen);
+		}
+	}
+}
+
 static void *monmp3thread(void *data)
 {
 #define	MOH_MS_INTERVAL		100
@@ -686,6 +716,11 @@ static void *monmp3thread(void *data)
 	struct mohclass *class = data;
 	struct mohdata *moh;
 	short sbuf[8192];
+	struct ast_frame frame = {
+		.frametype = AST_FRAME_VOICE,
+		.data.ptr = sbuf,
+		.src = "monmp3thread",
+	};
 	int res = 0, res2;
 	int len;
 	struct timeval deadline, tv_tmp;
@@ -787,11 +822,15 @@ static void *monmp3thread(void *data)
 		pthread_testcancel();
 
 		ao2_lock(class);
+		if (class->translate) {
+			frame.subclass.format = class->format;
+			frame.datalen = res2;
+			frame.samples = ast_codec_samples_count(&frame);
+			ast_translate_shared_frame(class->translate, &frame);
+		}
 		AST_LIST_TRAVERSE(&class->members, moh, list) {
 			/* Write data */
-			if ((res = write(moh->pipe[1], sbuf, res2)) != res2) {
-				ast_debug(1, "Only wrote %d of %d bytes to pipe\n", res, res2);
-			}
+			moh_member_write(class, moh, sbuf, res2);
 		}
 		ao2_unlock(class);
 	}
@@ -885,7 +924,7 @@ static struct mohclass *_get_mohbyname(const char *name, int warn, int flags, co
 	return moh;
 }
 
-static struct mohdata *mohalloc(struct mohclass *cl)
+static struct mohdata *mohalloc(struct mohclass *cl, struct ast_format *format)
 {
 	struct mohdata *moh;
 	long flags;
@@ -905,8 +944,9 @@ static struct mohdata *mohalloc(struct mohclass *cl)
 	flags = fcntl(moh->pipe[1], F_GETFL);
 	fcntl(moh->pipe[1], F_SETFL, flags | O_NONBLOCK);
 
+	moh->format = ao2_bump(format);
 	moh->f.frametype = AST_FRAME_VOICE;
-	moh->f.subclass.format = cl->format;
+	moh->f.subclass.format = moh->format;
 	moh->f.offset = AST_FRIENDLY_OFFSET;
 
 	moh->parent = mohclass_ref(cl, "Reffing music class for mohdata parent");
@@ -935,6 +975,7 @@ static void moh_release(struct ast_channel *chan, void *data)
 
 	moh->parent = class = mohclass_unref(class, "unreffing moh->parent upon deactivation of generator");
 
+	ao2_cleanup(moh->format);
 	ast_free(moh);
 
 	if (chan) {
@@ -955,6 +996,44 @@ static void moh_release(struct ast_channel *chan, void *data)
 	ao2_cleanup(oldwfmt);
 }
 
+/*!
+ * \internal
+ * \brief Pick the format a new member's audio is written to its pipe in
+ *
+ * \details If the class translates its audio for its members, the member
+ * gets the channel's raw write format so the channel has nothing left to
+ * translate.  Otherwise it gets the class's format.
+ */
+static struct ast_format *moh_member_format(struct mohclass *class, struct ast_channel *chan)
+{
+	struct ast_format *raw = ast_channel_rawwriteformat(chan);
+
+	if (!class->translate || !raw
+		|| ast_format_cmp(raw, class->format) == AST_FORMAT_CMP_EQUAL
+		/* The pipe is read in lengths of whole frames, so they have to be fixed in size */
+		|| !ast_format_determine_length(raw, 160)
+		|| ast_translate_path_steps(raw, class->format) == -1) {
+		return class->format;
+	}
+	return raw;
+}
+
+/*!
+ * \internal
+ * \brief Change the format of a member's audio, discarding what is in its pipe
+ */
+static void moh_member_set_format(struct mohdata *moh, struct ast_format *format)
+{
+	char buf[1024];
+
+	ao2_lock(moh->parent);
+	while (read(moh->pipe[0], buf, sizeof(buf)) > 0) {
+	}
+	ao2_replace(moh->format, format);
+	moh->f.subclass.format = moh->format;
+	ao2_unlock(moh->parent);
+}
+
 static void *moh_alloc(struct ast_channel *chan, void *params)
 {
 	struct mohdata *res;
@@ -979,7 +1058,7 @@ static void *moh_alloc(struct ast_channel *chan, void *params)
 		memset(state, 0, sizeof(*state));
 	}
 
-	if ((res = mohalloc(class))) {
+	if ((res = mohalloc(class, moh_member_format(class, chan)))) {
 		res->origwfmt = ao2_bump(ast_channel_writeformat(chan));
 		if (ast_set_write_format(chan, class->format)) {
 			ast_log(LOG_WARNING, "Unable to set channel '%s' to format '%s'\n", ast_channel_name(chan),
@@ -1000,7 +1079,13 @@ static int moh_generate(struct ast_channel *chan, void *data, int len, int sampl
 	short buf[1280 + AST_FRIENDLY_OFFSET / 2];
 	int res;
 
-	len = ast_format_determine_length(moh->parent->format, samples);
+	if (ast_format_cmp(moh->format, moh->parent->format) != AST_FORMAT_CMP_EQUAL
+		&& ast_format_cmp(moh->format, ast_channel_rawwriteformat(chan)) != AST_FORMAT_CMP_EQUAL) {
+		/* The channel changed codecs, so let it translate the class's audio itself. */
+		moh_member_set_format(moh, moh->parent->format);
+	}
+
+	len = ast_format_determine_length(moh->format, samples);
 
 	if (len > sizeof(buf) - AST_FRIENDLY_OFFSET) {
 		ast_log(LOG_WARNING, "Only doing %d of %d requested bytes on %s\n", (int)sizeof(buf), len, ast_channel_name(chan));
@@ -1260,6 +1345,9 @@ static int init_app_class(struct mohclass *class)
 
 	class->srcfd = -1;
 
+	/* Without it every member's channel translates for itself */
+	class->translate = ast_translate_shared_alloc(class->format);
+
 	if (!(class->timer = ast_timer_open())) {
 		ast_log(LOG_WARNING, "Unable to create timer: %s\n", strerror(errno));
 		return -1;
@@ -1608,6 +1696,7 @@ static void moh_class_destructor(void *obj)
 
 	ao2_lock(class);
 	while ((member = AST_LIST_REMOVE_HEAD(&class->members, list))) {
+		ao2_cleanup(member->format);
 		ast_free(member);
 	}
 	ao2_unlock(class);
@@ -1687,6 +1776,8 @@ static void moh_class_destructor(void *obj)
 		pthread_join(tid, NULL);
 	}
 
+	ao2_cleanup(class->translate);
+
 }
 
 static int moh_class_mark(void *obj, void *arg, int flags)
@@ -56,6 +56,7 @@ struct system_config {
 
 static struct ast_threadpool_options sip_threadpool_options = {
 	.version = AST_THREADPOOL_OPTIONS_VERSION,
+	.work_stealing = 1,
 };
 
 void sip_get_threadpool_options(struct ast_threadpool_options *threadpool_options)
@@ -34,7 +34,21 @@
 #include "asterisk/test.h"
 #include "asterisk/module.h"
 #include "asterisk/astdb.h"
+#include "asterisk/cli.h"
+#include "asterisk/options.h"
 #include "asterisk/logger.h"
+#include "asterisk/lock.h"
+#include "asterisk/time.h"
+#include "asterisk/utils.h"
+
+/*! Keys stored at once by the batch test */
+#define BATCH_KEYS 10000
+/*! Keys each parallel test thread works on */
+#define PARALLEL_KEYS 100
+/*! Operations done by each parallel test thread */
+#define PARALLEL_OPS 20000
+/*! Threads reading while one thread writes */
+#define PARALLEL_READERS 8
 
 enum {
 	FAMILY = 0,
@@ -231,6 +245,328 @@ AST_TEST_DEFINE(perftest)
 	return res;
 }
 
+AST_TEST_DEFINE(put_batch)
+{
+	struct ast_db_put_entry *entries;
+	char (*keys)[16];
+	int res = AST_TEST_PASS;
+	struct timeval start;
+	int64_t elapsed_us;
+	char out[16];
+	int num_deleted;
+	size_t x;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "put_batch";
+		info->category = "/main/astdb/";
+		info->summary = "ast_db_put_batch unit test";
+		info->description =
+			"Ensures that ast_db_put_batch stores every value, stores nothing\n"
+			"when one of them is refused by the checks or by the database, and\n"
+			"reports how long storing many keys at once takes compared to one\n"
+			"at a time.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	entries = ast_calloc(BATCH_KEYS, sizeof(*entries));
+	keys = ast_calloc(BATCH_KEYS, sizeof(*keys));
+	if (!entries || !keys) {
+		ast_free(entries);
+		ast_free(keys);
+		return AST_TEST_FAIL;
+	}
+
+	for (x = 0; x < BATCH_KEYS; x++) {
+		snprintf(keys[x], sizeof(keys[x]), "%zu", x);
+		entries[x].family = "astdbtest";
+		entries[x].key = keys[x];
+		entries[x].value = keys[x];
+	}
+
+	start = ast_tvnow();
+	for (x = 0; x < BATCH_KEYS; x++) {
+		ast_db_put(entries[x].family, entries[x].key, entries[x].value);
+	}
+	elapsed_us = ast_tvdiff_us(ast_tvnow(), start);
+	ast_test_status_update(test, "Put %d keys one at a time in %" PRIi64 " us\n",
+		BATCH_KEYS, elapsed_us);
+	ast_db_deltree("astdbtest", NULL);
+
+	start = ast_tvnow();
+	if (ast_db_put_batch(entries, BATCH_KEYS)) {
+		ast_test_status_update(test, "Failed to put a batch of %d keys\n", BATCH_KEYS);
+		res = AST_TEST_FAIL;
+		goto cleanup;
+	}
+	elapsed_us = ast_tvdiff_us(ast_tvnow(), start);
+	ast_test_status_update(test, "Put %d keys in a batch in %" PRIi64 " us\n",
+		BATCH_KEYS, elapsed_us);
+
+	for (x = 0; x < BATCH_KEYS; x++) {
+		if (ast_db_get("astdbtest", keys[x], out, sizeof(out)) || strcmp(out, keys[x])) {
+			ast_test_status_update(test, "Failed to get astdbtest/%s from the batch\n", keys[x]);
+			res = AST_TEST_FAIL;
+			goto cleanup;
+		}
+	}
+
+	num_deleted = ast_db_deltree("astdbtest", NULL);
+	if (num_deleted != BATCH_KEYS) {
+		ast_test_status_update(test, "Expected %d keys from the batch and deleted %d\n",
+			BATCH_KEYS, num_deleted);
+		res = AST_TEST_FAIL;
+		goto cleanup;
+	}
+
+	/* A key too long for the database fails the whole batch before it is stored */
+	entries[BATCH_KEYS - 1].key = long_val;
+	if (!ast_db_put_batch(entries, BATCH_KEYS)) {
+		ast_test_status_update(test, "Put a batch with a key that is too long\n");
+		res = AST_TEST_FAIL;
+		goto cleanup;
+	} else if (!ast_db_get("astdbtest", keys[0], out, sizeof(out))) {
+		ast_test_status_update(test, "Batch with a key that is too long stored astdbtest/%s\n", keys[0]);
+		res = AST_TEST_FAIL;
+		goto cleanup;
+	}
+
+	/* A key the database refuses to store rolls back the ones stored before it */
+	entries[BATCH_KEYS - 1].key = "fail";
+	ast_cli_command(-1, "database query \"CREATE TEMP TRIGGER astdbtest_fail BEFORE INSERT ON astdb"
+		" WHEN NEW.key = '/astdbtest/fail' BEGIN SELECT RAISE(ABORT, 'astdbtest'); END\"");
+	if (!ast_db_put_batch(entries, BATCH_KEYS)) {
+		ast_test_status_update(test, "Put a batch with a key the database refuses\n");
+		res = AST_TEST_FAIL;
+	} else if (!ast_db_get("astdbtest", keys[0], out, sizeof(out))) {
+		ast_test_status_update(test, "Rolled back batch stored astdbtest/%s\n", keys[0]);
+		res = AST_TEST_FAIL;
+	}
+	ast_cli_command(-1, "database query \"DROP TRIGGER IF EXISTS astdbtest_fail\"");
+
+cleanup:
+	ast_db_deltree("astdbtest", NULL);
+	ast_free(entries);
+	ast_free(keys);
+
+	return res;
+}
+
+/*! \brief What a parallel test thread works on */
+struct parallel_args {
+	/*! Which thread this is, used for the written keys */
+	int id;
+	/*! Set if the thread writes rather than reads */
+	int writer;
+	/*! Writes that could not be read back, or reads that failed */
+	int failures;
+};
+
+static void *parallel_thread(void *data)
+{
+	struct parallel_args *args = data;
+	char key[32];
+	char value[32];
+	char out[32];
+	int n;
+
+	for (n = 0; n < PARALLEL_OPS; ++n) {
+		if (args->writer) {
+			snprintf(key, sizeof(key), "w%d-%d", args->id, n % PARALLEL_KEYS);
+			snprintf(value, sizeof(value), "%d", n);
+			/* A value written must be read back at once, from any connection */
+			if (ast_db_put("astdbtest", key, value)
+				|| ast_db_get("astdbtest", key, out, sizeof(out))
+				|| strcmp(out, value)) {
+				++args->failures;
+			}
+		} else {
+			snprintf(key, sizeof(key), "r%d", n % PARALLEL_KEYS);
+			if (ast_db_get("astdbtest", key, out, sizeof(out)) || strcmp(out, key)) {
+				++args->failures;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+AST_TEST_DEFINE(perf_parallel)
+{
+	pthread_t threads[PARALLEL_READERS + 1];
+	struct parallel_args args[PARALLEL_READERS + 1];
+	int res = AST_TEST_PASS;
+	struct timeval start;
+	int64_t elapsed_us;
+	int num_readers;
+	int created;
+	char key[32];
+	int i;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "perf_parallel";
+		info->category = "/main/astdb/";
+		info->summary = "astdb parallel access unit test";
+		info->description =
+			"Ensures values are read correctly by many threads while another\n"
+			"thread writes, that a written value is read back at once, and\n"
+			"reports how many operations per second are done as readers are added.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	for (i = 0; i < PARALLEL_KEYS; ++i) {
+		snprintf(key, sizeof(key), "r%d", i);
+		if (ast_db_put("astdbtest", key, key)) {
+			ast_test_status_update(test, "Failed to put astdbtest/%s\n", key);
+			ast_db_deltree("astdbtest", NULL);
+			return AST_TEST_FAIL;
+		}
+	}
+
+	for (num_readers = 1; num_readers <= PARALLEL_READERS && res == AST_TEST_PASS; num_readers *= 2) {
+		start = ast_tvnow();
+		for (created = 0; created <= num_readers; ++created) {
+			args[created].id = created;
+			args[created].writer = created == num_readers;
+			args[created].failures = 0;
+			if (ast_pthread_create(&threads[created], NULL, parallel_thread, &args[created])) {
+				ast_test_status_update(test, "Unable to create thread\n");
+				res = AST_TEST_FAIL;
+				break;
+			}
+		}
+		for (i = 0; i < created; ++i) {
+			pthread_join(threads[i], NULL);
+		}
+		elapsed_us = ast_tvdiff_us(ast_tvnow(), start);
+
+		for (i = 0; i < created; ++i) {
+			if (args[i].failures) {
+				ast_test_status_update(test, "%s thread had %d failures\n",
+					args[i].writer ? "Writer" : "Reader", args[i].failures);
+				res = AST_TEST_FAIL;
+			}
+		}
+		if (res != AST_TEST_PASS) {
+			break;
+		}
+
+		ast_test_status_update(test, "%d readers and a writer: %.0f operations per second\n",
+			num_readers, elapsed_us
+			? (double) (num_readers + 1) * PARALLEL_OPS * 1000000.0 / elapsed_us : 0.0);
+	}
+
+	ast_db_deltree("astdbtest", NULL);
+
+	return res;
+}
+
+/*! \brief What a thread working on the one key of the cache test does */
+struct one_key_args {
+	/*! Set if the thread writes and deletes the key rather than reads it */
+	int writer;
+	/*! Values that were not read back as written */
+	int failures;
+};
+
+static void *one_key_thread(void *data)
+{
+	struct one_key_args *args = data;
+	char value[32];
+	char out[32];
+	int n;
+
+	for (n = 0; n < PARALLEL_OPS; ++n) {
+		if (!args->writer) {
+			ast_db_get("astdbtest", "onekey", out, sizeof(out));
+			continue;
+		}
+		if (n % 2) {
+			/* A deleted key must not be read from the cache */
+			if (ast_db_del("astdbtest", "onekey")
+				|| !ast_db_get("astdbtest", "onekey", out, sizeof(out))) {
+				++args->failures;
+			}
+		} else {
+			snprintf(value, sizeof(value), "%d", n);
+			if (ast_db_put("astdbtest", "onekey", value)
+				|| ast_db_get("astdbtest", "onekey", out, sizeof(out))
+				|| strcmp(out, value)) {
+				++args->failures;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+AST_TEST_DEFINE(cache_one_key)
+{
+	pthread_t threads[PARALLEL_READERS + 1];
+	struct one_key_args args[PARALLEL_READERS + 1];
+	int res = AST_TEST_PASS;
+	int created;
+	char out[32];
+	int i;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "cache_one_key";
+		info->category = "/main/astdb/";
+		info->summary = "astdb value cache unit test";
+		info->description =
+			"Ensures that while many threads read one key, the values a thread\n"
+			"puts and deletes for the key are read back as they were left.\n"
+			"Set astdb_cache in asterisk.conf to test the cache of values.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	if (!ast_opt_astdb_cache) {
+		ast_test_status_update(test, "astdb_cache is off, only the database is tested\n");
+	}
+
+	for (created = 0; created <= PARALLEL_READERS; ++created) {
+		args[created].writer = created == PARALLEL_READERS;
+		args[created].failures = 0;
+		if (ast_pthread_create(&threads[created], NULL, one_key_thread, &args[created])) {
+			ast_test_status_update(test, "Unable to create thread\n");
+			res = AST_TEST_FAIL;
+			break;
+		}
+	}
+	for (i = 0; i < created; ++i) {
+		pthread_join(threads[i], NULL);
+	}
+
+	if (created > PARALLEL_READERS && args[PARALLEL_READERS].failures) {
+		ast_test_status_update(test, "%d values were not read back as written\n",
+			args[PARALLEL_READERS].failures);
+		res = AST_TEST_FAIL;
+	}
+
+	/* Nothing left behind by the readers may hide the last change */
+	if (res == AST_TEST_PASS
+		&& (ast_db_put("astdbtest", "onekey", "last")
+			|| ast_db_get("astdbtest", "onekey", out, sizeof(out))
+			|| strcmp(out, "last")
+			|| ast_db_del("astdbtest", "onekey")
+			|| !ast_db_get("astdbtest", "onekey", out, sizeof(out)))) {
+		ast_test_status_update(test, "The last value put and deleted was not read back\n");
+		res = AST_TEST_FAIL;
+	}
+
+	ast_db_deltree("astdbtest", NULL);
+
+	return res;
+}
+
 AST_TEST_DEFINE(put_get_long)
 {
 	int res = AST_TEST_PASS;
@@ -293,7 +629,10 @@ static int unload_module(void)
 	AST_TEST_UNREGISTER(put_get_del);
 	AST_TEST_UNREGISTER(gettree_deltree);
 	AST_TEST_UNREGISTER(perftest);
+	AST_TEST_UNREGISTER(perf_parallel);
+	AST_TEST_UNREGISTER(put_batch);
 	AST_TEST_UNREGISTER(put_get_long);
+	AST_TEST_UNREGISTER(cache_one_key);
 	return 0;
 }
 
@@ -302,7 +641,10 @@ static int load_module(void)
 	AST_TEST_REGISTER(put_get_del);
 	AST_TEST_REGISTER(gettree_deltree);
 	AST_TEST_REGISTER(perftest);
+	AST_TEST_REGISTER(perf_parallel);
+	AST_TEST_REGISTER(put_batch);
 	AST_TEST_REGISTER(put_get_long);
+	AST_TEST_REGISTER(cache_one_key);
 	return AST_MODULE_LOAD_SUCCESS;
 }
 
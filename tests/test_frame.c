@@ -0,0 +1,398 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2017, Digium, Inc.
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+/*!
+ * \file
+ * \brief Frame allocation and sharing unit tests
+ *
+ */
+
+/*** MODULEINFO
+	<depend>TEST_FRAMEWORK</depend>
+	<support_level>core</support_level>
+ ***/
+
+#include "asterisk.h"
+
+#include "asterisk/test.h"
+#include "asterisk/module.h"
+#include "asterisk/format_cache.h"
+#include "asterisk/frame.h"
+#include "asterisk/lock.h"
+#include "asterisk/time.h"
+#include "asterisk/utils.h"
+
+/*! Largest payload duplicated, beyond the largest pooled one */
+#define MAX_PAYLOAD 8192
+/*! Frames allocated and freed when timing */
+#define BENCH_FRAMES 1000000
+/*! Frames handed from the allocating thread to the freeing thread at once */
+#define HANDOFF_FRAMES 256
+/*! Channels a frame is handed to when sharing */
+#define FANOUT_CHANNELS 8
+
+static const char test_src[] = "test_frame";
+
+AST_TEST_DEFINE(frame_dup)
+{
+	static const int datalens[] = { 0, 1, 160, 320, 640, 1920, 4000, MAX_PAYLOAD };
+	unsigned char *payload;
+	struct ast_frame frame = {
+		.frametype = AST_FRAME_VOICE,
+		.src = test_src,
+	};
+	enum ast_test_result_state res = AST_TEST_PASS;
+	int i;
+	int x;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "frame_dup";
+		info->category = "/main/frame/";
+		info->summary = "frame duplication test";
+		info->description =
+			"Ensures that duplicated and isolated frames of every size hold\n"
+			"their own copies of the data and source, and that duplicated\n"
+			"frames are already isolated.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	payload = ast_malloc(MAX_PAYLOAD);
+	if (!payload) {
+		return AST_TEST_FAIL;
+	}
+	for (x = 0; x < MAX_PAYLOAD; ++x) {
+		payload[x] = ast_random();
+	}
+	frame.subclass.format = ast_format_ulaw;
+	frame.data.ptr = payload;
+
+	for (i = 0; i < ARRAY_LEN(datalens) && res == AST_TEST_PASS; ++i) {
+		struct ast_frame *dup;
+		struct ast_frame *isolated;
+
+		frame.datalen = frame.samples = datalens[i];
+		if (!frame.datalen) {
+			frame.data.uint32 = 0x12345678;
+		} else {
+			frame.data.ptr = payload;
+		}
+
+		dup = ast_frdup(&frame);
+		isolated = ast_frisolate(&frame);
+		if (!dup || !isolated) {
+			res = AST_TEST_FAIL;
+		} else if (dup == &frame || isolated == &frame) {
+			ast_test_status_update(test, "Frame of %d bytes was not copied\n", datalens[i]);
+			res = AST_TEST_FAIL;
+		} else if (dup->datalen != frame.datalen || isolated->datalen != frame.datalen
+			|| (frame.datalen && (dup->data.ptr == frame.data.ptr
+				|| memcmp(dup->data.ptr, payload, frame.datalen)
+				|| memcmp(isolated->data.ptr, payload, frame.datalen)))
+			|| (!frame.datalen && (dup->data.uint32 != frame.data.uint32
+				|| isolated->data.uint32 != frame.data.uint32))) {
+			ast_test_status_update(test, "Data of frame of %d bytes differs\n", datalens[i]);
+			res = AST_TEST_FAIL;
+		} else if (dup->src == test_src || strcmp(dup->src, test_src)
+			|| isolated->src == test_src || strcmp(isolated->src, test_src)) {
+			ast_test_status_update(test, "Source of frame of %d bytes was not copied\n", datalens[i]);
+			res = AST_TEST_FAIL;
+		} else if (frame.datalen && dup->offset < AST_FRIENDLY_OFFSET) {
+			ast_test_status_update(test, "Frame of %d bytes has no room for headers\n", datalens[i]);
+			res = AST_TEST_FAIL;
+		} else if (ast_frisolate(dup) != dup) {
+			ast_test_status_update(test, "Duplicated frame of %d bytes was isolated again\n", datalens[i]);
+			res = AST_TEST_FAIL;
+		}
+
+		if (dup) {
+			ast_frfree(dup);
+		}
+		if (isolated) {
+			ast_frfree(isolated);
+		}
+	}
+
+	ast_free(payload);
+	return res;
+}
+
+AST_TEST_DEFINE(frame_share)
+{
+	char payload[320];
+	struct ast_frame frame = {
+		.frametype = AST_FRAME_VOICE,
+		.datalen = sizeof(payload),
+		.samples = sizeof(payload) / 2,
+		.data.ptr = payload,
+		.src = test_src,
+	};
+	struct ast_frame *copies[FANOUT_CHANNELS];
+	struct ast_frame *first;
+	struct ast_frame *second;
+	enum ast_test_result_state res = AST_TEST_PASS;
+	struct timeval start;
+	int64_t elapsed_us;
+	int n;
+	int x;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "frame_share";
+		info->category = "/main/frame/";
+		info->summary = "shared frame data test";
+		info->description =
+			"Ensures that frames sharing data see the same data until one is\n"
+			"unshared to be modified, and reports the cost of handing a frame\n"
+			"to several channels with copies and with shared data.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	for (x = 0; x < sizeof(payload); ++x) {
+		payload[x] = ast_random();
+	}
+	frame.subclass.format = ast_format_slin;
+
+	first = ast_frshare(&frame);
+	second = first ? ast_frshare(first) : NULL;
+	if (!first || !second) {
+		res = AST_TEST_FAIL;
+	} else if (first->data.ptr == frame.data.ptr || second->data.ptr != first->data.ptr
+		|| memcmp(first->data.ptr, payload, sizeof(payload))
+		|| strcmp(second->src, test_src)
+		|| second->samples != frame.samples) {
+		ast_test_status_update(test, "Shared frames do not share a copy of the data\n");
+		res = AST_TEST_FAIL;
+	} else if (ast_frisolate(second) != second) {
+		ast_test_status_update(test, "Frame sharing data was isolated again\n");
+		res = AST_TEST_FAIL;
+	} else if (ast_frame_unshare(second) || second->data.ptr == first->data.ptr
+		|| memcmp(second->data.ptr, payload, sizeof(payload))
+		|| second->offset < AST_FRIENDLY_OFFSET) {
+		ast_test_status_update(test, "Unsharing did not give a frame its own data\n");
+		res = AST_TEST_FAIL;
+	} else {
+		void *data = first->data.ptr;
+
+		memset(second->data.ptr, 0, second->datalen);
+		if (memcmp(first->data.ptr, payload, sizeof(payload))) {
+			ast_test_status_update(test, "Modifying an unshared frame changed another\n");
+			res = AST_TEST_FAIL;
+		} else if (ast_frame_unshare(first) || first->data.ptr != data) {
+			ast_test_status_update(test, "Data no longer shared was copied\n");
+			res = AST_TEST_FAIL;
+		}
+	}
+	if (first) {
+		ast_frfree(first);
+	}
+	if (second) {
+		ast_frfree(second);
+	}
+	if (res != AST_TEST_PASS) {
+		return res;
+	}
+
+	start = ast_tvnow();
+	for (n = 0; n < BENCH_FRAMES / FANOUT_CHANNELS; ++n) {
+		for (x = 0; x < FANOUT_CHANNELS; ++x) {
+			copies[x] = ast_frdup(&frame);
+		}
+		for (x = 0; x < FANOUT_CHANNELS; ++x) {
+			ast_frfree(copies[x]);
+		}
+	}
+	elapsed_us = ast_tvdiff_us(ast_tvnow(), start);
+	ast_test_status_update(test, "Copied to %d channels: %.1f ns per channel\n",
+		FANOUT_CHANNELS, elapsed_us * 1000.0 / (BENCH_FRAMES / FANOUT_CHANNELS * FANOUT_CHANNELS));
+
+	start = ast_tvnow();
+	for (n = 0; n < BENCH_FRAMES / FANOUT_CHANNELS; ++n) {
+		first = ast_frshare(&frame);
+		for (x = 0; x < FANOUT_CHANNELS; ++x) {
+			copies[x] = first ? ast_frshare(first) : NULL;
+		}
+		for (x = 0; x < FANOUT_CHANNELS; ++x) {
+			if (copies[x]) {
+				ast_frfree(copies[x]);
+			}
+		}
+		if (first) {
+			ast_frfree(first);
+		}
+	}
+	elapsed_us = ast_tvdiff_us(ast_tvnow(), start);
+	ast_test_status_update(test, "Shared with %d channels: %.1f ns per channel\n",
+		FANOUT_CHANNELS, elapsed_us * 1000.0 / (BENCH_FRAMES / FANOUT_CHANNELS * FANOUT_CHANNELS));
+
+	return AST_TEST_PASS;
+}
+
+/*! \brief Frames handed from the allocating thread to the freeing thread */
+static struct {
+	ast_mutex_t lock;
+	ast_cond_t cond;
+	struct ast_frame *frames[HANDOFF_FRAMES];
+	/*! Whether frames holds frames to be freed */
+	int full;
+	/*! Whether the allocating thread is done */
+	int done;
+} handoff;
+
+static void *free_thread(void *data)
+{
+	int x;
+
+	ast_mutex_lock(&handoff.lock);
+	for (;;) {
+		while (!handoff.full && !handoff.done) {
+			ast_cond_wait(&handoff.cond, &handoff.lock);
+		}
+		if (!handoff.full) {
+			break;
+		}
+		for (x = 0; x < HANDOFF_FRAMES; ++x) {
+			ast_frfree(handoff.frames[x]);
+		}
+		handoff.full = 0;
+		ast_cond_signal(&handoff.cond);
+	}
+	ast_mutex_unlock(&handoff.lock);
+
+	return NULL;
+}
+
+AST_TEST_DEFINE(frame_alloc_cost)
+{
+	char payload[160] = { 0, };
+	struct ast_frame frame = {
+		.frametype = AST_FRAME_VOICE,
+		.datalen = sizeof(payload),
+		.samples = sizeof(payload),
+		.data.ptr = payload,
+		.src = test_src,
+	};
+	size_t len = sizeof(frame) + AST_FRIENDLY_OFFSET + sizeof(payload) + sizeof(test_src);
+	struct timeval start;
+	int64_t malloc_us;
+	int64_t elapsed_us;
+	pthread_t thread;
+	int n;
+	int x;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "frame_alloc_cost";
+		info->category = "/main/frame/";
+		info->summary = "frame allocation cost test";
+		info->description =
+			"Reports the cost of duplicating and freeing a 20 ms mu-law frame,\n"
+			"on the same thread and with another thread freeing it, against\n"
+			"allocating and freeing the same bytes with malloc.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	frame.subclass.format = ast_format_ulaw;
+
+	start = ast_tvnow();
+	for (n = 0; n < BENCH_FRAMES; ++n) {
+		char *buf = ast_malloc(len);
+
+		if (buf) {
+			memcpy(buf + len - sizeof(payload), payload, sizeof(payload));
+		}
+		ast_free(buf);
+	}
+	malloc_us = ast_tvdiff_us(ast_tvnow(), start);
+	ast_test_status_update(test, "malloc and free: %.1f ns per frame\n",
+		malloc_us * 1000.0 / BENCH_FRAMES);
+
+	start = ast_tvnow();
+	for (n = 0; n < BENCH_FRAMES; ++n) {
+		ast_frfree(ast_frdup(&frame));
+	}
+	elapsed_us = ast_tvdiff_us(ast_tvnow(), start);
+	ast_test_status_update(test, "Same thread: %.1f ns per frame\n",
+		elapsed_us * 1000.0 / BENCH_FRAMES);
+
+	ast_mutex_init(&handoff.lock);
+	ast_cond_init(&handoff.cond, NULL);
+	handoff.full = 0;
+	handoff.done = 0;
+	if (ast_pthread_create(&thread, NULL, free_thread, NULL)) {
+		ast_test_status_update(test, "Unable to create thread\n");
+		ast_cond_destroy(&handoff.cond);
+		ast_mutex_destroy(&handoff.lock);
+		return AST_TEST_FAIL;
+	}
+
+	start = ast_tvnow();
+	for (n = 0; n < BENCH_FRAMES / HANDOFF_FRAMES; ++n) {
+		struct ast_frame *frames[HANDOFF_FRAMES];
+
+		for (x = 0; x < HANDOFF_FRAMES; ++x) {
+			frames[x] = ast_frdup(&frame);
+		}
+
+		ast_mutex_lock(&handoff.lock);
+		while (handoff.full) {
+			ast_cond_wait(&handoff.cond, &handoff.lock);
+		}
+		memcpy(handoff.frames, frames, sizeof(frames));
+		handoff.full = 1;
+		ast_cond_signal(&handoff.cond);
+		ast_mutex_unlock(&handoff.lock);
+	}
+
+	ast_mutex_lock(&handoff.lock);
+	handoff.done = 1;
+	ast_cond_signal(&handoff.cond);
+	ast_mutex_unlock(&handoff.lock);
+	pthread_join(thread, NULL);
+	elapsed_us = ast_tvdiff_us(ast_tvnow(), start);
+
+	ast_cond_destroy(&handoff.cond);
+	ast_mutex_destroy(&handoff.lock);
+
+	ast_test_status_update(test, "Freed by another thread: %.1f ns per frame\n",
+		elapsed_us * 1000.0 / (BENCH_FRAMES / HANDOFF_FRAMES * HANDOFF_FRAMES));
+
+	return AST_TEST_PASS;
+}
+
+static int unload_module(void)
+{
+	AST_TEST_UNREGISTER(frame_dup);
+	AST_TEST_UNREGISTER(frame_alloc_cost);
+	AST_TEST_UNREGISTER(frame_share);
+	return 0;
+}
+
+static int load_module(void)
+{
+	AST_TEST_REGISTER(frame_dup);
+	AST_TEST_REGISTER(frame_alloc_cost);
+	AST_TEST_REGISTER(frame_share);
+	return AST_MODULE_LOAD_SUCCESS;
+}
+
+AST_MODULE_INFO_STANDARD(ASTERISK_GPL_KEY, "Frame allocation tests");
@@ -0,0 +1,279 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2017, Digium, Inc.
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+/*!
+ * \file
+ * \brief G.711 conversion unit tests
+ *
+ */
+
+/*** MODULEINFO
+	<depend>TEST_FRAMEWORK</depend>
+	<support_level>core</support_level>
+ ***/
+
+#include "asterisk.h"
+
+#include "asterisk/test.h"
+#include "asterisk/module.h"
+#include "asterisk/g711.h"
+#include "asterisk/ulaw.h"
+#include "asterisk/alaw.h"
+#include "asterisk/format_cache.h"
+#include "asterisk/frame.h"
+#include "asterisk/translate.h"
+#include "asterisk/time.h"
+#include "asterisk/utils.h"
+
+/*! Every signed linear sample, plus an odd tail */
+#define ALL_SAMPLES (65536 + 7)
+/*! Samples in a 20 ms frame at 8 kHz */
+#define FRAME_SAMPLES 160
+/*! Frames translated for each path and implementation */
+#define BENCH_FRAMES 100000
+
+static const enum ast_g711_impl all_impls[] = {
+	AST_G711_SCALAR,
+	AST_G711_AVX2,
+};
+
+AST_TEST_DEFINE(g711_exact)
+{
+	enum ast_g711_impl saved = ast_g711_get_impl();
+	enum ast_test_result_state res = AST_TEST_PASS;
+	int16_t *linear;
+	int16_t *decoded;
+	unsigned char *encoded;
+	unsigned char *law;
+	size_t i;
+	size_t x;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "g711_exact";
+		info->category = "/main/g711/";
+		info->summary = "G.711 conversion bit exactness test";
+		info->description =
+			"Ensures that every G.711 conversion implementation this CPU\n"
+			"supports gives exactly the same results as the lookup tables\n"
+			"for every possible sample.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	linear = ast_malloc(ALL_SAMPLES * sizeof(*linear));
+	decoded = ast_malloc(ALL_SAMPLES * sizeof(*decoded));
+	encoded = ast_malloc(ALL_SAMPLES);
+	law = ast_malloc(ALL_SAMPLES);
+	if (!linear || !decoded || !encoded || !law) {
+		res = AST_TEST_FAIL;
+		goto cleanup;
+	}
+	for (x = 0; x < ALL_SAMPLES; ++x) {
+		linear[x] = (int16_t) (x - 32768);
+		law[x] = x;
+	}
+
+	for (i = 0; i < ARRAY_LEN(all_impls) && res == AST_TEST_PASS; ++i) {
+		const char *name = ast_g711_impl_name(all_impls[i]);
+
+		if (ast_g711_set_impl(all_impls[i])) {
+			ast_test_status_update(test, "Skipping unsupported %s implementation\n", name);
+			continue;
+		}
+
+		ast_ulaw_encode_buf(encoded, linear, ALL_SAMPLES);
+		ast_ulaw_decode_buf(decoded, law, ALL_SAMPLES);
+		for (x = 0; x < ALL_SAMPLES; ++x) {
+			if (encoded[x] != AST_LIN2MU(linear[x])) {
+				ast_test_status_update(test, "%s mu-law encoding of %d differs\n",
+					name, linear[x]);
+				res = AST_TEST_FAIL;
+				break;
+			}
+			if (decoded[x] != AST_MULAW(law[x])) {
+				ast_test_status_update(test, "%s mu-law decoding of %u differs\n",
+					name, law[x]);
+				res = AST_TEST_FAIL;
+				break;
+			}
+		}
+
+		ast_alaw_encode_buf(encoded, linear, ALL_SAMPLES);
+		ast_alaw_decode_buf(decoded, law, ALL_SAMPLES);
+		for (x = 0; x < ALL_SAMPLES; ++x) {
+			if (encoded[x] != AST_LIN2A(linear[x])) {
+				ast_test_status_update(test, "%s a-law encoding of %d differs\n",
+					name, linear[x]);
+				res = AST_TEST_FAIL;
+				break;
+			}
+			if (decoded[x] != AST_ALAW(law[x])) {
+				ast_test_status_update(test, "%s a-law decoding of %u differs\n",
+					name, law[x]);
+				res = AST_TEST_FAIL;
+				break;
+			}
+		}
+
+		ast_ulaw_to_alaw_buf(encoded, law, ALL_SAMPLES);
+		for (x = 0; x < ALL_SAMPLES; ++x) {
+			if (encoded[x] != AST_LIN2A(AST_MULAW(law[x]))) {
+				ast_test_status_update(test, "%s mu-law to a-law of %u differs\n",
+					name, law[x]);
+				res = AST_TEST_FAIL;
+				break;
+			}
+		}
+
+		ast_alaw_to_ulaw_buf(encoded, law, ALL_SAMPLES);
+		for (x = 0; x < ALL_SAMPLES; ++x) {
+			if (encoded[x] != AST_LIN2MU(AST_ALAW(law[x]))) {
+				ast_test_status_update(test, "%s a-law to mu-law of %u differs\n",
+					name, law[x]);
+				res = AST_TEST_FAIL;
+				break;
+			}
+		}
+	}
+
+cleanup:
+	ast_g711_set_impl(saved);
+	ast_free(linear);
+	ast_free(decoded);
+	ast_free(encoded);
+	ast_free(law);
+	return res;
+}
+
+/*!
+ * \internal
+ * \brief Translate frames through a path and report frames per second
+ *
+ * \retval 0 the path was timed
+ * \retval -1 no translation path exists
+ */
+static int time_translation(struct ast_test *test, const char *impl_name,
+	struct ast_format *src, struct ast_format *dst, void *data)
+{
+	struct ast_trans_pvt *path;
+	struct ast_frame frame = {
+		.frametype = AST_FRAME_VOICE,
+		.samples = FRAME_SAMPLES,
+		.data.ptr = data,
+		.src = "test_g711",
+	};
+	struct timeval start;
+	int64_t elapsed_us;
+	int n;
+
+	path = ast_translator_build_path(dst, src);
+	if (!path) {
+		return -1;
+	}
+
+	frame.subclass.format = src;
+	frame.datalen = ast_format_cmp(src, ast_format_slin) == AST_FORMAT_CMP_EQUAL
+		? FRAME_SAMPLES * 2 : FRAME_SAMPLES;
+
+	start = ast_tvnow();
+	for (n = 0; n < BENCH_FRAMES; ++n) {
+		struct ast_frame *out = ast_translate(path, &frame, 0);
+
+		if (out) {
+			ast_frfree(out);
+		}
+	}
+	elapsed_us = ast_tvdiff_us(ast_tvnow(), start);
+	ast_translator_free_path(path);
+
+	ast_test_status_update(test, "%s %s to %s: %.0f frames per second\n",
+		impl_name, ast_format_get_name(src), ast_format_get_name(dst),
+		elapsed_us ? BENCH_FRAMES * 1000000.0 / elapsed_us : 0.0);
+	return 0;
+}
+
+AST_TEST_DEFINE(g711_translation_throughput)
+{
+	struct {
+		struct ast_format *src;
+		struct ast_format *dst;
+	} paths[] = {
+		{ ast_format_ulaw, ast_format_slin },
+		{ ast_format_slin, ast_format_ulaw },
+		{ ast_format_alaw, ast_format_slin },
+		{ ast_format_slin, ast_format_alaw },
+		{ ast_format_alaw, ast_format_ulaw },
+		{ ast_format_ulaw, ast_format_alaw },
+	};
+	enum ast_g711_impl saved = ast_g711_get_impl();
+	int16_t data[FRAME_SAMPLES];
+	size_t i;
+	size_t p;
+	size_t x;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "g711_translation_throughput";
+		info->category = "/main/g711/";
+		info->summary = "G.711 translation throughput test";
+		info->description =
+			"Reports how many 20 ms frames per second one core translates\n"
+			"between G.711 and signed linear, and between mu-law and a-law,\n"
+			"with each implementation this CPU supports.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	for (x = 0; x < ARRAY_LEN(data); ++x) {
+		data[x] = (int16_t) ast_random();
+	}
+
+	for (i = 0; i < ARRAY_LEN(all_impls); ++i) {
+		if (ast_g711_set_impl(all_impls[i])) {
+			continue;
+		}
+
+		for (p = 0; p < ARRAY_LEN(paths); ++p) {
+			if (time_translation(test, ast_g711_impl_name(all_impls[i]),
+				paths[p].src, paths[p].dst, data)) {
+				ast_test_status_update(test, "No translation path from %s to %s, skipping\n",
+					ast_format_get_name(paths[p].src), ast_format_get_name(paths[p].dst));
+			}
+		}
+	}
+
+	ast_g711_set_impl(saved);
+	return AST_TEST_PASS;
+}
+
+static int unload_module(void)
+{
+	AST_TEST_UNREGISTER(g711_exact);
+	AST_TEST_UNREGISTER(g711_translation_throughput);
+	return 0;
+}
+
+static int load_module(void)
+{
+	AST_TEST_REGISTER(g711_exact);
+	AST_TEST_REGISTER(g711_translation_throughput);
+	return AST_MODULE_LOAD_SUCCESS;
+}
+
+AST_MODULE_INFO_STANDARD(ASTERISK_GPL_KEY, "G.711 conversion tests");
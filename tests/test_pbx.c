@@ -35,6 +35,10 @@
 
 #include "asterisk/module.h"
 #include "asterisk/pbx.h"
+#include "asterisk/devicestate.h"
+#include "asterisk/hashtab.h"
+#include "asterisk/lock.h"
+#include "asterisk/time.h"
 #include "asterisk/test.h"
 
 /*!
@@ -321,15 +325,534 @@ cleanup:
 	return res;
 }
 
+/*! \brief Device state provider for the devices of the hint test */
+#define HINT_PROVIDER "TestHint"
+
+/*! \brief Current states of the devices of the hint test */
+static enum ast_device_state hint_device_states[2];
+
+static enum ast_device_state hint_provider_cb(const char *data)
+{
+	if (!strcmp(data, "a")) {
+		return hint_device_states[0];
+	}
+	if (!strcmp(data, "b")) {
+		return hint_device_states[1];
+	}
+	return AST_DEVICE_INVALID;
+}
+
+/*! \brief Extension states seen by the watcher of the hint test */
+struct hint_watcher {
+	ast_mutex_t lock;
+	ast_cond_t cond;
+	/*! Last extension state the watcher was told about */
+	int state;
+	/*! Number of times the watcher was told about a device state */
+	int notified;
+};
+
+static int hint_watcher_cb(const char *context, const char *exten,
+	struct ast_state_cb_info *info, void *data)
+{
+	struct hint_watcher *watcher = data;
+
+	if (info->reason != AST_HINT_UPDATE_DEVICE) {
+		return 0;
+	}
+
+	ast_mutex_lock(&watcher->lock);
+	watcher->state = info->exten_state;
+	++watcher->notified;
+	ast_cond_signal(&watcher->cond);
+	ast_mutex_unlock(&watcher->lock);
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Change the state of a device and wait for the watcher to see the hint state
+ *
+ * \retval 0 the watcher saw the expected state
+ * \retval -1 the watcher did not see the expected state in time
+ */
+static int hint_change_device(struct ast_test *test, struct hint_watcher *watcher,
+	int device, enum ast_device_state state, int expected)
+{
+	struct timeval wait = ast_tvadd(ast_tvnow(), ast_tv(5, 0));
+	struct timespec end = {
+		.tv_sec = wait.tv_sec,
+		.tv_nsec = wait.tv_usec * 1000,
+	};
+	int res = 0;
+
+	hint_device_states[device] = state;
+	ast_devstate_changed(state, AST_DEVSTATE_CACHABLE, HINT_PROVIDER ":%s", device ? "b" : "a");
+
+	ast_mutex_lock(&watcher->lock);
+	while (watcher->state != expected && !res) {
+		res = ast_cond_timedwait(&watcher->cond, &watcher->lock, &end);
+	}
+	if (watcher->state != expected) {
+		ast_test_status_update(test, "Hint is %s rather than %s after device %c is %s\n",
+			ast_extension_state2str(watcher->state), ast_extension_state2str(expected),
+			device ? 'b' : 'a', ast_devstate2str(state));
+		res = -1;
+	}
+	ast_mutex_unlock(&watcher->lock);
+
+	return res ? -1 : 0;
+}
+
+AST_TEST_DEFINE(hint_state_test)
+{
+	static const char registrar[] = "test_pbx";
+	static const char TEST_HINT[] = "test_hint";
+	struct hint_watcher watcher = {
+		.state = AST_EXTENSION_NOT_INUSE,
+	};
+	enum ast_test_result_state res = AST_TEST_PASS;
+	int id = -1;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "hint_state_test";
+		info->category = "/main/pbx/";
+		info->summary = "Test hint device state aggregation";
+		info->description = "Create a hint of two devices and change the state of one\n"
+			"device at a time.  The watcher of the hint must see the state of\n"
+			"both devices combined after every change.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	hint_device_states[0] = AST_DEVICE_NOT_INUSE;
+	hint_device_states[1] = AST_DEVICE_NOT_INUSE;
+	if (ast_devstate_prov_add(HINT_PROVIDER, hint_provider_cb)) {
+		ast_test_status_update(test, "Failed to add device state provider\n");
+		return AST_TEST_FAIL;
+	}
+	ast_devstate_changed(AST_DEVICE_NOT_INUSE, AST_DEVSTATE_CACHABLE, HINT_PROVIDER ":a");
+	ast_devstate_changed(AST_DEVICE_NOT_INUSE, AST_DEVSTATE_CACHABLE, HINT_PROVIDER ":b");
+
+	ast_mutex_init(&watcher.lock);
+	ast_cond_init(&watcher.cond, NULL);
+
+	if (!ast_context_find_or_create(NULL, NULL, TEST_HINT, registrar)
+		|| ast_add_extension(TEST_HINT, 0, "1000", PRIORITY_HINT, NULL, NULL,
+			HINT_PROVIDER ":a&" HINT_PROVIDER ":b", NULL, NULL, registrar)) {
+		ast_test_status_update(test, "Failed to add hint\n");
+		res = AST_TEST_FAIL;
+		goto cleanup;
+	}
+
+	if (ast_extension_state(NULL, TEST_HINT, "1000") != AST_EXTENSION_NOT_INUSE) {
+		ast_test_status_update(test, "Hint is not idle with both devices idle\n");
+		res = AST_TEST_FAIL;
+		goto cleanup;
+	}
+
+	id = ast_extension_state_add(TEST_HINT, "1000", hint_watcher_cb, &watcher);
+	if (id < 0) {
+		ast_test_status_update(test, "Failed to watch hint\n");
+		res = AST_TEST_FAIL;
+		goto cleanup;
+	}
+
+	if (hint_change_device(test, &watcher, 0, AST_DEVICE_INUSE, AST_EXTENSION_INUSE)
+		|| hint_change_device(test, &watcher, 1, AST_DEVICE_RINGING,
+			AST_EXTENSION_INUSE | AST_EXTENSION_RINGING)
+		|| hint_change_device(test, &watcher, 0, AST_DEVICE_NOT_INUSE, AST_EXTENSION_RINGING)
+		|| hint_change_device(test, &watcher, 1, AST_DEVICE_UNAVAILABLE, AST_EXTENSION_NOT_INUSE)
+		|| hint_change_device(test, &watcher, 0, AST_DEVICE_UNAVAILABLE, AST_EXTENSION_UNAVAILABLE)
+		|| hint_change_device(test, &watcher, 1, AST_DEVICE_BUSY, AST_EXTENSION_BUSY)) {
+		res = AST_TEST_FAIL;
+	}
+
+cleanup:
+	if (id >= 0) {
+		ast_extension_state_del(id, hint_watcher_cb);
+	}
+	ast_context_destroy(NULL, registrar);
+	ast_devstate_prov_del(HINT_PROVIDER);
+	ast_mutex_destroy(&watcher.lock);
+	ast_cond_destroy(&watcher.cond);
+
+	return res;
+}
+
+/*! Context of the dialplan reloaded under lookups */
+#define RELOAD_CONTEXT "test_pbx_reload"
+/*! Extensions in the dialplan reloaded under lookups */
+#define RELOAD_EXTENS 20000
+/*! Times the dialplan is reloaded under lookups */
+#define RELOAD_TIMES 5
+/*! Threads looking up extensions during the reloads */
+#define RELOAD_LOOKUP_THREADS 4
+
+/*!
+ * \internal
+ * \brief Build the test dialplan off to the side and merge it in, as a reload does
+ */
+static int reload_dialplan(const char *registrar)
+{
+	struct ast_context *local_contexts = NULL;
+	struct ast_hashtab *local_table;
+	struct ast_context *con;
+	char exten[16];
+	int i;
+
+	local_table = ast_hashtab_create(17, ast_hashtab_compare_contexts,
+		ast_hashtab_resize_java, ast_hashtab_newsize_java, ast_hashtab_hash_contexts, 0);
+	if (!local_table) {
+		return -1;
+	}
+
+	con = ast_context_find_or_create(&local_contexts, local_table, RELOAD_CONTEXT, registrar);
+	for (i = 0; con && i < RELOAD_EXTENS; ++i) {
+		snprintf(exten, sizeof(exten), "%d", 10000 + i);
+		ast_add_extension2(con, 0, exten, 1, NULL, NULL, "Noop", NULL, NULL, registrar, NULL, 0);
+	}
+
+	ast_merge_contexts_and_delete(&local_contexts, local_table, registrar);
+
+	return con ? 0 : -1;
+}
+
+/*! \brief What a thread looking up extensions during the reloads found */
+struct reload_lookups {
+	/*! Set to stop looking up */
+	int *stop;
+	/*! Lookups done */
+	int lookups;
+	/*! Lookups that did not find an extension that is always there */
+	int failures;
+	/*! Longest a lookup took */
+	int64_t max_us;
+};
+
+static void *reload_lookup_thread(void *data)
+{
+	struct reload_lookups *args = data;
+	char exten[16];
+
+	while (!ast_atomic_fetchadd_int(args->stop, 0)) {
+		struct timeval start = ast_tvnow();
+		int64_t elapsed_us;
+
+		snprintf(exten, sizeof(exten), "%d", 10000 + (int) (ast_random() % RELOAD_EXTENS));
+		if (!ast_exists_extension(NULL, RELOAD_CONTEXT, exten, 1, NULL)) {
+			++args->failures;
+		}
+		elapsed_us = ast_tvdiff_us(ast_tvnow(), start);
+		if (elapsed_us > args->max_us) {
+			args->max_us = elapsed_us;
+		}
+		++args->lookups;
+	}
+
+	return NULL;
+}
+
+AST_TEST_DEFINE(reload_lookup_test)
+{
+	static const char registrar[] = "test_pbx";
+	pthread_t threads[RELOAD_LOOKUP_THREADS];
+	struct reload_lookups lookups[RELOAD_LOOKUP_THREADS];
+	enum ast_test_result_state res = AST_TEST_PASS;
+	int64_t max_reload_us = 0;
+	int64_t max_lookup_us = 0;
+	int total_lookups = 0;
+	int stop = 0;
+	int created;
+	int i;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "reload_lookup_test";
+		info->category = "/main/pbx/";
+		info->summary = "Test extension lookups during dialplan reloads";
+		info->description = "Reload a large context again and again while other threads\n"
+			"look up its extensions.  Every lookup must find its extension in\n"
+			"the old or the new dialplan, and the slowest lookup is reported\n"
+			"next to how long a reload takes.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	if (reload_dialplan(registrar)) {
+		ast_test_status_update(test, "Failed to load the dialplan\n");
+		ast_context_destroy(NULL, registrar);
+		return AST_TEST_FAIL;
+	}
+
+	memset(lookups, 0, sizeof(lookups));
+	for (created = 0; created < RELOAD_LOOKUP_THREADS; ++created) {
+		lookups[created].stop = &stop;
+		if (ast_pthread_create(&threads[created], NULL, reload_lookup_thread, &lookups[created])) {
+			ast_test_status_update(test, "Unable to create thread\n");
+			res = AST_TEST_FAIL;
+			break;
+		}
+	}
+
+	for (i = 0; i < RELOAD_TIMES && res == AST_TEST_PASS; ++i) {
+		struct timeval start = ast_tvnow();
+		int64_t elapsed_us;
+
+		if (reload_dialplan(registrar)) {
+			ast_test_status_update(test, "Failed to reload the dialplan\n");
+			res = AST_TEST_FAIL;
+		}
+		elapsed_us = ast_tvdiff_us(ast_tvnow(), start);
+		if (elapsed_us > max_reload_us) {
+			max_reload_us = elapsed_us;
+		}
+	}
+
+	ast_atomic_fetchadd_int(&stop, +1);
+	for (i = 0; i < created; ++i) {
+		pthread_join(threads[i], NULL);
+		if (lookups[i].failures) {
+			ast_test_status_update(test, "%d lookups of %d did not find their extension\n",
+				lookups[i].failures, lookups[i].lookups);
+			res = AST_TEST_FAIL;
+		}
+		total_lookups += lookups[i].lookups;
+		if (lookups[i].max_us > max_lookup_us) {
+			max_lookup_us = lookups[i].max_us;
+		}
+	}
+
+	ast_test_status_update(test, "Slowest of %d reloads of %d extensions: %" PRIi64 " us\n",
+		RELOAD_TIMES, RELOAD_EXTENS, max_reload_us);
+	ast_test_status_update(test, "Slowest of %d lookups during the reloads: %" PRIi64 " us\n",
+		total_lookups, max_lookup_us);
+
+	ast_context_destroy(NULL, registrar);
+
+	return res;
+}
+
+/*! Context of the compiled extensions */
+#define COMPILED_CONTEXT "test_pbx_compiled"
+/*! Rate deck patterns in the compiled context */
+#define COMPILED_PATTERNS 50000
+/*! Numbers looked up at every length to compare compiled lookups with the scan */
+#define COMPILED_CHECK_NUMBERS 100
+/*! Numbers dialed one digit at a time when timing lookups */
+#define COMPILED_BENCH_NUMBERS 200
+
+/*!
+ * \internal
+ * \brief Load a rate deck and some awkward extensions, as a reload does
+ */
+static int load_compiled_dialplan(const char *registrar)
+{
+	static const char * const tails[] = {
+		"XXXX", "NXXXXX", "[2-7]XXX", "Z-XX", "X.", "XXXXXXX",
+	};
+	static const char * const extras[] = {
+		"100", "2125551212", "_X.", "_NXXNXXXXXX", "_9!", "_[*#]XX", "_1[]2", "_44-XX",
+	};
+	struct ast_context *local_contexts = NULL;
+	struct ast_hashtab *local_table;
+	struct ast_context *con;
+	char exten[32];
+	int i;
+
+	local_table = ast_hashtab_create(17, ast_hashtab_compare_contexts,
+		ast_hashtab_resize_java, ast_hashtab_newsize_java, ast_hashtab_hash_contexts, 0);
+	if (!local_table) {
+		return -1;
+	}
+
+	con = ast_context_find_or_create(&local_contexts, local_table, COMPILED_CONTEXT, registrar);
+	for (i = 0; con && i < COMPILED_PATTERNS; ++i) {
+		static const int prefix_max[] = { 10, 100, 1000, 10000, 100000, 1000000 };
+
+		/* Prefixes of one to six digits; the same pattern twice is refused */
+		snprintf(exten, sizeof(exten), "_%d%s",
+			1 + (int) (ast_random() % (prefix_max[ast_random() % ARRAY_LEN(prefix_max)] - 1)),
+			tails[ast_random() % ARRAY_LEN(tails)]);
+		ast_add_extension2(con, 0, exten, 1, NULL, NULL, "Noop", NULL, NULL, registrar, NULL, 0);
+		if (!(i % 10)) {
+			/* Lookups of priority 2 go on past the extensions without it */
+			ast_add_extension2(con, 0, exten, 2, NULL, NULL, "Noop", NULL, NULL, registrar, NULL, 0);
+		}
+	}
+	for (i = 0; con && i < ARRAY_LEN(extras); ++i) {
+		ast_add_extension2(con, 0, extras[i], 1, NULL, NULL, "Noop", NULL, NULL, registrar, NULL, 0);
+	}
+	if (con) {
+		ast_add_extension2(con, 0, "_1NXX.", 1, NULL, "_555XXXX", "Noop", NULL, NULL, registrar, NULL, 0);
+	}
+
+	ast_merge_contexts_and_delete(&local_contexts, local_table, registrar);
+
+	return con ? 0 : -1;
+}
+
+/*!
+ * \internal
+ * \brief Find an extension in the compiled context, compiled or scanned
+ */
+static struct ast_exten *find_compiled(int compiled, const char *exten, int priority,
+	const char *callerid, enum ext_match_t action, int *status)
+{
+	struct pbx_find_info q = { .stacklen = 0 };
+	struct ast_exten *e;
+
+	pbx_set_extenpatterncompile(compiled);
+	ast_rdlock_contexts();
+	e = pbx_find_extension(NULL, NULL, &q, COMPILED_CONTEXT, exten, priority, NULL, callerid, action);
+	ast_unlock_contexts();
+	*status = q.status;
+	return e;
+}
+
+/*!
+ * \internal
+ * \brief Dial numbers a digit at a time, as overlap dialing does
+ *
+ * \return lookups per second
+ */
+static double dial_compiled(int compiled, char numbers[][16])
+{
+	struct timeval start;
+	int64_t elapsed_us;
+	int lookups = 0;
+	int n;
+	int len;
+
+	pbx_set_extenpatterncompile(compiled);
+	start = ast_tvnow();
+	for (n = 0; n < COMPILED_BENCH_NUMBERS; ++n) {
+		char number[16];
+
+		for (len = 1; len <= strlen(numbers[n]); ++len) {
+			ast_copy_string(number, numbers[n], len + 1);
+			ast_matchmore_extension(NULL, COMPILED_CONTEXT, number, 1, NULL);
+			ast_exists_extension(NULL, COMPILED_CONTEXT, number, 1, NULL);
+			lookups += 2;
+		}
+	}
+	elapsed_us = ast_tvdiff_us(ast_tvnow(), start);
+
+	return elapsed_us ? lookups * 1000000.0 / elapsed_us : 0.0;
+}
+
+AST_TEST_DEFINE(compiled_pattern_test)
+{
+	static const char registrar[] = "test_pbx";
+	static const struct {
+		enum ext_match_t action;
+		int priority;
+	} lookups[] = {
+		{ E_MATCHMORE, 1 },
+		{ E_CANMATCH, 1 },
+		{ E_MATCH, 1 },
+		{ E_MATCH, 2 },
+	};
+	char (*numbers)[16];
+	enum ast_test_result_state res = AST_TEST_PASS;
+	int old_compile;
+	int old_matchnew;
+	double scanned;
+	double compiled;
+	int n;
+	int len;
+	int i;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "compiled_pattern_test";
+		info->category = "/main/pbx/";
+		info->summary = "Test compiled extension patterns";
+		info->description = "Load a context of 50000 patterns with extenpatterncompile set, and\n"
+			"check that lookups of numbers at every length, in every match mode,\n"
+			"find the same extensions as the scan of the context.  Then report\n"
+			"how many lookups per second overlap dialing does each way.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	numbers = ast_malloc(COMPILED_BENCH_NUMBERS * sizeof(*numbers));
+	if (!numbers) {
+		return AST_TEST_FAIL;
+	}
+	for (n = 0; n < COMPILED_BENCH_NUMBERS; ++n) {
+		snprintf(numbers[n], sizeof(numbers[n]), "%d%09d",
+			1 + (int) (ast_random() % 99), (int) (ast_random() % 1000000000));
+	}
+
+	old_matchnew = pbx_set_extenpatternmatchnew(0);
+	old_compile = pbx_set_extenpatterncompile(1);
+	if (load_compiled_dialplan(registrar)) {
+		ast_test_status_update(test, "Failed to load the dialplan\n");
+		res = AST_TEST_FAIL;
+		goto cleanup;
+	}
+
+	for (n = 0; n < COMPILED_CHECK_NUMBERS && res == AST_TEST_PASS; ++n) {
+		const char *callerid = n % 2 ? "5551234" : NULL;
+		char number[16];
+
+		for (len = 0; len <= strlen(numbers[n]); ++len) {
+			ast_copy_string(number, numbers[n], len + 1);
+			for (i = 0; i < ARRAY_LEN(lookups); ++i) {
+				struct ast_exten *expected;
+				struct ast_exten *found;
+				int expected_status;
+				int found_status;
+
+				expected = find_compiled(0, number, lookups[i].priority, callerid,
+					lookups[i].action, &expected_status);
+				found = find_compiled(1, number, lookups[i].priority, callerid,
+					lookups[i].action, &found_status);
+				if (found != expected || found_status != expected_status) {
+					ast_test_status_update(test, "Lookup %d of '%s' priority %d found %s, not %s\n",
+						lookups[i].action, number, lookups[i].priority,
+						found ? ast_get_extension_name(found) : "nothing",
+						expected ? ast_get_extension_name(expected) : "nothing");
+					res = AST_TEST_FAIL;
+				}
+			}
+		}
+	}
+
+	scanned = dial_compiled(0, numbers);
+	compiled = dial_compiled(1, numbers);
+	ast_test_status_update(test, "Overlap dialing in %d patterns: %.0f lookups per second scanned, %.0f compiled\n",
+		COMPILED_PATTERNS, scanned, compiled);
+
+cleanup:
+	ast_context_destroy(NULL, registrar);
+	pbx_set_extenpatterncompile(old_compile);
+	pbx_set_extenpatternmatchnew(old_matchnew);
+	ast_free(numbers);
+
+	return res;
+}
+
 static int unload_module(void)
 {
 	AST_TEST_UNREGISTER(pattern_match_test);
+	AST_TEST_UNREGISTER(hint_state_test);
+	AST_TEST_UNREGISTER(reload_lookup_test);
+	AST_TEST_UNREGISTER(compiled_pattern_test);
 	return 0;
 }
 
 static int load_module(void)
 {
 	AST_TEST_REGISTER(pattern_match_test);
+	AST_TEST_REGISTER(hint_state_test);
+	AST_TEST_REGISTER(reload_lookup_test);
+	AST_TEST_REGISTER(compiled_pattern_test);
 	return AST_MODULE_LOAD_SUCCESS;
 }
 
@@ -104,26 +104,13 @@ static int sched_order_8_cb(const void *data)
 	return 0;
 }
 
-AST_TEST_DEFINE(sched_test_order)
+static enum ast_test_result_state sched_test_order_run(struct ast_test *test, enum ast_sched_backend backend)
 {
 	struct ast_sched_context *con;
 	enum ast_test_result_state res = AST_TEST_FAIL;
 	int id1, id2, id3, wait;
 
-	switch (cmd) {
-	case TEST_INIT:
-		info->name = "sched_test_order";
-		info->category = "/main/sched/";
-		info->summary = "Test ordering of events in the scheduler API";
-		info->description =
-			"This test ensures that events are properly ordered by the "
-			"time they are scheduled to execute in the scheduler API.";
-		return AST_TEST_NOT_RUN;
-	case TEST_EXECUTE:
-		break;
-	}
-
-	if (!(con = ast_sched_context_create())) {
+	if (!(con = ast_sched_context_create_backend(backend))) {
 		ast_test_status_update(test,
 				"Test failed - could not create scheduler context\n");
 		return AST_TEST_FAIL;
@@ -262,6 +249,116 @@ return_cleanup:
 	return res;
 }
 
+AST_TEST_DEFINE(sched_test_order)
+{
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "sched_test_order";
+		info->category = "/main/sched/";
+		info->summary = "Test ordering of events in the scheduler API";
+		info->description =
+			"This test ensures that events are properly ordered by the "
+			"time they are scheduled to execute in the scheduler API.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	return sched_test_order_run(test, AST_SCHED_BACKEND_HEAP);
+}
+
+AST_TEST_DEFINE(sched_test_wheel_order)
+{
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "sched_test_wheel_order";
+		info->category = "/main/sched/";
+		info->summary = "Test ordering of events in a timing wheel scheduler";
+		info->description =
+			"This test ensures that events are properly ordered by the "
+			"time they are scheduled to execute when the scheduler context "
+			"uses the timing wheel backend.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	return sched_test_order_run(test, AST_SCHED_BACKEND_WHEEL);
+}
+
+static int sched_count_cb(const void *data)
+{
+	ast_atomic_fetchadd_int((int *) data, 1);
+	return 0;
+}
+
+AST_TEST_DEFINE(sched_test_sharded)
+{
+	struct ast_sched_context *con;
+	enum ast_test_result_state res = AST_TEST_FAIL;
+	int ids[16];
+	int ran = 0;
+	int i;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "sched_test_sharded";
+		info->category = "/main/sched/";
+		info->summary = "Test a sharded scheduler context";
+		info->description =
+			"This test ensures that events added to a sharded scheduler "
+			"context can be found, deleted and run through the regular "
+			"scheduler API.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	if (!(con = ast_sched_context_create_sharded(4))) {
+		ast_test_status_update(test,
+				"Test failed - could not create sharded scheduler context\n");
+		return AST_TEST_FAIL;
+	}
+
+	ast_test_validate_cleanup(test, ast_sched_wait(con) == -1, res, return_cleanup);
+
+	for (i = 0; i < ARRAY_LEN(ids); i++) {
+		ids[i] = ast_sched_add(con, i % 2 ? 100000 : 0, sched_count_cb, &ran);
+		ast_test_validate_cleanup(test, ids[i] > 0, res, return_cleanup);
+		ast_test_validate_cleanup(test, ast_sched_find_data(con, ids[i]) == &ran, res, return_cleanup);
+	}
+
+	/* Deleting the delayed entries must leave only the immediate ones. */
+	for (i = 1; i < ARRAY_LEN(ids); i += 2) {
+		ast_test_validate_cleanup(test, !ast_sched_del(con, ids[i]), res, return_cleanup);
+		ast_test_validate_cleanup(test, !ast_sched_find_data(con, ids[i]), res, return_cleanup);
+		ast_test_validate_cleanup(test, ast_sched_del(con, ids[i]) == -1, res, return_cleanup);
+	}
+
+	usleep(50 * 1000);
+	ast_test_validate_cleanup(test, ast_sched_runq(con) == ARRAY_LEN(ids) / 2, res, return_cleanup);
+	ast_test_validate_cleanup(test, ran == ARRAY_LEN(ids) / 2, res, return_cleanup);
+	ast_test_validate_cleanup(test, ast_sched_wait(con) == -1, res, return_cleanup);
+
+	/* Now let the per-shard threads run the entries. */
+	ast_test_validate_cleanup(test, !ast_sched_start_thread(con), res, return_cleanup);
+	ran = 0;
+	for (i = 0; i < ARRAY_LEN(ids); i++) {
+		ast_test_validate_cleanup(test, ast_sched_add(con, 0, sched_count_cb, &ran) > 0, res, return_cleanup);
+	}
+	for (i = 0; i < 100 && ran < ARRAY_LEN(ids); i++) {
+		usleep(10 * 1000);
+	}
+	ast_test_validate_cleanup(test, ran == ARRAY_LEN(ids), res, return_cleanup);
+
+	res = AST_TEST_PASS;
+
+return_cleanup:
+	ast_sched_context_destroy(con);
+
+	return res;
+}
+
 static char *handle_cli_sched_bench(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
 {
 	struct ast_sched_context *con;
@@ -336,13 +433,259 @@ return_cleanup:
 	return CLI_SUCCESS;
 }
 
+static char *handle_cli_sched_churn_bench(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	struct ast_sched_context *con;
+	struct timeval start;
+	int64_t elapsed;
+	unsigned int live = 100000;
+	unsigned int num = 100000;
+	unsigned int i;
+	int *sched_ids = NULL;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "sched benchmark churn";
+		e->usage = ""
+			"Usage: sched benchmark churn [<live> [<num>]]\n"
+			"       Fill a scheduler context with <live> entries (default 100000)\n"
+			"       and then time <num> (default 100000) rounds of deleting a\n"
+			"       random live entry and adding a replacement.\n"
+			"";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc > e->args + 2) {
+		return CLI_SHOWUSAGE;
+	}
+
+	if (a->argc > e->args && (sscanf(a->argv[e->args], "%u", &live) != 1 || !live)) {
+		return CLI_SHOWUSAGE;
+	}
+
+	if (a->argc > e->args + 1 && sscanf(a->argv[e->args + 1], "%u", &num) != 1) {
+		return CLI_SHOWUSAGE;
+	}
+
+	if (!(con = ast_sched_context_create())) {
+		ast_cli(a->fd, "Test failed - could not create scheduler context\n");
+		return CLI_FAILURE;
+	}
+
+	if (!(sched_ids = ast_malloc(sizeof(*sched_ids) * live))) {
+		ast_cli(a->fd, "Test failed - memory allocation failure\n");
+		goto return_cleanup;
+	}
+
+	for (i = 0; i < live; i++) {
+		long when = labs(ast_random()) % 60000;
+		if ((sched_ids[i] = ast_sched_add(con, when, sched_cb, NULL)) == -1) {
+			ast_cli(a->fd, "Test failed - sched_add returned -1\n");
+			goto return_cleanup;
+		}
+	}
+
+	ast_cli(a->fd, "Testing ast_sched_del()/ast_sched_add() churn - timing %u rounds "
+			"of replacing a random entry with %u live entries\n", num, live);
+
+	start = ast_tvnow();
+
+	for (i = 0; i < num; i++) {
+		unsigned int victim = labs(ast_random()) % live;
+		long when = labs(ast_random()) % 60000;
+
+		if (ast_sched_del(con, sched_ids[victim]) == -1) {
+			ast_cli(a->fd, "Test failed - sched_del returned -1\n");
+			goto return_cleanup;
+		}
+		if ((sched_ids[victim] = ast_sched_add(con, when, sched_cb, NULL)) == -1) {
+			ast_cli(a->fd, "Test failed - sched_add returned -1\n");
+			goto return_cleanup;
+		}
+	}
+
+	elapsed = ast_tvdiff_us(ast_tvnow(), start);
+	ast_cli(a->fd, "Test complete - %" PRIi64 " us (%" PRIi64 " ns per del/add)\n",
+		elapsed, num ? elapsed * 1000 / num : 0);
+
+return_cleanup:
+	ast_sched_context_destroy(con);
+	ast_free(sched_ids);
+
+	return CLI_SUCCESS;
+}
+
+/*! Number of outstanding entries during the backend benchmark */
+#define SCHED_BENCH_LIVE 10000
+
+/*!
+ * \internal
+ * \brief Time an add/cancel dominated workload on a scheduler backend.
+ *
+ * \return Microseconds taken, -1 on failure.
+ */
+static int64_t sched_backend_bench(enum ast_sched_backend backend, unsigned int num, int *sched_ids)
+{
+	struct ast_sched_context *con;
+	struct timeval start;
+	int64_t elapsed = -1;
+	unsigned int i;
+
+	if (!(con = ast_sched_context_create_backend(backend))) {
+		return -1;
+	}
+
+	start = ast_tvnow();
+
+	/*
+	 * Protocol style timers of 20 ms to 60 s that get cancelled before
+	 * they expire while SCHED_BENCH_LIVE others are outstanding.
+	 */
+	for (i = 0; i < num; i++) {
+		long when = 20 + labs(ast_random()) % 60000;
+
+		if ((sched_ids[i] = ast_sched_add(con, when, sched_cb, NULL)) == -1) {
+			goto return_cleanup;
+		}
+		if (i >= SCHED_BENCH_LIVE && ast_sched_del(con, sched_ids[i - SCHED_BENCH_LIVE]) == -1) {
+			goto return_cleanup;
+		}
+	}
+	ast_sched_runq(con);
+
+	elapsed = ast_tvdiff_us(ast_tvnow(), start);
+
+return_cleanup:
+	ast_sched_context_destroy(con);
+
+	return elapsed;
+}
+
+static char *handle_cli_sched_backend_bench(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	static const struct {
+		enum ast_sched_backend backend;
+		const char *name;
+	} backends[] = {
+		{ AST_SCHED_BACKEND_HEAP, "heap" },
+		{ AST_SCHED_BACKEND_WHEEL, "wheel" },
+	};
+	unsigned int num = 1000000;
+	unsigned int i;
+	int *sched_ids;
+
+	switch (cmd) {
+	case CLI_INIT:
+		e->command = "sched benchmark backends";
+		e->usage = ""
+			"Usage: sched benchmark backends [<num>]\n"
+			"       Compare the scheduler backends by adding <num> (default\n"
+			"       1000000) entries and cancelling each of them again while\n"
+			"       10000 other entries are outstanding.\n"
+			"";
+		return NULL;
+	case CLI_GENERATE:
+		return NULL;
+	}
+
+	if (a->argc > e->args + 1) {
+		return CLI_SHOWUSAGE;
+	}
+
+	if (a->argc > e->args && (sscanf(a->argv[e->args], "%u", &num) != 1 || !num)) {
+		return CLI_SHOWUSAGE;
+	}
+
+	if (!(sched_ids = ast_malloc(sizeof(*sched_ids) * num))) {
+		ast_cli(a->fd, "Test failed - memory allocation failure\n");
+		return CLI_FAILURE;
+	}
+
+	ast_cli(a->fd, "Testing add/cancel performance - timing how long it takes "
+			"to add and cancel %u entries at random time intervals from 20 ms to 60 seconds\n", num);
+
+	for (i = 0; i < ARRAY_LEN(backends); i++) {
+		int64_t elapsed = sched_backend_bench(backends[i].backend, num, sched_ids);
+
+		if (elapsed < 0) {
+			ast_cli(a->fd, "Test failed - %s backend failed to add or delete an entry\n",
+				backends[i].name);
+			break;
+		}
+		ast_cli(a->fd, "%-6s: %" PRIi64 " us (%" PRIi64 " ns per add/del)\n",
+			backends[i].name, elapsed, elapsed * 1000 / num);
+	}
+
+	ast_free(sched_ids);
+
+	return CLI_SUCCESS;
+}
+
+/*! Delays, in ms, that usually put an entry in the wrapped around slot of the second wheel level */
+static const int wheel_wrap_delays[] = { 65400, 65535 };
+
+AST_TEST_DEFINE(sched_test_wheel_wrap_wait)
+{
+	struct ast_sched_context *con;
+	enum ast_test_result_state res = AST_TEST_FAIL;
+	int i;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "sched_test_wheel_wrap_wait";
+		info->category = "/main/sched/";
+		info->summary = "Test waiting for a wrapped around timing wheel event";
+		info->description =
+			"This test ensures that a timing wheel scheduler context whose "
+			"only event is just over 65 seconds away, in the slot of the "
+			"second level that wrapped around, still has a time to wait for.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	for (i = 0; i < ARRAY_LEN(wheel_wrap_delays); i++) {
+		int wait;
+
+		if (!(con = ast_sched_context_create_backend(AST_SCHED_BACKEND_WHEEL))) {
+			ast_test_status_update(test,
+					"Test failed - could not create scheduler context\n");
+			return AST_TEST_FAIL;
+		}
+
+		ast_test_validate_cleanup(test, ast_sched_add(con, wheel_wrap_delays[i], sched_cb, NULL) > 0,
+			res, return_cleanup);
+		wait = ast_sched_wait(con);
+		if (wait == -1 || wait > wheel_wrap_delays[i]) {
+			ast_test_status_update(test, "Wait for an event %d ms away was %d ms\n",
+				wheel_wrap_delays[i], wait);
+			goto return_cleanup;
+		}
+		ast_sched_context_destroy(con);
+	}
+
+	return AST_TEST_PASS;
+
+return_cleanup:
+	ast_sched_context_destroy(con);
+
+	return res;
+}
+
 static struct ast_cli_entry cli_sched[] = {
 	AST_CLI_DEFINE(handle_cli_sched_bench, "Benchmark ast_sched add/del performance"),
+	AST_CLI_DEFINE(handle_cli_sched_churn_bench, "Benchmark ast_sched add/del churn with many live entries"),
+	AST_CLI_DEFINE(handle_cli_sched_backend_bench, "Compare ast_sched backends on add/cancel workloads"),
 };
 
 static int unload_module(void)
 {
 	AST_TEST_UNREGISTER(sched_test_order);
+	AST_TEST_UNREGISTER(sched_test_wheel_order);
+	AST_TEST_UNREGISTER(sched_test_sharded);
+	AST_TEST_UNREGISTER(sched_test_wheel_wrap_wait);
 	ast_cli_unregister_multiple(cli_sched, ARRAY_LEN(cli_sched));
 	return 0;
 }
@@ -350,6 +693,9 @@ static int unload_module(void)
 static int load_module(void)
 {
 	AST_TEST_REGISTER(sched_test_order);
+	AST_TEST_REGISTER(sched_test_wheel_order);
+	AST_TEST_REGISTER(sched_test_sharded);
+	AST_TEST_REGISTER(sched_test_wheel_wrap_wait);
 	ast_cli_register_multiple(cli_sched, ARRAY_LEN(cli_sched));
 	return AST_MODULE_LOAD_SUCCESS;
 }
@@ -0,0 +1,275 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2017, Digium, Inc.
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+/*!
+ * \file
+ * \brief Signed linear mixing unit tests
+ *
+ */
+
+/*** MODULEINFO
+	<depend>TEST_FRAMEWORK</depend>
+	<support_level>core</support_level>
+ ***/
+
+#include "asterisk.h"
+
+#include "asterisk/test.h"
+#include "asterisk/module.h"
+#include "asterisk/slinear_mix.h"
+#include "asterisk/time.h"
+#include "asterisk/utils.h"
+
+/*! Most participants mixed by the tests */
+#define MAX_INPUTS 128
+/*! Most samples mixed by the tests; 20 ms at 48 kHz */
+#define MAX_SAMPLES 960
+/*! Mixes timed for each implementation */
+#define BENCH_ITERATIONS 2000
+
+static const enum ast_slinear_mix_impl all_impls[] = {
+	AST_SLINEAR_MIX_SCALAR,
+	AST_SLINEAR_MIX_SSE2,
+	AST_SLINEAR_MIX_AVX2,
+	AST_SLINEAR_MIX_NEON,
+};
+
+/*!
+ * \internal
+ * \brief Mix the way bridge_softmix always has, as the reference
+ */
+static void reference_mix(int16_t *output, int16_t **inputs, size_t num_inputs, size_t samples)
+{
+	size_t idx;
+	size_t x;
+
+	memset(output, 0, samples * sizeof(*output));
+	for (idx = 0; idx < num_inputs; ++idx) {
+		for (x = 0; x < samples; ++x) {
+			ast_slinear_saturated_add(output + x, inputs[idx] + x);
+		}
+	}
+}
+
+/*!
+ * \internal
+ * \brief Fill the inputs with a mix of quiet and full scale audio
+ *
+ * Quiet inputs sum without saturating while the loud ones saturate in
+ * both directions, part way through the mix.
+ */
+static void fill_inputs(int16_t **inputs, size_t num_inputs)
+{
+	size_t idx;
+	size_t x;
+
+	for (idx = 0; idx < num_inputs; ++idx) {
+		for (x = 0; x < MAX_SAMPLES; ++x) {
+			int sample = (int) (ast_random() % 65536) - 32768;
+
+			inputs[idx][x] = idx % 4 ? sample / 64 : sample;
+		}
+	}
+}
+
+static int16_t **alloc_inputs(void)
+{
+	int16_t **inputs;
+	size_t idx;
+
+	inputs = ast_calloc(MAX_INPUTS, sizeof(*inputs));
+	if (!inputs) {
+		return NULL;
+	}
+	for (idx = 0; idx < MAX_INPUTS; ++idx) {
+		inputs[idx] = ast_malloc(MAX_SAMPLES * sizeof(**inputs));
+		if (!inputs[idx]) {
+			break;
+		}
+	}
+	if (idx < MAX_INPUTS) {
+		while (idx--) {
+			ast_free(inputs[idx]);
+		}
+		ast_free(inputs);
+		return NULL;
+	}
+	return inputs;
+}
+
+static void free_inputs(int16_t **inputs)
+{
+	size_t idx;
+
+	if (!inputs) {
+		return;
+	}
+	for (idx = 0; idx < MAX_INPUTS; ++idx) {
+		ast_free(inputs[idx]);
+	}
+	ast_free(inputs);
+}
+
+AST_TEST_DEFINE(slinear_mix_exact)
+{
+	static const size_t input_counts[] = { 0, 1, 2, 3, 17, 100, MAX_INPUTS };
+	/* Sample counts that leave every possible tail after the vectors */
+	static const size_t sample_counts[] = { 1, 7, 8, 9, 15, 16, 17, 31, 33, 160, 320, MAX_SAMPLES };
+	enum ast_slinear_mix_impl saved = ast_slinear_mix_get_impl();
+	enum ast_test_result_state res = AST_TEST_PASS;
+	int16_t **inputs;
+	int16_t expected[MAX_SAMPLES];
+	int16_t actual[MAX_SAMPLES];
+	int16_t expected_sub[MAX_SAMPLES];
+	size_t i;
+	size_t c;
+	size_t s;
+	size_t x;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "slinear_mix_exact";
+		info->category = "/main/slinear_mix/";
+		info->summary = "signed linear mixing bit exactness test";
+		info->description =
+			"Ensures that every mixing implementation this CPU supports\n"
+			"gives exactly the same results as mixing one sample at a time.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	inputs = alloc_inputs();
+	if (!inputs) {
+		return AST_TEST_FAIL;
+	}
+	fill_inputs(inputs, MAX_INPUTS);
+
+	for (i = 0; i < ARRAY_LEN(all_impls) && res == AST_TEST_PASS; ++i) {
+		if (ast_slinear_mix_set_impl(all_impls[i])) {
+			ast_test_status_update(test, "Skipping unsupported %s implementation\n",
+				ast_slinear_mix_impl_name(all_impls[i]));
+			continue;
+		}
+
+		for (c = 0; c < ARRAY_LEN(input_counts) && res == AST_TEST_PASS; ++c) {
+			for (s = 0; s < ARRAY_LEN(sample_counts); ++s) {
+				size_t samples = sample_counts[s];
+
+				reference_mix(expected, inputs, input_counts[c], samples);
+				ast_slinear_saturated_mix(actual, inputs, input_counts[c], samples);
+				if (memcmp(expected, actual, samples * sizeof(*actual))) {
+					ast_test_status_update(test, "%s mix of %zu inputs of %zu samples differs\n",
+						ast_slinear_mix_impl_name(all_impls[i]), input_counts[c], samples);
+					res = AST_TEST_FAIL;
+					break;
+				}
+
+				/* Take a loud participant back out, as for a talking listener */
+				memcpy(expected_sub, expected, samples * sizeof(*expected));
+				for (x = 0; x < samples; ++x) {
+					ast_slinear_saturated_subtract(&expected_sub[x], &inputs[0][x]);
+				}
+				ast_slinear_saturated_subtract_buf(actual, inputs[0], samples);
+				if (memcmp(expected_sub, actual, samples * sizeof(*actual))) {
+					ast_test_status_update(test, "%s subtract of %zu samples differs\n",
+						ast_slinear_mix_impl_name(all_impls[i]), samples);
+					res = AST_TEST_FAIL;
+					break;
+				}
+			}
+		}
+	}
+
+	ast_slinear_mix_set_impl(saved);
+	free_inputs(inputs);
+	return res;
+}
+
+AST_TEST_DEFINE(slinear_mix_throughput)
+{
+	enum ast_slinear_mix_impl saved = ast_slinear_mix_get_impl();
+	int16_t **inputs;
+	int16_t output[MAX_SAMPLES];
+	struct timeval start;
+	int64_t reference_us;
+	int64_t elapsed_us;
+	size_t i;
+	int n;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "slinear_mix_throughput";
+		info->category = "/main/slinear_mix/";
+		info->summary = "signed linear mixing throughput test";
+		info->description =
+			"Reports how long mixing 100 participants of 20 ms of 48 kHz\n"
+			"audio takes with each implementation this CPU supports.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	inputs = alloc_inputs();
+	if (!inputs) {
+		return AST_TEST_FAIL;
+	}
+	fill_inputs(inputs, MAX_INPUTS);
+
+	start = ast_tvnow();
+	for (n = 0; n < BENCH_ITERATIONS; ++n) {
+		reference_mix(output, inputs, 100, MAX_SAMPLES);
+	}
+	reference_us = ast_tvdiff_us(ast_tvnow(), start);
+	ast_test_status_update(test, "Sample at a time mix: %" PRIi64 " us for %d mixes\n",
+		reference_us, BENCH_ITERATIONS);
+
+	for (i = 0; i < ARRAY_LEN(all_impls); ++i) {
+		if (ast_slinear_mix_set_impl(all_impls[i])) {
+			continue;
+		}
+
+		start = ast_tvnow();
+		for (n = 0; n < BENCH_ITERATIONS; ++n) {
+			ast_slinear_saturated_mix(output, inputs, 100, MAX_SAMPLES);
+			ast_slinear_saturated_subtract_buf(output, inputs[0], MAX_SAMPLES);
+		}
+		elapsed_us = ast_tvdiff_us(ast_tvnow(), start);
+		ast_test_status_update(test, "%s mix and subtract: %" PRIi64 " us for %d mixes (%.1fx)\n",
+			ast_slinear_mix_impl_name(all_impls[i]), elapsed_us, BENCH_ITERATIONS,
+			elapsed_us ? (double) reference_us / elapsed_us : 0.0);
+	}
+
+	ast_slinear_mix_set_impl(saved);
+	free_inputs(inputs);
+	return AST_TEST_PASS;
+}
+
+static int unload_module(void)
+{
+	AST_TEST_UNREGISTER(slinear_mix_exact);
+	AST_TEST_UNREGISTER(slinear_mix_throughput);
+	return 0;
+}
+
+static int load_module(void)
+{
+	AST_TEST_REGISTER(slinear_mix_exact);
+	AST_TEST_REGISTER(slinear_mix_throughput);
+	return AST_MODULE_LOAD_SUCCESS;
+}
+
+AST_MODULE_INFO_STANDARD(ASTERISK_GPL_KEY, "Signed linear mixing tests");
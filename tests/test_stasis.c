@@ -509,6 +509,68 @@ AST_TEST_DEFINE(publish_sync)
 	return AST_TEST_PASS;
 }
 
+AST_TEST_DEFINE(subscription_filter)
+{
+	RAII_VAR(struct stasis_topic *, topic, NULL, ao2_cleanup);
+	RAII_VAR(struct stasis_subscription *, uut, NULL, stasis_unsubscribe);
+	RAII_VAR(char *, test_data, NULL, ao2_cleanup);
+	RAII_VAR(struct stasis_message_type *, accepted_type, NULL, ao2_cleanup);
+	RAII_VAR(struct stasis_message_type *, filtered_type, NULL, ao2_cleanup);
+	RAII_VAR(struct stasis_message *, accepted_message, NULL, ao2_cleanup);
+	RAII_VAR(struct stasis_message *, filtered_message, NULL, ao2_cleanup);
+	RAII_VAR(struct consumer *, consumer, NULL, ao2_cleanup);
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = __func__;
+		info->category = test_category;
+		info->summary = "Test message type filtering of subscriptions";
+		info->description = "Test that a selective subscription only receives\n"
+			"the message types it accepts.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	topic = stasis_topic_create("TestTopic");
+	ast_test_validate(test, NULL != topic);
+
+	consumer = consumer_create(1);
+	ast_test_validate(test, NULL != consumer);
+
+	uut = stasis_subscribe(topic, consumer_exec, consumer);
+	ast_test_validate(test, NULL != uut);
+	ao2_ref(consumer, +1);
+
+	test_data = ao2_alloc(1, NULL);
+	ast_test_validate(test, NULL != test_data);
+	ast_test_validate(test, stasis_message_type_create("TestAccepted", NULL, &accepted_type) == STASIS_MESSAGE_TYPE_SUCCESS);
+	ast_test_validate(test, stasis_message_type_create("TestFiltered", NULL, &filtered_type) == STASIS_MESSAGE_TYPE_SUCCESS);
+	ast_test_validate(test, stasis_message_type_id(accepted_type) != stasis_message_type_id(filtered_type));
+	accepted_message = stasis_message_create(accepted_type, test_data);
+	filtered_message = stasis_message_create(filtered_type, test_data);
+	ast_test_validate(test, NULL != accepted_message);
+	ast_test_validate(test, NULL != filtered_message);
+
+	/* Without a filter everything gets through */
+	stasis_publish_sync(uut, filtered_message);
+	ast_test_validate(test, 1 == consumer->messages_rxed_len);
+
+	ast_test_validate(test, 0 == stasis_subscription_accept_message_type(uut, accepted_type));
+	ast_test_validate(test, 0 == stasis_subscription_set_filter(uut, STASIS_SUBSCRIPTION_FILTER_SELECTIVE));
+
+	stasis_publish_sync(uut, filtered_message);
+	stasis_publish_sync(uut, accepted_message);
+	ast_test_validate(test, 2 == consumer->messages_rxed_len);
+	ast_test_validate(test, accepted_message == consumer->messages_rxed[1]);
+
+	/* The final message must still arrive */
+	uut = stasis_unsubscribe(uut);
+	ast_test_validate(test, 1 == consumer_wait_for_completion(consumer));
+
+	return AST_TEST_PASS;
+}
+
 AST_TEST_DEFINE(publish_pool)
 {
 	RAII_VAR(struct stasis_topic *, topic, NULL, ao2_cleanup);
@@ -1883,6 +1945,83 @@ AST_TEST_DEFINE(to_json)
 	return AST_TEST_PASS;
 }
 
+static int counting_json_calls;
+static int counting_ami_calls;
+
+static struct ast_json *counting_json(struct stasis_message *message, const struct stasis_message_sanitizer *sanitize)
+{
+	ast_atomic_fetchadd_int(&counting_json_calls, +1);
+	return fake_json(message, sanitize);
+}
+
+static struct ast_manager_event_blob *counting_ami(struct stasis_message *message)
+{
+	ast_atomic_fetchadd_int(&counting_ami_calls, +1);
+	return fake_ami(message);
+}
+
+static struct stasis_message_vtable counting_vtable = {
+	.to_json = counting_json,
+	.to_ami = counting_ami
+};
+
+AST_TEST_DEFINE(representation_cache)
+{
+	RAII_VAR(struct stasis_message_type *, type, NULL, ao2_cleanup);
+	RAII_VAR(struct stasis_message *, uut, NULL, ao2_cleanup);
+	RAII_VAR(char *, data, NULL, ao2_cleanup);
+	RAII_VAR(struct ast_json *, json1, NULL, ast_json_unref);
+	RAII_VAR(struct ast_json *, json2, NULL, ast_json_unref);
+	RAII_VAR(struct ast_json *, json3, NULL, ast_json_unref);
+	RAII_VAR(struct ast_manager_event_blob *, ami1, NULL, ao2_cleanup);
+	RAII_VAR(struct ast_manager_event_blob *, ami2, NULL, ao2_cleanup);
+	struct stasis_message_sanitizer sanitize = { NULL, };
+	const char *expected_text = "SomeData";
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = __func__;
+		info->category = test_category;
+		info->summary = "Test that message representations are built once";
+		info->description = "Test that the JSON and AMI representations of a message\n"
+			"are built once per message and sanitizer.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	counting_json_calls = 0;
+	counting_ami_calls = 0;
+
+	ast_test_validate(test, stasis_message_type_create("SomeMessage", &counting_vtable, &type) == STASIS_MESSAGE_TYPE_SUCCESS);
+
+	data = ao2_alloc(strlen(expected_text) + 1, NULL);
+	ast_test_validate(test, NULL != data);
+	strcpy(data, expected_text);
+	uut = stasis_message_create(type, data);
+	ast_test_validate(test, NULL != uut);
+
+	json1 = stasis_message_to_json(uut, NULL);
+	json2 = stasis_message_to_json(uut, NULL);
+	ast_test_validate(test, NULL != json1 && NULL != json2);
+	ast_test_validate(test, 1 == counting_json_calls);
+	ast_test_validate(test, ast_json_equal(json1, json2));
+	/* Each caller gets its own copy to modify */
+	ast_test_validate(test, json1 != json2);
+
+	json3 = stasis_message_to_json(uut, &sanitize);
+	ast_test_validate(test, NULL != json3);
+	ast_test_validate(test, 2 == counting_json_calls);
+
+	ami1 = stasis_message_to_ami(uut);
+	ami2 = stasis_message_to_ami(uut);
+	ast_test_validate(test, NULL != ami1);
+	ast_test_validate(test, ami1 == ami2);
+	ast_test_validate(test, 1 == counting_ami_calls);
+
+	return AST_TEST_PASS;
+}
+
 AST_TEST_DEFINE(no_to_ami)
 {
 	RAII_VAR(struct stasis_message_type *, type, NULL, ao2_cleanup);
@@ -2044,6 +2183,198 @@ AST_TEST_DEFINE(caching_dtor_order)
 	return AST_TEST_PASS;
 }
 
+#define BENCH_MESSAGES 10000
+#define BENCH_MAX_SUBSCRIBERS 50
+
+struct bench_data {
+	/*! Type of the benchmark messages */
+	struct stasis_message_type *type;
+	/*! Messages delivered to all subscribers */
+	int delivered;
+	/*! Messages delivered out of order */
+	int out_of_order;
+	/*! Sequence number each subscriber expects next */
+	int next_seq[BENCH_MAX_SUBSCRIBERS];
+	ast_mutex_t lock;
+	ast_cond_t cond;
+};
+
+struct bench_subscriber {
+	struct bench_data *data;
+	int index;
+};
+
+static void bench_exec(void *data, struct stasis_subscription *sub,
+	struct stasis_message *message)
+{
+	struct bench_subscriber *subscriber = data;
+	struct bench_data *bench = subscriber->data;
+	int *seq;
+
+	if (stasis_message_type(message) != bench->type) {
+		return;
+	}
+
+	/* Only this subscriber's mailbox touches its sequence number. */
+	seq = stasis_message_data(message);
+	if (*seq != bench->next_seq[subscriber->index]++) {
+		ast_atomic_fetchadd_int(&bench->out_of_order, +1);
+	}
+
+	ast_mutex_lock(&bench->lock);
+	++bench->delivered;
+	ast_cond_signal(&bench->cond);
+	ast_mutex_unlock(&bench->lock);
+}
+
+/*!
+ * \internal
+ * \brief Time publishing to a number of pool subscribers
+ *
+ * \retval 0 Every subscriber got every message in order
+ * \retval -1 Failure
+ */
+static int bench_run(struct ast_test *test, struct stasis_message **messages,
+	struct bench_data *bench, int num_subscribers)
+{
+	struct stasis_topic *topic;
+	struct stasis_subscription *subs[BENCH_MAX_SUBSCRIBERS] = { NULL, };
+	struct bench_subscriber subscribers[BENCH_MAX_SUBSCRIBERS];
+	struct timeval start;
+	struct timespec end;
+	int64_t publish_us;
+	int64_t total_us;
+	int expected = BENCH_MESSAGES * num_subscribers;
+	int res = -1;
+	int i;
+
+	bench->delivered = 0;
+	bench->out_of_order = 0;
+	memset(bench->next_seq, 0, sizeof(bench->next_seq));
+
+	topic = stasis_topic_create("BenchTopic");
+	if (!topic) {
+		return -1;
+	}
+
+	for (i = 0; i < num_subscribers; ++i) {
+		subscribers[i].data = bench;
+		subscribers[i].index = i;
+		subs[i] = stasis_subscribe_pool(topic, bench_exec, &subscribers[i]);
+		if (!subs[i]) {
+			ast_test_status_update(test, "Failed to subscribe\n");
+			goto end;
+		}
+	}
+
+	start = ast_tvnow();
+	for (i = 0; i < BENCH_MESSAGES; ++i) {
+		stasis_publish(topic, messages[i]);
+	}
+	publish_us = ast_tvdiff_us(ast_tvnow(), start);
+
+	end.tv_sec = start.tv_sec + 60;
+	end.tv_nsec = start.tv_usec * 1000;
+	ast_mutex_lock(&bench->lock);
+	while (bench->delivered < expected) {
+		if (ast_cond_timedwait(&bench->cond, &bench->lock, &end) == ETIMEDOUT) {
+			break;
+		}
+	}
+	ast_mutex_unlock(&bench->lock);
+	total_us = ast_tvdiff_us(ast_tvnow(), start);
+
+	if (bench->delivered != expected) {
+		ast_test_status_update(test, "Expected %d deliveries but got %d\n",
+			expected, bench->delivered);
+		goto end;
+	}
+	if (bench->out_of_order) {
+		ast_test_status_update(test, "%d messages delivered out of order\n",
+			bench->out_of_order);
+		goto end;
+	}
+
+	ast_test_status_update(test, "%d subscribers: published %d messages in %" PRIi64
+		" us, all delivered after %" PRIi64 " us\n",
+		num_subscribers, BENCH_MESSAGES, publish_us, total_us);
+	res = 0;
+
+end:
+	for (i = 0; i < num_subscribers; ++i) {
+		/* The subscribers' data is on the stack; wait for them to finish. */
+		stasis_unsubscribe_and_join(subs[i]);
+	}
+	ao2_cleanup(topic);
+	return res;
+}
+
+AST_TEST_DEFINE(publish_benchmark)
+{
+	static const int subscriber_counts[] = { 1, 10, 50 };
+	struct stasis_message **messages;
+	struct bench_data bench;
+	enum ast_test_result_state res = AST_TEST_FAIL;
+	int i;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = __func__;
+		info->category = test_category;
+		info->summary = "Benchmark publishing to many subscribers";
+		info->description = "Times publishing messages to 1, 10 and 50 pool\n"
+			"subscribers and checks each subscriber gets them all in order.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	memset(&bench, 0, sizeof(bench));
+	ast_mutex_init(&bench.lock);
+	ast_cond_init(&bench.cond, NULL);
+
+	messages = ast_calloc(BENCH_MESSAGES, sizeof(*messages));
+	if (!messages
+		|| stasis_message_type_create("BenchMessage", NULL, &bench.type) != STASIS_MESSAGE_TYPE_SUCCESS) {
+		goto end;
+	}
+
+	/* Create the messages up front so only publishing is timed. */
+	for (i = 0; i < BENCH_MESSAGES; ++i) {
+		int *seq = ao2_alloc(sizeof(*seq), NULL);
+
+		if (!seq) {
+			goto end;
+		}
+		*seq = i;
+		messages[i] = stasis_message_create(bench.type, seq);
+		ao2_ref(seq, -1);
+		if (!messages[i]) {
+			goto end;
+		}
+	}
+
+	for (i = 0; i < ARRAY_LEN(subscriber_counts); ++i) {
+		if (bench_run(test, messages, &bench, subscriber_counts[i])) {
+			goto end;
+		}
+	}
+
+	res = AST_TEST_PASS;
+
+end:
+	if (messages) {
+		for (i = 0; i < BENCH_MESSAGES; ++i) {
+			ao2_cleanup(messages[i]);
+		}
+		ast_free(messages);
+	}
+	ao2_cleanup(bench.type);
+	ast_mutex_destroy(&bench.lock);
+	ast_cond_destroy(&bench.cond);
+	return res;
+}
+
 static int unload_module(void)
 {
 	AST_TEST_UNREGISTER(message_type);
@@ -2053,6 +2384,7 @@ static int unload_module(void)
 	AST_TEST_UNREGISTER(publish);
 	AST_TEST_UNREGISTER(publish_sync);
 	AST_TEST_UNREGISTER(publish_pool);
+	AST_TEST_UNREGISTER(subscription_filter);
 	AST_TEST_UNREGISTER(unsubscribe_stops_messages);
 	AST_TEST_UNREGISTER(forward);
 	AST_TEST_UNREGISTER(cache_filter);
@@ -2068,8 +2400,10 @@ static int unload_module(void)
 	AST_TEST_UNREGISTER(to_json);
 	AST_TEST_UNREGISTER(no_to_ami);
 	AST_TEST_UNREGISTER(to_ami);
+	AST_TEST_UNREGISTER(representation_cache);
 	AST_TEST_UNREGISTER(dtor_order);
 	AST_TEST_UNREGISTER(caching_dtor_order);
+	AST_TEST_UNREGISTER(publish_benchmark);
 	return 0;
 }
 
@@ -2082,6 +2416,7 @@ static int load_module(void)
 	AST_TEST_REGISTER(publish);
 	AST_TEST_REGISTER(publish_sync);
 	AST_TEST_REGISTER(publish_pool);
+	AST_TEST_REGISTER(subscription_filter);
 	AST_TEST_REGISTER(unsubscribe_stops_messages);
 	AST_TEST_REGISTER(forward);
 	AST_TEST_REGISTER(cache_filter);
@@ -2097,8 +2432,10 @@ static int load_module(void)
 	AST_TEST_REGISTER(to_json);
 	AST_TEST_REGISTER(no_to_ami);
 	AST_TEST_REGISTER(to_ami);
+	AST_TEST_REGISTER(representation_cache);
 	AST_TEST_REGISTER(dtor_order);
 	AST_TEST_REGISTER(caching_dtor_order);
+	AST_TEST_REGISTER(publish_benchmark);
 	return AST_MODULE_LOAD_SUCCESS;
 }
 
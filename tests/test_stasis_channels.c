@@ -304,6 +304,103 @@ AST_TEST_DEFINE(channel_snapshot_json)
 	return AST_TEST_PASS;
 }
 
+static struct ast_channel_snapshot *snapshot_create(struct ast_channel *chan)
+{
+	struct ast_channel_snapshot *snapshot;
+
+	ast_channel_lock(chan);
+	snapshot = ast_channel_snapshot_create(chan);
+	ast_channel_unlock(chan);
+	return snapshot;
+}
+
+AST_TEST_DEFINE(channel_snapshot_segments)
+{
+	RAII_VAR(struct ast_channel *, chan, NULL, safe_channel_release);
+	RAII_VAR(struct ast_channel_snapshot *, first, NULL, ao2_cleanup);
+	RAII_VAR(struct ast_channel_snapshot *, second, NULL, ao2_cleanup);
+	RAII_VAR(struct ast_channel_snapshot *, third, NULL, ao2_cleanup);
+	RAII_VAR(struct ast_channel_snapshot *, fourth, NULL, ao2_cleanup);
+	int res;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = __func__;
+		info->category = test_category;
+		info->summary = "Test sharing of strings between channel snapshots";
+		info->description = "Test that successive snapshots of a channel share\n"
+			"the strings that did not change and copy the ones that did.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	chan = ast_channel_alloc(0, AST_STATE_DOWN, "cid_num", "cid_name", "acctcode", "exten", "context", NULL, NULL, 0, "TEST/name");
+	ast_test_validate(test, NULL != chan);
+	ast_channel_unlock(chan);
+
+	first = snapshot_create(chan);
+	ast_test_validate(test, NULL != first);
+
+	/* Only the state changes, so all the strings are shared */
+	ast_channel_lock(chan);
+	ast_channel_state_set(chan, AST_STATE_RING);
+	ast_channel_unlock(chan);
+	second = snapshot_create(chan);
+	ast_test_validate(test, NULL != second);
+	ast_test_validate(test, first != second);
+	ast_test_validate(test, AST_STATE_DOWN == first->state);
+	ast_test_validate(test, AST_STATE_RING == second->state);
+	ast_test_validate(test, first->name == second->name);
+	ast_test_validate(test, first->caller_name == second->caller_name);
+	ast_test_validate(test, first->context == second->context);
+	ast_test_validate(test, first->bridgeid == second->bridgeid);
+
+	/* Only the dialplan location is copied when it changes */
+	ast_channel_lock(chan);
+	ast_channel_context_set(chan, "other_context");
+	ast_channel_appl_set(chan, "Wait");
+	ast_channel_data_set(chan, "5");
+	ast_channel_unlock(chan);
+	third = snapshot_create(chan);
+	ast_test_validate(test, NULL != third);
+	ast_test_validate(test, !strcmp("context", second->context));
+	ast_test_validate(test, !strcmp("other_context", third->context));
+	ast_test_validate(test, !strcmp("exten", third->exten));
+	ast_test_validate(test, !strcmp("Wait", third->appl));
+	ast_test_validate(test, !strcmp("5", third->data));
+	ast_test_validate(test, second->name == third->name);
+	ast_test_validate(test, second->caller_number == third->caller_number);
+	ast_test_validate(test, ast_channel_snapshot_caller_id_equal(second, third));
+
+	/* Replacing the application leaves the channel's other snapshots alone */
+	ast_channel_lock(chan);
+	res = ast_channel_snapshot_set_application(third, "Playback", "hello-world");
+	ast_channel_unlock(chan);
+	ast_test_validate(test, !res);
+	ast_test_validate(test, !strcmp("Playback", third->appl));
+	ast_test_validate(test, !strcmp("hello-world", third->data));
+	ast_test_validate(test, !strcmp("other_context", third->context));
+	ast_test_validate(test, !strcmp("context", second->context));
+
+	/* Changing the caller copies the parties, but nothing else */
+	ast_channel_lock(chan);
+	ast_channel_caller(chan)->id.name.valid = 1;
+	ast_free(ast_channel_caller(chan)->id.name.str);
+	ast_channel_caller(chan)->id.name.str = ast_strdup("new_name");
+	ast_channel_unlock(chan);
+	fourth = snapshot_create(chan);
+	ast_test_validate(test, NULL != fourth);
+	ast_test_validate(test, !strcmp("new_name", fourth->caller_name));
+	ast_test_validate(test, !strcmp("cid_name", third->caller_name));
+	ast_test_validate(test, !strcmp("cid_num", fourth->caller_number));
+	ast_test_validate(test, !ast_channel_snapshot_caller_id_equal(third, fourth));
+	ast_test_validate(test, third->name == fourth->name);
+	ast_test_validate(test, !strcmp("Wait", fourth->appl));
+
+	return AST_TEST_PASS;
+}
+
 static int unload_module(void)
 {
 	AST_TEST_UNREGISTER(channel_blob_create);
@@ -311,6 +408,7 @@ static int unload_module(void)
 	AST_TEST_UNREGISTER(multi_channel_blob_create);
 	AST_TEST_UNREGISTER(multi_channel_blob_snapshots);
 	AST_TEST_UNREGISTER(channel_snapshot_json);
+	AST_TEST_UNREGISTER(channel_snapshot_segments);
 
 	return 0;
 }
@@ -322,6 +420,7 @@ static int load_module(void)
 	AST_TEST_REGISTER(multi_channel_blob_create);
 	AST_TEST_REGISTER(multi_channel_blob_snapshots);
 	AST_TEST_REGISTER(channel_snapshot_json);
+	AST_TEST_REGISTER(channel_snapshot_segments);
 
 	return AST_MODULE_LOAD_SUCCESS;
 }
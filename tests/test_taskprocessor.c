@@ -481,6 +481,123 @@ test_exit:
 	return res;
 }
 
+/*!
+ * \brief Test for batch execution on a taskprocessor with custom listener.
+ *
+ * This test pushes tasks to a taskprocessor with a custom listener and executes
+ * them in batches.
+ *
+ * The test ensures that a batch executes no more than the requested number of
+ * tasks and that the listener only sees the taskprocessor empty once every task
+ * of the last batch has been executed.
+ */
+AST_TEST_DEFINE(taskprocessor_batch)
+{
+	struct ast_taskprocessor *tps = NULL;
+	struct ast_taskprocessor_listener *listener = NULL;
+	struct test_listener_pvt *pvt = NULL;
+	enum ast_test_result_state res = AST_TEST_PASS;
+	int i;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "taskprocessor_batch";
+		info->category = "/main/taskprocessor/";
+		info->summary = "Test of taskprocessor batch execution";
+		info->description =
+			"Ensures that tasks are executed in batches of the requested size.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	pvt = test_listener_pvt_alloc();
+	if (!pvt) {
+		ast_test_status_update(test, "Unable to allocate test taskprocessor listener user data\n");
+		return AST_TEST_FAIL;
+	}
+
+	listener = ast_taskprocessor_listener_alloc(&test_callbacks, pvt);
+	if (!listener) {
+		ast_test_status_update(test, "Unable to allocate test taskprocessor listener\n");
+		res = AST_TEST_FAIL;
+		goto test_exit;
+	}
+
+	tps = ast_taskprocessor_create_with_listener("test_batch", listener);
+	if (!tps) {
+		ast_test_status_update(test, "Unable to allocate test taskprocessor\n");
+		res = AST_TEST_FAIL;
+		goto test_exit;
+	}
+
+	for (i = 0; i < 5; ++i) {
+		ast_taskprocessor_push(tps, listener_test_task, NULL);
+	}
+
+	if (check_stats(test, pvt, 5, 0, 1) < 0) {
+		res = AST_TEST_FAIL;
+		goto test_exit;
+	}
+
+	if (!ast_taskprocessor_execute_batch(tps, 3)) {
+		ast_test_status_update(test, "Batch reported no remaining tasks\n");
+		res = AST_TEST_FAIL;
+		goto test_exit;
+	}
+
+	if (ast_taskprocessor_size(tps) != 2) {
+		ast_test_status_update(test, "Unexpected queue size. Expected 2 but got %ld\n",
+			ast_taskprocessor_size(tps));
+		res = AST_TEST_FAIL;
+		goto test_exit;
+	}
+
+	if (check_stats(test, pvt, 5, 0, 1) < 0) {
+		res = AST_TEST_FAIL;
+		goto test_exit;
+	}
+
+	if (ast_taskprocessor_execute_batch(tps, 3)) {
+		ast_test_status_update(test, "Batch reported remaining tasks\n");
+		res = AST_TEST_FAIL;
+		goto test_exit;
+	}
+
+	if (check_stats(test, pvt, 5, 1, 1) < 0) {
+		res = AST_TEST_FAIL;
+		goto test_exit;
+	}
+
+	ast_taskprocessor_push(tps, listener_test_task, NULL);
+
+	if (check_stats(test, pvt, 6, 1, 2) < 0) {
+		res = AST_TEST_FAIL;
+		goto test_exit;
+	}
+
+	ast_taskprocessor_execute_batch(tps, 3);
+
+	if (check_stats(test, pvt, 6, 2, 2) < 0) {
+		res = AST_TEST_FAIL;
+		goto test_exit;
+	}
+
+	tps = ast_taskprocessor_unreference(tps);
+
+	if (!pvt->shutdown) {
+		res = AST_TEST_FAIL;
+		goto test_exit;
+	}
+
+test_exit:
+	ao2_cleanup(listener);
+	/* This is safe even if tps is NULL */
+	ast_taskprocessor_unreference(tps);
+	ast_free(pvt);
+	return res;
+}
+
 struct shutdown_data {
 	ast_cond_t in;
 	ast_cond_t out;
@@ -727,13 +844,186 @@ AST_TEST_DEFINE(taskprocessor_push_local)
 	return AST_TEST_PASS;
 }
 
+/*! Number of threads pushing at once in the contention test */
+#define CONTENTION_PRODUCERS 32
+/*! Number of tasks pushed by each producer in the contention test */
+#define CONTENTION_TASKS 10000
+
+/*!
+ * \brief Results of the push contention test
+ */
+static struct contention_results {
+	/*! The taskprocessor being pushed to */
+	struct ast_taskprocessor *tps;
+	/*! Sequence number of the next task expected from each producer */
+	int next_seq[CONTENTION_PRODUCERS];
+	/*! Number of tasks executed so far */
+	int tasks_completed;
+	/*! Number of tasks that executed out of order */
+	int out_of_order;
+	/*! Number of pushes that failed */
+	int push_failures;
+	/*! Condition used to signal that all tasks were executed */
+	ast_cond_t cond;
+	/*! Lock protecting the condition */
+	ast_mutex_t lock;
+} contention_results;
+
+/*!
+ * \brief Queued task for the push contention test.
+ *
+ * The task data encodes the producer and its sequence number.  Tasks
+ * from one producer must execute in the order they were pushed.
+ */
+static int contention_task(void *data)
+{
+	intptr_t id = (intptr_t) data;
+	int producer = id % CONTENTION_PRODUCERS;
+	int seq = id / CONTENTION_PRODUCERS;
+
+	/* Only the taskprocessor thread touches next_seq until the test completes. */
+	if (contention_results.next_seq[producer] != seq) {
+		++contention_results.out_of_order;
+	}
+	contention_results.next_seq[producer] = seq + 1;
+
+	if (++contention_results.tasks_completed == CONTENTION_PRODUCERS * CONTENTION_TASKS) {
+		SCOPED_MUTEX(lock, &contention_results.lock);
+		ast_cond_signal(&contention_results.cond);
+	}
+	return 0;
+}
+
+/*!
+ * \brief Producer thread for the push contention test
+ */
+static void *contention_producer(void *data)
+{
+	intptr_t producer = (intptr_t) data;
+	intptr_t seq;
+
+	for (seq = 0; seq < CONTENTION_TASKS; ++seq) {
+		if (ast_taskprocessor_push(contention_results.tps, contention_task,
+			(void *) (seq * CONTENTION_PRODUCERS + producer))) {
+			ast_atomic_fetchadd_int(&contention_results.push_failures, +1);
+		}
+	}
+
+	return NULL;
+}
+
+/*!
+ * \brief Push contention test and benchmark
+ *
+ * Many threads push to the same taskprocessor at once.  The test ensures
+ * that every task is executed and that each producer's tasks are executed
+ * in the order they were pushed, and reports how long it took.
+ */
+AST_TEST_DEFINE(taskprocessor_push_contention)
+{
+	pthread_t producers[CONTENTION_PRODUCERS];
+	struct timeval start;
+	struct timespec ts;
+	int64_t push_us;
+	int64_t total_us;
+	int created;
+	int i;
+	enum ast_test_result_state res = AST_TEST_PASS;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "taskprocessor_push_contention";
+		info->category = "/main/taskprocessor/";
+		info->summary = "Contention test of taskprocessor pushes";
+		info->description =
+			"Ensures that tasks pushed by 32 threads at once are all executed\n"
+			"in order for each thread, and reports how long it took.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	memset(&contention_results, 0, sizeof(contention_results));
+	ast_cond_init(&contention_results.cond, NULL);
+	ast_mutex_init(&contention_results.lock);
+
+	contention_results.tps = ast_taskprocessor_get("test_contention", TPS_REF_DEFAULT);
+	if (!contention_results.tps) {
+		ast_test_status_update(test, "Unable to create test taskprocessor\n");
+		res = AST_TEST_FAIL;
+		goto test_end;
+	}
+
+	start = ast_tvnow();
+	for (created = 0; created < CONTENTION_PRODUCERS; ++created) {
+		if (ast_pthread_create(&producers[created], NULL, contention_producer,
+			(void *) (intptr_t) created)) {
+			ast_test_status_update(test, "Unable to create producer thread\n");
+			res = AST_TEST_FAIL;
+			break;
+		}
+	}
+	for (i = 0; i < created; ++i) {
+		pthread_join(producers[i], NULL);
+	}
+	push_us = ast_tvdiff_us(ast_tvnow(), start);
+	if (res == AST_TEST_FAIL) {
+		goto test_end;
+	}
+
+	ts.tv_sec = start.tv_sec + 60;
+	ts.tv_nsec = start.tv_usec * 1000;
+
+	ast_mutex_lock(&contention_results.lock);
+	while (contention_results.tasks_completed < CONTENTION_PRODUCERS * CONTENTION_TASKS) {
+		if (ast_cond_timedwait(&contention_results.cond, &contention_results.lock, &ts) == ETIMEDOUT) {
+			break;
+		}
+	}
+	ast_mutex_unlock(&contention_results.lock);
+	total_us = ast_tvdiff_us(ast_tvnow(), start);
+
+	if (contention_results.push_failures) {
+		ast_test_status_update(test, "%d pushes failed\n", contention_results.push_failures);
+		res = AST_TEST_FAIL;
+		goto test_end;
+	}
+
+	if (contention_results.tasks_completed != CONTENTION_PRODUCERS * CONTENTION_TASKS) {
+		ast_test_status_update(test, "Unexpected number of tasks executed. Expected %d but got %d\n",
+			CONTENTION_PRODUCERS * CONTENTION_TASKS, contention_results.tasks_completed);
+		res = AST_TEST_FAIL;
+		goto test_end;
+	}
+
+	if (contention_results.out_of_order) {
+		ast_test_status_update(test, "%d tasks executed out of order\n",
+			contention_results.out_of_order);
+		res = AST_TEST_FAIL;
+		goto test_end;
+	}
+
+	ast_test_status_update(test, "%d producers pushed %d tasks each in %" PRIi64
+		" us, all executed after %" PRIi64 " us\n",
+		CONTENTION_PRODUCERS, CONTENTION_TASKS, push_us, total_us);
+
+test_end:
+	/* Wait for the taskprocessor thread to finish before the results go away. */
+	contention_results.tps = ast_taskprocessor_unreference(contention_results.tps);
+	ast_mutex_destroy(&contention_results.lock);
+	ast_cond_destroy(&contention_results.cond);
+	return res;
+}
+
 static int unload_module(void)
 {
 	ast_test_unregister(default_taskprocessor);
 	ast_test_unregister(default_taskprocessor_load);
 	ast_test_unregister(taskprocessor_listener);
+	ast_test_unregister(taskprocessor_batch);
 	ast_test_unregister(taskprocessor_shutdown);
 	ast_test_unregister(taskprocessor_push_local);
+	ast_test_unregister(taskprocessor_push_contention);
 	return 0;
 }
 
@@ -742,8 +1032,10 @@ static int load_module(void)
 	ast_test_register(default_taskprocessor);
 	ast_test_register(default_taskprocessor_load);
 	ast_test_register(taskprocessor_listener);
+	ast_test_register(taskprocessor_batch);
 	ast_test_register(taskprocessor_shutdown);
 	ast_test_register(taskprocessor_push_local);
+	ast_test_register(taskprocessor_push_contention);
 	return AST_MODULE_LOAD_SUCCESS;
 }
 
@@ -1726,6 +1726,369 @@ end:
 	return res;
 }
 
+#define WS_SERIALIZERS 8
+#define WS_SERIALIZER_TASKS 1000
+
+struct ws_order_data {
+	/*! Number of tasks each serializer has executed */
+	int executed[WS_SERIALIZERS];
+	/*! Number of tasks executed out of order */
+	int out_of_order;
+	/*! Number of tasks executed by all serializers */
+	int total;
+	ast_mutex_t lock;
+	ast_cond_t cond;
+};
+
+struct ws_order_task {
+	struct ws_order_data *data;
+	int serializer;
+	int seq;
+};
+
+static int ws_order_task_cb(void *data)
+{
+	struct ws_order_task *task = data;
+	struct ws_order_data *order = task->data;
+	SCOPED_MUTEX(lock, &order->lock);
+
+	if (order->executed[task->serializer]++ != task->seq) {
+		++order->out_of_order;
+	}
+	if (++order->total == WS_SERIALIZERS * WS_SERIALIZER_TASKS) {
+		ast_cond_signal(&order->cond);
+	}
+	ast_free(task);
+	return 0;
+}
+
+static const struct ast_threadpool_listener_callbacks ws_test_callbacks = {
+	.state_changed = test_state_changed,
+	.shutdown = test_shutdown,
+};
+
+AST_TEST_DEFINE(threadpool_work_stealing)
+{
+	enum ast_test_result_state res = AST_TEST_FAIL;
+	struct ast_threadpool *pool = NULL;
+	struct ast_threadpool_listener *listener = NULL;
+	struct test_listener_data *tld = NULL;
+	struct ast_taskprocessor *serializers[WS_SERIALIZERS] = { NULL, };
+	struct simple_task_data *std = NULL;
+	struct ws_order_data order;
+	struct timeval start;
+	struct timespec end;
+	int size;
+	int i;
+	int j;
+	struct ast_threadpool_options options = {
+		.version = AST_THREADPOOL_OPTIONS_VERSION,
+		.idle_timeout = 1,
+		.auto_increment = 1,
+		.initial_size = 0,
+		.max_size = 4,
+		.work_stealing = 1,
+	};
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "threadpool_work_stealing";
+		info->category = "/main/threadpool/";
+		info->summary = "Test a work stealing threadpool";
+		info->description =
+			"Ensures that a work stealing threadpool runs pushed tasks,\n"
+			"keeps serializer tasks in order, grows no larger than its\n"
+			"maximum size and lets idle threads time out.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	memset(&order, 0, sizeof(order));
+	ast_mutex_init(&order.lock);
+	ast_cond_init(&order.cond, NULL);
+
+	tld = test_alloc();
+	if (!tld) {
+		goto end;
+	}
+	/* No task_pushed callback, so pushes do not have to notify the listener. */
+	listener = ast_threadpool_listener_alloc(&ws_test_callbacks, tld);
+	if (!listener) {
+		goto end;
+	}
+
+	pool = ast_threadpool_create(info->name, listener, &options);
+	std = simple_task_data_alloc();
+	if (!pool || !std) {
+		ast_test_status_update(test, "Allocation failed\n");
+		goto end;
+	}
+
+	if (ast_threadpool_push(pool, simple_task, std)) {
+		ast_test_status_update(test, "Failed to push task\n");
+		goto end;
+	}
+	if (wait_for_completion(test, std) == AST_TEST_FAIL) {
+		goto end;
+	}
+
+	for (i = 0; i < WS_SERIALIZERS; ++i) {
+		char name[AST_TASKPROCESSOR_MAX_NAME + 1];
+
+		snprintf(name, sizeof(name), "ws_test/%d", i);
+		serializers[i] = ast_threadpool_serializer(name, pool);
+		if (!serializers[i]) {
+			ast_test_status_update(test, "Failed to create serializer\n");
+			goto end;
+		}
+	}
+
+	/* Interleave the serializers so their tasks are spread over the workers. */
+	for (j = 0; j < WS_SERIALIZER_TASKS; ++j) {
+		for (i = 0; i < WS_SERIALIZERS; ++i) {
+			struct ws_order_task *task = ast_malloc(sizeof(*task));
+
+			if (!task) {
+				goto end;
+			}
+			task->data = &order;
+			task->serializer = i;
+			task->seq = j;
+			if (ast_taskprocessor_push(serializers[i], ws_order_task_cb, task)) {
+				ast_free(task);
+				ast_test_status_update(test, "Failed to push serializer task\n");
+				goto end;
+			}
+		}
+	}
+
+	start = ast_tvnow();
+	end.tv_sec = start.tv_sec + 30;
+	end.tv_nsec = start.tv_usec * 1000;
+	ast_mutex_lock(&order.lock);
+	while (order.total < WS_SERIALIZERS * WS_SERIALIZER_TASKS) {
+		if (ast_cond_timedwait(&order.cond, &order.lock, &end) == ETIMEDOUT) {
+			break;
+		}
+	}
+	ast_mutex_unlock(&order.lock);
+
+	if (order.total != WS_SERIALIZERS * WS_SERIALIZER_TASKS) {
+		ast_test_status_update(test, "Expected %d tasks to execute but only %d did\n",
+			WS_SERIALIZERS * WS_SERIALIZER_TASKS, order.total);
+		goto end;
+	}
+	if (order.out_of_order) {
+		ast_test_status_update(test, "%d serializer tasks executed out of order\n",
+			order.out_of_order);
+		goto end;
+	}
+
+	ast_mutex_lock(&tld->lock);
+	size = tld->num_active + tld->num_idle;
+	ast_mutex_unlock(&tld->lock);
+	if (size < 1 || size > options.max_size) {
+		ast_test_status_update(test, "Expected 1 to %d threads but there are %d\n",
+			options.max_size, size);
+		goto end;
+	}
+
+	/* With nothing left to do every thread should time out. */
+	start = ast_tvnow();
+	end.tv_sec = start.tv_sec + 10;
+	end.tv_nsec = start.tv_usec * 1000;
+	ast_mutex_lock(&tld->lock);
+	while (tld->num_active + tld->num_idle) {
+		if (ast_cond_timedwait(&tld->cond, &tld->lock, &end) == ETIMEDOUT) {
+			break;
+		}
+	}
+	size = tld->num_active + tld->num_idle;
+	ast_mutex_unlock(&tld->lock);
+	if (size) {
+		ast_test_status_update(test, "Expected idle threads to time out but %d remain\n",
+			size);
+		goto end;
+	}
+
+	res = AST_TEST_PASS;
+
+end:
+	for (i = 0; i < WS_SERIALIZERS; ++i) {
+		ast_taskprocessor_unreference(serializers[i]);
+	}
+	ast_threadpool_shutdown(pool);
+	ao2_cleanup(listener);
+	ast_free(std);
+	ast_free(tld);
+	ast_mutex_destroy(&order.lock);
+	ast_cond_destroy(&order.cond);
+	return res;
+}
+
+#define WS_BENCH_THREADS 4
+#define WS_BENCH_TASKS 100000
+#define WS_BENCH_LATENCY_TASKS 1000
+
+struct ws_bench_data {
+	/*! Number of tasks executed */
+	int executed;
+	/*! When the latency task was pushed */
+	struct timeval pushed;
+	/*! Total latency of the latency tasks */
+	int64_t latency_us;
+	/*! Worst latency of the latency tasks */
+	int64_t max_latency_us;
+	ast_mutex_t lock;
+	ast_cond_t cond;
+};
+
+static int ws_bench_task(void *data)
+{
+	struct ws_bench_data *bench = data;
+
+	if (ast_atomic_fetchadd_int(&bench->executed, +1) == WS_BENCH_TASKS - 1) {
+		SCOPED_MUTEX(lock, &bench->lock);
+		ast_cond_signal(&bench->cond);
+	}
+	return 0;
+}
+
+static int ws_bench_latency_task(void *data)
+{
+	struct ws_bench_data *bench = data;
+	SCOPED_MUTEX(lock, &bench->lock);
+	int64_t latency = ast_tvdiff_us(ast_tvnow(), bench->pushed);
+
+	bench->latency_us += latency;
+	if (latency > bench->max_latency_us) {
+		bench->max_latency_us = latency;
+	}
+	++bench->executed;
+	ast_cond_signal(&bench->cond);
+	return 0;
+}
+
+/*!
+ * \internal
+ * \brief Measure the throughput and latency of a threadpool
+ *
+ * \retval 0 All of the tasks executed
+ * \retval -1 Failure
+ */
+static int ws_bench_run(struct ast_test *test, int work_stealing)
+{
+	struct ast_threadpool *pool;
+	struct ws_bench_data bench;
+	struct timeval start;
+	struct timespec end;
+	int64_t elapsed_us;
+	int res = -1;
+	int i;
+	struct ast_threadpool_options options = {
+		.version = AST_THREADPOOL_OPTIONS_VERSION,
+		.idle_timeout = 0,
+		.auto_increment = 0,
+		.initial_size = WS_BENCH_THREADS,
+		.max_size = 0,
+		.work_stealing = work_stealing,
+	};
+
+	memset(&bench, 0, sizeof(bench));
+	ast_mutex_init(&bench.lock);
+	ast_cond_init(&bench.cond, NULL);
+
+	pool = ast_threadpool_create(work_stealing ? "ws_bench_stealing" : "ws_bench_shared",
+		NULL, &options);
+	if (!pool) {
+		ast_test_status_update(test, "Could not create threadpool\n");
+		goto end;
+	}
+
+	start = ast_tvnow();
+	for (i = 0; i < WS_BENCH_TASKS; ++i) {
+		if (ast_threadpool_push(pool, ws_bench_task, &bench)) {
+			ast_test_status_update(test, "Failed to push task\n");
+			goto end;
+		}
+	}
+	end.tv_sec = start.tv_sec + 60;
+	end.tv_nsec = start.tv_usec * 1000;
+	ast_mutex_lock(&bench.lock);
+	while (bench.executed < WS_BENCH_TASKS) {
+		if (ast_cond_timedwait(&bench.cond, &bench.lock, &end) == ETIMEDOUT) {
+			break;
+		}
+	}
+	ast_mutex_unlock(&bench.lock);
+	elapsed_us = ast_tvdiff_us(ast_tvnow(), start);
+	if (bench.executed != WS_BENCH_TASKS) {
+		ast_test_status_update(test, "Only %d of %d tasks executed\n",
+			bench.executed, WS_BENCH_TASKS);
+		goto end;
+	}
+
+	/* One task at a time, so each one finds the pool idle. */
+	bench.executed = 0;
+	for (i = 0; i < WS_BENCH_LATENCY_TASKS; ++i) {
+		ast_mutex_lock(&bench.lock);
+		bench.pushed = ast_tvnow();
+		if (ast_threadpool_push(pool, ws_bench_latency_task, &bench)) {
+			ast_mutex_unlock(&bench.lock);
+			ast_test_status_update(test, "Failed to push task\n");
+			goto end;
+		}
+		start = ast_tvnow();
+		end.tv_sec = start.tv_sec + 5;
+		end.tv_nsec = start.tv_usec * 1000;
+		while (bench.executed <= i) {
+			if (ast_cond_timedwait(&bench.cond, &bench.lock, &end) == ETIMEDOUT) {
+				break;
+			}
+		}
+		ast_mutex_unlock(&bench.lock);
+		if (bench.executed <= i) {
+			ast_test_status_update(test, "Latency task did not execute\n");
+			goto end;
+		}
+	}
+
+	ast_test_status_update(test, "%s queue: %d tasks on %d threads in %" PRIi64
+		" us (%" PRIi64 " tasks/s), latency avg %" PRIi64 " us max %" PRIi64 " us\n",
+		work_stealing ? "Work stealing" : "Shared", WS_BENCH_TASKS, WS_BENCH_THREADS,
+		elapsed_us, elapsed_us ? (int64_t) WS_BENCH_TASKS * 1000000 / elapsed_us : 0,
+		bench.latency_us / WS_BENCH_LATENCY_TASKS, bench.max_latency_us);
+	res = 0;
+
+end:
+	ast_threadpool_shutdown(pool);
+	ast_mutex_destroy(&bench.lock);
+	ast_cond_destroy(&bench.cond);
+	return res;
+}
+
+AST_TEST_DEFINE(threadpool_work_stealing_benchmark)
+{
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "threadpool_work_stealing_benchmark";
+		info->category = "/main/threadpool/";
+		info->summary = "Compare shared queue and work stealing threadpools";
+		info->description =
+			"Reports the throughput and wake up latency of a threadpool\n"
+			"with a shared queue and of one with work stealing.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	if (ws_bench_run(test, 0) || ws_bench_run(test, 1)) {
+		return AST_TEST_FAIL;
+	}
+	return AST_TEST_PASS;
+}
+
 static int unload_module(void)
 {
 	ast_test_unregister(threadpool_push);
@@ -1744,6 +2107,8 @@ static int unload_module(void)
 	ast_test_unregister(threadpool_more_destruction);
 	ast_test_unregister(threadpool_serializer);
 	ast_test_unregister(threadpool_serializer_dupe);
+	ast_test_unregister(threadpool_work_stealing);
+	ast_test_unregister(threadpool_work_stealing_benchmark);
 	return 0;
 }
 
@@ -1765,6 +2130,8 @@ static int load_module(void)
 	ast_test_register(threadpool_more_destruction);
 	ast_test_register(threadpool_serializer);
 	ast_test_register(threadpool_serializer_dupe);
+	ast_test_register(threadpool_work_stealing);
+	ast_test_register(threadpool_work_stealing_benchmark);
 	return AST_MODULE_LOAD_SUCCESS;
 }
 
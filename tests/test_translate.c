@@ -0,0 +1,507 @@
+/*
+ * Asterisk -- An open source telephony toolkit.
+ *
+ * Copyright (C) 2017, Digium, Inc.
+ *
+ * See http://www.asterisk.org for more information about
+ * the Asterisk project. Please do not directly contact
+ * any of the maintainers of this project for assistance;
+ * the project provides a web site, mailing lists and IRC
+ * channels for your use.
+ *
+ * This program is free software, distributed under the terms of
+ * the GNU General Public License Version 2. See the LICENSE file
+ * at the top of the source tree.
+ */
+
+/*!
+ * \file
+ * \brief Translation path unit tests
+ *
+ */
+
+/*** MODULEINFO
+	<depend>TEST_FRAMEWORK</depend>
+	<support_level>core</support_level>
+ ***/
+
+#include "asterisk.h"
+
+#include "asterisk/test.h"
+#include "asterisk/module.h"
+#include "asterisk/format_cache.h"
+#include "asterisk/format_cap.h"
+#include "asterisk/codec.h"
+#include "asterisk/frame.h"
+#include "asterisk/translate.h"
+#include "asterisk/time.h"
+#include "asterisk/utils.h"
+
+/*! Samples in a 20 ms frame at 8 kHz */
+#define FRAME_SAMPLES 160
+/*! Frames fed through the shared translation */
+#define SHARED_FRAMES 100
+/*! Paths built when timing path building */
+#define BENCH_PATHS 100000
+/*! Most threads negotiating formats at once */
+#define SETUP_THREADS 8
+/*! Format negotiations done by each thread */
+#define SETUP_ITERATIONS 20000
+
+AST_TEST_DEFINE(translate_shared)
+{
+	RAII_VAR(struct ast_translate_shared *, shared, NULL, ao2_cleanup);
+	struct ast_trans_pvt *path;
+	int16_t data[FRAME_SAMPLES];
+	struct ast_frame frame = {
+		.frametype = AST_FRAME_VOICE,
+		.samples = FRAME_SAMPLES,
+		.datalen = sizeof(data),
+		.data.ptr = data,
+		.src = "test_translate",
+	};
+	enum ast_test_result_state res = AST_TEST_PASS;
+	int n;
+	int x;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "translate_shared";
+		info->category = "/main/translate/";
+		info->summary = "shared translation test";
+		info->description =
+			"Ensures that the consumers of a shared translation all get the\n"
+			"same translated frame, identical to what translating the stream\n"
+			"on its own gives.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	frame.subclass.format = ast_format_slin;
+
+	path = ast_translator_build_path(ast_format_ulaw, ast_format_slin);
+	if (!path) {
+		ast_test_status_update(test, "No translation path from slin to ulaw; is codec_ulaw loaded?\n");
+		return AST_TEST_FAIL;
+	}
+
+	shared = ast_translate_shared_alloc(ast_format_slin);
+	if (!shared) {
+		ast_translator_free_path(path);
+		return AST_TEST_FAIL;
+	}
+
+	if (ast_translate_shared_get(shared, ast_format_ulaw)) {
+		ast_test_status_update(test, "Got a translation before any source frame\n");
+		res = AST_TEST_FAIL;
+	}
+
+	for (n = 0; n < SHARED_FRAMES && res == AST_TEST_PASS; ++n) {
+		struct ast_frame *expected;
+		struct ast_frame *first;
+		struct ast_frame *second;
+
+		for (x = 0; x < FRAME_SAMPLES; ++x) {
+			data[x] = ast_random();
+		}
+
+		ast_translate_shared_frame(shared, &frame);
+		first = ast_translate_shared_get(shared, ast_format_ulaw);
+		second = ast_translate_shared_get(shared, ast_format_ulaw);
+		expected = ast_translate(path, &frame, 0);
+
+		if (!first || first != second) {
+			ast_test_status_update(test, "Consumers did not share the translation of frame %d\n", n);
+			res = AST_TEST_FAIL;
+		} else if (!expected || first->datalen != expected->datalen
+			|| memcmp(first->data.ptr, expected->data.ptr, first->datalen)) {
+			ast_test_status_update(test, "Shared translation of frame %d differs\n", n);
+			res = AST_TEST_FAIL;
+		} else if (ast_translate_shared_get(shared, ast_format_slin) != &frame) {
+			ast_test_status_update(test, "Source format consumer did not get the source frame\n");
+			res = AST_TEST_FAIL;
+		}
+
+		if (expected) {
+			ast_frfree(expected);
+		}
+	}
+
+	ast_translator_free_path(path);
+	return res;
+}
+
+/*! A codec only the list translator translates to */
+static struct ast_codec split_codec = {
+	.name = "unit_test_split",
+	.description = "Unit test codec",
+	.type = AST_MEDIA_TYPE_AUDIO,
+	.sample_rate = 8000,
+	.minimum_ms = 10,
+	.maximum_ms = 150,
+	.default_ms = 20,
+};
+
+static int split_framein(struct ast_trans_pvt *pvt, struct ast_frame *f)
+{
+	memcpy(pvt->outbuf.c + pvt->datalen, f->data.ptr, f->datalen);
+	pvt->datalen += f->datalen;
+	pvt->samples += f->samples;
+	return 0;
+}
+
+/*! \brief Give back what came in as two frames, each with half of the samples */
+static struct ast_frame *split_frameout(struct ast_trans_pvt *pvt)
+{
+	struct ast_frame f = pvt->f;
+	struct ast_frame *first;
+	struct ast_frame *second;
+	int half = pvt->samples / 2;
+
+	if (!half) {
+		return NULL;
+	}
+
+	f.samples = half;
+	f.datalen = half * sizeof(int16_t);
+	first = ast_frdup(&f);
+
+	f.data.ptr = pvt->outbuf.c + f.datalen;
+	f.samples = pvt->samples - half;
+	f.datalen = pvt->datalen - f.datalen;
+	second = ast_frdup(&f);
+
+	pvt->samples = 0;
+	pvt->datalen = 0;
+
+	if (!first || !second) {
+		ast_frame_dtor(first);
+		ast_frame_dtor(second);
+		return NULL;
+	}
+	AST_LIST_NEXT(first, frame_list) = second;
+	return first;
+}
+
+static struct ast_translator split_translator = {
+	.name = "slintosplit",
+	.src_codec = {
+		.name = "slin",
+		.type = AST_MEDIA_TYPE_AUDIO,
+		.sample_rate = 8000,
+	},
+	.dst_codec = {
+		.name = "unit_test_split",
+		.type = AST_MEDIA_TYPE_AUDIO,
+		.sample_rate = 8000,
+	},
+	.table_cost = AST_TRANS_COST_LL_LL_ORIGSAMP,
+	.framein = split_framein,
+	.frameout = split_frameout,
+	.buffer_samples = FRAME_SAMPLES,
+	.buf_size = FRAME_SAMPLES * sizeof(int16_t),
+};
+
+AST_TEST_DEFINE(translate_shared_list)
+{
+	RAII_VAR(struct ast_translate_shared *, shared, NULL, ao2_cleanup);
+	RAII_VAR(struct ast_codec *, codec, NULL, ao2_cleanup);
+	RAII_VAR(struct ast_format *, split, NULL, ao2_cleanup);
+	int16_t data[FRAME_SAMPLES];
+	struct ast_frame frame = {
+		.frametype = AST_FRAME_VOICE,
+		.samples = FRAME_SAMPLES,
+		.datalen = sizeof(data),
+		.data.ptr = data,
+		.src = "test_translate",
+	};
+	struct ast_frame *out;
+	enum ast_test_result_state res = AST_TEST_PASS;
+	int x;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "translate_shared_list";
+		info->category = "/main/translate/";
+		info->summary = "shared translation of a frame list test";
+		info->description =
+			"Ensures that when a translator gives back a list of frames the\n"
+			"consumers of a shared translation get every frame of the list.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	/* A codec can not be unregistered, so it may be left from an earlier run */
+	codec = ast_codec_get(split_codec.name, split_codec.type, split_codec.sample_rate);
+	if (!codec) {
+		if (ast_codec_register(&split_codec)) {
+			ast_test_status_update(test, "Could not register the test codec\n");
+			return AST_TEST_FAIL;
+		}
+		codec = ast_codec_get(split_codec.name, split_codec.type, split_codec.sample_rate);
+	}
+	split = codec ? ast_format_create(codec) : NULL;
+	if (!split) {
+		return AST_TEST_FAIL;
+	}
+
+	if (ast_register_translator(&split_translator)) {
+		ast_test_status_update(test, "Could not register the test translator\n");
+		return AST_TEST_FAIL;
+	}
+
+	shared = ast_translate_shared_alloc(ast_format_slin);
+	if (!shared) {
+		ast_unregister_translator(&split_translator);
+		return AST_TEST_FAIL;
+	}
+
+	frame.subclass.format = ast_format_slin;
+	for (x = 0; x < FRAME_SAMPLES; ++x) {
+		data[x] = x;
+	}
+
+	ast_translate_shared_frame(shared, &frame);
+	out = ast_translate_shared_get(shared, split);
+	if (!out) {
+		ast_test_status_update(test, "No shared translation\n");
+		res = AST_TEST_FAIL;
+	} else if (out->samples != FRAME_SAMPLES / 2
+		|| memcmp(out->data.ptr, data, out->datalen)) {
+		ast_test_status_update(test, "First shared frame differs\n");
+		res = AST_TEST_FAIL;
+	} else if (!AST_LIST_NEXT(out, frame_list)) {
+		ast_test_status_update(test, "Shared translation lost the second frame\n");
+		res = AST_TEST_FAIL;
+	} else {
+		struct ast_frame *next = AST_LIST_NEXT(out, frame_list);
+
+		if (next->samples != FRAME_SAMPLES / 2
+			|| memcmp(next->data.ptr, data + FRAME_SAMPLES / 2, next->datalen)) {
+			ast_test_status_update(test, "Second shared frame differs\n");
+			res = AST_TEST_FAIL;
+		} else if (AST_LIST_NEXT(next, frame_list)) {
+			ast_test_status_update(test, "Shared translation has too many frames\n");
+			res = AST_TEST_FAIL;
+		}
+	}
+
+	/* Drop the shared translation before the translator it uses */
+	ao2_cleanup(shared);
+	shared = NULL;
+	ast_unregister_translator(&split_translator);
+
+	return res;
+}
+
+AST_TEST_DEFINE(translate_path_build)
+{
+	RAII_VAR(struct ast_str *, first_str, ast_str_create(64), ast_free);
+	RAII_VAR(struct ast_str *, second_str, ast_str_create(64), ast_free);
+	struct ast_trans_pvt *first;
+	struct ast_trans_pvt *second;
+	struct timeval start;
+	int64_t elapsed_us;
+	int res;
+	int n;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "translate_path_build";
+		info->category = "/main/translate/";
+		info->summary = "translation path building test";
+		info->description =
+			"Ensures a translation path built again, from the path cache,\n"
+			"has the same steps, and reports how long building paths takes.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	if (!first_str || !second_str) {
+		return AST_TEST_FAIL;
+	}
+
+	first = ast_translator_build_path(ast_format_ulaw, ast_format_alaw);
+	second = ast_translator_build_path(ast_format_ulaw, ast_format_alaw);
+	if (!first || !second) {
+		ast_test_status_update(test, "No translation path from alaw to ulaw\n");
+		ast_translator_free_path(first);
+		ast_translator_free_path(second);
+		return AST_TEST_FAIL;
+	}
+
+	ast_translate_path_to_str(first, &first_str);
+	ast_translate_path_to_str(second, &second_str);
+	res = strcmp(ast_str_buffer(first_str), ast_str_buffer(second_str));
+	ast_translator_free_path(first);
+	ast_translator_free_path(second);
+	if (res) {
+		ast_test_status_update(test, "Paths differ: %s and %s\n",
+			ast_str_buffer(first_str), ast_str_buffer(second_str));
+		return AST_TEST_FAIL;
+	}
+
+	if (ast_translator_build_path(ast_format_slin, ast_format_slin)) {
+		ast_test_status_update(test, "Built a path between identical formats\n");
+		return AST_TEST_FAIL;
+	}
+
+	start = ast_tvnow();
+	for (n = 0; n < BENCH_PATHS; ++n) {
+		ast_translator_free_path(ast_translator_build_path(ast_format_ulaw, ast_format_alaw));
+	}
+	elapsed_us = ast_tvdiff_us(ast_tvnow(), start);
+	ast_test_status_update(test, "Built and freed %d alaw to ulaw paths in %" PRIi64 " us\n",
+		BENCH_PATHS, elapsed_us);
+
+	return AST_TEST_PASS;
+}
+
+/*! \brief The formats each thread negotiates between */
+struct setup_caps {
+	struct ast_format_cap *dst;
+	struct ast_format_cap *src;
+	/*! Negotiations that did not pick mu-law from a-law */
+	int failures;
+};
+
+/*!
+ * \internal
+ * \brief Negotiate formats the way a call being set up does
+ *
+ * \retval 0 the expected formats were chosen
+ * \retval -1 failure
+ */
+static int negotiate(struct setup_caps *caps, struct ast_format_cap *result)
+{
+	struct ast_format *dst_fmt = NULL;
+	struct ast_format *src_fmt = NULL;
+	int res;
+
+	res = ast_translator_best_choice(caps->dst, caps->src, &dst_fmt, &src_fmt);
+	if (!res) {
+		res = ast_format_cmp(dst_fmt, ast_format_ulaw) == AST_FORMAT_CMP_EQUAL
+			&& ast_format_cmp(src_fmt, ast_format_alaw) == AST_FORMAT_CMP_EQUAL ? 0 : -1;
+	}
+	ao2_cleanup(dst_fmt);
+	ao2_cleanup(src_fmt);
+
+	ast_format_cap_remove_by_type(result, AST_MEDIA_TYPE_UNKNOWN);
+	ast_translate_available_formats(caps->dst, caps->src, result);
+	if (ast_format_cap_iscompatible_format(result, ast_format_ulaw) == AST_FORMAT_CMP_NOT_EQUAL) {
+		res = -1;
+	}
+
+	return res;
+}
+
+static void *setup_thread(void *data)
+{
+	struct setup_caps *caps = data;
+	struct ast_format_cap *result;
+	int n;
+
+	result = ast_format_cap_alloc(AST_FORMAT_CAP_FLAG_DEFAULT);
+	if (!result) {
+		ast_atomic_fetchadd_int(&caps->failures, +1);
+		return NULL;
+	}
+
+	for (n = 0; n < SETUP_ITERATIONS; ++n) {
+		if (negotiate(caps, result)) {
+			ast_atomic_fetchadd_int(&caps->failures, +1);
+		}
+	}
+
+	ao2_ref(result, -1);
+	return NULL;
+}
+
+AST_TEST_DEFINE(translate_setup_parallel)
+{
+	RAII_VAR(struct ast_format_cap *, dst, ast_format_cap_alloc(AST_FORMAT_CAP_FLAG_DEFAULT), ao2_cleanup);
+	RAII_VAR(struct ast_format_cap *, src, ast_format_cap_alloc(AST_FORMAT_CAP_FLAG_DEFAULT), ao2_cleanup);
+	pthread_t threads[SETUP_THREADS];
+	struct setup_caps caps;
+	struct timeval start;
+	int64_t elapsed_us;
+	int num_threads;
+	int created;
+	int i;
+
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "translate_setup_parallel";
+		info->category = "/main/translate/";
+		info->summary = "parallel format negotiation test";
+		info->description =
+			"Ensures that format negotiation needing translation chooses the\n"
+			"right formats from many threads at once, and reports how many\n"
+			"negotiations per second are done as threads are added.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
+
+	if (!dst || !src
+		|| ast_format_cap_append(dst, ast_format_ulaw, 0)
+		|| ast_format_cap_append(src, ast_format_alaw, 0)) {
+		return AST_TEST_FAIL;
+	}
+	caps.dst = dst;
+	caps.src = src;
+
+	for (num_threads = 1; num_threads <= SETUP_THREADS; num_threads *= 2) {
+		caps.failures = 0;
+		start = ast_tvnow();
+		for (created = 0; created < num_threads; ++created) {
+			if (ast_pthread_create(&threads[created], NULL, setup_thread, &caps)) {
+				ast_test_status_update(test, "Unable to create thread\n");
+				break;
+			}
+		}
+		for (i = 0; i < created; ++i) {
+			pthread_join(threads[i], NULL);
+		}
+		elapsed_us = ast_tvdiff_us(ast_tvnow(), start);
+
+		if (created < num_threads) {
+			return AST_TEST_FAIL;
+		}
+		if (caps.failures) {
+			ast_test_status_update(test, "%d negotiations from a-law to mu-law failed\n",
+				caps.failures);
+			return AST_TEST_FAIL;
+		}
+
+		ast_test_status_update(test, "%d threads: %.0f negotiations per second\n",
+			num_threads, elapsed_us
+			? (double) num_threads * SETUP_ITERATIONS * 1000000.0 / elapsed_us : 0.0);
+	}
+
+	return AST_TEST_PASS;
+}
+
+/*! \brief What the path lookup threads look up, and how */
+static int unload_module(void)
+{
+	AST_TEST_UNREGISTER(translate_shared);
+	AST_TEST_UNREGISTER(translate_shared_list);
+	AST_TEST_UNREGISTER(translate_path_build);
+	AST_TEST_UNREGISTER(translate_setup_parallel);
+	return 0;
+}
+
+static int load_module(void)
+{
+	AST_TEST_REGISTER(translate_shared);
+	AST_TEST_REGISTER(translate_shared_list);
+	AST_TEST_REGISTER(translate_path_build);
+	AST_TEST_REGISTER(translate_setup_parallel);
+	return AST_MODULE_LOAD_SUCCESS;
+}
+
+AST_MODULE_INFO_STANDARD(ASTERISK_GPL_KEY, "Translation path tests");